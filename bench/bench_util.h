@@ -0,0 +1,50 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace bench {
+
+// Keeps the optimizer from discarding a benchmark result.
+template <class T> inline void doNotOptimize(T const &value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+class Timer {
+  std::chrono::steady_clock::time_point start;
+
+public:
+  Timer() : start(std::chrono::steady_clock::now()) {}
+  void reset() { start = std::chrono::steady_clock::now(); }
+  double elapsedMs() const {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  }
+};
+
+// Runs fn() `repeats` times and returns the best wall time in milliseconds.
+template <class Fn> double bestOf(int repeats, Fn fn) {
+  double best = 1e30;
+  for (int i = 0; i < repeats; i++) {
+    Timer t;
+    fn();
+    double ms = t.elapsedMs();
+    if (ms < best) {
+      best = ms;
+    }
+  }
+  return best;
+}
+
+inline void report(const std::string &name, double ms, uint64_t ops) {
+  printf("%-40s %10.3f ms %10.3f ns/op\n", name.c_str(), ms,
+         ms * 1e6 / double(ops));
+}
+
+} // namespace bench
+
+#endif
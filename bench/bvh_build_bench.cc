@@ -0,0 +1,142 @@
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "bench_util.h"
+#include "bvh.h"
+#include "camera.h"
+#include "compressed_mesh.h"
+#include "procedural_scene.h"
+#include "thread_pool.h"
+#include "triangle.h"
+
+// Build times of the acceleration structures over a generated scene of
+// sphere meshes (procedural_scene.h, 16 meshes, about n million triangles
+// together): the scene BVH over the triangles as objects, serial
+// (Bvh::build) and on 1 to maxThreads threads (Bvh::build(objects, pool),
+// parallel_bvh.h), then one CompressedMesh of all the triangles built the
+// same two ways. Prints per build the best time of 3, the time per million
+// triangles, the speedup over the serial build, the SAH cost of the tree
+// (scene BVH only) and the time to trace 256 x 256 rays through it, which
+// tells the tree quality.
+//
+// usage: bvh_build_bench [millions [maxThreads]]
+
+using namespace raytracer_cu;
+
+namespace {
+
+const int nRepeats = 3;
+const int2 raySize = make_int2(256, 256);
+
+Camera benchCamera(float extent) {
+  return Camera::lookAt(make_float3(0.0f, -0.5f * extent, -2.0f * extent),
+                        make_float3(0.0f, 0.0f, 0.0f),
+                        make_float3(0.0f, 1.0f, 0.0f));
+}
+
+template <class Hit> double traceMs(const Camera &camera, Hit hit) {
+  int hits = 0;
+  double ms = bench::bestOf(nRepeats, [&] {
+    hits = 0;
+    for (int y = 0; y < raySize.y; y++) {
+      for (int x = 0; x < raySize.x; x++) {
+        Ray ray = camera.primaryRay(x + 0.5f, y + 0.5f, raySize, 1);
+        hits += hit(ray);
+      }
+    }
+  });
+  bench::doNotOptimize(hits);
+  return ms;
+}
+
+void printRow(const char *name, int threads, double ms, double serialMs,
+              double millions, float sahCost, double trace) {
+  char sah[16] = "";
+  if (sahCost > 0.0f) {
+    snprintf(sah, sizeof(sah), "%.1f", sahCost);
+  }
+  printf("%-20s %8d %10.1f %10.1f %8.2fx %10s %10.1f\n", name, threads, ms,
+         ms / millions, serialMs / ms, sah, trace);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  double millions = argc > 1 ? atof(argv[1]) : 1.0;
+  int maxThreads = argc > 2 ? atoi(argv[2])
+                            : int(std::thread::hardware_concurrency());
+  maxThreads = maxThreads > 0 ? maxThreads : 1;
+  std::vector<int> threadCounts; // powers of 2, then maxThreads
+  for (int threads = 1; threads < maxThreads; threads *= 2) {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(maxThreads);
+
+  ProceduralSceneParams params;
+  params.nSpheres = 0;
+  params.nMeshes = 16;
+  params.meshTriangles = int(millions * 1e6 / params.nMeshes);
+  params.shadows = false;
+  ThreadPool setupPool(maxThreads - 1);
+  ProceduralScene scene(params);
+  scene.buildPool = &setupPool;
+  scene.buildScene();
+  EasyVector<Object *> &objects = scene.sceneObjects;
+  int n = int(objects.size());
+  millions = n / 1e6;
+  Camera camera = benchCamera(params.extent);
+  printf("%d triangles in %d meshes, %u hardware threads\n", n,
+         params.nMeshes, std::thread::hardware_concurrency());
+  printf("%-20s %8s %10s %10s %9s %10s %10s\n", "build", "threads", "ms",
+         "ms/M", "speedup", "SAH cost", "trace ms");
+
+  Bvh bvh;
+  double serialMs = bench::bestOf(nRepeats, [&] { bvh.build(objects); });
+  auto traceBvh = [&] {
+    return traceMs(camera, [&](Ray &ray) {
+      float3 point, normal, color;
+      int objectId;
+      return bvh.closestHit(ray, objects, point, normal, color, objectId);
+    });
+  };
+  printRow("bvh serial", 1, serialMs, serialMs, millions, bvh.sahCost(),
+           traceBvh());
+  for (int threads : threadCounts) {
+    ThreadPool pool(threads - 1);
+    double ms = bench::bestOf(nRepeats, [&] { bvh.build(objects, pool); });
+    printRow("bvh parallel", threads, ms, serialMs, millions, bvh.sahCost(),
+             traceBvh());
+  }
+
+  std::vector<MeshTriangle> triangles(n);
+  for (int i = 0; i < n; i++) {
+    Triangle *t = static_cast<Triangle *>(objects[i]);
+    triangles[i].v[0] = t->vertex0;
+    triangles[i].v[1] = t->vertex1;
+    triangles[i].v[2] = t->vertex2;
+    triangles[i].uv[0] = t->texCoord0;
+    triangles[i].uv[1] = t->texCoord1;
+    triangles[i].uv[2] = t->texCoord2;
+    triangles[i].normal = make_float3(0.0f, 0.0f, 0.0f);
+  }
+  CompressedMesh mesh(make_float3(1.0f, 1.0f, 1.0f));
+  auto traceMesh = [&] {
+    return traceMs(camera, [&](Ray &ray) {
+      float3 point, normal, color;
+      return mesh.intersect(ray, point, normal, color);
+    });
+  };
+  serialMs = bench::bestOf(nRepeats, [&] { mesh.build(triangles); });
+  printRow("compressed serial", 1, serialMs, serialMs, millions, 0.0f,
+           traceMesh());
+  for (int threads : threadCounts) {
+    ThreadPool pool(threads - 1);
+    double ms =
+        bench::bestOf(nRepeats, [&] { mesh.build(triangles, &pool); });
+    printRow("compressed parallel", threads, ms, serialMs, millions, 0.0f,
+             traceMesh());
+  }
+  return 0;
+}
@@ -0,0 +1,144 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "bench_util.h"
+#include "bvh.h"
+#include "camera.h"
+#include "room_scene.h"
+#include "sphere.h"
+
+// Animated scene: the room plus n small spheres, a fraction of them moving
+// every frame. Per frame the scene BVH is refit (update()) and, for
+// comparison, a second tree is built from scratch over the same objects;
+// both are then timed on the closest hits of the primary rays. The net
+// frame time is the update or build plus the trace, which is what the
+// rebuild threshold trades.
+//
+// usage: bvh_refit_bench [nSpheres [movingPercent [frames [threshold]]]]
+//   threshold: Bvh::rebuildThreshold (default: the Bvh default), 0 refits
+//   only
+
+using namespace raytracer_cu;
+
+namespace {
+
+struct Mover {
+  int objectId;
+  float3 velocity;
+};
+
+float random01(uint32_t &state) {
+  state = state * 1664525u + 1013904223u;
+  return float(state >> 8) / float(1 << 24);
+}
+
+// Closest hits of a w x h grid of primary rays, returns the number of hits.
+int traceGrid(Bvh &bvh, EasyVector<Object *> &objects, int2 size) {
+  Camera camera = Camera::initialView();
+  int hits = 0;
+  for (int y = 0; y < size.y; y++) {
+    for (int x = 0; x < size.x; x++) {
+      Ray ray = camera.primaryRay(x, y, size, 1);
+      float3 point, normal, color;
+      int objectId;
+      hits += bvh.closestHit(ray, objects, point, normal, color, objectId);
+    }
+  }
+  return hits;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int nSpheres = argc > 1 ? atoi(argv[1]) : 5000;
+  float movingPercent = argc > 2 ? float(atof(argv[2])) : 10.0f;
+  int nFrames = argc > 3 ? atoi(argv[3]) : 60;
+  float threshold = argc > 4 ? float(atof(argv[4])) : Bvh().rebuildThreshold;
+
+  RoomScene *scene = new RoomScene();
+  scene->buildScene();
+  uint32_t rng = 7;
+  std::vector<Mover> movers;
+  for (int i = 0; i < nSpheres; i++) {
+    float3 center = make_float3(240.0f * random01(rng) - 120.0f,
+                                240.0f * random01(rng) - 120.0f,
+                                240.0f * random01(rng) - 120.0f);
+    auto sphere = new Sphere(center, 1.0f + 3.0f * random01(rng),
+                             make_float3(1.0f, 1.0f, 1.0f));
+    int objectId = int(scene->sceneObjects.size());
+    scene->sceneObjects.push_back(sphere);
+    if (random01(rng) * 100.0f < movingPercent) {
+      float3 velocity = make_float3(random01(rng) - 0.5f, random01(rng) - 0.5f,
+                                    random01(rng) - 0.5f);
+      movers.push_back(Mover{objectId, 8.0f * velocity});
+    }
+  }
+  EasyVector<Object *> &objects = scene->sceneObjects;
+  scene->bvh.rebuildThreshold = threshold > 0.0f ? threshold : 1e30f;
+  scene->buildAccelerationStructure();
+
+  Bvh rebuilt;
+  int2 grid = make_int2(160, 120);
+  printf("%d objects, %zu moving, %d frames, rebuild threshold %.2f\n",
+         int(objects.size()), movers.size(), nFrames, threshold);
+  printf("%6s %10s %10s %9s %9s %9s %9s %11s %11s %9s %9s\n", "frame",
+         "update ms", "build ms", "refit", "rebuilt", "SAH upd", "SAH new",
+         "trace upd", "trace new", "net upd", "net new");
+
+  double updateMs = 0.0, buildMs = 0.0, traceUpdatedMs = 0.0,
+         traceRebuiltMs = 0.0;
+  for (int frame = 0; frame < nFrames; frame++) {
+    for (Mover &mover : movers) {
+      Sphere *sphere = (Sphere *)objects[mover.objectId];
+      sphere->center = sphere->center + mover.velocity;
+      // Bounce off the walls of the room.
+      float3 &c = sphere->center;
+      if (c.x < -120.0f || c.x > 120.0f) mover.velocity.x = -mover.velocity.x;
+      if (c.y < -120.0f || c.y > 120.0f) mover.velocity.y = -mover.velocity.y;
+      if (c.z < -120.0f || c.z > 120.0f) mover.velocity.z = -mover.velocity.z;
+      scene->markDirty(mover.objectId);
+    }
+
+    bench::Timer timer;
+    BvhUpdateStats stats = scene->updateAccelerationStructure();
+    double frameUpdateMs = timer.elapsedMs();
+    timer.reset();
+    rebuilt.build(objects);
+    double frameBuildMs = timer.elapsedMs();
+
+    timer.reset();
+    int hitsUpdated = traceGrid(scene->bvh, objects, grid);
+    double frameTraceUpdated = timer.elapsedMs();
+    timer.reset();
+    int hitsRebuilt = traceGrid(rebuilt, objects, grid);
+    double frameTraceRebuilt = timer.elapsedMs();
+    if (hitsUpdated != hitsRebuilt) {
+      printf("frame %d: the trees disagree (%d / %d hits)\n", frame,
+             hitsUpdated, hitsRebuilt);
+      return 1;
+    }
+
+    updateMs += frameUpdateMs;
+    buildMs += frameBuildMs;
+    traceUpdatedMs += frameTraceUpdated;
+    traceRebuiltMs += frameTraceRebuilt;
+    if (frame % 10 == 0 || frame == nFrames - 1) {
+      printf("%6d %10.3f %10.3f %9d %9d %9.1f %9.1f %11.2f %11.2f %9.2f "
+             "%9.2f\n",
+             frame, frameUpdateMs, frameBuildMs, stats.refitNodes,
+             stats.rebuiltObjects, scene->bvh.sahCost(), rebuilt.sahCost(),
+             frameTraceUpdated, frameTraceRebuilt,
+             frameUpdateMs + frameTraceUpdated,
+             frameBuildMs + frameTraceRebuilt);
+    }
+  }
+  printf("per frame: update %.3f ms, full rebuild %.3f ms (%.1fx), "
+         "primary rays %.2f ms updated vs %.2f ms rebuilt tree\n",
+         updateMs / nFrames, buildMs / nFrames, buildMs / updateMs,
+         traceUpdatedMs / nFrames, traceRebuiltMs / nFrames);
+  printf("net per frame: %.2f ms updated vs %.2f ms rebuilt every frame\n",
+         (updateMs + traceUpdatedMs) / nFrames,
+         (buildMs + traceRebuiltMs) / nFrames);
+  return 0;
+}
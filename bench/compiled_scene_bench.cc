@@ -0,0 +1,79 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "bench_util.h"
+#include "camera.h"
+#include "checker_textures.h"
+#include "compiled_scene.h"
+#include "host_renderer.h"
+#include "room_scene.h"
+#include "thread_pool.h"
+
+// Frame time of the generic host path (virtual dispatch, shader weight
+// checks, BVH over Scene::sceneObjects) against the room scene compiled by
+// scene_compiler, for growing bounce budgets, and how much the images
+// differ (they should not).
+//
+// usage: compiled_scene_bench [width height [threads]]
+
+using namespace raytracer_cu;
+
+const int nRepeats = 3;
+
+int main(int argc, char **argv) {
+  int2 size = make_int2(640, 480);
+  int nThreads = 0; // 0: all cores
+  if (argc >= 3) {
+    size = make_int2(atoi(argv[1]), atoi(argv[2]));
+  }
+  if (argc >= 4) {
+    nThreads = atoi(argv[3]);
+  }
+
+  RoomScene *scene = new RoomScene();
+  addCheckerTextures(scene, compiled::sceneInfo.nTextures);
+  scene->buildScene();
+  compiled::bindTextures(&scene->textures[0], scene->textures.size());
+  Camera camera = Camera::initialView();
+
+  ThreadPool pool(nThreads - 1);
+  HostRenderer generic(scene, pool);
+  CompiledRenderer specialized(pool);
+  std::vector<uint8_t> genericImage(size.x * size.y * 4);
+  std::vector<uint8_t> compiledImage(size.x * size.y * 4);
+
+  printf("%dx%d, %u threads, %s compiled to %d triangles, %d spheres, %d "
+         "lights, %d materials, best of %d\n",
+         size.x, size.y, pool.size() + 1, compiled::sceneInfo.name,
+         compiled::sceneInfo.nTriangles, compiled::sceneInfo.nSpheres,
+         compiled::sceneInfo.nLights, compiled::sceneInfo.nMaterials,
+         nRepeats);
+  printf("%8s %12s %12s %9s %12s %10s\n", "bounces", "generic ms",
+         "compiled ms", "speedup", "max diff", "pixels");
+  for (int bounces : {1, 2, 3, 4, 6, 8}) {
+    generic.maxBounces = bounces;
+    specialized.maxBounces = bounces;
+    double genericMs = bench::bestOf(nRepeats, [&] {
+      generic.render(camera, size, 0, genericImage.data());
+    });
+    double compiledMs = bench::bestOf(nRepeats, [&] {
+      specialized.render(camera, size, 0, compiledImage.data());
+    });
+
+    int maxDiff = 0, nDiffering = 0;
+    for (int i = 0; i < size.x * size.y; i++) {
+      int pixelDiff = 0;
+      for (int c = 1; c < 4; c++) {
+        int d = abs(int(genericImage[i * 4 + c]) -
+                    int(compiledImage[i * 4 + c]));
+        pixelDiff = d > pixelDiff ? d : pixelDiff;
+      }
+      maxDiff = pixelDiff > maxDiff ? pixelDiff : maxDiff;
+      nDiffering += pixelDiff > 0;
+    }
+    printf("%8d %12.2f %12.2f %8.2fx %12d %10d\n", bounces, genericMs,
+           compiledMs, genericMs / compiledMs, maxDiff, nDiffering);
+  }
+  return 0;
+}
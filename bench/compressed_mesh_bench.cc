@@ -0,0 +1,195 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <unistd.h>
+
+#include "bench_util.h"
+#include "camera.h"
+#include "compressed_mesh.h"
+#include "host_renderer.h"
+#include "room_scene.h"
+#include "thread_pool.h"
+#include "triangle.h"
+
+// The room with a bumpy sphere of n triangles in it, once as n Triangle
+// objects under the scene BVH and once as one CompressedMesh. Prints the
+// memory each takes (resident set growth while building), the frame times
+// of primary rays only and of full renders, and how much the images differ
+// (the compressed positions are off by up to half a 16 bit step).
+//
+// usage: compressed_mesh_bench [nTriangles [width height [threads]]]
+
+using namespace raytracer_cu;
+
+namespace {
+
+const int nRepeats = 3;
+
+size_t residentBytes() {
+  long pages = 0, resident = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (f) {
+    if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+      resident = 0;
+    }
+    fclose(f);
+  }
+  return size_t(resident) * size_t(sysconf(_SC_PAGESIZE));
+}
+
+// A sphere with ridges, rings x 2 rings quads split in two.
+std::vector<MeshTriangle> bumpySphere(int nTriangles) {
+  int rings = std::max(2, int(std::sqrt(nTriangles / 4.0)));
+  int segments = 2 * rings;
+  float3 center = make_float3(0.0f, 16.0f, 96.0f);
+  auto point = [&](int ring, int segment) {
+    float theta = 3.14159265f * ring / rings;
+    float phi = 2.0f * 3.14159265f * segment / segments;
+    float r = 100.0f * (1.0f + 0.08f * std::sin(7.0f * theta) *
+                                   std::sin(9.0f * phi) +
+                        0.02f * std::sin(61.0f * theta + 3.0f * phi));
+    return center + r * make_float3(std::sin(theta) * std::cos(phi),
+                                    std::cos(theta),
+                                    std::sin(theta) * std::sin(phi));
+  };
+  auto uv = [&](int ring, int segment) {
+    return make_float2(float(segment) / segments, float(ring) / rings);
+  };
+  std::vector<MeshTriangle> mesh;
+  mesh.reserve(size_t(2) * rings * segments);
+  for (int ring = 0; ring < rings; ring++) {
+    for (int segment = 0; segment < segments; segment++) {
+      int corners[4][2] = {{ring, segment},
+                           {ring + 1, segment},
+                           {ring + 1, segment + 1},
+                           {ring, segment + 1}};
+      for (int half = 0; half < 2; half++) {
+        MeshTriangle t;
+        int ids[3] = {0, half ? 2 : 1, half ? 3 : 2};
+        for (int k = 0; k < 3; k++) {
+          t.v[k] = point(corners[ids[k]][0], corners[ids[k]][1]);
+          t.uv[k] = uv(corners[ids[k]][0], corners[ids[k]][1]);
+        }
+        t.normal = make_float3(0.0f, 0.0f, 0.0f);
+        mesh.push_back(t);
+      }
+    }
+  }
+  return mesh;
+}
+
+GenericTriangleShader *meshShader() {
+  auto shader = new GenericTriangleShader(make_float3(0.9f, 0.8f, 0.6f));
+  shader->setProfile(0.7f, 0.3f, 0.0f);
+  shader->enableShadows = false;
+  return shader;
+}
+
+struct Timings {
+  double primaryMs, fullMs;
+};
+
+Timings timeRenders(Scene *scene, ThreadPool &pool, int2 size,
+                    std::vector<uint8_t> &image) {
+  HostRenderer renderer(scene, pool);
+  Camera camera = Camera::initialView();
+  Timings timings;
+  renderer.maxBounces = 0;
+  timings.primaryMs = bench::bestOf(nRepeats, [&] {
+    renderer.render(camera, size, 0, image.data());
+  });
+  renderer.maxBounces = -1;
+  timings.fullMs = bench::bestOf(nRepeats, [&] {
+    renderer.render(camera, size, 0, image.data());
+  });
+  return timings;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int nTriangles = argc > 1 ? atoi(argv[1]) : 2000000;
+  int2 size = make_int2(640, 480);
+  int nThreads = 0; // 0: all cores
+  if (argc >= 4) {
+    size = make_int2(atoi(argv[2]), atoi(argv[3]));
+  }
+  if (argc >= 5) {
+    nThreads = atoi(argv[4]);
+  }
+  ThreadPool pool(nThreads - 1);
+  std::vector<MeshTriangle> mesh = bumpySphere(nTriangles);
+  printf("%zu triangles, %dx%d, %u threads, best of %d\n", mesh.size(),
+         size.x, size.y, pool.size() + 1, nRepeats);
+
+  // Compressed first, the Triangle objects take most of the memory.
+  size_t before = residentBytes();
+  bench::Timer timer;
+  RoomScene *compressedScene = new RoomScene();
+  compressedScene->buildScene();
+  CompressedMesh *compressed = new CompressedMesh(make_float3(0.9f, 0.8f, 0.6f));
+  compressed->build(mesh);
+  compressed->setShader(meshShader());
+  compressedScene->sceneObjects.push_back(compressed);
+  compressedScene->buildAccelerationStructure();
+  double compressedBuildMs = timer.elapsedMs();
+  size_t compressedBytes = residentBytes() - before;
+
+  before = residentBytes();
+  timer.reset();
+  RoomScene *objectScene = new RoomScene();
+  objectScene->buildScene();
+  GenericTriangleShader *shader = meshShader();
+  for (const MeshTriangle &t : mesh) {
+    Triangle *triangle = new Triangle(t.v[0], t.v[1], t.v[2], shader->color);
+    triangle->texCoord0 = t.uv[0];
+    triangle->texCoord1 = t.uv[1];
+    triangle->texCoord2 = t.uv[2];
+    triangle->setShader(shader);
+    objectScene->sceneObjects.push_back(triangle);
+  }
+  objectScene->buildAccelerationStructure();
+  double objectBuildMs = timer.elapsedMs();
+  size_t objectBytes = residentBytes() - before;
+
+  std::vector<uint8_t> objectImage(size.x * size.y * 4);
+  std::vector<uint8_t> compressedImage(size.x * size.y * 4);
+  Timings objectTimes = timeRenders(objectScene, pool, size, objectImage);
+  Timings compressedTimes =
+      timeRenders(compressedScene, pool, size, compressedImage);
+
+  int maxDiff = 0, nDiffering = 0;
+  for (int i = 0; i < size.x * size.y; i++) {
+    int pixelDiff = 0;
+    for (int c = 1; c < 4; c++) {
+      int d = abs(int(objectImage[i * 4 + c]) - int(compressedImage[i * 4 + c]));
+      pixelDiff = d > pixelDiff ? d : pixelDiff;
+    }
+    maxDiff = pixelDiff > maxDiff ? pixelDiff : maxDiff;
+    nDiffering += pixelDiff > 0;
+  }
+
+  double mrays = size.x * size.y / 1000.0;
+  printf("%-16s %10s %9s %9s %12s %13s %10s\n", "", "memory MB", "B/tri",
+         "build ms", "primary ms", "primary Mr/s", "full ms");
+  printf("%-16s %10.1f %9.1f %9.0f %12.2f %13.2f %10.2f\n", "Triangle + BVH",
+         objectBytes / 1048576.0, double(objectBytes) / mesh.size(),
+         objectBuildMs, objectTimes.primaryMs, mrays / objectTimes.primaryMs,
+         objectTimes.fullMs);
+  printf("%-16s %10.1f %9.1f %9.0f %12.2f %13.2f %10.2f\n", "CompressedMesh",
+         compressedBytes / 1048576.0, double(compressedBytes) / mesh.size(),
+         compressedBuildMs, compressedTimes.primaryMs,
+         mrays / compressedTimes.primaryMs, compressedTimes.fullMs);
+  printf("compressed: %d blocks, %d nodes, %.1f MB in arrays, max position "
+         "error %g\n",
+         compressed->blockCount(), compressed->nodeCount(),
+         compressed->memoryBytes() / 1048576.0, compressed->maxPositionError());
+  printf("memory %.1fx smaller, primary rays %.2fx, full frames %.2fx; images "
+         "differ by at most %d in %d pixels\n",
+         double(objectBytes) / compressedBytes,
+         objectTimes.primaryMs / compressedTimes.primaryMs,
+         objectTimes.fullMs / compressedTimes.fullMs, maxDiff, nDiffering);
+  return 0;
+}
@@ -0,0 +1,107 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "bench_util.h"
+#include "camera.h"
+#include "dirty_region.h"
+#include "host_renderer.h"
+#include "room_scene.h"
+#include "thread_pool.h"
+
+// Moves one object of the room at a time, as an editor would, and renders
+// the next frame twice: in full, and by retracing only the dirty tiles over
+// the previous frame (what Renderer::render does after transformObject).
+// Prints the share of the pixels retraced, both frame times, and the pixels
+// where the two images differ, which must be none.
+//
+// usage: dirty_region_bench [width height [threads]]
+
+using namespace raytracer_cu;
+
+namespace {
+
+const int nRepeats = 3;
+const int tileSize = 16;
+const float reflectiveWeight = 0.25f; // Renderer::viewDependentWeight
+
+struct Edit {
+  const char *name;
+  int objectId;
+  mat3x3 transform;
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int2 size = make_int2(640, 480);
+  int nThreads = 0; // 0: all cores
+  if (argc >= 3) {
+    size = make_int2(atoi(argv[1]), atoi(argv[2]));
+  }
+  if (argc >= 4) {
+    nThreads = atoi(argv[3]);
+  }
+
+  RoomScene *scene = new RoomScene();
+  scene->buildScene();
+  Camera camera = Camera::initialView();
+  ThreadPool pool(nThreads - 1);
+  HostRenderer renderer(scene, pool);
+  size_t imageBytes = size_t(size.x) * size.y * 4;
+  std::vector<uint8_t> previous(imageBytes), full(imageBytes),
+      dirty(imageBytes);
+
+  Edit edits[] = {
+      {"matte sphere, 3 deg", RoomScene::matteSphereId,
+       getRotationMatrixY(0.05f)},
+      {"matte sphere, 3 deg", RoomScene::matteSphereId,
+       getRotationMatrixX(0.05f)},
+      {"matte sphere, 1 deg", RoomScene::matteSphereId,
+       getRotationMatrixZ(0.0175f)},
+      {"shiny sphere, 3 deg", RoomScene::shinySphereId,
+       getRotationMatrixY(0.05f)},
+  };
+
+  printf("%dx%d, %u threads, %dx%d tiles, best of %d\n", size.x, size.y,
+         pool.size() + 1, tileSize, tileSize, nRepeats);
+  printf("%-22s %10s %9s %9s %9s %12s\n", "edit", "retraced", "full ms",
+         "dirty ms", "speedup", "wrong pixels");
+  renderer.render(camera, size, 0, previous.data());
+  std::vector<uint8_t> tiles;
+  std::vector<int> pixels;
+  for (const Edit &edit : edits) {
+    Object *object = scene->sceneObjects[edit.objectId];
+    AABB before = object->bounds();
+    mat3x3 transform = edit.transform;
+    object->transform(transform);
+    scene->markDirty(edit.objectId);
+    scene->updateAccelerationStructure();
+
+    DirtyRegion region;
+    addObjectMove(scene, edit.objectId, before, object->bounds(), camera,
+                  size, reflectiveWeight, region);
+    tiles.clear();
+    markDirtyTiles(region, size, tileSize, tiles);
+    dirtyTilePixels(tiles, size, tileSize, pixels);
+
+    double fullMs = bench::bestOf(nRepeats, [&] {
+      renderer.render(camera, size, 0, full.data());
+    });
+    double dirtyMs = bench::bestOf(nRepeats, [&] {
+      memcpy(dirty.data(), previous.data(), imageBytes);
+      renderer.renderPixels(camera, size, 0, pixels, dirty.data());
+    });
+
+    int wrong = 0;
+    for (int i = 0; i < size.x * size.y; i++) {
+      wrong += memcmp(&full[i * 4], &dirty[i * 4], 4) != 0;
+    }
+    printf("%-22s %9.1f%% %9.2f %9.2f %8.2fx %12d%s\n", edit.name,
+           100.0 * pixels.size() / (size.x * size.y), fullMs, dirtyMs,
+           fullMs / dirtyMs, wrong, region.fullFrame ? "  (full frame)" : "");
+    previous.swap(full);
+  }
+  return 0;
+}
@@ -0,0 +1,147 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "bench_util.h"
+#include "camera.h"
+#include "host_renderer.h"
+#include "irradiance_cache.h"
+#include "room_scene.h"
+#include "shader.h"
+#include "thread_pool.h"
+
+// The room with shadows on every surface and the area light sampled with
+// `samples` shadow rays per diffuse hit (the work of as many lights),
+// rendered without and with an irradiance cache (irradiance_cache.h)
+// whose records take 64 samples. Both are compared with a reference of 256
+// samples per hit: the uncached error is sampling noise, the cached one is
+// interpolation error (plus the noise of the records), and the first row
+// is the noise of the reference itself, another reference against it. The
+// cache persists over `frames` frames, then the light moves and the cache
+// starts over.
+//
+// usage: irradiance_cache_bench [width height [samples [frames [threads]]]]
+
+using namespace raytracer_cu;
+
+namespace {
+
+const int referenceSamples = 256;
+const int recordSamples = 64;
+const float cacheRadius = 48.0f;
+
+struct ImageError {
+  double rms = 0.0; // in 8 bit steps
+  int max = 0;
+  double over4 = 0.0; // share of the pixels off by more than 4 steps
+};
+
+ImageError compare(const std::vector<uint8_t> &a,
+                   const std::vector<uint8_t> &b) {
+  ImageError error;
+  double sum = 0.0;
+  size_t nPixels = a.size() / 4, far = 0;
+  for (size_t p = 0; p < nPixels; p++) {
+    int pixelMax = 0;
+    for (int c = 1; c < 4; c++) {
+      int d = abs(int(a[p * 4 + c]) - int(b[p * 4 + c]));
+      sum += double(d) * d;
+      pixelMax = d > pixelMax ? d : pixelMax;
+    }
+    error.max = pixelMax > error.max ? pixelMax : error.max;
+    far += pixelMax > 4;
+  }
+  error.rms = std::sqrt(sum / (nPixels * 3));
+  error.over4 = double(far) / nPixels;
+  return error;
+}
+
+void printRow(const char *name, double ms, const ImageError &error,
+              const IrradianceCacheStats *stats) {
+  printf("%-18s %9.1f %8.2f %6d %8.2f%%", name, ms, error.rms, error.max,
+         100.0 * error.over4);
+  if (stats) {
+    printf(" %8.1f%% %9llu", 100.0 * stats->hitRate(),
+           (unsigned long long)stats->records);
+  }
+  printf("\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int2 size = make_int2(320, 240);
+  int samples = 16;
+  int frames = 4;
+  int nThreads = 0; // 0: all cores
+  if (argc >= 3) {
+    size = make_int2(atoi(argv[1]), atoi(argv[2]));
+  }
+  if (argc >= 4) {
+    samples = atoi(argv[3]);
+  }
+  if (argc >= 5) {
+    frames = atoi(argv[4]);
+  }
+  if (argc >= 6) {
+    nThreads = atoi(argv[5]);
+  }
+
+  RoomScene *scene = new RoomScene();
+  scene->buildScene();
+  for (uint64_t i = 0; i < scene->sceneObjects.size(); i++) {
+    Shader *shader = scene->sceneObjects[i]->getShader();
+    if (shader) {
+      shader->enableShadows = true;
+    }
+  }
+  Light *light = scene->lights[0];
+  Camera camera = Camera::initialView();
+  ThreadPool pool(nThreads - 1);
+  HostRenderer renderer(scene, pool);
+  size_t imageBytes = size_t(size.x) * size.y * 4;
+  std::vector<uint8_t> reference(imageBytes), image(imageBytes);
+
+  IrradianceCache cache(cacheRadius);
+  cache.recordSamples = recordSamples;
+
+  printf("%dx%d, %u threads, %d shadow samples per hit, cache radius %.0f\n",
+         size.x, size.y, pool.size() + 1, samples, cacheRadius);
+  printf("%-18s %9s %8s %6s %9s %9s %9s\n", "frame", "ms", "rms err",
+         "max", ">4 steps", "hit rate", "records");
+  for (int move = 0; move < 2; move++) {
+    if (move == 1) {
+      light->lightPosition = light->lightPosition + make_float3(24.0f, 0, 0);
+    }
+    light->nShadowSamples = referenceSamples;
+    scene->irradianceCache = nullptr;
+    bench::Timer timer;
+    renderer.render(camera, size, 0, reference.data());
+    if (move == 0) {
+      double ms = timer.elapsedMs();
+      renderer.render(camera, size, 1, image.data());
+      printRow("reference", ms, compare(image, reference), nullptr);
+    }
+
+    light->nShadowSamples = samples;
+    timer.reset();
+    renderer.render(camera, size, 0, image.data());
+    printRow(move ? "uncached, moved" : "uncached", timer.elapsedMs(),
+             compare(image, reference), nullptr);
+
+    scene->irradianceCache = &cache;
+    for (int frame = 0; frame < frames; frame++) {
+      cache.resetStats();
+      timer.reset();
+      renderer.render(camera, size, frame, image.data());
+      double ms = timer.elapsedMs();
+      IrradianceCacheStats stats = cache.stats();
+      char name[32];
+      snprintf(name, sizeof(name), "cached %d%s", frame,
+               stats.invalidations ? ", cleared" : "");
+      printRow(name, ms, compare(image, reference), &stats);
+    }
+  }
+  return 0;
+}
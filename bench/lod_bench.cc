@@ -0,0 +1,192 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "bench_util.h"
+#include "camera.h"
+#include "cost_heatmap.h"
+#include "host_renderer.h"
+#include "lod_mesh.h"
+#include "procedural_scene.h"
+#include "thread_pool.h"
+
+// A wide scene of meshes (procedural_scene.h with lod=1: nMeshes sphere
+// meshes of nTriangles triangles each, spread over a 4000 unit cube with
+// a mirror share of 30%), seen from its edge, rendered with every mesh at
+// full resolution, with levels of detail for the primary rays only
+// (secondaryScale 1), with the default looser levels for secondary rays
+// (lod_mesh.h), with both errors halved and without the normal error
+// bound. Prints the levels of one mesh with their errors, then per mode
+// the best frame time of 3, the ray-triangle tests and BVH nodes per pixel
+// and how much the image differs from the full resolution one, at one
+// sample and at 4x4 samples per pixel (rendered larger and averaged, as an
+// antialiased frame would be: a single sample per pixel of a curved mirror
+// or a soft shadow changes with any shift of the surface). The "next
+// frame" row is the difference of two full resolution frames, the noise
+// of the soft shadows.
+//
+// usage: lod_bench [nMeshes [nTriangles [width height [threads]]]]
+
+using namespace raytracer_cu;
+
+namespace {
+
+const int nRepeats = 3;
+const int smoothSamples = 4; // per pixel side, for the "rms 4x4" column
+
+struct ImageError {
+  double rms = 0.0; // in 8 bit steps
+  double over8 = 0.0; // share of the pixels off by more than 8 steps
+};
+
+ImageError compare(const std::vector<uint8_t> &a,
+                   const std::vector<uint8_t> &b) {
+  ImageError error;
+  double sum = 0.0;
+  size_t nPixels = a.size() / 4, far = 0;
+  for (size_t p = 0; p < nPixels; p++) {
+    int pixelMax = 0;
+    for (int c = 1; c < 4; c++) {
+      int d = abs(int(a[p * 4 + c]) - int(b[p * 4 + c]));
+      sum += double(d) * d;
+      pixelMax = d > pixelMax ? d : pixelMax;
+    }
+    far += pixelMax > 8;
+  }
+  error.rms = std::sqrt(sum / (nPixels * 3));
+  error.over8 = double(far) / nPixels;
+  return error;
+}
+
+// The frame at smoothSamples^2 samples per pixel, as an antialiased
+// frame would be: rendered that many times larger and box filtered.
+void renderSmooth(HostRenderer &renderer, const Camera &camera, int2 size,
+                  int frame, std::vector<uint8_t> &out) {
+  int k = smoothSamples;
+  int2 large = make_int2(size.x * k, size.y * k);
+  std::vector<uint8_t> samples(size_t(large.x) * large.y * 4);
+  renderer.render(camera, large, frame, samples.data());
+  for (int y = 0; y < size.y; y++) {
+    for (int x = 0; x < size.x; x++) {
+      for (int c = 0; c < 4; c++) {
+        int sum = 0;
+        for (int j = 0; j < k; j++) {
+          for (int i = 0; i < k; i++) {
+            sum += samples[(size_t(y * k + j) * large.x + x * k + i) * 4 + c];
+          }
+        }
+        out[(size_t(y) * size.x + x) * 4 + c] =
+            uint8_t((sum + k * k / 2) / (k * k));
+      }
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  ProceduralSceneParams params;
+  params.nSpheres = 0;
+  params.nMeshes = argc > 1 ? atoi(argv[1]) : 64;
+  params.meshTriangles = argc > 2 ? atoi(argv[2]) : 20000;
+  params.lod = true;
+  params.extent = 2000.0f;
+  int2 size = make_int2(640, 480);
+  int nThreads = 0; // 0: all cores
+  if (argc >= 5) {
+    size = make_int2(atoi(argv[3]), atoi(argv[4]));
+  }
+  if (argc >= 6) {
+    nThreads = atoi(argv[5]);
+  }
+
+  bench::Timer timer;
+  ProceduralScene scene(params);
+  scene.buildScene();
+  double buildMs = timer.elapsedMs();
+  std::vector<LodMesh *> meshes;
+  for (uint64_t i = 0; i < scene.sceneObjects.size(); i++) {
+    if (LodMesh *mesh = dynamic_cast<LodMesh *>(scene.sceneObjects[i])) {
+      meshes.push_back(mesh);
+    }
+  }
+  if (meshes.empty()) {
+    fprintf(stderr, "no meshes\n");
+    return 1;
+  }
+  printf("%d meshes of %d triangles, built with their levels in %.0f ms\n",
+         int(meshes.size()), meshes[0]->triangleCount(0), buildMs);
+  printf("%8s %10s %10s %10s\n", "level", "triangles", "error",
+         "normal err");
+  for (int level = 0; level < meshes[0]->levelCount(); level++) {
+    printf("%8d %10d %10.2f %10.3f\n", level, meshes[0]->triangleCount(level),
+           meshes[0]->levelError(level), meshes[0]->normalError(level));
+  }
+
+  ThreadPool pool(nThreads - 1);
+  HostRenderer renderer(&scene, pool);
+  float e = params.extent;
+  Camera camera = Camera::lookAt(make_float3(0.0f, 0.2f * e, -1.4f * e),
+                                 make_float3(0.0f, 0.0f, 0.0f),
+                                 make_float3(0.0f, 1.0f, 0.0f));
+  size_t imageBytes = size_t(size.x) * size.y * 4;
+  std::vector<uint8_t> reference(imageBytes), image(imageBytes);
+  std::vector<uint8_t> smoothReference(imageBytes), smooth(imageBytes);
+
+  struct Mode {
+    const char *name;
+    int forcedLevel;
+    float secondaryScale;
+    float pixelError;
+    float maxNormalError;
+  };
+  const LodMesh &defaults = *meshes[0];
+  float scale = defaults.secondaryScale, error = defaults.pixelError,
+        angle = defaults.maxNormalError;
+  const Mode modes[] = {
+      {"full resolution", 0, 1.0f, error, angle},
+      {"lod, primary only", -1, 1.0f, error, angle},
+      {"lod", -1, scale, error, angle},
+      {"lod, half errors", -1, scale, 0.5f * error, 0.5f * angle},
+      {"lod, no normal err", -1, scale, error, 1e30f}};
+  printf("%dx%d, %u threads\n", size.x, size.y, pool.size() + 1);
+  printf("%-20s %10s %12s %12s %10s %10s %10s\n", "mode", "frame ms",
+         "tests/pixel", "nodes/pixel", "rms err", ">8 steps", "rms 4x4");
+  for (const Mode &mode : modes) {
+    for (LodMesh *mesh : meshes) {
+      mesh->forcedLevel = mode.forcedLevel;
+      mesh->secondaryScale = mode.secondaryScale;
+      mesh->pixelError = mode.pixelError;
+      mesh->maxNormalError = mode.maxNormalError;
+    }
+    double ms = bench::bestOf(nRepeats, [&] {
+      renderer.render(camera, size, 0, image.data());
+    });
+    renderSmooth(renderer, camera, size, 0, smooth);
+    if (mode.forcedLevel == 0) {
+      reference = image;
+      smoothReference = smooth;
+    }
+    double nPixels = double(size.x) * size.y;
+    CostMap tests, nodes;
+    tests.measure(renderer, pool, camera, size, 0,
+                  CostMetric::IntersectionTests);
+    nodes.measure(renderer, pool, camera, size, 0, CostMetric::NodeVisits);
+    ImageError imageError = compare(image, reference);
+    printf("%-20s %10.1f %12.1f %12.1f %10.2f %9.2f%% %10.2f\n", mode.name,
+           ms, tests.total() / nPixels, nodes.total() / nPixels,
+           imageError.rms, 100.0 * imageError.over8,
+           compare(smooth, smoothReference).rms);
+    if (mode.forcedLevel == 0) {
+      // The sampling noise of the soft shadows, for scale.
+      renderer.render(camera, size, 1, image.data());
+      renderSmooth(renderer, camera, size, 1, smooth);
+      ImageError noise = compare(image, reference);
+      printf("%-20s %10s %12s %12s %10.2f %9.2f%% %10.2f\n", "next frame", "",
+             "", "", noise.rms, 100.0 * noise.over8,
+             compare(smooth, smoothReference).rms);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,194 @@
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "bench_util.h"
+#include "math.h"
+#include "math_legacy.h"
+#include "vec3a.h"
+
+// Microbenchmarks of the vector math kernels: the header-only inline float3
+// functions and the aligned vec3a type against the previous out-of-line
+// implementations (see math_legacy.cc).
+
+using namespace raytracer_cu;
+
+namespace {
+
+const int nElements = 1 << 20;
+const int nRepeats = 10;
+
+std::vector<float3> randomVectors(int n, uint32_t seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  std::vector<float3> v(n);
+  for (int i = 0; i < n; i++) {
+    v[i] = make_float3(dist(gen), dist(gen), dist(gen));
+  }
+  return v;
+}
+
+std::vector<vec3a> toAligned(const std::vector<float3> &v) {
+  std::vector<vec3a> out(v.size());
+  for (size_t i = 0; i < v.size(); i++) {
+    out[i] = vec3a(v[i]);
+  }
+  return out;
+}
+
+mat3x3 rotation(float rad) {
+  mat3x3 rot;
+  rot.data[1][1] = 1.;
+  rot.data[0][0] = std::cos(rad);
+  rot.data[2][0] = -std::sin(rad);
+  rot.data[0][2] = std::sin(rad);
+  rot.data[2][2] = std::cos(rad);
+  return rot;
+}
+
+// The edge/determinant part of Moller-Trumbore, the densest use of the
+// vector operations in the intersection path.
+template <class V, class Dot, class Cross, class Sub>
+float mollerTrumbore(const V &origin, const V &dir, const V &v0, const V &v1,
+                     const V &v2, Dot dotFn, Cross crossFn, Sub subFn) {
+  V edge1 = subFn(v1, v0);
+  V edge2 = subFn(v2, v0);
+  V h = crossFn(dir, edge2);
+  float a = dotFn(edge1, h);
+  float f = 1.0f / a;
+  V s = subFn(origin, v0);
+  float u = f * dotFn(s, h);
+  V q = crossFn(s, edge1);
+  float v = f * dotFn(dir, q);
+  return u + v + f * dotFn(edge2, q);
+}
+
+} // namespace
+
+int main() {
+  std::vector<float3> a = randomVectors(nElements, 1);
+  std::vector<float3> b = randomVectors(nElements, 2);
+  std::vector<float3> c = randomVectors(nElements, 3);
+  std::vector<float3> out(nElements);
+  std::vector<vec3a> aa = toAligned(a);
+  std::vector<vec3a> ba = toAligned(b);
+  std::vector<vec3a> ca = toAligned(c);
+  std::vector<vec3a> outa(nElements);
+
+  mat3x3 rot = mm(rotation(0.3f), rotation(0.7f));
+  mat3x4 xfm = affine(rot, make_float3(1.0f, 2.0f, 3.0f));
+  float3 translation = make_float3(1.0f, 2.0f, 3.0f);
+
+  printf("%d elements, best of %d\n", nElements, nRepeats);
+
+  double ms;
+  float acc = 0.0f;
+
+  // dot
+  ms = bench::bestOf(nRepeats, [&] {
+    for (int i = 0; i < nElements; i++) acc += legacy::dot(a[i], b[i]);
+  });
+  bench::report("dot (legacy)", ms, nElements);
+  ms = bench::bestOf(nRepeats, [&] {
+    for (int i = 0; i < nElements; i++) acc += dot(a[i], b[i]);
+  });
+  bench::report("dot (inline float3)", ms, nElements);
+  ms = bench::bestOf(nRepeats, [&] {
+    for (int i = 0; i < nElements; i++) acc += dot(aa[i], ba[i]);
+  });
+  bench::report("dot (vec3a)", ms, nElements);
+
+  // cross
+  ms = bench::bestOf(nRepeats, [&] {
+    for (int i = 0; i < nElements; i++) out[i] = legacy::cross(a[i], b[i]);
+  });
+  bench::report("cross (legacy)", ms, nElements);
+  ms = bench::bestOf(nRepeats, [&] {
+    for (int i = 0; i < nElements; i++) out[i] = cross(a[i], b[i]);
+  });
+  bench::report("cross (inline float3)", ms, nElements);
+  ms = bench::bestOf(nRepeats, [&] {
+    for (int i = 0; i < nElements; i++) outa[i] = cross(aa[i], ba[i]);
+  });
+  bench::report("cross (vec3a)", ms, nElements);
+
+  // norm
+  ms = bench::bestOf(nRepeats, [&] {
+    for (int i = 0; i < nElements; i++) out[i] = legacy::norm(a[i]);
+  });
+  bench::report("norm (legacy)", ms, nElements);
+  ms = bench::bestOf(nRepeats, [&] {
+    for (int i = 0; i < nElements; i++) out[i] = norm(a[i]);
+  });
+  bench::report("norm (inline float3)", ms, nElements);
+  ms = bench::bestOf(nRepeats, [&] {
+    for (int i = 0; i < nElements; i++) outa[i] = norm(aa[i]);
+  });
+  bench::report("norm (vec3a)", ms, nElements);
+
+  // mat3x3 * float3
+  ms = bench::bestOf(nRepeats, [&] {
+    for (int i = 0; i < nElements; i++) out[i] = legacy::mm(rot, a[i]);
+  });
+  bench::report("mm<3>(mat3x3, float3) (legacy)", ms, nElements);
+  ms = bench::bestOf(nRepeats, [&] {
+    for (int i = 0; i < nElements; i++) out[i] = mm<3>(rot, a[i]);
+  });
+  bench::report("mm<3>(mat3x3, float3) (inline)", ms, nElements);
+
+  // Affine point transform: rotate then translate.
+  ms = bench::bestOf(nRepeats, [&] {
+    for (int i = 0; i < nElements; i++)
+      out[i] = legacy::add(legacy::mm(rot, a[i]), translation);
+  });
+  bench::report("R*p+t (legacy)", ms, nElements);
+  ms = bench::bestOf(nRepeats, [&] {
+    for (int i = 0; i < nElements; i++) out[i] = transformPoint(xfm, a[i]);
+  });
+  bench::report("transformPoint(mat3x4, float3)", ms, nElements);
+
+  // mat3x3 * mat3x3
+  mat3x3 accMat = eye<3>();
+  ms = bench::bestOf(nRepeats, [&] {
+    for (int i = 0; i < nElements; i++) accMat = legacy::mm(rot, accMat);
+  });
+  bench::report("mm(mat3x3, mat3x3) (legacy)", ms, nElements);
+  ms = bench::bestOf(nRepeats, [&] {
+    for (int i = 0; i < nElements; i++) accMat = mm(rot, accMat);
+  });
+  bench::report("mm(mat3x3, mat3x3) (inline)", ms, nElements);
+
+  // Composite intersection kernel
+  float3 origin = make_float3(0.0f, 0.0f, -5.0f);
+  vec3a origina(origin);
+  ms = bench::bestOf(nRepeats, [&] {
+    for (int i = 0; i < nElements - 1; i++)
+      acc += mollerTrumbore(origin, a[i], b[i], c[i], b[i + 1], legacy::dot,
+                            legacy::cross, legacy::sub);
+  });
+  bench::report("triangle kernel (legacy)", ms, nElements);
+  ms = bench::bestOf(nRepeats, [&] {
+    for (int i = 0; i < nElements - 1; i++)
+      acc += mollerTrumbore(
+          origin, a[i], b[i], c[i], b[i + 1],
+          [](float3 x, float3 y) { return dot(x, y); },
+          [](float3 x, float3 y) { return cross(x, y); },
+          [](float3 x, float3 y) { return x - y; });
+  });
+  bench::report("triangle kernel (inline float3)", ms, nElements);
+  ms = bench::bestOf(nRepeats, [&] {
+    for (int i = 0; i < nElements - 1; i++)
+      acc += mollerTrumbore(
+          origina, aa[i], ba[i], ca[i], ba[i + 1],
+          [](const vec3a &x, const vec3a &y) { return dot(x, y); },
+          [](const vec3a &x, const vec3a &y) { return cross(x, y); },
+          [](const vec3a &x, const vec3a &y) { return x - y; });
+  });
+  bench::report("triangle kernel (vec3a)", ms, nElements);
+
+  bench::doNotOptimize(acc);
+  bench::doNotOptimize(accMat);
+  bench::doNotOptimize(out);
+  bench::doNotOptimize(outa);
+  return 0;
+}
@@ -0,0 +1,58 @@
+#include "math_legacy.h"
+
+#include <cmath>
+
+namespace legacy {
+
+template <int N, int M, int K>
+raytracer_cu::Mat<N, K> genericMm(raytracer_cu::Mat<N, M> a,
+                                  raytracer_cu::Mat<M, K> b) {
+  raytracer_cu::Mat<N, K> c;
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < K; j++) {
+      float dot = 0.0f;
+      for (int k = 0; k < M; k++) {
+        dot += a.data[i][k] * b.data[k][j];
+      }
+      c.data[i][j] = dot;
+    }
+  }
+  return c;
+}
+
+float dot(float3 a, float3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+float3 cross(float3 a, float3 b) {
+  return make_float3(a.y * b.z - b.y * a.z, a.z * b.x - b.z * a.x,
+                     a.x * b.y - b.x * a.y);
+}
+
+float3 add(float3 a, float3 b) {
+  return make_float3(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+float3 sub(float3 a, float3 b) {
+  return make_float3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+float3 mul(float a, float3 b) { return make_float3(a * b.x, a * b.y, a * b.z); }
+
+float length(float3 a) { return std::sqrt(a.x * a.x + a.y * a.y + a.z * a.z); }
+
+float3 norm(float3 a) {
+  float len = std::sqrt(a.x * a.x + a.y * a.y + a.z * a.z);
+  return make_float3(a.x / len, a.y / len, a.z / len);
+}
+
+float3 mm(mat3x3 a, float3 v) {
+  raytracer_cu::Mat<3, 1> matVec;
+  matVec.data[0][0] = v.x;
+  matVec.data[1][0] = v.y;
+  matVec.data[2][0] = v.z;
+  raytracer_cu::Mat<3, 1> result = genericMm(a, matVec);
+  return make_float3(result.data[0][0], result.data[1][0], result.data[2][0]);
+}
+
+mat3x3 mm(mat3x3 a, mat3x3 b) { return genericMm(a, b); }
+
+} // namespace legacy
@@ -0,0 +1,26 @@
+#ifndef MATH_LEGACY_H
+#define MATH_LEGACY_H
+
+#include "math.h"
+
+// Out-of-line copies of the float3 and matrix functions as they were before
+// math.h became header-only. They live in their own TU so every call pays
+// the function call the old library paid without LTO.
+
+namespace legacy {
+
+using raytracer_cu::mat3x3;
+
+float dot(float3 a, float3 b);
+float3 cross(float3 a, float3 b);
+float3 add(float3 a, float3 b);
+float3 sub(float3 a, float3 b);
+float3 mul(float a, float3 b);
+float length(float3 a);
+float3 norm(float3 a);
+float3 mm(mat3x3 a, float3 v);
+mat3x3 mm(mat3x3 a, mat3x3 b);
+
+} // namespace legacy
+
+#endif
@@ -0,0 +1,85 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "bench_util.h"
+#include "camera.h"
+#include "checker_textures.h"
+#include "host_renderer.h"
+#include "room_scene.h"
+#include "triangle.h"
+#include "thread_pool.h"
+
+// Frame time for growing bounce budgets, tracing every secondary ray
+// against skipping the ones below Scene::minThroughput, and how much the
+// pruned image differs. Runs the room scene as it is and with partially
+// mirrored walls (40% reflective), where every path keeps bouncing until
+// the budget runs out.
+//
+// usage: pruning_bench [width height [threads]]
+
+using namespace raytracer_cu;
+
+const int nRepeats = 3;
+
+int main(int argc, char **argv) {
+  int2 size = make_int2(640, 480);
+  int nThreads = 0; // 0: all cores
+  if (argc >= 3) {
+    size = make_int2(atoi(argv[1]), atoi(argv[2]));
+  }
+  if (argc >= 4) {
+    nThreads = atoi(argv[3]);
+  }
+
+  RoomScene *scene = new RoomScene();
+  addCheckerTextures(scene, 3);
+  scene->buildScene();
+  float minThroughput = scene->minThroughput;
+  Camera camera = Camera::initialView();
+
+  ThreadPool pool(nThreads - 1);
+  HostRenderer renderer(scene, pool);
+  std::vector<uint8_t> fullImage(size.x * size.y * 4);
+  std::vector<uint8_t> prunedImage(size.x * size.y * 4);
+
+  printf("%dx%d, %u threads, min throughput %g, best of %d\n", size.x,
+         size.y, pool.size() + 1, minThroughput, nRepeats);
+  for (bool mirroredWalls : {false, true}) {
+    if (mirroredWalls) {
+      // The first 12 objects are the walls of the room.
+      for (int i = 0; i < 12; i++) {
+        ((Triangle *)scene->sceneObjects[i])->shader->setProfile(0.6f, 0.4f,
+                                                                  0.0f);
+      }
+    }
+    printf("%s\n", mirroredWalls ? "mirrored walls" : "room scene");
+    printf("%8s %12s %12s %9s %12s %10s\n", "bounces", "full ms",
+           "pruned ms", "speedup", "max diff", "pixels");
+    for (int bounces : {1, 2, 3, 4, 6, 8, 12, 16}) {
+      scene->maxBounces = bounces;
+      scene->minThroughput = 0.0f;
+      double fullMs = bench::bestOf(nRepeats, [&] {
+        renderer.render(camera, size, 0, fullImage.data());
+      });
+      scene->minThroughput = minThroughput;
+      double prunedMs = bench::bestOf(nRepeats, [&] {
+        renderer.render(camera, size, 0, prunedImage.data());
+      });
+
+      int maxDiff = 0, nDiffering = 0;
+      for (int i = 0; i < size.x * size.y; i++) {
+        int pixelDiff = 0;
+        for (int c = 1; c < 4; c++) {
+          int d = abs(int(fullImage[i * 4 + c]) - int(prunedImage[i * 4 + c]));
+          pixelDiff = d > pixelDiff ? d : pixelDiff;
+        }
+        maxDiff = pixelDiff > maxDiff ? pixelDiff : maxDiff;
+        nDiffering += pixelDiff > 0;
+      }
+      printf("%8d %12.2f %12.2f %8.2fx %12d %10d\n", bounces, fullMs,
+             prunedMs, fullMs / prunedMs, maxDiff, nDiffering);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "bench_util.h"
+#include "random.h"
+#include "ray_query.h"
+#include "room_scene.h"
+#include "thread_pool.h"
+
+// Throughput of the batched ray queries (ray_query.h) on the room: n rays
+// between random points of the room's bounding box, as nearest hit queries
+// and as occlusion queries along the segments, at 1, 2, 4, ... threads up
+// to the number of cores. The results are checked against tracing the
+// rays one by one through Scene::closestIntersection.
+//
+// usage: ray_query_bench [nRays [maxThreads]]
+
+using namespace raytracer_cu;
+
+namespace {
+
+const int nRepeats = 3;
+
+float3 randomPoint(const AABB &box, uint32_t &seed) {
+  return make_float3(box.lo.x + randomFloat(seed) * (box.hi.x - box.lo.x),
+                     box.lo.y + randomFloat(seed) * (box.hi.y - box.lo.y),
+                     box.lo.z + randomFloat(seed) * (box.hi.z - box.lo.z));
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t nRays = size_t(4) << 20;
+  int maxThreads = int(std::max(1u, std::thread::hardware_concurrency()));
+  if (argc >= 2) {
+    nRays = size_t(atoll(argv[1]));
+  }
+  if (argc >= 3) {
+    maxThreads = std::max(1, atoi(argv[2]));
+  }
+
+  RoomScene *scene = new RoomScene();
+  scene->buildScene();
+  AABB room = scene->sceneObjects[0]->bounds();
+  for (uint64_t i = 1; i < scene->sceneObjects.size(); i++) {
+    room.grow(scene->sceneObjects[i]->bounds());
+  }
+
+  std::vector<float3> origins(nRays), directions(nRays);
+  std::vector<float> lengths(nRays);
+  uint32_t seed = 12345u;
+  for (size_t i = 0; i < nRays; i++) {
+    origins[i] = randomPoint(room, seed);
+    directions[i] = randomPoint(room, seed) - origins[i];
+    lengths[i] = length(directions[i]);
+  }
+  RayBatch rays;
+  rays.origins = origins.data();
+  rays.directions = directions.data();
+  rays.count = nRays;
+  RayBatch segments = rays;
+  segments.maxDistances = lengths.data();
+
+  std::vector<int> objectIds(nRays);
+  std::vector<float> distances(nRays);
+  std::vector<uint8_t> flags(nRays);
+  HitBatch hits;
+  hits.objectIds = objectIds.data();
+  hits.distances = distances.data();
+
+  // Reference, one ray at a time on this thread.
+  std::vector<int> expectedIds(nRays);
+  std::vector<uint8_t> expectedFlags(nRays);
+  bench::Timer timer;
+  for (size_t i = 0; i < nRays; i++) {
+    Ray ray(origins[i], directions[i]);
+    Intersection hit;
+    bool isHit = scene->closestIntersection(ray, hit);
+    expectedIds[i] = isHit ? hit.objectId : -1;
+    expectedFlags[i] =
+        isHit && length(hit.surfacePoint - origins[i]) < lengths[i];
+  }
+  double referenceMs = timer.elapsedMs();
+
+  printf("%zu rays in the room, one by one: %.1f Mrays/s\n", nRays,
+         nRays / referenceMs * 1e-3);
+  printf("%8s %16s %16s %10s\n", "threads", "closest Mrays/s",
+         "occluded Mrays/s", "mismatches");
+  for (int step = 1;; step *= 2) {
+    int nThreads = std::min(step, maxThreads);
+    ThreadPool pool(nThreads - 1);
+    RayQuery query(scene, pool);
+    double closestMs =
+        bench::bestOf(nRepeats, [&] { query.closestHits(rays, hits); });
+    double occludedMs = bench::bestOf(
+        nRepeats, [&] { query.occluded(segments, flags.data()); });
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < nRays; i++) {
+      mismatches += objectIds[i] != expectedIds[i];
+      mismatches += flags[i] != expectedFlags[i];
+    }
+    printf("%8d %16.1f %16.1f %10zu\n", nThreads, nRays / closestMs * 1e-3,
+           nRays / occludedMs * 1e-3, mismatches);
+    if (nThreads == maxThreads) {
+      break;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,114 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "bench_util.h"
+#include "camera.h"
+#include "host_renderer.h"
+#include "procedural_scene.h"
+#include "thread_pool.h"
+
+// Frame times of generated scenes (procedural_scene.h) against one
+// parameter at a time, for plotting: the number of spheres, the triangles
+// of 4 meshes, the number of lights, and the share of mirrors and of glass.
+// Every other parameter stays at its default (64 spheres, 1 light, 60%
+// diffuse, 30% mirror, 10% glass, shadows on). Prints one row per scene:
+// its sweep, the swept value, the objects in the BVH, the build time and
+// the best frame time of 3.
+//
+// usage: scene_scaling_bench [width height [threads [seed]]]
+
+using namespace raytracer_cu;
+
+namespace {
+
+const int nRepeats = 3;
+
+struct Row {
+  const char *sweep;
+  double value;
+  ProceduralSceneParams params;
+};
+
+void run(const Row &row, ThreadPool &pool, int2 size,
+         std::vector<uint8_t> &image) {
+  bench::Timer timer;
+  ProceduralScene *scene = new ProceduralScene(row.params);
+  scene->buildScene();
+  double buildMs = timer.elapsedMs();
+
+  HostRenderer renderer(scene, pool);
+  Camera camera = Camera::lookAt(make_float3(0.0f, -150.0f, -300.0f),
+                                 make_float3(0.0f, 20.0f, 0.0f),
+                                 make_float3(0.0f, 1.0f, 0.0f));
+  double frameMs = bench::bestOf(nRepeats, [&] {
+    renderer.render(camera, size, 0, image.data());
+  });
+  printf("%-10s %10g %10d %10.1f %10.1f %10.1f\n", row.sweep, row.value,
+         int(scene->sceneObjects.size()), buildMs, frameMs,
+         frameMs * 1e6 / (double(size.x) * size.y));
+  delete scene;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int2 size = make_int2(320, 240);
+  int nThreads = 0; // 0: all cores
+  uint32_t seed = 1;
+  if (argc >= 3) {
+    size = make_int2(atoi(argv[1]), atoi(argv[2]));
+  }
+  if (argc >= 4) {
+    nThreads = atoi(argv[3]);
+  }
+  if (argc >= 5) {
+    seed = uint32_t(atoi(argv[4]));
+  }
+
+  ProceduralSceneParams base;
+  base.seed = seed;
+  std::vector<Row> rows;
+  for (int n = 16; n <= 16384; n *= 4) {
+    Row row{"spheres", double(n), base};
+    row.params.nSpheres = n;
+    rows.push_back(row);
+  }
+  for (int n = 256; n <= 65536; n *= 4) {
+    Row row{"triangles", double(n), base};
+    row.params.nSpheres = 0;
+    row.params.nMeshes = 4;
+    row.params.meshTriangles = n;
+    rows.push_back(row);
+  }
+  for (int n = 1; n <= 16; n *= 2) {
+    Row row{"lights", double(n), base};
+    row.params.nLights = n;
+    rows.push_back(row);
+  }
+  for (int i = 0; i <= 4; i++) {
+    Row row{"mirror", i * 0.25, base};
+    row.params.diffuse = 1.0f - i * 0.25f;
+    row.params.mirror = i * 0.25f;
+    row.params.glass = 0.0f;
+    rows.push_back(row);
+  }
+  for (int i = 0; i <= 4; i++) {
+    Row row{"glass", i * 0.25, base};
+    row.params.diffuse = 1.0f - i * 0.25f;
+    row.params.mirror = 0.0f;
+    row.params.glass = i * 0.25f;
+    rows.push_back(row);
+  }
+
+  ThreadPool pool(nThreads - 1);
+  std::vector<uint8_t> image(size_t(size.x) * size.y * 4);
+  printf("%dx%d, %u threads, seed %u\n", size.x, size.y, pool.size() + 1,
+         seed);
+  printf("%-10s %10s %10s %10s %10s %10s\n", "sweep", "value", "objects",
+         "build ms", "frame ms", "ns/pixel");
+  for (const Row &row : rows) {
+    run(row, pool, size, image);
+  }
+  return 0;
+}
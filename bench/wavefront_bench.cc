@@ -0,0 +1,66 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "bench_util.h"
+#include "camera.h"
+#include "checker_textures.h"
+#include "host_renderer.h"
+#include "room_scene.h"
+#include "thread_pool.h"
+#include "wavefront.h"
+
+// Megakernel (recursive trace per pixel) against the wavefront renderer on
+// the host, both on the room scene with placeholder textures.
+//
+// usage: wavefront_bench [width height [threads]]
+
+using namespace raytracer_cu;
+
+const int nRepeats = 5;
+
+int main(int argc, char **argv) {
+  int2 size = make_int2(640, 480);
+  int nThreads = 0; // 0: all cores
+  if (argc >= 3) {
+    size = make_int2(atoi(argv[1]), atoi(argv[2]));
+  }
+  if (argc >= 4) {
+    nThreads = atoi(argv[3]);
+  }
+
+  RoomScene *scene = new RoomScene();
+  addCheckerTextures(scene, 3);
+  scene->buildScene();
+  Camera camera = Camera::initialView();
+
+  ThreadPool pool(nThreads - 1);
+  std::vector<uint8_t> megakernelImage(size.x * size.y * 4);
+  std::vector<uint8_t> wavefrontImage(size.x * size.y * 4);
+  HostRenderer megakernel(scene, pool);
+  WavefrontRenderer wavefront(scene, pool);
+
+  printf("%dx%d, %u threads, best of %d\n", size.x, size.y, pool.size() + 1,
+         nRepeats);
+
+  double ms = bench::bestOf(nRepeats, [&] {
+    megakernel.render(camera, size, 0, megakernelImage.data());
+  });
+  bench::report("megakernel frame", ms, uint64_t(size.x) * size.y);
+
+  ms = bench::bestOf(nRepeats, [&] {
+    wavefront.render(camera, size, 0, wavefrontImage.data());
+  });
+  bench::report("wavefront frame", ms, uint64_t(size.x) * size.y);
+  wavefront.stats.print(std::cout);
+
+  // Same random streams, so only the order of the film additions differs.
+  int maxDiff = 0;
+  for (size_t i = 0; i < megakernelImage.size(); i++) {
+    int diff = abs(int(megakernelImage[i]) - int(wavefrontImage[i]));
+    maxDiff = diff > maxDiff ? diff : maxDiff;
+  }
+  printf("max channel difference: %d\n", maxDiff);
+  return 0;
+}
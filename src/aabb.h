@@ -0,0 +1,85 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "cudastuff.h"
+#include "math.h"
+
+#include "cuda_runtime.h"
+
+namespace raytracer_cu {
+
+// Plain compare and select: fminf / fmaxf are library calls on the host
+// unless NaNs are ruled out, and the slab test is the inner loop of the
+// traversal.
+CUDA_HOSTDEV inline float minf(float a, float b) { return a < b ? a : b; }
+CUDA_HOSTDEV inline float maxf(float a, float b) { return a > b ? a : b; }
+
+/*
+Axis aligned bounding box, empty (lo > hi) when default constructed.
+
+grow(p), grow(box):   extend to contain a point or another box
+center(), surfaceArea()
+pad(eps):             extend every side by eps, keeps flat boxes (a triangle
+                      in an axis plane) from being missed by the slab test
+intersect(origin, invDir, tMax, tNear):
+                      slab test on the ray origin + t * dir, invDir is
+                      1 / dir per component; true if the box overlaps
+                      [0, tMax], tNear is the entry (0 if the origin is
+                      inside)
+*/
+struct AABB {
+  float3 lo = make_float3(1e30f, 1e30f, 1e30f);
+  float3 hi = make_float3(-1e30f, -1e30f, -1e30f);
+
+  CUDA_HOSTDEV bool empty() const { return lo.x > hi.x; }
+
+  CUDA_HOSTDEV void grow(float3 p) {
+    lo = make_float3(minf(lo.x, p.x), minf(lo.y, p.y), minf(lo.z, p.z));
+    hi = make_float3(maxf(hi.x, p.x), maxf(hi.y, p.y), maxf(hi.z, p.z));
+  }
+
+  CUDA_HOSTDEV void grow(const AABB &box) {
+    if (!box.empty()) {
+      grow(box.lo);
+      grow(box.hi);
+    }
+  }
+
+  CUDA_HOSTDEV void pad(float eps) {
+    lo = lo - make_float3(eps, eps, eps);
+    hi = hi + make_float3(eps, eps, eps);
+  }
+
+  CUDA_HOSTDEV float3 center() const { return 0.5f * (lo + hi); }
+
+  CUDA_HOSTDEV float surfaceArea() const {
+    if (empty()) {
+      return 0.0f;
+    }
+    float3 d = hi - lo;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+  }
+
+  CUDA_HOSTDEV bool intersect(float3 origin, float3 invDir, float tMax,
+                              float &tNear) const {
+    float tx1 = (lo.x - origin.x) * invDir.x, tx2 = (hi.x - origin.x) * invDir.x;
+    float ty1 = (lo.y - origin.y) * invDir.y, ty2 = (hi.y - origin.y) * invDir.y;
+    float tz1 = (lo.z - origin.z) * invDir.z, tz2 = (hi.z - origin.z) * invDir.z;
+    float tEnter = maxf(maxf(minf(tx1, tx2), minf(ty1, ty2)),
+                        maxf(minf(tz1, tz2), 0.0f));
+    float tExit = minf(minf(maxf(tx1, tx2), maxf(ty1, ty2)),
+                       minf(maxf(tz1, tz2), tMax));
+    tNear = tEnter;
+    return tEnter <= tExit;
+  }
+};
+
+CUDA_HOSTDEV inline AABB merge(const AABB &a, const AABB &b) {
+  AABB box = a;
+  box.grow(b);
+  return box;
+}
+
+} // namespace raytracer_cu
+
+#endif
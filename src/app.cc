@@ -1,13 +1,29 @@
 #include <iostream>
+#include <string>
 
 #include "disp_sdl.h"
+#include "memory_tracker.h"
 
 int main(int argc, char* args[]){
     Display::initSDL();
     int screenWidth = 1024;
     int screenHeight = 1024;
-    Display display(screenWidth, screenHeight);
-    display.mainLoop();
+    {
+        Display display(screenWidth, screenHeight);
+        // --frame-ring /name publishes every frame to shared memory.
+        for (int i = 1; i + 1 < argc; i++) {
+            if (std::string(args[i]) == "--frame-ring" &&
+                !display.shareFrames(args[i + 1])) {
+                return 1;
+            }
+        }
+        display.mainLoop();
+    }
     Display::destroySDL();
+    // Everything the display allocated is released by now.
+    if (raytracer_cu::MemoryTracker::enabled()) {
+        raytracer_cu::MemoryTracker::instance().printStats(std::cout);
+        raytracer_cu::MemoryTracker::instance().printLeaks(std::cout);
+    }
     return 0;
 }
\ No newline at end of file
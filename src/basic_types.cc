@@ -9,6 +9,7 @@ namespace raytracer_cu {
 template <class T>
 ColorBuffer<T>::ColorBuffer(int a_w, int a_h) : w(a_w), h(a_h) {
   c = new T[w * h];
+  MEMORY_ALLOCATED(c, sizeof(T) * size_t(w) * h, MemoryTag::textures);
 }
 
 template <class T> int ColorBuffer<T>::idx(int x, int y) { return y * w + x; }
@@ -31,7 +32,10 @@ template <class T> T *ColorBuffer<T>::getRawPtr() {
 }
 
 template <class T> ColorBuffer<T>::~ColorBuffer() {
-  delete c;
+  if (ownsTexels) {
+    MEMORY_FREED(c);
+    delete[] c;
+  }
 }
 
 template class ColorBuffer<float3>;
@@ -6,6 +6,7 @@
 #include <vector>
 
 #include "cudastuff.h"
+#include "memory_tracker.h"
 
 #define CUDA_TYPES
 // #define DEBUG_STDOUT
@@ -14,36 +15,103 @@
 
 namespace raytracer_cu {
 
+/*
+A w x h texel array. The texels are owned (allocated by the first
+constructor and counted as textures, see memory_tracker.h) unless they
+were handed in, e.g. device texels the renderer allocated itself.
+*/
 template <class T> class ColorBuffer {
 private:
   T maxIntensity;
   T minIntensity;
+  bool ownsTexels = true;
 
 public:
   T *c;
   const int w, h;
   CUDA_HOSTDEV ColorBuffer(int w, int h);
+  CUDA_HOSTDEV ColorBuffer(int w, int h, T *texels)
+      : ownsTexels(false), c(texels), w(w), h(h) {}
+  ColorBuffer(const ColorBuffer &) = delete;
+  ColorBuffer &operator=(const ColorBuffer &) = delete;
   CUDA_HOSTDEV void setPixel(int x, int y, T intensity);
   CUDA_HOSTDEV T getPixel(int x, int y, bool normalize = false);
   CUDA_HOSTDEV int idx(int x, int y);
   CUDA_HOSTDEV T *getRawPtr();
   CUDA_HOSTDEV ~ColorBuffer();
 };
+
+/*
+Growable array for host and device code. It owns its storage: copies are
+deep, moves take the storage over, and the destructor frees it.
+
+The storage is counted under the vector's MemoryTag (see memory_tracker.h),
+which stays with the vector: assigning another vector's elements keeps it.
+*/
 template <class T, class SizeType = uint64_t> class EasyVector {
 private:
   T *data;
   SizeType capacity;
   SizeType tailIdx = 0;
+  MemoryTag tag = MemoryTag::other;
+
+  CUDA_HOSTDEV void track() {
+    MEMORY_ALLOCATED_AT(data, sizeof(T) * size_t(capacity), tag,
+                        __PRETTY_FUNCTION__);
+  }
+  CUDA_HOSTDEV void untrack() { MEMORY_FREED(data); }
 
 public:
-  CUDA_HOSTDEV EasyVector() : capacity(12), data(new T[12]) {}
+  CUDA_HOSTDEV EasyVector() : data(new T[12]), capacity(12) { track(); }
+  CUDA_HOSTDEV explicit EasyVector(MemoryTag tag)
+      : data(new T[12]), capacity(12), tag(tag) {
+    track();
+  }
   CUDA_HOSTDEV EasyVector(SizeType length) {
     capacity = length;
     data = new T[length];
+    track();
+  }
+  CUDA_HOSTDEV EasyVector(const EasyVector &other)
+      : data(new T[other.capacity]), capacity(other.capacity),
+        tailIdx(other.tailIdx), tag(other.tag) {
+    for (SizeType i = 0; i < tailIdx; i++) {
+      data[i] = other.data[i];
+    }
+    track();
+  }
+  CUDA_HOSTDEV EasyVector(EasyVector &&other)
+      : data(other.data), capacity(other.capacity), tailIdx(other.tailIdx),
+        tag(other.tag) {
+    other.data = nullptr;
+    other.capacity = 0;
+    other.tailIdx = 0;
   }
+  // other is a copy or was moved from, its storage becomes ours.
+  CUDA_HOSTDEV EasyVector &operator=(EasyVector other) {
+    untrack();
+    delete[] data;
+    MEMORY_FREED(other.data);
+    data = other.data;
+    capacity = other.capacity;
+    tailIdx = other.tailIdx;
+    track();
+    other.data = nullptr;
+    other.capacity = 0;
+    other.tailIdx = 0;
+    return *this;
+  }
+  CUDA_HOSTDEV ~EasyVector() {
+    untrack();
+    delete[] data;
+  }
+
   CUDA_HOSTDEV void allocate(SizeType n) {
+    untrack();
+    delete[] data;
     data = new T[n];
     capacity = n;
+    track();
   }
   CUDA_HOSTDEV int getCapacity() { return capacity; }
   CUDA_HOSTDEV SizeType size() const { return tailIdx; }
@@ -68,14 +136,27 @@ public:
     tailIdx += 1;
   }
 
+  // Never shrinks the storage; elements past the old size keep whatever
+  // value their slot held.
+  CUDA_HOSTDEV void resize(SizeType n) {
+    while (n > capacity) {
+      grow();
+    }
+    tailIdx = n;
+  }
+  CUDA_HOSTDEV void clear() { tailIdx = 0; }
+
   CUDA_HOSTDEV void grow() {
-    SizeType newCapacity = capacity * 2;
+    SizeType newCapacity = capacity > 0 ? capacity * 2 : 12;
     T *newData = new T[newCapacity];
-    for (int i = 0; i < capacity; i++) {
+    for (SizeType i = 0; i < capacity; i++) {
       newData[i] = data[i];
     }
+    untrack();
+    delete[] data;
     capacity = newCapacity;
     data = newData;
+    track();
   }
 };
 
@@ -0,0 +1,414 @@
+#include "bvh.h"
+
+#include "parallel_bvh.h"
+#include "raytracer_basics.h"
+#include "thread_pool.h"
+
+namespace raytracer_cu {
+
+namespace {
+
+const int nBins = 16;
+// Deeper than this the SAH split gives way to halving the object range, so
+// the traversal stack below never overflows.
+const int maxSahDepth = 48;
+const int traversalStackSize = 96;
+const float boundsPadding = 1e-3f;
+const float maxDistance = 99999.0f; // as in _closestIntersection
+const int parallelGrain = 4096;
+
+CUDA_HOSTDEV AABB paddedBounds(Object *object) {
+  AABB box = object->bounds();
+  box.pad(boundsPadding);
+  return box;
+}
+
+CUDA_HOSTDEV float axisOf(float3 v, int axis) {
+  return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+} // namespace
+
+CUDA_HOSTDEV void Bvh::build(EasyVector<Object *> &objects) {
+  int n = int(objects.size());
+  objectIds.resize(n);
+  leafOf.resize(n);
+  objectBounds.resize(n);
+  for (int i = 0; i < n; i++) {
+    objectIds[i] = i;
+    objectBounds[i] = paddedBounds(objects[i]);
+  }
+  nodes.resize(n > 0 ? 2 * n - 1 : 0);
+  dirtyNodes.resize(nodes.size());
+  for (int i = 0; i < nodes.size(); i++) {
+    dirtyNodes[i] = 0;
+  }
+  anyDirty = false;
+  if (n > 0) {
+    buildSubtree(0, 0, n, -1, 0);
+  }
+}
+
+void Bvh::build(EasyVector<Object *> &objects, ThreadPool &pool) {
+  int n = int(objects.size());
+  objectIds.resize(n);
+  leafOf.resize(n);
+  objectBounds.resize(n);
+  pool.parallelFor(0, n, parallelGrain, [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      objectBounds[i] = paddedBounds(objects[i]);
+    }
+  });
+  ParallelBvhBuilder builder;
+  builder.build(n > 0 ? &objectBounds[0] : nullptr, n, pool);
+
+  int nNodes = int(builder.nodes.size());
+  nodes.resize(nNodes);
+  dirtyNodes.resize(nNodes);
+  anyDirty = false;
+  // Every node sets the parent of its children, fields of other nodes than
+  // the ones the other chunks write.
+  pool.parallelFor(0, nNodes, parallelGrain, [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      const ParallelBvhNode &in = builder.nodes[i];
+      BvhNode &node = nodes[i];
+      node.bounds = in.bounds;
+      node.left = in.left;
+      node.right = in.right;
+      node.first = in.first;
+      node.count = in.count;
+      node.cost = in.cost;
+      float area = in.bounds.surfaceArea();
+      node.builtCost = area > 0.0f ? in.cost / area : 0.0f;
+      dirtyNodes[i] = 0;
+      if (in.left < 0) {
+        objectIds[in.first] = builder.order[in.first];
+        leafOf[builder.order[in.first]] = i;
+      } else {
+        nodes[in.left].parent = i;
+        nodes[in.right].parent = i;
+      }
+    }
+  });
+  if (nNodes > 0) {
+    nodes[0].parent = -1;
+  }
+}
+
+// Partitions objectIds[first, first + count) and returns the size of the
+// left part, in [1, count - 1].
+CUDA_HOSTDEV int Bvh::split(int first, int count) {
+  AABB centroidBounds;
+  for (int i = first; i < first + count; i++) {
+    centroidBounds.grow(objectBounds[objectIds[i]].center());
+  }
+
+  int bestAxis = -1, bestBin = 0;
+  float bestCost = 1e30f;
+  for (int axis = 0; axis < 3; axis++) {
+    float lo = axisOf(centroidBounds.lo, axis);
+    float extent = axisOf(centroidBounds.hi, axis) - lo;
+    if (extent <= 0.0f) {
+      continue;
+    }
+    AABB binBounds[nBins];
+    int binCount[nBins] = {0};
+    for (int i = first; i < first + count; i++) {
+      const AABB &box = objectBounds[objectIds[i]];
+      int bin = int(nBins * (axisOf(box.center(), axis) - lo) / extent);
+      bin = bin < nBins ? bin : nBins - 1;
+      binCount[bin]++;
+      binBounds[bin].grow(box);
+    }
+    // Right-to-left sweep for the right side areas, then left-to-right.
+    float rightArea[nBins];
+    int rightCount[nBins];
+    AABB right;
+    int nRight = 0;
+    for (int bin = nBins - 1; bin > 0; bin--) {
+      right.grow(binBounds[bin]);
+      nRight += binCount[bin];
+      rightArea[bin] = right.surfaceArea();
+      rightCount[bin] = nRight;
+    }
+    AABB left;
+    int nLeft = 0;
+    for (int bin = 1; bin < nBins; bin++) {
+      left.grow(binBounds[bin - 1]);
+      nLeft += binCount[bin - 1];
+      if (nLeft == 0 || rightCount[bin] == 0) {
+        continue;
+      }
+      float cost = left.surfaceArea() * nLeft + rightArea[bin] * rightCount[bin];
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestAxis = axis;
+        bestBin = bin;
+      }
+    }
+  }
+  if (bestAxis < 0) {
+    return count / 2; // all centroids coincide, any halving is as good
+  }
+
+  float lo = axisOf(centroidBounds.lo, bestAxis);
+  float extent = axisOf(centroidBounds.hi, bestAxis) - lo;
+  int middle = first;
+  for (int i = first; i < first + count; i++) {
+    int id = objectIds[i];
+    int bin = int(nBins * (axisOf(objectBounds[id].center(), bestAxis) - lo) /
+                  extent);
+    if (bin < bestBin) {
+      objectIds[i] = objectIds[middle];
+      objectIds[middle] = id;
+      middle++;
+    }
+  }
+  return middle - first;
+}
+
+CUDA_HOSTDEV void Bvh::buildSubtree(int root, int first, int count, int parent,
+                                    int depth) {
+  buildStack.clear();
+  buildStack.push_back(BuildTask{root, first, count, parent, depth});
+  while (buildStack.size() > 0) {
+    BuildTask task = buildStack[buildStack.size() - 1];
+    buildStack.resize(buildStack.size() - 1);
+
+    BvhNode &node = nodes[task.node];
+    node.parent = task.parent;
+    node.first = task.first;
+    node.count = task.count;
+    node.bounds = AABB();
+    for (int i = task.first; i < task.first + task.count; i++) {
+      node.bounds.grow(objectBounds[objectIds[i]]);
+    }
+    if (task.count == 1) {
+      node.left = node.right = -1;
+      leafOf[objectIds[task.first]] = task.node;
+      continue;
+    }
+
+    int leftCount = task.depth < maxSahDepth ? split(task.first, task.count)
+                                             : task.count / 2;
+    node.left = task.node + 1;
+    node.right = task.node + 2 * leftCount;
+    buildStack.push_back(BuildTask{node.right, task.first + leftCount,
+                                   task.count - leftCount, task.node,
+                                   task.depth + 1});
+    buildStack.push_back(BuildTask{node.left, task.first, leftCount,
+                                   task.node, task.depth + 1});
+  }
+
+  // Children come after their parents.
+  for (int i = root + 2 * count - 2; i >= root; i--) {
+    computeCost(i);
+    float area = nodes[i].bounds.surfaceArea();
+    nodes[i].builtCost = area > 0.0f ? nodes[i].cost / area : 0.0f;
+  }
+}
+
+CUDA_HOSTDEV void Bvh::computeCost(int i) {
+  BvhNode &node = nodes[i];
+  float area = node.bounds.surfaceArea();
+  if (node.left < 0) {
+    node.cost = area;
+  } else {
+    node.cost = area + nodes[node.left].cost + nodes[node.right].cost;
+  }
+}
+
+CUDA_HOSTDEV int Bvh::depthOf(int node) {
+  int depth = 0;
+  while (nodes[node].parent >= 0) {
+    node = nodes[node].parent;
+    depth++;
+  }
+  return depth;
+}
+
+CUDA_HOSTDEV void Bvh::markDirty(int objectId) {
+  if (objectId < 0 || objectId >= leafOf.size()) {
+    return;
+  }
+  // Flags the path to the root, stops at the first node already flagged.
+  for (int node = leafOf[objectId]; node >= 0 && !dirtyNodes[node];
+       node = nodes[node].parent) {
+    dirtyNodes[node] = 1;
+  }
+  anyDirty = true;
+}
+
+CUDA_HOSTDEV void Bvh::markAllDirty() {
+  for (int i = 0; i < nodes.size(); i++) {
+    dirtyNodes[i] = 1;
+  }
+  anyDirty = nodes.size() > 0;
+}
+
+CUDA_HOSTDEV BvhUpdateStats Bvh::update(EasyVector<Object *> &objects) {
+  BvhUpdateStats stats;
+  if (objectCount() != int(objects.size())) {
+    build(objects);
+    stats.rebuiltSubtrees = 1;
+    stats.rebuiltObjects = objectCount();
+    return stats;
+  }
+  if (!anyDirty) {
+    return stats;
+  }
+
+  // Refit, children first.
+  for (int i = nodes.size() - 1; i >= 0; i--) {
+    if (!dirtyNodes[i]) {
+      continue;
+    }
+    BvhNode &node = nodes[i];
+    if (node.left < 0) {
+      int id = objectIds[node.first];
+      objectBounds[id] = paddedBounds(objects[id]);
+      node.bounds = objectBounds[id];
+    } else {
+      node.bounds = merge(nodes[node.left].bounds, nodes[node.right].bounds);
+    }
+    computeCost(i);
+    stats.refitNodes++;
+  }
+
+  // Rebuild the topmost degraded subtrees, parents first. Subtrees are
+  // contiguous, so everything below a rebuilt node is skipped.
+  int skipUntil = 0;
+  for (int i = 0; i < nodes.size(); i++) {
+    if (!dirtyNodes[i]) {
+      continue;
+    }
+    dirtyNodes[i] = 0;
+    BvhNode &node = nodes[i];
+    if (i < skipUntil || node.left < 0) {
+      continue;
+    }
+    float area = node.bounds.surfaceArea();
+    if (area <= 0.0f || node.cost / area <= rebuildThreshold * node.builtCost) {
+      continue;
+    }
+    buildSubtree(i, node.first, node.count, node.parent, depthOf(i));
+    skipUntil = i + 2 * node.count - 1;
+    stats.rebuiltSubtrees++;
+    stats.rebuiltObjects += node.count;
+    // Same objects, same bounds; only the costs above change.
+    for (int p = node.parent; p >= 0; p = nodes[p].parent) {
+      computeCost(p);
+    }
+  }
+  anyDirty = false;
+  return stats;
+}
+
+CUDA_HOSTDEV bool Bvh::closestHit(Ray &ray, EasyVector<Object *> &objects,
+                                  float3 &intersectionPoint, float3 &normal,
+                                  float3 &color, int &objectId) {
+  if (nodes.size() == 0) {
+    return false;
+  }
+  // Box distances are in units of the (unnormalized) ray direction.
+  float directionLength = length(ray.direction);
+  float3 invDir = make_float3(1.0f / ray.direction.x, 1.0f / ray.direction.y,
+                              1.0f / ray.direction.z);
+
+  float minDist = maxDistance;
+  int minDistObjectId = -1;
+  int stack[traversalStackSize];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize > 0) {
+    BvhNode &node = nodes[stack[--stackSize]];
+    if (ray.cost) {
+      ray.cost->nodeVisits++;
+    }
+    float tNear;
+    if (!node.bounds.intersect(ray.origin, invDir, minDist / directionLength,
+                               tNear)) {
+      continue;
+    }
+    if (node.left < 0) {
+      int id = objectIds[node.first];
+      if (ray.cost) {
+        ray.cost->intersectionTests++;
+      }
+      float3 point, n, c;
+      if (objects[id]->intersect(ray, point, n, c)) {
+        float dist = length(point - ray.origin);
+        if (dist < minDist || (dist == minDist && id < minDistObjectId)) {
+          minDist = dist;
+          minDistObjectId = id;
+          intersectionPoint = point;
+          normal = n;
+          color = c;
+        }
+      }
+      continue;
+    }
+    // Visit the nearer child first.
+    float tLeft, tRight;
+    float tMax = minDist / directionLength;
+    bool hitLeft =
+        nodes[node.left].bounds.intersect(ray.origin, invDir, tMax, tLeft);
+    bool hitRight =
+        nodes[node.right].bounds.intersect(ray.origin, invDir, tMax, tRight);
+    if (hitLeft && hitRight) {
+      bool leftFirst = tLeft <= tRight;
+      stack[stackSize++] = leftFirst ? node.right : node.left;
+      stack[stackSize++] = leftFirst ? node.left : node.right;
+    } else if (hitLeft) {
+      stack[stackSize++] = node.left;
+    } else if (hitRight) {
+      stack[stackSize++] = node.right;
+    }
+  }
+  objectId = minDistObjectId;
+  return minDistObjectId >= 0;
+}
+
+CUDA_HOSTDEV bool Bvh::anyHit(Ray &ray, EasyVector<Object *> &objects,
+                              float maxDist) {
+  if (nodes.size() == 0) {
+    return false;
+  }
+  maxDist = maxDist < maxDistance ? maxDist : maxDistance;
+  float directionLength = length(ray.direction);
+  float3 invDir = make_float3(1.0f / ray.direction.x, 1.0f / ray.direction.y,
+                              1.0f / ray.direction.z);
+  float tMax = maxDist / directionLength;
+
+  // No ordering: any hit under maxDist ends the walk.
+  int stack[traversalStackSize];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize > 0) {
+    BvhNode &node = nodes[stack[--stackSize]];
+    if (ray.cost) {
+      ray.cost->nodeVisits++;
+    }
+    float tNear;
+    if (!node.bounds.intersect(ray.origin, invDir, tMax, tNear)) {
+      continue;
+    }
+    if (node.left < 0) {
+      int id = objectIds[node.first];
+      if (ray.cost) {
+        ray.cost->intersectionTests++;
+      }
+      float3 point, n, c;
+      if (objects[id]->intersect(ray, point, n, c) &&
+          length(point - ray.origin) < maxDist) {
+        return true;
+      }
+      continue;
+    }
+    stack[stackSize++] = node.right;
+    stack[stackSize++] = node.left;
+  }
+  return false;
+}
+
+} // namespace raytracer_cu
@@ -0,0 +1,106 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "aabb.h"
+#include "basic_types.h"
+#include "cudastuff.h"
+
+#include "cuda_runtime.h"
+
+namespace raytracer_cu {
+
+class Object;
+class Ray;
+class ThreadPool;
+
+struct BvhNode {
+  AABB bounds;
+  int parent;
+  int left, right;  // -1 in leaves
+  int first, count; // the objects below are objectIds[first, first + count)
+  float cost;       // SAH cost of the subtree
+  float builtCost;  // cost / surface area when the subtree was (re)built
+};
+
+struct BvhUpdateStats {
+  int refitNodes = 0;
+  int rebuiltSubtrees = 0;
+  int rebuiltObjects = 0;
+};
+
+/*
+Bounding volume hierarchy over the objects of a scene, one object per leaf,
+built top-down with a binned SAH split. The nodes are stored depth first:
+the subtree of node i with n objects is the node range [i, i + 2n - 1), its
+left child is i + 1. This keeps every subtree rebuildable in place.
+
+Moving objects:
+  markDirty(objectId) after the object changed, then update() refits the
+  bounds of the dirty leaves and their ancestors bottom-up (nothing else is
+  touched). Refitting keeps the topology, so the tree degrades as objects
+  move apart; a refitted subtree whose SAH cost per unit area grew by more
+  than rebuildThreshold since it was built is rebuilt from its objects.
+  The cost at the last build stands in for the cost of a fresh build. The
+  default of 1.2 gave the lowest update plus trace time per frame in
+  bvh_refit_bench; 1.5 let the tree trace up to 1.7x slower than a fresh
+  one while its SAH cost grew by only 1.3x.
+
+closestHit returns the same hit as the linear search in
+_closestIntersection (the closest by distance from the ray origin, ties go
+to the lower object id, nothing beyond 99999 units).
+anyHit tells whether there is any hit closer than maxDist (also capped at
+99999 units) and stops at the first one it finds, for occlusion.
+
+Everything is CUDA_HOSTDEV, the device scene builds its tree in the scene
+building kernel. build(objects, pool) is the host build for many objects
+(parallel_bvh.h): the same layout, built on the pool with binned SAH over
+Morton clusters and LBVH below them, faster but with a somewhat worse tree.
+*/
+class Bvh {
+private:
+  struct BuildTask {
+    int node, first, count, parent, depth;
+  };
+
+  EasyVector<BvhNode, int> nodes{MemoryTag::accelerationStructures};
+  // leaf order
+  EasyVector<int, int> objectIds{MemoryTag::accelerationStructures};
+  // object id -> leaf node
+  EasyVector<int, int> leafOf{MemoryTag::accelerationStructures};
+  EasyVector<AABB, int> objectBounds{MemoryTag::accelerationStructures};
+  EasyVector<uint8_t, int> dirtyNodes{MemoryTag::accelerationStructures};
+  EasyVector<BuildTask, int> buildStack{MemoryTag::accelerationStructures};
+  bool anyDirty = false;
+
+  CUDA_HOSTDEV int split(int first, int count);
+  CUDA_HOSTDEV void buildSubtree(int root, int first, int count, int parent,
+                                 int depth);
+  CUDA_HOSTDEV void computeCost(int node);
+  CUDA_HOSTDEV int depthOf(int node);
+
+public:
+  float rebuildThreshold = 1.2f;
+
+  CUDA_HOSTDEV void build(EasyVector<Object *> &objects);
+  void build(EasyVector<Object *> &objects, ThreadPool &pool);
+  CUDA_HOSTDEV int objectCount() const { return leafOf.size(); }
+  CUDA_HOSTDEV int nodeCount() const { return nodes.size(); }
+  CUDA_HOSTDEV float sahCost() {
+    return nodes.size() > 0 ? nodes[0].cost / nodes[0].bounds.surfaceArea()
+                            : 0.0f;
+  }
+
+  CUDA_HOSTDEV void markDirty(int objectId);
+  CUDA_HOSTDEV void markAllDirty();
+  CUDA_HOSTDEV BvhUpdateStats update(EasyVector<Object *> &objects);
+
+  CUDA_HOSTDEV bool closestHit(Ray &ray, EasyVector<Object *> &objects,
+                               float3 &intersectionPoint, float3 &normal,
+                               float3 &color, int &objectId);
+  CUDA_HOSTDEV bool anyHit(Ray &ray, EasyVector<Object *> &objects,
+                           float maxDist);
+};
+
+} // namespace raytracer_cu
+
+#endif
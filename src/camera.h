@@ -0,0 +1,100 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include "cuda_runtime.h"
+
+#include "cudastuff.h"
+#include "math.h"
+#include "raytracer_basics.h"
+
+namespace raytracer_cu {
+
+/*
+Pinhole camera: rays start at the viewport point of a pixel and point away
+from the eye. The viewport is the rectangle spanned by viewport_v1 (left to
+right) and viewport_v2 (top to bottom) starting at viewport_tl.
+
+screenPoint(x, y):  viewport point of pixel (x, y) on a display of `size`
+primaryRay(x, y):   the eye ray through that point
+project(p, pixel):  inverse of screenPoint, returns false if p is behind
+                    the eye or not in front of the viewport plane
+lookAt(eye, target, down, viewportSize, viewportDistance):
+                    square viewport centered on the line of sight,
+                    viewportDistance in front of the eye; `down` is the
+                    direction of the image rows (+y in the room scene)
+*/
+class Camera {
+public:
+  float3 viewport_tl, viewport_v1, viewport_v2;
+  float3 eye;
+
+  CUDA_HOSTDEV float3 screenPoint(float x, float y, int2 size) const {
+    return viewport_tl + (x / size.x) * viewport_v1 +
+           (y / size.y) * viewport_v2;
+  }
+
+  CUDA_HOSTDEV Ray primaryRay(float x, float y, int2 size,
+                              uint32_t bounces) const {
+    float3 screen = screenPoint(x, y, size);
+    Ray ray(screen, screen - eye, bounces);
+    ray.coneWidth = length(viewport_v1) / size.x;
+    ray.coneSpread = ray.coneWidth / length(ray.direction);
+    return ray;
+  }
+
+  CUDA_HOSTDEV bool project(float3 p, int2 size, float2 &pixel) const {
+    float3 planeNormal = cross(viewport_v1, viewport_v2);
+    float3 eyeToPoint = p - eye;
+    float denom = dot(eyeToPoint, planeNormal);
+    float t = dot(viewport_tl - eye, planeNormal);
+    // Both must be on the same side of the eye, and the point beyond the
+    // viewport plane (t/denom <= 1).
+    if (denom * t <= 0.0f || abs(denom) < abs(t)) {
+      return false;
+    }
+    float3 onPlane = eye + (t / denom) * eyeToPoint - viewport_tl;
+    pixel.x = dot(onPlane, viewport_v1) / dot(viewport_v1, viewport_v1) * size.x;
+    pixel.y = dot(onPlane, viewport_v2) / dot(viewport_v2, viewport_v2) * size.y;
+    return true;
+  }
+
+  // The starting view of the room scene: the eye on the -z axis looking
+  // through a 256x256 viewport 100 units in front of it.
+  CUDA_HOSTDEV static Camera initialView() {
+    Camera camera;
+    float eyeZ = -200.0f;
+    float viewportSize = 256.0f;
+    camera.eye = make_float3(0.0f, 0.0f, eyeZ);
+    camera.viewport_tl =
+        make_float3(-viewportSize / 2.0f, -viewportSize / 2.0f, eyeZ + 100.0f);
+    camera.viewport_v1 = make_float3(viewportSize, 0.0f, 0.0f);
+    camera.viewport_v2 = make_float3(0.0f, viewportSize, 0.0f);
+    return camera;
+  }
+
+  CUDA_HOSTDEV static Camera lookAt(float3 eye, float3 target, float3 down,
+                                    float viewportSize = 256.0f,
+                                    float viewportDistance = 100.0f) {
+    float3 forward = norm(target - eye);
+    float3 right = norm(cross(down, forward));
+    float3 rowDown = cross(forward, right);
+    Camera camera;
+    camera.eye = eye;
+    camera.viewport_v1 = viewportSize * right;
+    camera.viewport_v2 = viewportSize * rowDown;
+    camera.viewport_tl = eye + viewportDistance * forward -
+                         0.5f * camera.viewport_v1 - 0.5f * camera.viewport_v2;
+    return camera;
+  }
+
+  CUDA_HOSTDEV void transform(const mat3x3 &t) {
+    viewport_tl = mm<3>(t, viewport_tl);
+    viewport_v1 = mm<3>(t, viewport_v1);
+    viewport_v2 = mm<3>(t, viewport_v2);
+    eye = mm<3>(t, eye);
+  }
+};
+
+} // namespace raytracer_cu
+
+#endif
@@ -0,0 +1,127 @@
+#include "camera_path.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+namespace raytracer_cu {
+
+namespace {
+
+float3 lerp(float3 a, float3 b, float t) { return a + t * (b - a); }
+
+float lerp(float a, float b, float t) { return a + t * (b - a); }
+
+template <typename T>
+T catmullRom(const T &p0, const T &p1, const T &p2, const T &p3, float t) {
+  float t2 = t * t;
+  float t3 = t2 * t;
+  return 0.5f * ((2.0f * p1) + (-1.0f * p0 + p2) * t +
+                 (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - 1.0f * p3) * t2 +
+                 (-1.0f * p0 + 3.0f * p1 - 3.0f * p2 + p3) * t3);
+}
+
+} // namespace
+
+void CameraPath::add(const CameraKeyframe &keyframe) {
+  auto position = std::upper_bound(
+      keyframes.begin(), keyframes.end(), keyframe,
+      [](const CameraKeyframe &a, const CameraKeyframe &b) {
+        return a.frame < b.frame;
+      });
+  keyframes.insert(position, keyframe);
+}
+
+float CameraPath::firstFrame() const {
+  return keyframes.empty() ? 0.0f : keyframes.front().frame;
+}
+
+float CameraPath::lastFrame() const {
+  return keyframes.empty() ? 0.0f : keyframes.back().frame;
+}
+
+Camera CameraPath::at(float frame) const {
+  if (keyframes.empty()) {
+    return Camera::initialView();
+  }
+  int n = int(keyframes.size());
+  if (frame <= keyframes.front().frame || n == 1) {
+    const CameraKeyframe &k = keyframes.front();
+    return Camera::lookAt(k.eye, k.target, down, k.viewportSize);
+  }
+  if (frame >= keyframes.back().frame) {
+    const CameraKeyframe &k = keyframes.back();
+    return Camera::lookAt(k.eye, k.target, down, k.viewportSize);
+  }
+
+  // Segment [i, i + 1] contains the frame.
+  int i = 0;
+  while (keyframes[i + 1].frame < frame) {
+    i++;
+  }
+  const CameraKeyframe &k1 = keyframes[i];
+  const CameraKeyframe &k2 = keyframes[i + 1];
+  float span = k2.frame - k1.frame;
+  float t = span > 0.0f ? (frame - k1.frame) / span : 0.0f;
+
+  float3 eye, target;
+  float viewportSize;
+  if (interpolation == Interpolation::Linear) {
+    eye = lerp(k1.eye, k2.eye, t);
+    target = lerp(k1.target, k2.target, t);
+    viewportSize = lerp(k1.viewportSize, k2.viewportSize, t);
+  } else {
+    const CameraKeyframe &k0 = keyframes[std::max(i - 1, 0)];
+    const CameraKeyframe &k3 = keyframes[std::min(i + 2, n - 1)];
+    eye = catmullRom(k0.eye, k1.eye, k2.eye, k3.eye, t);
+    target = catmullRom(k0.target, k1.target, k2.target, k3.target, t);
+    viewportSize = catmullRom(k0.viewportSize, k1.viewportSize,
+                              k2.viewportSize, k3.viewportSize, t);
+  }
+  return Camera::lookAt(eye, target, down, viewportSize);
+}
+
+bool CameraPath::load(const std::string &path) {
+  keyframes.clear();
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields(line);
+    CameraKeyframe k;
+    if (!(fields >> k.frame)) {
+      continue; // blank or comment line
+    }
+    if (!(fields >> k.eye.x >> k.eye.y >> k.eye.z >> k.target.x >>
+          k.target.y >> k.target.z)) {
+      keyframes.clear();
+      return false;
+    }
+    fields >> k.viewportSize;
+    add(k);
+  }
+  return !keyframes.empty();
+}
+
+CameraPath CameraPath::turntable(float3 center, float radius, float height,
+                                 int nFrames) {
+  CameraPath path;
+  const int nKeys = 24;
+  // One extra key on both sides keeps the tangents of the closed circle.
+  for (int key = -1; key <= nKeys + 1; key++) {
+    float angle = 2.0f * float(M_PI) * key / nKeys;
+    CameraKeyframe k;
+    k.frame = float(nFrames) * key / nKeys;
+    k.eye = center + make_float3(radius * std::sin(angle), height,
+                                 -radius * std::cos(angle));
+    k.target = center;
+    path.add(k);
+  }
+  return path;
+}
+
+} // namespace raytracer_cu
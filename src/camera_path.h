@@ -0,0 +1,58 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <string>
+#include <vector>
+
+#include "cuda_runtime.h"
+
+#include "camera.h"
+
+namespace raytracer_cu {
+
+struct CameraKeyframe {
+  float frame;
+  float3 eye;
+  float3 target;
+  float viewportSize = 256.0f;
+};
+
+/*
+Camera animation: keyframes at (fractional) frame numbers, interpolated
+per frame. Eye, target and viewport size are interpolated separately and
+the camera is rebuilt with Camera::lookAt, so the view never shears.
+
+Linear: piecewise linear between neighbouring keyframes.
+CatmullRom: the curve passes through every keyframe with a continuous
+  tangent (the end keyframes are repeated at the ends of the path).
+Before the first / after the last keyframe the camera holds still.
+
+Path files are text, one keyframe per line, '#' starts a comment:
+  frame  eye.x eye.y eye.z  target.x target.y target.z  [viewportSize]
+*/
+class CameraPath {
+public:
+  enum class Interpolation { Linear, CatmullRom };
+
+  std::vector<CameraKeyframe> keyframes; // sorted by frame
+  Interpolation interpolation = Interpolation::CatmullRom;
+  float3 down = make_float3(0.0f, 1.0f, 0.0f);
+
+  void add(const CameraKeyframe &keyframe);
+  Camera at(float frame) const;
+  float firstFrame() const;
+  float lastFrame() const;
+
+  // Returns false (and leaves the path empty) on a malformed file.
+  bool load(const std::string &path);
+
+  // Full circle around `center` over nFrames frames, keyframed every 15
+  // degrees. The eye is `radius` away in the xz plane and offset by
+  // `height` along y (negative is up in the room scene).
+  static CameraPath turntable(float3 center, float radius, float height,
+                              int nFrames);
+};
+
+} // namespace raytracer_cu
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef CHECKER_TEXTURES_H
+#define CHECKER_TEXTURES_H
+
+#include "basic_types.h"
+#include "raytracer_basics.h"
+
+namespace raytracer_cu {
+
+// Gray 16x16 checkerboards in place of the image textures the SDL app loads,
+// for the host tools that build the room scene without SDL_image.
+inline ColorBuffer<float3> *checkerTexture() {
+  auto texture = new ColorBuffer<float3>(16, 16);
+  for (int i = 0; i < 16 * 16; i++) {
+    float c = ((i / 16 + i % 16) % 2) ? 0.8f : 0.3f;
+    texture->c[i] = make_float3(c, c, c);
+  }
+  return texture;
+}
+
+inline void addCheckerTextures(Scene *scene, int n) {
+  for (int t = 0; t < n; t++) {
+    scene->textures.push_back(checkerTexture());
+  }
+}
+
+} // namespace raytracer_cu
+
+#endif
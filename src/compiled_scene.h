@@ -0,0 +1,164 @@
+#ifndef COMPILED_SCENE_H
+#define COMPILED_SCENE_H
+
+#include <cstdint>
+
+#include "cuda_runtime.h"
+
+#include "basic_types.h"
+#include "camera.h"
+#include "host_renderer.h"
+#include "math.h"
+#include "random.h"
+#include "raytracer_basics.h"
+#include "thread_pool.h"
+
+namespace raytracer_cu {
+
+/*
+A scene compiled to C++ by tools/scene_compiler: the primitives are
+constexpr arrays, every material is a shading function with its weights,
+colors and refractive index as literals and without the branches of the
+zero weights, and the object and light loops are unrolled. The generated
+file defines the functions declared in namespace compiled below; link it
+into the target that renders the scene (see compiled_render).
+
+The pixels match the ones of HostRenderer on the scene it was compiled
+from (same rays, random streams and arithmetic), except that the scene can
+not be transformed, only the camera moves, and there are no cost counters,
+pixel cones or virtual textures.
+*/
+namespace compiled {
+
+struct CompiledTriangle {
+  float v0[3];
+  float e1[3], e2[3]; // vertex1 - vertex0, vertex2 - vertex0
+  float normal[3];
+  float uv[6];
+};
+
+struct CompiledSphere {
+  float center[3];
+  float r;
+};
+
+struct CompiledSceneInfo {
+  const char *name;
+  int nTriangles, nSpheres, nLights, nMaterials;
+  int nTextures; // slots of bindTextures
+  int maxBounces;
+  float minThroughput;
+};
+
+// Defined by the generated code.
+extern const CompiledSceneInfo sceneInfo;
+// The textures of Scene::textures the scene was compiled with, looked up
+// at run time; unbound textured materials show their color.
+void bindTextures(ColorBuffer<float3> *const *textures, int n);
+// Scene::trace; hit.object stays null, hit.objectId is set.
+bool trace(Ray &ray, float3 &color, Intersection &hit);
+
+inline float3 f3(const float v[3]) { return make_float3(v[0], v[1], v[2]); }
+
+// RayIntersectsTriangle of triangle.cc with the edges precomputed.
+inline bool hitTriangle(const Ray &ray, const CompiledTriangle &tri,
+                        float3 &point) {
+  const float EPSILON = 0.0000001;
+  float3 edge1 = f3(tri.e1), edge2 = f3(tri.e2);
+  float3 h = cross(ray.direction, edge2);
+  float a = dot(edge1, h);
+  if (a > -EPSILON && a < EPSILON)
+    return false;
+  float f = 1.0 / a;
+  float3 s = ray.origin - f3(tri.v0);
+  float u = f * dot(s, h);
+  if (u < 0.0 || u > 1.0)
+    return false;
+  float3 q = cross(s, edge1);
+  float v = f * dot(ray.direction, q);
+  if (v < 0.0 || u + v > 1.0)
+    return false;
+  float t = f * dot(edge2, q);
+  if (t > EPSILON) {
+    point = ray.origin + ray.direction * t;
+    return true;
+  }
+  return false;
+}
+
+// Sphere::intersect.
+inline bool hitSphere(const Ray &ray, const CompiledSphere &sphere,
+                      float3 &point, float3 &normal) {
+  float3 center = f3(sphere.center);
+  float3 uhat = norm(ray.direction);
+  float nabla1 = dot(uhat, ray.origin - center);
+  float nabla2a = length(ray.origin - center);
+  float nabla = nabla1 * nabla1 - (nabla2a * nabla2a - sphere.r * sphere.r);
+  if (nabla < 0) {
+    return false;
+  }
+  float d1 = -nabla1 - sqrt(nabla);
+  float d2 = -nabla1 + sqrt(nabla);
+  if (d1 < 0.0f && d2 < 0.0f) {
+    return false;
+  }
+  point = d1 < 0.0f ? ray.origin + d2 * uhat : ray.origin + d1 * uhat;
+  normal = point - center;
+  normal = div(normal, length(normal));
+  return true;
+}
+
+// GenericTriangleShader::albedo for a texture.
+inline float3 sampleTexture(ColorBuffer<float3> *texture,
+                            const CompiledTriangle &tri, float3 point) {
+  float3 v0 = f3(tri.e1), v1 = f3(tri.e2), v2 = point - f3(tri.v0);
+  float d00 = dot(v0, v0);
+  float d01 = dot(v0, v1);
+  float d11 = dot(v1, v1);
+  float d20 = dot(v2, v0);
+  float d21 = dot(v2, v1);
+  float denom = d00 * d11 - d01 * d01;
+  float b1 = (d11 * d20 - d01 * d21) / denom;
+  float b2 = (d00 * d21 - d01 * d20) / denom;
+  float b0 = 1.0f - b1 - b2;
+  float2 sampleCoord = make_float2(tri.uv[0], tri.uv[1]) * b0 +
+                       make_float2(tri.uv[2], tri.uv[3]) * b1 +
+                       make_float2(tri.uv[4], tri.uv[5]) * b2;
+  return texture->getPixel(int(sampleCoord.x * texture->w) % texture->w,
+                           int(sampleCoord.y * texture->h) % texture->h);
+}
+
+} // namespace compiled
+
+// HostRenderer::render for the compiled scene.
+class CompiledRenderer {
+private:
+  ThreadPool &pool;
+
+public:
+  int maxBounces = -1; // -1: the budget the scene was compiled with
+  int rowsPerTask = 4;
+
+  explicit CompiledRenderer(ThreadPool &pool) : pool(pool) {}
+  void render(const Camera &camera, int2 size, uint32_t frameIndex,
+              uint8_t *colorBuffer) {
+    int bounces =
+        maxBounces >= 0 ? maxBounces : compiled::sceneInfo.maxBounces;
+    pool.parallelFor(0, size.y, rowsPerTask, [&](int rowBegin, int rowEnd) {
+      for (int y = rowBegin; y < rowEnd; y++) {
+        for (int x = 0; x < size.x; x++) {
+          Ray eyeRay = camera.primaryRay(x, y, size, bounces);
+          eyeRay.seed = pixelSeed(x, y, frameIndex);
+          float3 color = make_float3(0.0f, 0.0f, 0.0f);
+          Intersection hit;
+          compiled::trace(eyeRay, color, hit);
+          storePixel(colorBuffer, y * size.x + x, color);
+        }
+      }
+    });
+  }
+};
+
+} // namespace raytracer_cu
+
+#endif
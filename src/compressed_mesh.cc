@@ -0,0 +1,663 @@
+#include "compressed_mesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "parallel_bvh.h"
+#include "thread_pool.h"
+
+namespace raytracer_cu {
+
+namespace {
+
+const int nBins = 16;
+const int maxSahDepth = 48; // then halving, as in bvh.cc
+const int traversalStackSize = 96;
+const float boundsPadding = 1e-3f;
+const float maxDistance = 99999.0f; // as in _closestIntersection
+const float EPSILON = 0.0000001;
+const int blockGrain = 1024; // blocks per parallelFor chunk when packing
+
+float axisOf(float3 v, int axis) {
+  return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+uint16_t quantize16(float value, float origin, float step) {
+  if (step <= 0.0f) {
+    return 0;
+  }
+  float q = std::round((value - origin) / step);
+  return uint16_t(q < 0.0f ? 0.0f : (q > 65535.0f ? 65535.0f : q));
+}
+
+float3 decode16(const uint16_t q[3], float3 origin, float3 step) {
+  return make_float3(origin.x + float(q[0]) * step.x,
+                     origin.y + float(q[1]) * step.y,
+                     origin.z + float(q[2]) * step.z);
+}
+
+// Octahedral normal encoding, see Cigolle et al., "A Survey of Efficient
+// Representations for Independent Unit Vectors", 2014.
+void encodeNormal(float3 n, uint16_t out[2]) {
+  float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+  float x = l1 > 0.0f ? n.x / l1 : 0.0f, y = l1 > 0.0f ? n.y / l1 : 0.0f;
+  if (n.z < 0.0f) {
+    float ox = x;
+    x = (1.0f - std::abs(y)) * (ox >= 0.0f ? 1.0f : -1.0f);
+    y = (1.0f - std::abs(ox)) * (y >= 0.0f ? 1.0f : -1.0f);
+  }
+  out[0] = uint16_t(std::round((x * 0.5f + 0.5f) * 65535.0f));
+  out[1] = uint16_t(std::round((y * 0.5f + 0.5f) * 65535.0f));
+}
+
+float3 decodeOctahedral(const uint16_t in[2]) {
+  float x = float(in[0]) / 65535.0f * 2.0f - 1.0f;
+  float y = float(in[1]) / 65535.0f * 2.0f - 1.0f;
+  float z = 1.0f - std::abs(x) - std::abs(y);
+  if (z < 0.0f) {
+    float ox = x;
+    x = (1.0f - std::abs(y)) * (ox >= 0.0f ? 1.0f : -1.0f);
+    y = (1.0f - std::abs(ox)) * (y >= 0.0f ? 1.0f : -1.0f);
+  }
+  return norm(make_float3(x, y, z));
+}
+
+// A child box in the 255 steps of its parent box, rounded outwards. lo
+// counts from parent.lo and hi from parent.hi, so 0 and 255 give the
+// parent sides exactly.
+float decodeLo(float parentLo, float step, uint8_t q) {
+  return parentLo + float(q) * step;
+}
+
+float decodeHi(float parentHi, float step, uint8_t q) {
+  return parentHi - float(255 - q) * step;
+}
+
+void quantizeChild(const AABB &parent, const AABB &child, uint8_t lo[3],
+                   uint8_t hi[3]) {
+  for (int axis = 0; axis < 3; axis++) {
+    float pLo = axisOf(parent.lo, axis), pHi = axisOf(parent.hi, axis);
+    float cLo = axisOf(child.lo, axis), cHi = axisOf(child.hi, axis);
+    float step = (pHi - pLo) / 255.0f;
+    if (step <= 0.0f) {
+      lo[axis] = 0;
+      hi[axis] = 255;
+      continue;
+    }
+    int qLo = int(std::floor((cLo - pLo) / step));
+    qLo = std::max(0, std::min(255, qLo));
+    while (qLo > 0 && decodeLo(pLo, step, uint8_t(qLo)) > cLo) {
+      qLo--;
+    }
+    int qHi = 255 - int(std::floor((pHi - cHi) / step));
+    qHi = std::max(qLo, std::min(255, qHi));
+    while (qHi < 255 && decodeHi(pHi, step, uint8_t(qHi)) < cHi) {
+      qHi++;
+    }
+    lo[axis] = uint8_t(qLo);
+    hi[axis] = uint8_t(qHi);
+  }
+}
+
+AABB decodeChild(const AABB &parent, const uint8_t lo[3], const uint8_t hi[3]) {
+  float3 step = (parent.hi - parent.lo) * (1.0f / 255.0f);
+  AABB box;
+  box.lo = make_float3(decodeLo(parent.lo.x, step.x, lo[0]),
+                       decodeLo(parent.lo.y, step.y, lo[1]),
+                       decodeLo(parent.lo.z, step.z, lo[2]));
+  box.hi = make_float3(decodeHi(parent.hi.x, step.x, hi[0]),
+                       decodeHi(parent.hi.y, step.y, hi[1]),
+                       decodeHi(parent.hi.z, step.z, hi[2]));
+  return box;
+}
+
+// Möller–Trumbore as in triangle.cc, returns the ray parameter.
+bool hitTriangle(float3 origin, float3 direction, const float3 v[3],
+                 float &t) {
+  float3 edge1 = v[1] - v[0], edge2 = v[2] - v[0];
+  float3 h = cross(direction, edge2);
+  float a = dot(edge1, h);
+  if (a > -EPSILON && a < EPSILON)
+    return false;
+  float f = 1.0f / a;
+  float3 s = origin - v[0];
+  float u = f * dot(s, h);
+  if (u < 0.0f || u > 1.0f)
+    return false;
+  float3 q = cross(s, edge1);
+  float v_ = f * dot(direction, q);
+  if (v_ < 0.0f || u + v_ > 1.0f)
+    return false;
+  t = f * dot(edge2, q);
+  return t > EPSILON;
+}
+
+// The last hit of a mesh on this thread, so that excite usually finds the
+// triangle without traversing again.
+struct LastHit {
+  const CompressedMesh *mesh = nullptr;
+  float3 origin, direction;
+  int triangle = -1;
+};
+thread_local LastHit lastHit;
+
+bool sameRay(const LastHit &hit, const Ray &ray) {
+  return hit.origin.x == ray.origin.x && hit.origin.y == ray.origin.y &&
+         hit.origin.z == ray.origin.z && hit.direction.x == ray.direction.x &&
+         hit.direction.y == ray.direction.y &&
+         hit.direction.z == ray.direction.z;
+}
+
+// Build-time tree over the input triangles.
+struct BuildNode {
+  AABB bounds; // of the decoded triangles, padded
+  int left = -1, right = -1;
+  int first = 0, count = 0;
+};
+
+class Builder {
+public:
+  const std::vector<MeshTriangle> &input;
+  std::vector<AABB> triangleBounds;
+  std::vector<int> order;
+  std::vector<BuildNode> tree;
+  int leafSize;
+
+  Builder(const std::vector<MeshTriangle> &input, int leafSize,
+          ThreadPool *pool)
+      : input(input), leafSize(leafSize) {
+    int n = int(input.size());
+    triangleBounds.resize(n);
+    order.resize(n);
+    auto initialize = [&](int begin, int end) {
+      for (int i = begin; i < end; i++) {
+        for (int k = 0; k < 3; k++) {
+          triangleBounds[i].grow(input[i].v[k]);
+        }
+        order[i] = i;
+      }
+    };
+    if (pool) {
+      pool->parallelFor(0, n, blockGrain * CompressedMesh::maxBlockSize,
+                        initialize);
+    } else {
+      initialize(0, n);
+    }
+  }
+
+  // Partitions order[first, first + count), returns the left size.
+  int split(int first, int count, int depth) {
+    if (depth >= maxSahDepth) {
+      return count / 2;
+    }
+    AABB centroidBounds;
+    for (int i = first; i < first + count; i++) {
+      centroidBounds.grow(triangleBounds[order[i]].center());
+    }
+    int bestAxis = -1, bestBin = 0;
+    float bestCost = 1e30f;
+    for (int axis = 0; axis < 3; axis++) {
+      float lo = axisOf(centroidBounds.lo, axis);
+      float extent = axisOf(centroidBounds.hi, axis) - lo;
+      if (extent <= 0.0f) {
+        continue;
+      }
+      AABB binBounds[nBins];
+      int binCount[nBins] = {0};
+      for (int i = first; i < first + count; i++) {
+        const AABB &box = triangleBounds[order[i]];
+        int bin = std::min(nBins - 1,
+                           int(nBins * (axisOf(box.center(), axis) - lo) /
+                               extent));
+        binCount[bin]++;
+        binBounds[bin].grow(box);
+      }
+      float rightArea[nBins];
+      int rightCount[nBins];
+      AABB right;
+      int nRight = 0;
+      for (int bin = nBins - 1; bin > 0; bin--) {
+        right.grow(binBounds[bin]);
+        nRight += binCount[bin];
+        rightArea[bin] = right.surfaceArea();
+        rightCount[bin] = nRight;
+      }
+      AABB left;
+      int nLeft = 0;
+      for (int bin = 1; bin < nBins; bin++) {
+        left.grow(binBounds[bin - 1]);
+        nLeft += binCount[bin - 1];
+        if (nLeft == 0 || rightCount[bin] == 0) {
+          continue;
+        }
+        float cost =
+            left.surfaceArea() * nLeft + rightArea[bin] * rightCount[bin];
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestBin = bin;
+        }
+      }
+    }
+    if (bestAxis < 0) {
+      return count / 2;
+    }
+    float lo = axisOf(centroidBounds.lo, bestAxis);
+    float extent = axisOf(centroidBounds.hi, bestAxis) - lo;
+    auto middle = std::partition(
+        order.begin() + first, order.begin() + first + count, [&](int id) {
+          return int(nBins *
+                     (axisOf(triangleBounds[id].center(), bestAxis) - lo) /
+                     extent) < bestBin;
+        });
+    return int(middle - order.begin()) - first;
+  }
+
+  // On the pool (parallel_bvh.h), depth first.
+  void build(ThreadPool &pool) {
+    ParallelBvhBuilder parallel;
+    parallel.leafSize = leafSize;
+    parallel.build(triangleBounds.data(), int(triangleBounds.size()), pool);
+    order.swap(parallel.order);
+    tree.resize(parallel.nodes.size());
+    for (size_t i = 0; i < tree.size(); i++) {
+      const ParallelBvhNode &in = parallel.nodes[i];
+      tree[i].left = in.left;
+      tree[i].right = in.right;
+      tree[i].first = in.first;
+      tree[i].count = in.count;
+    }
+  }
+
+  // Depth first, children after their parent.
+  void build() {
+    struct Task {
+      int node, first, count, depth;
+    };
+    tree.clear();
+    tree.emplace_back();
+    std::vector<Task> stack = {{0, 0, int(input.size()), 0}};
+    while (!stack.empty()) {
+      Task task = stack.back();
+      stack.pop_back();
+      tree[task.node].first = task.first;
+      tree[task.node].count = task.count;
+      if (task.count <= leafSize) {
+        continue;
+      }
+      int leftCount = split(task.first, task.count, task.depth);
+      int left = int(tree.size()), right = left + 1;
+      tree.emplace_back();
+      tree.emplace_back();
+      tree[task.node].left = left;
+      tree[task.node].right = right;
+      stack.push_back({right, task.first + leftCount, task.count - leftCount,
+                       task.depth + 1});
+      stack.push_back({left, task.first, leftCount, task.depth + 1});
+    }
+  }
+};
+
+} // namespace
+
+// Out of class so that they can be bound to references (std::min).
+const int CompressedMesh::maxBlockSize;
+const uint32_t CompressedMesh::leafFlag;
+
+void CompressedMesh::build(const std::vector<MeshTriangle> &input,
+                           ThreadPool *pool) {
+  triangles.clear();
+  blocks.clear();
+  nodes.clear();
+  rootBounds = AABB();
+  rootIsLeaf = false;
+  positionError = 0.0f;
+  if (input.empty()) {
+    return;
+  }
+
+  Builder builder(input, std::max(1, std::min(leafSize, maxBlockSize)),
+                  pool);
+  if (pool) {
+    builder.build(*pool);
+  } else {
+    builder.build();
+  }
+  std::vector<BuildNode> &tree = builder.tree;
+
+  float2 uvLo = input[0].uv[0], uvHi = input[0].uv[0];
+  for (const MeshTriangle &t : input) {
+    for (int k = 0; k < 3; k++) {
+      uvLo = make_float2(std::min(uvLo.x, t.uv[k].x), std::min(uvLo.y, t.uv[k].y));
+      uvHi = make_float2(std::max(uvHi.x, t.uv[k].x), std::max(uvHi.y, t.uv[k].y));
+    }
+  }
+  uvOrigin = uvLo;
+  uvStep = make_float2((uvHi.x - uvLo.x) / 65535.0f,
+                       (uvHi.y - uvLo.y) / 65535.0f);
+
+  // Leaves become blocks, their boxes the decoded ones. The triangles are
+  // stored in the order of the builder, every leaf a range of it.
+  triangles.resize(input.size());
+  std::vector<int> blockOf(tree.size(), -1);
+  std::vector<int> leaves;
+  for (size_t n = 0; n < tree.size(); n++) {
+    if (tree[n].left < 0) {
+      blockOf[n] = int(leaves.size());
+      leaves.push_back(int(n));
+    }
+  }
+  blocks.resize(leaves.size());
+  int nLeaves = int(leaves.size());
+  std::vector<float> chunkErrors((nLeaves + blockGrain - 1) / blockGrain, 0.0f);
+  auto pack = [&](int begin, int end) {
+    float error = 0.0f;
+    for (int b = begin; b < end; b++) {
+      BuildNode &node = tree[leaves[b]];
+      AABB exact;
+      for (int i = node.first; i < node.first + node.count; i++) {
+        exact.grow(builder.triangleBounds[builder.order[i]]);
+      }
+      MeshBlock &block = blocks[b];
+      block.origin = exact.lo;
+      block.step = (exact.hi - exact.lo) * (1.0f / 65535.0f);
+      block.first = uint32_t(node.first);
+      block.count = uint32_t(node.count);
+      node.bounds = AABB();
+      for (int i = node.first; i < node.first + node.count; i++) {
+        const MeshTriangle &in = input[builder.order[i]];
+        PackedTriangle &packed = triangles[i];
+        float3 decoded[3];
+        for (int k = 0; k < 3; k++) {
+          packed.v[k][0] = quantize16(in.v[k].x, block.origin.x, block.step.x);
+          packed.v[k][1] = quantize16(in.v[k].y, block.origin.y, block.step.y);
+          packed.v[k][2] = quantize16(in.v[k].z, block.origin.z, block.step.z);
+          decoded[k] = decode16(packed.v[k], block.origin, block.step);
+          node.bounds.grow(decoded[k]);
+          error = std::max(error, length(decoded[k] - in.v[k]));
+          packed.uv[k][0] = quantize16(in.uv[k].x, uvOrigin.x, uvStep.x);
+          packed.uv[k][1] = quantize16(in.uv[k].y, uvOrigin.y, uvStep.y);
+        }
+        float3 n = in.normal;
+        if (dot(n, n) == 0.0f) {
+          // Triangle::normal
+          n = norm(cross(decoded[0] - decoded[2], decoded[1] - decoded[0]));
+        }
+        encodeNormal(n, packed.normal);
+      }
+      node.bounds.pad(boundsPadding);
+    }
+    float &chunkError = chunkErrors[begin / blockGrain];
+    chunkError = std::max(chunkError, error);
+  };
+  if (pool) {
+    pool->parallelFor(0, nLeaves, blockGrain, pack);
+  } else {
+    for (int begin = 0; begin < nLeaves; begin += blockGrain) {
+      pack(begin, std::min(nLeaves, begin + blockGrain));
+    }
+  }
+  for (float error : chunkErrors) {
+    positionError = std::max(positionError, error);
+  }
+
+  // Inner boxes bottom-up (children come after their parent).
+  for (int n = int(tree.size()) - 1; n >= 0; n--) {
+    if (tree[n].left >= 0) {
+      tree[n].bounds = merge(tree[tree[n].left].bounds,
+                             tree[tree[n].right].bounds);
+    }
+  }
+
+  rootBounds = tree[0].bounds;
+  if (tree[0].left < 0) {
+    rootIsLeaf = true;
+    return;
+  }
+  // Top-down: every child quantized in the decoded box of its parent.
+  std::vector<int> nodeOf(tree.size(), -1);
+  struct Task {
+    int treeNode;
+    AABB decoded;
+  };
+  std::vector<Task> stack = {{0, rootBounds}};
+  nodeOf[0] = 0;
+  nodes.emplace_back();
+  while (!stack.empty()) {
+    Task task = stack.back();
+    stack.pop_back();
+    const BuildNode &node = tree[task.treeNode];
+    int index = nodeOf[task.treeNode];
+    int children[2] = {node.left, node.right};
+    for (int c = 0; c < 2; c++) {
+      QuantizedNode &q = nodes[index];
+      quantizeChild(task.decoded, tree[children[c]].bounds, q.lo[c], q.hi[c]);
+      AABB decoded = decodeChild(task.decoded, q.lo[c], q.hi[c]);
+      if (tree[children[c]].left < 0) {
+        q.child[c] = uint32_t(blockOf[children[c]]) | leafFlag;
+      } else {
+        nodeOf[children[c]] = int(nodes.size());
+        q.child[c] = uint32_t(nodes.size());
+        nodes.emplace_back(); // q is not used after this
+        stack.push_back({children[c], decoded});
+      }
+    }
+  }
+}
+
+size_t CompressedMesh::memoryBytes() const {
+  return sizeof(*this) + triangles.capacity() * sizeof(PackedTriangle) +
+         blocks.capacity() * sizeof(MeshBlock) +
+         nodes.capacity() * sizeof(QuantizedNode);
+}
+
+void CompressedMesh::decode(int triangle, float3 v[3]) const {
+  const PackedTriangle &packed = triangles[triangle];
+  // Blocks are in triangle order.
+  size_t lo = 0, hi = blocks.size();
+  while (hi - lo > 1) {
+    size_t mid = (lo + hi) / 2;
+    (blocks[mid].first <= uint32_t(triangle) ? lo : hi) = mid;
+  }
+  const MeshBlock *block = &blocks[lo];
+  for (int k = 0; k < 3; k++) {
+    v[k] = decode16(packed.v[k], block->origin, block->step);
+  }
+}
+
+void CompressedMesh::decodeUv(int triangle, float2 uv[3]) const {
+  const PackedTriangle &packed = triangles[triangle];
+  for (int k = 0; k < 3; k++) {
+    uv[k] = make_float2(uvOrigin.x + float(packed.uv[k][0]) * uvStep.x,
+                        uvOrigin.y + float(packed.uv[k][1]) * uvStep.y);
+  }
+}
+
+float3 CompressedMesh::decodeNormal(int triangle) const {
+  // Normals go with the inverse transpose.
+  return norm(mm<3>(decodeOctahedral(triangles[triangle].normal), toLocal));
+}
+
+bool CompressedMesh::closestTriangle(float3 origin, float3 direction,
+                                     float tMax, float &t, int &triangle,
+                                     RayCost *cost) const {
+  if (blocks.empty()) {
+    return false;
+  }
+  float3 invDir = make_float3(1.0f / direction.x, 1.0f / direction.y,
+                              1.0f / direction.z);
+  struct Entry {
+    uint32_t ref;
+    float tNear;
+    AABB box;
+  };
+  Entry stack[traversalStackSize];
+  int stackSize = 0;
+  float tNear;
+  if (!rootBounds.intersect(origin, invDir, tMax, tNear)) {
+    return false;
+  }
+  stack[stackSize++] = {rootIsLeaf ? leafFlag : 0u, tNear, rootBounds};
+
+  float best = tMax;
+  int bestTriangle = -1;
+  while (stackSize > 0) {
+    Entry entry = stack[--stackSize];
+    if (entry.tNear > best) {
+      continue;
+    }
+    if (cost) {
+      cost->nodeVisits++;
+    }
+    if (entry.ref & leafFlag) {
+      const MeshBlock &block = blocks[entry.ref & ~leafFlag];
+      if (cost) {
+        cost->intersectionTests += block.count;
+      }
+      for (uint32_t i = block.first; i < block.first + block.count; i++) {
+        float3 v[3];
+        for (int k = 0; k < 3; k++) {
+          v[k] = decode16(triangles[i].v[k], block.origin, block.step);
+        }
+        float tHit;
+        if (hitTriangle(origin, direction, v, tHit) && tHit < best) {
+          best = tHit;
+          bestTriangle = int(i);
+        }
+      }
+      continue;
+    }
+    const QuantizedNode &node = nodes[entry.ref];
+    Entry children[2];
+    bool hit[2];
+    for (int c = 0; c < 2; c++) {
+      children[c].box = decodeChild(entry.box, node.lo[c], node.hi[c]);
+      children[c].ref = node.child[c];
+      hit[c] = children[c].box.intersect(origin, invDir, best,
+                                         children[c].tNear);
+    }
+    // Nearer child on top.
+    if (hit[0] && hit[1]) {
+      bool firstNearer = children[0].tNear <= children[1].tNear;
+      stack[stackSize++] = children[firstNearer ? 1 : 0];
+      stack[stackSize++] = children[firstNearer ? 0 : 1];
+    } else if (hit[0] || hit[1]) {
+      stack[stackSize++] = children[hit[0] ? 0 : 1];
+    }
+  }
+  if (bestTriangle < 0) {
+    return false;
+  }
+  t = best;
+  triangle = bestTriangle;
+  return true;
+}
+
+bool CompressedMesh::findHit(Ray &ray, Intersection &intersection,
+                             float3 v[3], float2 uv[3]) const {
+  int triangle = -1;
+  if (lastHit.mesh == this && sameRay(lastHit, ray)) {
+    triangle = lastHit.triangle;
+  } else {
+    float3 origin = mm<3>(toLocal, ray.origin);
+    float3 direction = mm<3>(toLocal, ray.direction);
+    float tHit = length(intersection.surfacePoint - ray.origin) /
+                 length(ray.direction);
+    float t;
+    if (!closestTriangle(origin, direction, tHit * 1.0001f + 1e-4f, t,
+                         triangle)) {
+      return false;
+    }
+  }
+  decode(triangle, v);
+  for (int k = 0; k < 3; k++) {
+    v[k] = mm<3>(toWorld, v[k]);
+  }
+  decodeUv(triangle, uv);
+  return true;
+}
+
+bool CompressedMesh::intersect(Ray &ray, float3 &outIntersectionPoint,
+                               float3 &outNormal, float3 &outColor) {
+#ifndef __CUDA_ARCH__
+  float3 origin = mm<3>(toLocal, ray.origin);
+  float3 direction = mm<3>(toLocal, ray.direction);
+  float t;
+  int triangle;
+  if (!closestTriangle(origin, direction,
+                       maxDistance / length(ray.direction), t, triangle,
+                       ray.cost)) {
+    return false;
+  }
+  lastHit.mesh = this;
+  lastHit.origin = ray.origin;
+  lastHit.direction = ray.direction;
+  lastHit.triangle = triangle;
+  outIntersectionPoint = ray.origin + ray.direction * t;
+  outNormal = decodeNormal(triangle);
+  outColor = color;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void CompressedMesh::transform(mat3x3 &transformMatrix) {
+  toWorld = mm(transformMatrix, toWorld);
+  toLocal = inverse(toWorld);
+}
+
+AABB CompressedMesh::bounds() {
+  AABB box;
+  for (int corner = 0; corner < 8; corner++) {
+    float3 p = make_float3(corner & 1 ? rootBounds.hi.x : rootBounds.lo.x,
+                           corner & 2 ? rootBounds.hi.y : rootBounds.lo.y,
+                           corner & 4 ? rootBounds.hi.z : rootBounds.lo.z);
+    box.grow(mm<3>(toWorld, p));
+  }
+  return box;
+}
+
+float3 CompressedMesh::excite(Scene *scene, Ray &incidentRay,
+                              Intersection &intersection) {
+#ifndef __CUDA_ARCH__
+  float3 v[3];
+  float2 uv[3];
+  if (shader && findHit(incidentRay, intersection, v, uv)) {
+    return shader->shade(scene, incidentRay, intersection, v[0], v[1], v[2],
+                         uv[0], uv[1], uv[2]);
+  }
+#endif
+  return color;
+}
+
+SurfaceResponse CompressedMesh::respond(Ray &incidentRay,
+                                        Intersection &intersection) {
+  SurfaceResponse response;
+  response.shaded = shader != nullptr;
+  response.diffuseColor = color;
+  response.reflect = false;
+  response.refract = false;
+  response.refractiveIndex = 1.0f;
+  if (!shader) {
+    return response;
+  }
+  // Mirrors Triangle::respond
+#ifndef __CUDA_ARCH__
+  float3 v[3];
+  float2 uv[3];
+  response.diffuseColor = shader->color;
+  if (findHit(incidentRay, intersection, v, uv)) {
+    response.diffuseColor = shader->albedo(intersection, v[0], v[1], v[2],
+                                           uv[0], uv[1], uv[2]);
+  }
+#endif
+  if (incidentRay.bounces > 0) {
+    response.reflect = shader->reflectedWeight > shader->weightThreshold;
+    response.refract = shader->refractedWeight > shader->weightThreshold;
+  }
+  response.refractiveIndex = shader->refractiveIndex;
+  return response;
+}
+
+} // namespace raytracer_cu
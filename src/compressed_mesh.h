@@ -0,0 +1,130 @@
+#ifndef COMPRESSED_MESH_H
+#define COMPRESSED_MESH_H
+
+#include <cstdint>
+#include <vector>
+
+#include "cuda_runtime.h"
+
+#include "aabb.h"
+#include "basic_types.h"
+#include "math.h"
+#include "raytracer_basics.h"
+#include "triangle.h"
+
+namespace raytracer_cu {
+
+class ThreadPool;
+
+// A triangle as given to CompressedMesh::build.
+struct MeshTriangle {
+  float3 v[3];
+  float3 normal; // zero: the geometric normal
+  float2 uv[3];
+};
+
+// One triangle in a block, 34 bytes instead of the 100+ of a Triangle.
+struct PackedTriangle {
+  uint16_t v[3][3];  // position in the grid of the block bounds
+  uint16_t normal[2]; // octahedral
+  uint16_t uv[3][2];  // in the grid of the mesh uv bounds
+};
+
+// Up to CompressedMesh::maxBlockSize triangles of one leaf.
+struct MeshBlock {
+  float3 origin; // block bounds lo
+  float3 step;   // extent / 65535
+  uint32_t first, count;
+};
+
+// Two children boxes in 1/255 steps of the box of the node itself.
+struct QuantizedNode {
+  uint8_t lo[2][3], hi[2][3];
+  uint32_t child[2]; // node index, or block index | leafFlag
+};
+
+/*
+Many triangles as one Object, stored compressed for scenes where memory
+bandwidth, not arithmetic, limits the traversal:
+
+  - the triangles are grouped into blocks of up to leafSize, the leaves
+    of a BVH built over them with binned SAH, and stored in leaf order; the
+    positions are 16 bit coordinates in the grid of the block bounds
+  - normals are octahedral encoded into 2 x 16 bits, uvs are 16 bit in the
+    grid of the uv bounds of the mesh
+  - the BVH nodes hold the bounds of their two children as 8 bit offsets in
+    the box of the node, rounded outwards; only the root box is float. The
+    boxes are built from the decoded positions, so they contain the
+    triangles actually intersected.
+
+Positions move by at most half a grid step (block extent / 131070), i.e.
+the compressed mesh is a slightly different mesh than the input, not a
+lossy view of it.
+
+Scene::transform works (the mesh keeps the matrix and transforms the rays).
+Intersection does not carry the triangle that was hit: intersect leaves it
+for excite / respond in a per-thread slot keyed by the ray, otherwise they
+traverse again, cut at the hit distance. Host only, like the
+virtual textures: the data is in host vectors.
+*/
+class CompressedMesh : public Object {
+private:
+  std::vector<PackedTriangle> triangles;
+  std::vector<MeshBlock> blocks;
+  std::vector<QuantizedNode> nodes;
+  AABB rootBounds; // in mesh space
+  bool rootIsLeaf = false;
+  float2 uvOrigin = make_float2(0.0f, 0.0f), uvStep = make_float2(0.0f, 0.0f);
+  mat3x3 toWorld = eye<3>(), toLocal = eye<3>();
+  float positionError = 0.0f;
+
+  // Closest triangle along the ray in mesh space with t in (0, tMax);
+  // adds the triangles tested and the nodes visited to *cost if given.
+  bool closestTriangle(float3 origin, float3 direction, float tMax, float &t,
+                       int &triangle, RayCost *cost = nullptr) const;
+  void decode(int triangle, float3 v[3]) const;
+  void decodeUv(int triangle, float2 uv[3]) const;
+  float3 decodeNormal(int triangle) const; // in world space
+  // The triangle of a hit of this mesh, in world space.
+  bool findHit(Ray &ray, Intersection &intersection, float3 v[3],
+               float2 uv[3]) const;
+
+public:
+  static const int maxBlockSize = 8;
+  static const uint32_t leafFlag = 0x80000000u;
+  TriangleShader *shader = nullptr;
+  // Triangles per block at most (1 to maxBlockSize), for the next build.
+  // Smaller blocks mean fewer triangle tests per ray and more nodes.
+  int leafSize = maxBlockSize;
+
+  CompressedMesh(float3 color) : Object(color) {}
+  // With a pool the BVH is built by ParallelBvhBuilder and the blocks are
+  // packed in parallel; faster for millions of triangles, a somewhat worse
+  // tree.
+  void build(const std::vector<MeshTriangle> &input,
+             ThreadPool *pool = nullptr);
+
+  int triangleCount() const { return int(triangles.size()); }
+  int blockCount() const { return int(blocks.size()); }
+  int nodeCount() const { return int(nodes.size()); }
+  size_t memoryBytes() const;
+  // Largest distance of a decoded vertex from its input position.
+  float maxPositionError() const { return positionError; }
+
+  CUDA_HOSTDEV void setShader(TriangleShader *triangleShader) {
+    shader = triangleShader;
+  }
+  CUDA_HOSTDEV Shader *getShader() { return shader; }
+  CUDA_HOSTDEV bool intersect(Ray &ray, float3 &outIntersectionPoint,
+                              float3 &outNormal, float3 &outColor);
+  CUDA_HOSTDEV void transform(mat3x3 &transformMatrix);
+  CUDA_HOSTDEV AABB bounds();
+  CUDA_HOSTDEV float3 excite(Scene *scene, Ray &incidentRay,
+                             Intersection &intersection);
+  CUDA_HOSTDEV SurfaceResponse respond(Ray &incidentRay,
+                                       Intersection &intersection);
+};
+
+} // namespace raytracer_cu
+
+#endif
@@ -0,0 +1,156 @@
+#include "cost_heatmap.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "image_io.h"
+#include "profiler.h"
+
+namespace raytracer_cu {
+
+namespace {
+
+// Blue, cyan, green, yellow, red.
+float3 falseColor(float t) {
+  const float3 stops[5] = {
+      make_float3(0.0f, 0.0f, 0.5f), make_float3(0.0f, 0.8f, 1.0f),
+      make_float3(0.1f, 0.9f, 0.1f), make_float3(1.0f, 0.9f, 0.0f),
+      make_float3(0.9f, 0.0f, 0.0f)};
+  t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+  float s = t * 4.0f;
+  int i = s >= 4.0f ? 3 : int(s);
+  float f = s - float(i);
+  return (1.0f - f) * stops[i] + f * stops[i + 1];
+}
+
+} // namespace
+
+const char *costMetricName(CostMetric metric) {
+  switch (metric) {
+  case CostMetric::IntersectionTests:
+    return "intersection tests";
+  case CostMetric::NodeVisits:
+    return "node visits";
+  case CostMetric::Rays:
+    return "rays";
+  case CostMetric::BounceDepth:
+    return "bounce depth";
+  case CostMetric::Nanoseconds:
+  default:
+    return "nanoseconds";
+  }
+}
+
+bool parseCostMetric(const std::string &name, CostMetric &metric) {
+  if (name == "tests") {
+    metric = CostMetric::IntersectionTests;
+  } else if (name == "nodes") {
+    metric = CostMetric::NodeVisits;
+  } else if (name == "rays") {
+    metric = CostMetric::Rays;
+  } else if (name == "depth") {
+    metric = CostMetric::BounceDepth;
+  } else if (name == "ns") {
+    metric = CostMetric::Nanoseconds;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void CostMap::measure(HostRenderer &renderer, ThreadPool &pool,
+                      const Camera &camera, int2 imageSize,
+                      uint32_t frameIndex, CostMetric costMetric) {
+  PROFILE_SCOPE("CostMap::measure", "host");
+  size = imageSize;
+  metric = costMetric;
+  values.assign(size_t(size.x) * size.y, 0);
+  primaryObject.assign(values.size(), -1);
+
+  pool.parallelFor(0, size.y, renderer.rowsPerTask, [&](int rowBegin,
+                                                        int rowEnd) {
+    for (int y = rowBegin; y < rowEnd; y++) {
+      for (int x = 0; x < size.x; x++) {
+        int linIdx = y * size.x + x;
+        RayCost cost;
+        GBufferTexel texel;
+        auto start = std::chrono::steady_clock::now();
+        renderer.tracePixel(camera, size, frameIndex,
+                            renderer.bouncesOf(size, x, y), x, y, &texel,
+                            &cost);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        switch (metric) {
+        case CostMetric::IntersectionTests:
+          values[linIdx] = cost.intersectionTests;
+          break;
+        case CostMetric::NodeVisits:
+          values[linIdx] = cost.nodeVisits;
+          break;
+        case CostMetric::Rays:
+          values[linIdx] = cost.rays;
+          break;
+        case CostMetric::BounceDepth:
+          values[linIdx] = cost.maxDepth;
+          break;
+        case CostMetric::Nanoseconds:
+          values[linIdx] = uint32_t(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                  .count());
+          break;
+        }
+        primaryObject[linIdx] = texel.objectId;
+      }
+    }
+  });
+}
+
+uint64_t CostMap::total() const {
+  uint64_t sum = 0;
+  for (uint32_t value : values) {
+    sum += value;
+  }
+  return sum;
+}
+
+uint32_t CostMap::maxValue() const {
+  return values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+}
+
+uint32_t CostMap::percentile(float p) const {
+  if (values.empty()) {
+    return 0;
+  }
+  std::vector<uint32_t> sorted(values);
+  size_t k = size_t(p * float(sorted.size() - 1) + 0.5f);
+  k = std::min(k, sorted.size() - 1);
+  std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+  return sorted[k];
+}
+
+std::vector<uint64_t> CostMap::totalByObject(int nObjects) const {
+  std::vector<uint64_t> sums(nObjects, 0);
+  for (size_t i = 0; i < values.size(); i++) {
+    int object = primaryObject[i];
+    if (object >= 0 && object < nObjects) {
+      sums[object] += values[i];
+    }
+  }
+  return sums;
+}
+
+void CostMap::heatmap(uint8_t *colorBuffer, float scaleMax) const {
+  if (scaleMax <= 0.0f) {
+    scaleMax = float(std::max(percentile(0.99f), 1u));
+  }
+  for (size_t i = 0; i < values.size(); i++) {
+    storePixel(colorBuffer, int(i), falseColor(float(values[i]) / scaleMax));
+  }
+}
+
+bool CostMap::writeRaw(const std::string &path) const {
+  std::vector<float> floats(values.begin(), values.end());
+  return writeFile(path, encodePFM(floats.data(), size.x, size.y));
+}
+
+} // namespace raytracer_cu
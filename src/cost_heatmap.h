@@ -0,0 +1,66 @@
+#ifndef COST_HEATMAP_H
+#define COST_HEATMAP_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cuda_runtime.h"
+
+#include "camera.h"
+#include "host_renderer.h"
+#include "thread_pool.h"
+
+namespace raytracer_cu {
+
+// What a cost map counts per pixel, see RayCost.
+enum class CostMetric {
+  IntersectionTests, // ray-object tests of all the rays of the pixel
+  NodeVisits,        // BVH nodes visited by all the rays of the pixel
+  Rays,              // primary, secondary and shadow rays traced
+  BounceDepth,       // deepest bounce reached, 1 if only the primary ray hit
+  Nanoseconds        // wall clock time of the pixel
+};
+
+const char *costMetricName(CostMetric metric);
+// "tests", "nodes", "rays", "depth" or "ns"; returns false for anything
+// else.
+bool parseCostMetric(const std::string &name, CostMetric &metric);
+
+/*
+Per-pixel cost of rendering a frame with the host renderer: the pixels are
+traced as in HostRenderer::render (same camera, scene, bounce budget and
+random streams), but instead of the colors the work of every pixel is kept.
+
+measure(renderer, pool, camera, size, frameIndex, metric) fills values
+(size.x * size.y, row major) and the object of the primary hit of every
+pixel (-1 on a miss), so the cost can be attributed to the objects seen.
+
+heatmap(colorBuffer, scaleMax) writes a false color RGBA8888 image, blue
+(cheap) through green and yellow to red at scaleMax; scaleMax <= 0 scales
+to the 99th percentile so a few outliers do not flatten the picture. The
+raw values are exported with writeRaw(path) as a float PFM.
+*/
+struct CostMap {
+  int2 size = make_int2(0, 0);
+  CostMetric metric = CostMetric::IntersectionTests;
+  std::vector<uint32_t> values;
+  std::vector<int> primaryObject;
+
+  void measure(HostRenderer &renderer, ThreadPool &pool, const Camera &camera,
+               int2 size, uint32_t frameIndex, CostMetric metric);
+
+  uint64_t total() const;
+  uint32_t maxValue() const;
+  uint32_t percentile(float p) const; // p in [0, 1]
+  // Sum of the values per primary hit object, indexed by object id (nObjects
+  // entries); misses are not counted.
+  std::vector<uint64_t> totalByObject(int nObjects) const;
+
+  void heatmap(uint8_t *colorBuffer, float scaleMax = 0.0f) const;
+  bool writeRaw(const std::string &path) const;
+};
+
+} // namespace raytracer_cu
+
+#endif
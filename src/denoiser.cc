@@ -0,0 +1,179 @@
+#include "denoiser.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "math.h"
+#include "thread_pool.h"
+
+namespace raytracer_cu {
+
+namespace {
+
+const float atrousKernel[5] = {1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f,
+                               1.0f / 4.0f, 1.0f / 16.0f};
+
+float3 readPixel(const uint8_t *frameBuffer, int linIdx) {
+  const uint8_t *p = frameBuffer + linIdx * 4;
+  return make_float3(p[3] / 255.0f, p[2] / 255.0f, p[1] / 255.0f);
+}
+
+uint8_t toByte(float v) {
+  return uint8_t(std::lround(std::min(std::max(v, 0.0f), 1.0f) * 255.0f));
+}
+
+// Albedo channels darker than this are not divided out.
+const float minAlbedo = 1e-3f;
+const int rowsPerTask = 16;
+
+float3 demodulate(float3 c, float3 albedo) {
+  return make_float3(albedo.x > minAlbedo ? c.x / albedo.x : c.x,
+                     albedo.y > minAlbedo ? c.y / albedo.y : c.y,
+                     albedo.z > minAlbedo ? c.z / albedo.z : c.z);
+}
+
+float3 remodulate(float3 c, float3 albedo) {
+  return make_float3(albedo.x > minAlbedo ? c.x * albedo.x : c.x,
+                     albedo.y > minAlbedo ? c.y * albedo.y : c.y,
+                     albedo.z > minAlbedo ? c.z * albedo.z : c.z);
+}
+
+void writePixel(uint8_t *frameBuffer, int linIdx, float3 c) {
+  uint8_t *p = frameBuffer + linIdx * 4;
+  p[1] = toByte(c.z);
+  p[2] = toByte(c.y);
+  p[3] = toByte(c.x);
+}
+
+} // namespace
+
+Denoiser::Denoiser(int a_w, int a_h)
+    : w(a_w), h(a_h), color(a_w * a_h), filtered(a_w * a_h),
+      history(a_w * a_h), historyObjectId(a_w * a_h, -1),
+      historyLength(a_w * a_h, 0) {}
+
+void Denoiser::resetHistory() { historyValid = false; }
+
+void Denoiser::forRows(const std::function<void(int, int)> &fn) {
+  if (pool) {
+    pool->parallelFor(0, h, rowsPerTask, fn);
+  } else {
+    fn(0, h);
+  }
+}
+
+void Denoiser::temporalAccumulate(const GBufferTexel *gBuffer) {
+  forRows([&](int rowBegin, int rowEnd) {
+    for (int i = rowBegin * w; i < rowEnd * w; i++) {
+      int objectId = gBuffer[i].objectId;
+      if (!historyValid || historyObjectId[i] != objectId) {
+        historyLength[i] = 0;
+      }
+      historyLength[i] = std::min(historyLength[i] + 1, maxHistoryLength);
+
+      // Running mean until the history is long enough, then an exponential
+      // moving average so lighting changes still come through.
+      float alpha = std::max(temporalAlpha, 1.0f / historyLength[i]);
+      float3 accumulated = (1.0f - alpha) * history[i] + alpha * color[i];
+      if (historyLength[i] == 1) {
+        accumulated = color[i];
+      }
+
+      history[i] = accumulated;
+      historyObjectId[i] = objectId;
+      color[i] = accumulated;
+    }
+  });
+  historyValid = true;
+}
+
+void Denoiser::atrousPass(const std::vector<float3> &in,
+                          std::vector<float3> &out,
+                          const GBufferTexel *gBuffer, int step) {
+  forRows([&](int rowBegin, int rowEnd) {
+    atrousRows(in, out, gBuffer, step, rowBegin, rowEnd);
+  });
+}
+
+void Denoiser::atrousRows(const std::vector<float3> &in,
+                          std::vector<float3> &out,
+                          const GBufferTexel *gBuffer, int step, int rowBegin,
+                          int rowEnd) const {
+  for (int y = rowBegin; y < rowEnd; y++) {
+    for (int x = 0; x < w; x++) {
+      int p = y * w + x;
+      const GBufferTexel &gp = gBuffer[p];
+      if (gp.objectId < 0) {
+        out[p] = in[p];
+        continue;
+      }
+
+      float3 sum = make_float3(0.0f, 0.0f, 0.0f);
+      float weightSum = 0.0f;
+
+      for (int j = -2; j <= 2; j++) {
+        int qy = y + j * step;
+        if (qy < 0 || qy >= h) {
+          continue;
+        }
+        for (int i = -2; i <= 2; i++) {
+          int qx = x + i * step;
+          if (qx < 0 || qx >= w) {
+            continue;
+          }
+          int q = qy * w + qx;
+          const GBufferTexel &gq = gBuffer[q];
+          if (gq.objectId != gp.objectId) {
+            continue;
+          }
+
+          float wNormal =
+              std::pow(std::max(0.0f, dot(gp.normal, gq.normal)), sigmaNormal);
+          float depthDiff = std::abs(gp.depth - gq.depth) / std::max(gp.depth, 1e-4f);
+          float wDepth = std::exp(-depthDiff / (sigmaDepth * step));
+          float3 colorDiff = in[p] - in[q];
+          float wColor =
+              std::exp(-dot(colorDiff, colorDiff) / (2.0f * sq(sigmaColor)));
+
+          float weight = atrousKernel[i + 2] * atrousKernel[j + 2] * wNormal *
+                         wDepth * wColor;
+          sum = sum + weight * in[q];
+          weightSum += weight;
+        }
+      }
+      // The center tap always has weight 1 in the edge-stopping terms, so
+      // weightSum is never zero here.
+      out[p] = div(sum, weightSum);
+    }
+  }
+}
+
+void Denoiser::denoise(uint8_t *frameBuffer, const GBufferTexel *gBuffer) {
+  // The lighting is filtered, the texture detail in the albedo is not.
+  forRows([&](int rowBegin, int rowEnd) {
+    for (int i = rowBegin * w; i < rowEnd * w; i++) {
+      color[i] = gBuffer[i].objectId >= 0
+                     ? demodulate(readPixel(frameBuffer, i), gBuffer[i].albedo)
+                     : readPixel(frameBuffer, i);
+    }
+  });
+
+  if (temporal) {
+    temporalAccumulate(gBuffer);
+  }
+
+  for (int iteration = 0; iteration < iterations; iteration++) {
+    atrousPass(color, filtered, gBuffer, 1 << iteration);
+    std::swap(color, filtered);
+  }
+
+  forRows([&](int rowBegin, int rowEnd) {
+    for (int i = rowBegin * w; i < rowEnd * w; i++) {
+      if (gBuffer[i].objectId >= 0) {
+        writePixel(frameBuffer, i, remodulate(color[i], gBuffer[i].albedo));
+      }
+    }
+  });
+}
+
+} // namespace raytracer_cu
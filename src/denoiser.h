@@ -0,0 +1,71 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "cuda_runtime.h"
+
+#include "gbuffer.h"
+
+namespace raytracer_cu {
+
+class ThreadPool;
+
+/*
+Edge-aware denoiser for the stochastic area light shadows, runs on the host
+after the frame is copied back. It filters the lighting: every pixel is
+divided by the albedo of its primary hit (GBufferTexel::albedo) before the
+passes and multiplied by it after, so textures stay sharp. With a pool the
+passes run as parallelFor chunks of rows.
+
+1) Optional temporal accumulation: while the camera is still, each pixel is
+   blended into a running average kept across frames. A pixel restarts its
+   history if the object under it changes, resetHistory() drops everything
+   (the renderer calls it when the view moves).
+2) A-trous wavelet filter (Dammertz et al., "Edge-Avoiding A-Trous Wavelet
+   Transform for fast Global Illumination Filtering", 2010): `iterations`
+   passes of a 5x5 B3-spline kernel with holes of 2^i pixels. The weights
+   are stopped by the primary hit object id, normal, depth and color so
+   edges and textures survive.
+
+The frame buffer is the RGBA8888 layout the trace kernel writes (byte 0 is
+alpha, bytes 1..3 are blue, green, red).
+*/
+class Denoiser {
+private:
+  int w, h;
+  std::vector<float3> color;
+  std::vector<float3> filtered;
+  std::vector<float3> history;
+  std::vector<int> historyObjectId;
+  std::vector<int> historyLength;
+  bool historyValid = false;
+
+  void temporalAccumulate(const GBufferTexel *gBuffer);
+  void forRows(const std::function<void(int, int)> &fn);
+  void atrousPass(const std::vector<float3> &in, std::vector<float3> &out,
+                  const GBufferTexel *gBuffer, int step);
+  void atrousRows(const std::vector<float3> &in, std::vector<float3> &out,
+                  const GBufferTexel *gBuffer, int step, int rowBegin,
+                  int rowEnd) const;
+
+public:
+  int iterations = 4;
+  float sigmaNormal = 64.0f; // exponent applied to dot(n_p, n_q)
+  float sigmaDepth = 0.01f;  // relative depth difference per unit of step
+  float sigmaColor = 0.1f;   // std. deviation of the RGB difference
+  bool temporal = true;
+  float temporalAlpha = 0.1f; // minimum weight of the newest frame
+  int maxHistoryLength = 32;
+  ThreadPool *pool = nullptr;
+
+  Denoiser(int w, int h);
+  void denoise(uint8_t *frameBuffer, const GBufferTexel *gBuffer);
+  void resetHistory();
+};
+
+} // namespace raytracer_cu
+
+#endif
@@ -0,0 +1,393 @@
+#include "dirty_region.h"
+
+#include "shader.h"
+
+namespace raytracer_cu {
+
+namespace {
+
+const int maxHullPoints = 64;
+
+CUDA_HOSTDEV float3 corner(const AABB &box, int i) {
+  return make_float3(i & 1 ? box.hi.x : box.lo.x, i & 2 ? box.hi.y : box.lo.y,
+                     i & 4 ? box.hi.z : box.lo.z);
+}
+
+CUDA_HOSTDEV float distanceToBox(float3 p, const AABB &box) {
+  float dx = maxf(maxf(box.lo.x - p.x, 0.0f), p.x - box.hi.x);
+  float dy = maxf(maxf(box.lo.y - p.y, 0.0f), p.y - box.hi.y);
+  float dz = maxf(maxf(box.lo.z - p.z, 0.0f), p.z - box.hi.z);
+  return sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+CUDA_HOSTDEV bool reflects(Shader *shader, float reflectiveWeight) {
+  return shader &&
+         shader->reflectedWeight + shader->refractedWeight > reflectiveWeight;
+}
+
+CUDA_HOSTDEV ScreenRect projectBox(const Camera &camera, int2 size,
+                                   const AABB &box) {
+  if (box.empty()) {
+    return ScreenRect();
+  }
+  float3 points[8];
+  for (int i = 0; i < 8; i++) {
+    points[i] = corner(box, i);
+  }
+  return projectHull(camera, size, points, 8);
+}
+
+// Bounding box of points on the screen, in pixels.
+struct ScreenBounds {
+  float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+
+  // p at k viewport distances from the eye.
+  CUDA_HOSTDEV void add(const Camera &camera, int2 size, float3 p, float k) {
+    float3 onPlane =
+        camera.eye + (p - camera.eye) * (1.0f / k) - camera.viewport_tl;
+    float x = dot(onPlane, camera.viewport_v1) /
+              dot(camera.viewport_v1, camera.viewport_v1) * size.x;
+    float y = dot(onPlane, camera.viewport_v2) /
+              dot(camera.viewport_v2, camera.viewport_v2) * size.y;
+    minX = minf(minX, x);
+    maxX = maxf(maxX, x);
+    minY = minf(minY, y);
+    maxY = maxf(maxY, y);
+  }
+};
+
+// A box and the box pushed away from the light corners, see shadowHull.
+const int maxShadowPoints = 8 + 4 * 8;
+
+/*
+A hull containing the points the box shadows from the light, in points
+(maxShadowPoints), within a scene of the given diagonal. Returns the number
+of points, 0 if the light is inside the box.
+
+A point p shadowed by the box lies on a ray from a light point L through a
+box point q, p = L + s * (q - L) with s >= 1. Both p and q are in the
+scene, so (s - 1) * |q - L| is at most its diagonal: the hull of the box
+and of its corners pushed to s = 1 + diagonal / (the distance of L to the
+box) contains every such p. For an area light the hull over its four
+corners contains the points of all the others.
+*/
+CUDA_HOSTDEV int shadowHull(Light *light, const AABB &box, float diagonal,
+                            float3 *points) {
+  float3 lightCorners[4];
+  int nCorners = 1;
+  lightCorners[0] = light->lightPosition;
+  if (light->isAreaLight()) {
+    nCorners = 4;
+    for (int c = 0; c < 4; c++) {
+      lightCorners[c] = light->samplePoint(float(c & 1), float(c >> 1));
+    }
+  }
+  int nPoints = 0;
+  for (int i = 0; i < 8; i++) {
+    points[nPoints++] = corner(box, i);
+  }
+  for (int c = 0; c < nCorners; c++) {
+    float distance = distanceToBox(lightCorners[c], box);
+    if (distance <= 1e-4f * diagonal) {
+      return 0;
+    }
+    float s = 1.0f + diagonal / distance;
+    for (int i = 0; i < 8; i++) {
+      points[nPoints++] =
+          lightCorners[c] + (corner(box, i) - lightCorners[c]) * s;
+    }
+  }
+  return nPoints;
+}
+
+CUDA_HOSTDEV AABB hullBounds(const float3 *points, int nPoints) {
+  AABB box;
+  for (int i = 0; i < nPoints; i++) {
+    box.grow(points[i]);
+  }
+  return box;
+}
+
+CUDA_HOSTDEV AABB intersection(const AABB &a, const AABB &b) {
+  AABB box;
+  box.lo = make_float3(maxf(a.lo.x, b.lo.x), maxf(a.lo.y, b.lo.y),
+                       maxf(a.lo.z, b.lo.z));
+  box.hi = make_float3(minf(a.hi.x, b.hi.x), minf(a.hi.y, b.hi.y),
+                       minf(a.hi.z, b.hi.z));
+  if (box.lo.x > box.hi.x || box.lo.y > box.hi.y || box.lo.z > box.hi.z) {
+    return AABB();
+  }
+  return box;
+}
+
+CUDA_HOSTDEV ScreenRect intersection(const ScreenRect &a,
+                                     const ScreenRect &b) {
+  ScreenRect rect;
+  rect.x0 = a.x0 > b.x0 ? a.x0 : b.x0;
+  rect.y0 = a.y0 > b.y0 ? a.y0 : b.y0;
+  rect.x1 = a.x1 < b.x1 ? a.x1 : b.x1;
+  rect.y1 = a.y1 < b.y1 ? a.y1 : b.y1;
+  return rect;
+}
+
+// The bounds of both rectangles, ignoring an empty one.
+CUDA_HOSTDEV ScreenRect bounds(const ScreenRect &a, const ScreenRect &b) {
+  if (a.empty()) {
+    return b;
+  }
+  if (b.empty()) {
+    return a;
+  }
+  ScreenRect rect;
+  rect.x0 = a.x0 < b.x0 ? a.x0 : b.x0;
+  rect.y0 = a.y0 < b.y0 ? a.y0 : b.y0;
+  rect.x1 = a.x1 > b.x1 ? a.x1 : b.x1;
+  rect.y1 = a.y1 > b.y1 ? a.y1 : b.y1;
+  return rect;
+}
+
+// World space boxes, the ones beyond maxBoxes merged into the last one.
+struct ChangedBoxes {
+  static const int maxBoxes = 32;
+  int nBoxes = 0;
+  AABB boxes[maxBoxes];
+
+  CUDA_HOSTDEV void add(const AABB &box) {
+    if (box.empty()) {
+      return;
+    }
+    if (nBoxes < maxBoxes) {
+      boxes[nBoxes++] = box;
+    } else {
+      boxes[maxBoxes - 1].grow(box);
+    }
+  }
+};
+
+// The range of dot(normal, p) - offset over the box.
+CUDA_HOSTDEV void planeDistances(const AABB &box, float3 normal, float offset,
+                                 float &lo, float &hi) {
+  lo = 1e30f;
+  hi = -1e30f;
+  for (int i = 0; i < 8; i++) {
+    float d = dot(normal, corner(box, i)) - offset;
+    lo = minf(lo, d);
+    hi = maxf(hi, d);
+  }
+}
+
+/*
+Adds the pixels where the reflecting or refracting object may show one of
+the changed boxes. A curved reflector may show anything, so that is all
+of its pixels. A primary ray reflected by a plane goes on like the ray
+through the mirror image of the scene, so the plane only shows the boxes
+in front of it (on the side of the viewport) where their mirror images
+project onto it. A refracted ray crosses the plane: any box behind it adds
+all of its pixels. Boxes within tolerance of the plane, like the reflector
+itself, are not seen in it.
+*/
+CUDA_HOSTDEV void addReflector(Object *object, const ChangedBoxes &changed,
+                               float diagonal, const Camera &camera,
+                               int2 size, DirtyRegion &region) {
+  ScreenRect pixels = projectBox(camera, size, object->bounds());
+  float3 normal;
+  float offset;
+  if (!object->plane(normal, offset)) {
+    region.add(pixels);
+    return;
+  }
+  // Flip the normal towards the viewport; if the plane crosses it, primary
+  // rays reach both sides.
+  float3 viewport[5] = {camera.eye, camera.viewport_tl,
+                        camera.viewport_tl + camera.viewport_v1,
+                        camera.viewport_tl + camera.viewport_v2,
+                        camera.viewport_tl + camera.viewport_v1 +
+                            camera.viewport_v2};
+  float viewLo, viewHi;
+  planeDistances(hullBounds(viewport, 5), normal, offset, viewLo, viewHi);
+  if (viewLo < 0.0f && viewHi > 0.0f) {
+    region.add(pixels);
+    return;
+  }
+  if (viewHi <= 0.0f) {
+    normal = -1.0f * normal;
+    offset = -offset;
+  }
+
+  Shader *shader = object->getShader();
+  float tolerance = 1e-5f * diagonal;
+  ScreenRect shown;
+  for (int b = 0; b < changed.nBoxes; b++) {
+    const AABB &box = changed.boxes[b];
+    float lo, hi;
+    planeDistances(box, normal, offset, lo, hi);
+    if (shader->refractedWeight > 0.0f && lo < -tolerance) {
+      region.add(pixels);
+      return;
+    }
+    if (shader->reflectedWeight > 0.0f && hi > tolerance) {
+      float3 mirrored[8];
+      for (int i = 0; i < 8; i++) {
+        float3 p = corner(box, i);
+        mirrored[i] = p - (2.0f * (dot(normal, p) - offset)) * normal;
+      }
+      shown = bounds(shown, intersection(projectHull(camera, size, mirrored, 8),
+                                         pixels));
+    }
+  }
+  region.add(shown);
+}
+
+} // namespace
+
+CUDA_HOSTDEV ScreenRect projectHull(const Camera &camera, int2 size,
+                                    const float3 *points, int nPoints) {
+  // k: distance from the eye along the view axis in viewport distances,
+  // primary rays see the points with k >= 1.
+  float3 planeNormal = cross(camera.viewport_v1, camera.viewport_v2);
+  float viewportDistance = dot(camera.viewport_tl - camera.eye, planeNormal);
+  float k[maxHullPoints];
+  int n = nPoints < maxHullPoints ? nPoints : maxHullPoints;
+  for (int i = 0; i < n; i++) {
+    k[i] = dot(points[i] - camera.eye, planeNormal) / viewportDistance;
+  }
+
+  ScreenBounds bounds;
+  // The hull clipped at the viewport plane is the hull of the points in
+  // front and of the crossings of the segments from those to the others.
+  for (int a = 0; a < n; a++) {
+    if (k[a] < 1.0f) {
+      continue;
+    }
+    bounds.add(camera, size, points[a], k[a]);
+    for (int b = 0; b < n; b++) {
+      if (k[b] < 1.0f) {
+        float s = (k[a] - 1.0f) / (k[a] - k[b]);
+        bounds.add(camera, size, points[a] + (points[b] - points[a]) * s,
+                   1.0f);
+      }
+    }
+  }
+  float minX = bounds.minX, minY = bounds.minY;
+  float maxX = bounds.maxX, maxY = bounds.maxY;
+
+  ScreenRect rect;
+  if (minX > maxX) {
+    return rect;
+  }
+  // A pixel x samples the screen at x, one pixel of margin for rounding.
+  minX = maxf(minf(minX, float(size.x)), -1.0f);
+  maxX = maxf(minf(maxX, float(size.x)), -1.0f);
+  minY = maxf(minf(minY, float(size.y)), -1.0f);
+  maxY = maxf(minf(maxY, float(size.y)), -1.0f);
+  rect.x0 = int(floor(minX)) - 1;
+  rect.y0 = int(floor(minY)) - 1;
+  rect.x1 = int(ceil(maxX)) + 2;
+  rect.y1 = int(ceil(maxY)) + 2;
+  rect.x0 = rect.x0 < 0 ? 0 : rect.x0;
+  rect.y0 = rect.y0 < 0 ? 0 : rect.y0;
+  rect.x1 = rect.x1 > size.x ? size.x : rect.x1;
+  rect.y1 = rect.y1 > size.y ? size.y : rect.y1;
+  return rect;
+}
+
+CUDA_HOSTDEV void addObjectMove(Scene *scene, int objectId, const AABB &before,
+                                const AABB &after, const Camera &camera,
+                                int2 size, float reflectiveWeight,
+                                DirtyRegion &region) {
+  if (region.fullFrame) {
+    return;
+  }
+  if (reflects(scene->sceneObjects[objectId]->getShader(), reflectiveWeight)) {
+    region.fullFrame = true;
+    return;
+  }
+
+  int nObjects = int(scene->sceneObjects.size());
+  int nLights = int(scene->lights.size());
+  AABB sceneBox = merge(before, after);
+  for (int i = 0; i < nObjects; i++) {
+    sceneBox.grow(scene->sceneObjects[i]->bounds());
+  }
+  region.add(projectBox(camera, size, before));
+  region.add(projectBox(camera, size, after));
+
+  // The boxes whose look may change: both boxes and their shadows, and
+  // every other reflector, which may show them.
+  ChangedBoxes changed;
+  changed.add(before);
+  changed.add(after);
+  float diagonal = length(sceneBox.hi - sceneBox.lo);
+  for (int l = 0; l < nLights; l++) {
+    const AABB *boxes[2] = {&before, &after};
+    for (int b = 0; b < 2; b++) {
+      if (boxes[b]->empty()) {
+        continue;
+      }
+      float3 points[maxShadowPoints];
+      int nPoints = shadowHull(scene->lights[l], *boxes[b], diagonal, points);
+      if (nPoints == 0) {
+        region.fullFrame = true;
+        return;
+      }
+      region.add(projectHull(camera, size, points, nPoints));
+      changed.add(intersection(hullBounds(points, nPoints), sceneBox));
+    }
+  }
+  for (int i = 0; i < nObjects; i++) {
+    Object *object = scene->sceneObjects[i];
+    if (i != objectId && reflects(object->getShader(), reflectiveWeight)) {
+      changed.add(object->bounds());
+    }
+  }
+
+  for (int i = 0; i < nObjects; i++) {
+    Object *object = scene->sceneObjects[i];
+    if (i != objectId && reflects(object->getShader(), reflectiveWeight)) {
+      addReflector(object, changed, diagonal, camera, size, region);
+    }
+  }
+}
+
+void markDirtyTiles(const DirtyRegion &region, int2 size, int tileSize,
+                    std::vector<uint8_t> &tiles) {
+  int tilesX = (size.x + tileSize - 1) / tileSize;
+  int tilesY = (size.y + tileSize - 1) / tileSize;
+  tiles.resize(size_t(tilesX) * tilesY, 0);
+  if (region.fullFrame) {
+    tiles.assign(tiles.size(), 1);
+    return;
+  }
+  for (int r = 0; r < region.nRects; r++) {
+    const ScreenRect &rect = region.rects[r];
+    if (rect.empty()) {
+      continue;
+    }
+    for (int ty = rect.y0 / tileSize; ty <= (rect.y1 - 1) / tileSize; ty++) {
+      for (int tx = rect.x0 / tileSize; tx <= (rect.x1 - 1) / tileSize; tx++) {
+        tiles[size_t(ty) * tilesX + tx] = 1;
+      }
+    }
+  }
+}
+
+void dirtyTilePixels(const std::vector<uint8_t> &tiles, int2 size,
+                     int tileSize, std::vector<int> &pixels) {
+  int tilesX = (size.x + tileSize - 1) / tileSize;
+  pixels.clear();
+  for (size_t t = 0; t < tiles.size(); t++) {
+    if (!tiles[t]) {
+      continue;
+    }
+    int x0 = int(t % tilesX) * tileSize, y0 = int(t / tilesX) * tileSize;
+    int x1 = x0 + tileSize < size.x ? x0 + tileSize : size.x;
+    int y1 = y0 + tileSize < size.y ? y0 + tileSize : size.y;
+    for (int y = y0; y < y1; y++) {
+      for (int x = x0; x < x1; x++) {
+        pixels.push_back(y * size.x + x);
+      }
+    }
+  }
+}
+
+} // namespace raytracer_cu
@@ -0,0 +1,93 @@
+#ifndef DIRTY_REGION_H
+#define DIRTY_REGION_H
+
+#include <cstdint>
+#include <vector>
+
+#include "cuda_runtime.h"
+
+#include "aabb.h"
+#include "camera.h"
+#include "cudastuff.h"
+#include "raytracer_basics.h"
+
+namespace raytracer_cu {
+
+// Pixels [x0, x1) x [y0, y1), empty unless x0 < x1 and y0 < y1.
+struct ScreenRect {
+  int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+
+  CUDA_HOSTDEV bool empty() const { return x0 >= x1 || y0 >= y1; }
+};
+
+/*
+The pixels a scene change can affect, as a few screen rectangles, or the
+whole frame. Rectangles beyond maxRects are merged into the last one.
+*/
+struct DirtyRegion {
+  static const int maxRects = 16;
+  bool fullFrame = false;
+  int nRects = 0;
+  ScreenRect rects[maxRects];
+
+  CUDA_HOSTDEV void add(const ScreenRect &rect) {
+    if (rect.empty()) {
+      return;
+    }
+    if (nRects < maxRects) {
+      rects[nRects++] = rect;
+      return;
+    }
+    ScreenRect &last = rects[maxRects - 1];
+    last.x0 = rect.x0 < last.x0 ? rect.x0 : last.x0;
+    last.y0 = rect.y0 < last.y0 ? rect.y0 : last.y0;
+    last.x1 = rect.x1 > last.x1 ? rect.x1 : last.x1;
+    last.y1 = rect.y1 > last.y1 ? rect.y1 : last.y1;
+  }
+};
+
+/*
+The pixels of a size display whose primary ray can see a point of the
+convex hull of `points`, widened by a pixel. The hull is clipped at the
+viewport plane first (primary rays start there), so points behind the eye
+are fine. Returns an empty rectangle if nothing is in front.
+*/
+CUDA_HOSTDEV ScreenRect projectHull(const Camera &camera, int2 size,
+                                    const float3 *points, int nPoints);
+
+/*
+Adds the pixels that can change when scene object objectId moved from the
+box `before` to the box `after` (both in world space, the other objects in
+place), seen from camera:
+
+  - the projections of both boxes
+  - the shadows of both boxes: per light the hull of the box and of the
+    box pushed away from every light corner until it is out of the scene
+  - the pixels of every object reflecting or refracting more than
+    reflectiveWeight in total (the weights of its shader) that may show
+    any of the above or another such object: all of them for curved
+    objects, for flat ones the projections of the mirror images of the
+    boxes in front of them, or all of them if a refracting one has a box
+    behind it
+
+If the moved object itself reflects or refracts more than reflectiveWeight,
+or a light is inside one of the boxes, the region is the full frame.
+Lights that move, like the whole scene transform, are not tracked here:
+the caller traces the full frame for those.
+*/
+CUDA_HOSTDEV void addObjectMove(Scene *scene, int objectId, const AABB &before,
+                                const AABB &after, const Camera &camera,
+                                int2 size, float reflectiveWeight,
+                                DirtyRegion &region);
+
+// Marks the tileSize x tileSize tiles the region touches in tiles (row major,
+// ceil(size / tileSize) tiles per axis, sized by the call).
+void markDirtyTiles(const DirtyRegion &region, int2 size, int tileSize,
+                    std::vector<uint8_t> &tiles);
+// The pixels (y * size.x + x) of the marked tiles, tile by tile.
+void dirtyTilePixels(const std::vector<uint8_t> &tiles, int2 size,
+                     int tileSize, std::vector<int> &pixels);
+
+} // namespace raytracer_cu
+
+#endif
@@ -1,10 +1,14 @@
 #include "disp_sdl.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstring>
+#include <future>
 #include <iostream>
 #include <sstream>
 #include <stdio.h>
 #include <string>
+#include <thread>
 
 #include <SDL.h>
 #include <SDL2/SDL_keycode.h>
@@ -12,6 +16,10 @@
 
 #include "basic_types.h"
 #include "cuda_runtime.h"
+#include "memory_tracker.h"
+#include "profiler.h"
+#include "room_scene.h"
+#include "thread_pool.h"
 
 RenderingCanvas::RenderingCanvas(int width, int height,
                                  SDL_Renderer *a_sdlRenderer) {
@@ -37,6 +45,7 @@ void RenderingCanvas::render() {
 }
 
 Display::~Display() {
+  delete frameRing;
   delete renderer;
   delete renderingCanvas;
 
@@ -46,6 +55,18 @@ Display::~Display() {
   gRenderer = NULL;
 }
 
+bool Display::shareFrames(const std::string &ringName) {
+  raytracer_cu::FrameRingProducer *ring = new raytracer_cu::FrameRingProducer();
+  if (!ring->create(ringName, 3, texWidth, texHeight)) {
+    printf("Could not create the frame ring %s\n", ringName.c_str());
+    delete ring;
+    return false;
+  }
+  delete frameRing;
+  frameRing = ring;
+  return true;
+}
+
 bool Display::initSDL() {
   bool success = true;
   // Initialize SDL
@@ -70,59 +91,110 @@ void Display::destroySDL() {
   SDL_Quit();
 }
 
-bool Display::loadUserTexture(std::string path) {
-  // Initialize PNG loading
-  int imgFlags = IMG_INIT_PNG;
-  if (!(IMG_Init(imgFlags) & imgFlags)) {
-    printf("SDL_image could not initialize! SDL_image Error: %s\n",
+std::vector<std::string> Display::defaultTextures() {
+  return {"../assets/floor.png", "../assets/wall.jpg", "../assets/ceiling.jpg"};
+}
+
+bool Display::decodeTexture(const std::string &path, DecodedTexture &out) {
+  auto start = std::chrono::steady_clock::now();
+  SDL_Surface *loadedSurface = IMG_Load(path.c_str());
+  if (loadedSurface == NULL) {
+    printf("Unable to load image %s! SDL_image Error: %s\n", path.c_str(),
            IMG_GetError());
     return false;
   }
+  // Whatever the file holds (palette, gray, RGBA, BGR), as R, G, B bytes.
+  SDL_Surface *rgb =
+      SDL_ConvertSurfaceFormat(loadedSurface, SDL_PIXELFORMAT_RGB24, 0);
+  SDL_FreeSurface(loadedSurface);
+  if (rgb == NULL) {
+    printf("Unable to convert image %s! SDL Error: %s\n", path.c_str(),
+           SDL_GetError());
+    return false;
+  }
 
-  SDL_Surface *loadedSurface = IMG_Load(path.c_str());
-  std::cout << loadedSurface->w << std::endl;
-
-  int bytesPerPixel = loadedSurface->pitch / loadedSurface->w;
-  std::cout << "Bytes per pixel: " << bytesPerPixel << std::endl;
-
-  uint8_t *pixels = (uint8_t *)loadedSurface->pixels;
-  float3 *targetTexturePixels = new float3[loadedSurface->w * loadedSurface->h];
-
-  for (int x = 0; x < loadedSurface->w; x++) {
-    for (int y = 0; y < loadedSurface->h; y++) {
-      int linIdx = y * (loadedSurface->w) + x;
-      uint8_t r = pixels[linIdx * bytesPerPixel + 0];
-      uint8_t g = pixels[linIdx * bytesPerPixel + 1];
-      uint8_t b = pixels[linIdx * bytesPerPixel + 2];
-      targetTexturePixels[linIdx] =
-          make_float3(r / 255.0f, g / 255.0f, b / 255.0f);
+  out.width = rgb->w;
+  out.height = rgb->h;
+  out.texels.resize(size_t(rgb->w) * rgb->h);
+  // Row by row over the bytes, a loop the compiler vectorizes; the rows of
+  // the surface may be padded to its pitch.
+  const float scale = 1.0f / 255.0f;
+  int rowFloats = rgb->w * 3;
+  for (int y = 0; y < rgb->h; y++) {
+    const uint8_t *src = (const uint8_t *)rgb->pixels + size_t(y) * rgb->pitch;
+    float *dst = &out.texels[size_t(y) * rgb->w].x;
+    for (int i = 0; i < rowFloats; i++) {
+      dst[i] = float(src[i]) * scale;
     }
   }
+  SDL_FreeSurface(rgb);
+  out.ms = std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+               .count();
+  return true;
+}
 
-  renderer->addTexture(loadedSurface->w, loadedSurface->h, targetTexturePixels);
+void Display::placeholderTexture(DecodedTexture &out) {
+  out.width = 16;
+  out.height = 16;
+  out.texels.resize(16 * 16);
+  for (int i = 0; i < 16 * 16; i++) {
+    float c = ((i / 16 + i % 16) % 2) ? 0.8f : 0.3f;
+    out.texels[i] = make_float3(c, c, c);
+  }
+  out.ms = 0.0;
+}
 
-  if (loadedSurface == NULL) {
-    printf("Unable to load image %s! SDL_image Error: %s\n", path.c_str(),
-           IMG_GetError());
+bool Display::loadUserTexture(std::string path) {
+  DecodedTexture texture;
+  if (!decodeTexture(path, texture)) {
     return false;
   }
-  SDL_FreeSurface(loadedSurface);
-  free(targetTexturePixels);
+  renderer->addTexture(texture.width, texture.height, texture.texels.data());
   return true;
 }
 
-Display::Display(int screenW, int screenH) {
+Display::Display(int screenW, int screenH,
+                 const std::vector<std::string> &texturePaths) {
   bool success = true;
+  auto start = std::chrono::steady_clock::now();
+  auto msSince = [](std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - t)
+        .count();
+  };
 
   texWidth = screenW;
   texHeight = screenH;
+
+  // Decode every texture on its own task while the main thread sets up
+  // CUDA and the window; IMG_Init is not thread safe, the loaders are.
+  int imgFlags = IMG_INIT_PNG | IMG_INIT_JPG;
+  if ((IMG_Init(imgFlags) & imgFlags) != imgFlags) {
+    printf("SDL_image could not initialize! SDL_image Error: %s\n"
+           "Textures that do not load are replaced by placeholders.\n",
+           IMG_GetError());
+  }
+  int nTextures = int(texturePaths.size());
+  int nLoaders = std::min(
+      std::max(1, nTextures),
+      int(std::max(1u, std::thread::hardware_concurrency())));
+  raytracer_cu::ThreadPool loaders(nLoaders);
+  std::vector<DecodedTexture> decoded(nTextures);
+  std::vector<char> decodedOk(nTextures, 0);
+  std::vector<std::future<void>> pending;
+  for (int i = 0; i < nTextures; i++) {
+    pending.push_back(loaders.enqueue([&, i] {
+      decodedOk[i] = decodeTexture(texturePaths[i], decoded[i]);
+    }));
+  }
+
+  auto phase = std::chrono::steady_clock::now();
   renderer = new raytracer_cu::Renderer(screenW, screenH);
-  loadUserTexture("../assets/floor.png");
-  loadUserTexture("../assets/wall.jpg");
-  loadUserTexture("../assets/ceiling.jpg");
-  renderer->buildScene();
+  double rendererMs = msSince(phase);
 
   // Create window
+  phase = std::chrono::steady_clock::now();
   gWindow = SDL_CreateWindow("Raytracer", SDL_WINDOWPOS_UNDEFINED,
                              SDL_WINDOWPOS_UNDEFINED, screenW, screenH,
                              SDL_WINDOW_SHOWN);
@@ -139,18 +211,47 @@ Display::Display(int screenW, int screenH) {
     } else {
       // Initialize renderer color
       SDL_SetRenderDrawColor(gRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
-
-      // Initialize PNG loading
-      int imgFlags = IMG_INIT_PNG;
-      if (!(IMG_Init(imgFlags) & imgFlags)) {
-        printf("SDL_image could not initialize! SDL_image Error: %s\n",
-               IMG_GetError());
-        success = false;
-      }
     }
   }
-
   renderingCanvas = new RenderingCanvas(screenW, screenH, gRenderer);
+  double windowMs = msSince(phase);
+
+  // Upload in the order of Scene::textures, each as soon as it is decoded.
+  // RoomScene binds the textures by index, so one that failed is replaced
+  // by a placeholder instead of shifting the ones after it.
+  double waitMs = 0.0, uploadMs = 0.0, decodeSumMs = 0.0, slowestMs = 0.0;
+  int slowest = -1;
+  for (int i = 0; i < nTextures; i++) {
+    phase = std::chrono::steady_clock::now();
+    pending[i].wait();
+    waitMs += msSince(phase);
+    if (!decodedOk[i]) {
+      printf("Using a placeholder for %s\n", texturePaths[i].c_str());
+      placeholderTexture(decoded[i]);
+    }
+    decodeSumMs += decoded[i].ms;
+    if (decoded[i].ms > slowestMs) {
+      slowestMs = decoded[i].ms;
+      slowest = i;
+    }
+    phase = std::chrono::steady_clock::now();
+    renderer->addTexture(decoded[i].width, decoded[i].height,
+                         decoded[i].texels.data());
+    uploadMs += msSince(phase);
+    std::vector<float3>().swap(decoded[i].texels);
+  }
+
+  phase = std::chrono::steady_clock::now();
+  renderer->buildScene(); // queued, runs before the first frame
+  double sceneMs = msSince(phase);
+
+  printf("Startup %.1f ms: renderer %.1f ms, window %.1f ms, waiting for "
+         "textures %.1f ms, upload %.1f ms, scene %.1f ms\n",
+         msSince(start), rendererMs, windowMs, waitMs, uploadMs, sceneMs);
+  printf("  %d textures on %d threads: %.1f ms decoding in total, slowest "
+         "%.1f ms (%s)\n",
+         nTextures, nLoaders, decodeSumMs, slowestMs,
+         slowest >= 0 ? texturePaths[slowest].c_str() : "-");
 }
 
 // Key press surfaces constants
@@ -173,9 +274,13 @@ void Display::mainLoop() {
   int epochTime = SDL_GetTicks();
 
   SDL_SetRelativeMouseMode(SDL_TRUE);
+  PROFILE_THREAD_NAME("main");
 
   // While application is running
   while (!quit) {
+    PROFILE_BEGIN_FRAME();
+    PROFILE_SCOPE("frame", "frame");
+
     // Handle events on queue
     int cumMouseMotionX = 0;
     int cumMouseMotionY = 0;
@@ -185,34 +290,65 @@ void Display::mainLoop() {
     int cumKeyX = 0;
     int cumKeyY = 0;
 
-    while (SDL_PollEvent(&e) != 0) {
-      // User requests quit
-      if (e.type == SDL_QUIT) {
-        quit = true;
-      } else if (e.type == SDL_KEYDOWN) {
-        switch (e.key.keysym.sym) {
-        case SDLK_UP:
-          cumKeyY += 1;
-          break;
-
-        case SDLK_DOWN:
-          cumKeyY -= 1;
-          break;
-
-        case SDLK_RIGHT:
-          cumKeyX += 1;
-          break;
-
-        case SDLK_LEFT:
-          cumKeyX -= 1;
-          break;
+    bool dumpTrace = false;
+    {
+      PROFILE_SCOPE("event polling", "frame");
+      while (SDL_PollEvent(&e) != 0) {
+        // User requests quit
+        if (e.type == SDL_QUIT) {
+          quit = true;
+        } else if (e.type == SDL_KEYDOWN) {
+          switch (e.key.keysym.sym) {
+          case SDLK_UP:
+            cumKeyY += 1;
+            break;
+
+          case SDLK_DOWN:
+            cumKeyY -= 1;
+            break;
+
+          case SDLK_RIGHT:
+            cumKeyX += 1;
+            break;
+
+          case SDLK_LEFT:
+            cumKeyX -= 1;
+            break;
+
+          case SDLK_d:
+            denoise = !denoise;
+            renderer->setDenoise(denoise);
+            break;
+
+          case SDLK_r:
+            reprojection = !reprojection;
+            renderer->setReprojection(reprojection);
+            break;
+
+          case SDLK_t:
+            dumpTrace = true;
+            break;
+
+          case SDLK_b:
+            // Bytes per subsystem now and at their peak since the last b.
+            raytracer_cu::MemoryTracker::instance().printStats(std::cout);
+            raytracer_cu::MemoryTracker::instance().resetPeaks();
+            break;
+
+          case SDLK_m:
+            // Nudges the matte sphere around the y axis, an edit that
+            // retraces only its dirty tiles.
+            renderer->transformObject(raytracer_cu::RoomScene::matteSphereId,
+                                      raytracer_cu::getRotationMatrixY(0.05f));
+            break;
+          }
+
+        } else if (e.type == SDL_MOUSEMOTION) {
+          cumMouseMotionX += e.motion.xrel;
+          cumMouseMotionY += e.motion.yrel;
+        } else if (e.type == SDL_MOUSEWHEEL) {
+          cumWheel += e.wheel.y;
         }
-
-      } else if (e.type == SDL_MOUSEMOTION) {
-        cumMouseMotionX += e.motion.xrel;
-        cumMouseMotionY += e.motion.yrel;
-      } else if (e.type == SDL_MOUSEWHEEL) {
-        cumWheel += e.wheel.y;
       }
     }
 
@@ -232,15 +368,47 @@ void Display::mainLoop() {
     SDL_SetRenderDrawColor(gRenderer, 0xFF, 0x00, 0xFF, 0xFF);
     SDL_RenderClear(gRenderer);
 
-    renderingCanvas->lock();
-    renderer->render((uint8_t *)renderingCanvas->mRawPixels);
-    renderingCanvas->unLock();
+    if (frameRing) {
+      uint8_t *shared = frameRing->beginFrame(texWidth, texHeight);
+      renderer->render(shared);
+      frameRing->publish();
+      PROFILE_SCOPE("texture lock", "frame");
+      renderingCanvas->lock();
+      for (int y = 0; y < texHeight; y++) {
+        memcpy((uint8_t *)renderingCanvas->mRawPixels +
+                   size_t(y) * renderingCanvas->mRawPitch,
+               shared + size_t(y) * texWidth * 4, size_t(texWidth) * 4);
+      }
+    } else {
+      PROFILE_SCOPE("texture lock", "frame");
+      renderingCanvas->lock();
+      renderer->render((uint8_t *)renderingCanvas->mRawPixels);
+    }
+    {
+      PROFILE_SCOPE("texture unlock", "frame");
+      renderingCanvas->unLock();
+    }
 
     // Render frame
-    renderingCanvas->render();
+    {
+      PROFILE_SCOPE("SDL_RenderCopy", "frame");
+      renderingCanvas->render();
+    }
 
     // Update screen
-    SDL_RenderPresent(gRenderer);
+    {
+      PROFILE_SCOPE("SDL_RenderPresent", "frame");
+      SDL_RenderPresent(gRenderer);
+    }
+
+    // The frame span of this frame is not closed yet, the dump has the
+    // frames before it.
+    if (dumpTrace) {
+      const char *tracePath = "frame_trace.json";
+      if (raytracer_cu::Profiler::instance().writeChromeTrace(tracePath)) {
+        std::cout << "Frame timeline written to " << tracePath << std::endl;
+      }
+    }
 
     int currFrameTime = SDL_GetTicks() - epochTime;
     frameTimeStapms.push_back(currFrameTime);
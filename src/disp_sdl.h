@@ -1,6 +1,7 @@
 #ifndef DISP_SDL_H
 #define DISP_SDL_H
 
+#include "frame_ring.h"
 #include "renderer.h"
 
 #include <SDL.h>
@@ -8,6 +9,8 @@
 #include <SDL_image.h>
 
 #include <queue>
+#include <string>
+#include <vector>
 
 class RenderingCanvas {
 public:
@@ -24,23 +27,47 @@ public:
   void unLock();
 };
 
+// An image file as the float3 texels Renderer::addTexture takes.
+struct DecodedTexture {
+  int width = 0;
+  int height = 0;
+  std::vector<float3> texels; // row major
+  double ms = 0.0;            // decoding and conversion time
+};
+
 class Display {
 public:
   static bool initSDL();
   static void destroySDL();
+  // The textures of the room scene, in the order of Scene::textures.
+  static std::vector<std::string> defaultTextures();
+  // Loads an image and converts it, thread safe once IMG_Init was called.
+  static bool decodeTexture(const std::string &path, DecodedTexture &out);
+  // A 16x16 gray checkerboard (as checker_textures.h) in place of a
+  // texture that could not be decoded.
+  static void placeholderTexture(DecodedTexture &out);
 
   int texWidth;
   int texHeight;
 
   std::deque<int> frameTimeStapms;
   int fpsStatsMovinWindowSize = 10;
+  bool denoise = false;
+  bool reprojection = true;
   RenderingCanvas *renderingCanvas;
   SDL_Window *gWindow = NULL;
   SDL_Renderer *gRenderer = NULL;
   raytracer_cu::Renderer *renderer;
+  // When set, frames are rendered into the shared memory ring and copied to
+  // the window from there.
+  raytracer_cu::FrameRingProducer *frameRing = nullptr;
 
-  Display(int screenW, int screenH);
+  // The textures are decoded on a thread pool while the renderer and the
+  // window are created, then uploaded in order; prints the startup times.
+  Display(int screenW, int screenH,
+          const std::vector<std::string> &texturePaths = defaultTextures());
   bool loadUserTexture(std::string path);
+  bool shareFrames(const std::string &ringName);
   void mainLoop();
   ~Display();
 };
@@ -0,0 +1,242 @@
+#include "frame_ring.h"
+
+#include <chrono>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace raytracer_cu {
+
+namespace {
+
+const uint32_t ringMagic = 0x52465452; // "RTFR"
+const uint32_t ringVersion = 1;
+const size_t headerBytes = 64; // FrameRingHeader and FrameSlotHeader
+const size_t alignment = 64;
+
+static_assert(sizeof(FrameRingHeader) <= headerBytes,
+              "FrameRingHeader must fit in its 64 bytes");
+static_assert(sizeof(FrameSlotHeader) <= headerBytes,
+              "FrameSlotHeader must fit in its 64 bytes");
+
+int64_t steadyNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace
+
+// ---------- FrameRingProducer ----------
+
+FrameRingProducer::~FrameRingProducer() {
+  if (base) {
+    header->producerAlive.store(0, std::memory_order_release);
+    munmap(base, mappedBytes);
+    shm_unlink(name.c_str());
+  }
+}
+
+bool FrameRingProducer::create(const std::string &ringName, int nSlots,
+                               int maxWidth, int maxHeight) {
+  if (base || nSlots < 2 || maxWidth <= 0 || maxHeight <= 0) {
+    return false;
+  }
+  uint64_t pixelBytes = uint64_t(maxWidth) * maxHeight * 4;
+  uint64_t slotBytes =
+      (headerBytes + pixelBytes + alignment - 1) / alignment * alignment;
+  size_t totalBytes = size_t(headerBytes + slotBytes * nSlots);
+
+  shm_unlink(ringName.c_str());
+  int fd = shm_open(ringName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  if (ftruncate(fd, off_t(totalBytes)) != 0) {
+    close(fd);
+    shm_unlink(ringName.c_str());
+    return false;
+  }
+  void *mapped =
+      mmap(nullptr, totalBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    shm_unlink(ringName.c_str());
+    return false;
+  }
+
+  name = ringName;
+  base = static_cast<uint8_t *>(mapped);
+  mappedBytes = totalBytes;
+  header = new (base) FrameRingHeader();
+  header->version = ringVersion;
+  header->nSlots = uint32_t(nSlots);
+  header->maxWidth = uint32_t(maxWidth);
+  header->maxHeight = uint32_t(maxHeight);
+  header->slotBytes = slotBytes;
+  header->publishedFrames.store(0, std::memory_order_relaxed);
+  header->producerAlive.store(1, std::memory_order_relaxed);
+  for (int i = 0; i < nSlots; i++) {
+    FrameSlotHeader *s =
+        new (base + headerBytes + slotBytes * i) FrameSlotHeader();
+    s->sequence.store(0, std::memory_order_relaxed);
+  }
+  // Consumers check the magic before anything else.
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic = ringMagic;
+  nextFrame = 0;
+  return true;
+}
+
+FrameSlotHeader *FrameRingProducer::slot(uint64_t frame) {
+  return reinterpret_cast<FrameSlotHeader *>(
+      base + headerBytes + header->slotBytes * (frame % header->nSlots));
+}
+
+uint8_t *FrameRingProducer::beginFrame(int w, int h) {
+  if (!base || w <= 0 || h <= 0 || uint32_t(w) > header->maxWidth ||
+      uint32_t(h) > header->maxHeight) {
+    return nullptr;
+  }
+  FrameSlotHeader *s = slot(nextFrame);
+  uint64_t sequence = s->sequence.load(std::memory_order_relaxed);
+  if (sequence % 2 == 0) {
+    // Odd: consumers holding the previous frame of this slot see it change.
+    s->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+  s->width = uint32_t(w);
+  s->height = uint32_t(h);
+  s->stride = uint32_t(w) * 4;
+  s->format = 0;
+  current = s;
+  return reinterpret_cast<uint8_t *>(s) + headerBytes;
+}
+
+void FrameRingProducer::publish() {
+  if (!current) {
+    return;
+  }
+  current->frameNumber = nextFrame;
+  current->publishTimeNs = steadyNowNs();
+  current->sequence.store(current->sequence.load(std::memory_order_relaxed) +
+                              1,
+                          std::memory_order_release);
+  current = nullptr;
+  nextFrame++;
+  header->publishedFrames.store(nextFrame, std::memory_order_release);
+}
+
+// ---------- FrameRingConsumer ----------
+
+FrameRingConsumer::~FrameRingConsumer() {
+  if (base) {
+    munmap(const_cast<uint8_t *>(base), mappedBytes);
+  }
+}
+
+bool FrameRingConsumer::open(const std::string &name) {
+  if (base) {
+    return false;
+  }
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < headerBytes) {
+    close(fd);
+    return false;
+  }
+  void *mapped = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return false;
+  }
+  const FrameRingHeader *h = static_cast<const FrameRingHeader *>(mapped);
+  bool valid = h->magic == ringMagic;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  valid = valid && h->version == ringVersion && h->nSlots >= 2 &&
+          headerBytes + h->slotBytes * h->nSlots <= uint64_t(st.st_size);
+  if (!valid) {
+    munmap(mapped, size_t(st.st_size));
+    return false;
+  }
+  base = static_cast<const uint8_t *>(mapped);
+  mappedBytes = size_t(st.st_size);
+  header = h;
+  return true;
+}
+
+uint64_t FrameRingConsumer::publishedFrames() const {
+  return header ? header->publishedFrames.load(std::memory_order_acquire) : 0;
+}
+
+bool FrameRingConsumer::producerAlive() const {
+  return header && header->producerAlive.load(std::memory_order_acquire);
+}
+
+const FrameSlotHeader *FrameRingConsumer::slot(uint64_t frame) const {
+  return reinterpret_cast<const FrameSlotHeader *>(
+      base + headerBytes + header->slotBytes * (frame % header->nSlots));
+}
+
+bool FrameRingConsumer::acquire(uint64_t frame, FrameView &view) const {
+  const FrameSlotHeader *s = slot(frame);
+  uint64_t sequence = s->sequence.load(std::memory_order_acquire);
+  if (sequence % 2 != 0 || sequence == 0) {
+    return false;
+  }
+  FrameView candidate;
+  candidate.frameNumber = s->frameNumber;
+  candidate.width = s->width;
+  candidate.height = s->height;
+  candidate.stride = s->stride;
+  candidate.publishTimeNs = s->publishTimeNs;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (s->sequence.load(std::memory_order_relaxed) != sequence ||
+      candidate.frameNumber != frame ||
+      uint64_t(candidate.stride) * candidate.height >
+          header->slotBytes - headerBytes) {
+    return false;
+  }
+  candidate.pixels = reinterpret_cast<const uint8_t *>(s) + headerBytes;
+  candidate.slot = uint32_t(frame % header->nSlots);
+  candidate.sequence = sequence;
+  view = candidate;
+  return true;
+}
+
+bool FrameRingConsumer::acquireLatest(FrameView &view) const {
+  if (!header) {
+    return false;
+  }
+  // The newest frame can be overwritten between the two loads only if the
+  // producer went around the whole ring; then the next newest of a fresh
+  // count is tried, one slot further from the one being written.
+  for (uint64_t back = 1; back <= 2; back++) {
+    uint64_t published = publishedFrames();
+    if (published < back) {
+      return false;
+    }
+    if (acquire(published - back, view)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool FrameRingConsumer::acquireFrame(uint64_t frame, FrameView &view) const {
+  return header && frame < publishedFrames() && acquire(frame, view);
+}
+
+bool FrameRingConsumer::stillValid(const FrameView &view) const {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return header && slot(view.frameNumber)->sequence.load(
+                       std::memory_order_relaxed) == view.sequence;
+}
+
+} // namespace raytracer_cu
@@ -0,0 +1,131 @@
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace raytracer_cu {
+
+/*
+Ring of frame slots in POSIX shared memory (shm_open), written by one
+renderer process and read by any number of consumer processes without
+copies, sockets or locks.
+
+Layout (everything 64 byte aligned):
+  FrameRingHeader   magic, version, slot count and size, the number of the
+                    last published frame
+  nSlots x          FrameSlotHeader + maxWidth * maxHeight * 4 bytes for
+                    the RGBA8888 pixels (renderer layout, byte 0 alpha,
+                    packed rows of width * 4 bytes)
+
+Frame n goes to slot n % nSlots. Every slot has a sequence counter used as
+a seqlock: odd while the producer writes the slot, even once the frame is
+complete. The producer never waits for consumers; a consumer that reads a
+slot checks afterwards that the sequence did not change, otherwise the
+producer lapped it and the frame is dropped. With nSlots frames in the ring
+a consumer has nSlots - 1 frame times to finish with a frame.
+
+Producer:
+  FrameRingProducer ring;
+  ring.create("/raytracer_frames", nSlots, maxWidth, maxHeight);
+  uint8_t *pixels = ring.beginFrame(w, h);  // render into it
+  ring.publish();
+
+Consumer (maps the ring read-only):
+  FrameRingConsumer ring;
+  ring.open("/raytracer_frames");
+  FrameView frame;
+  if (ring.acquireLatest(frame) && frame.frameNumber != seen) {
+    ... read frame.pixels in place ...
+    if (ring.stillValid(frame)) { use the result }
+  }
+*/
+struct FrameRingHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t nSlots;
+  uint32_t maxWidth, maxHeight;
+  uint64_t slotBytes; // header and pixels, a multiple of 64
+  std::atomic<uint64_t> publishedFrames; // frames published so far
+  std::atomic<uint32_t> producerAlive;   // cleared when the producer exits
+};
+
+struct FrameSlotHeader {
+  std::atomic<uint64_t> sequence; // odd while being written
+  uint64_t frameNumber;
+  uint32_t width, height;
+  uint32_t stride; // bytes per row
+  uint32_t format; // 0: RGBA8888 in the renderer layout
+  int64_t publishTimeNs; // steady clock of the producer
+};
+
+struct FrameView {
+  const uint8_t *pixels = nullptr;
+  uint64_t frameNumber = 0;
+  uint32_t width = 0, height = 0, stride = 0;
+  int64_t publishTimeNs = 0;
+  uint32_t slot = 0;
+  uint64_t sequence = 0;
+};
+
+class FrameRingProducer {
+private:
+  std::string name;
+  uint8_t *base = nullptr;
+  size_t mappedBytes = 0;
+  FrameRingHeader *header = nullptr;
+  FrameSlotHeader *current = nullptr;
+  uint64_t nextFrame = 0;
+
+  FrameSlotHeader *slot(uint64_t frame);
+
+public:
+  FrameRingProducer() = default;
+  ~FrameRingProducer(); // unmaps and unlinks the shared memory
+  FrameRingProducer(const FrameRingProducer &) = delete;
+  FrameRingProducer &operator=(const FrameRingProducer &) = delete;
+
+  // name is a shm name ("/something"), an existing ring is replaced.
+  bool create(const std::string &name, int nSlots, int maxWidth,
+              int maxHeight);
+  // The pixels of the next frame, packed rows of w * 4 bytes as the
+  // renderers write them; nullptr if w x h is over the maximum size.
+  uint8_t *beginFrame(int w, int h);
+  void publish();
+  uint64_t publishedFrames() const { return nextFrame; }
+};
+
+class FrameRingConsumer {
+private:
+  const uint8_t *base = nullptr;
+  size_t mappedBytes = 0;
+  const FrameRingHeader *header = nullptr;
+
+  const FrameSlotHeader *slot(uint64_t frame) const;
+  bool acquire(uint64_t frame, FrameView &view) const;
+
+public:
+  FrameRingConsumer() = default;
+  ~FrameRingConsumer();
+  FrameRingConsumer(const FrameRingConsumer &) = delete;
+  FrameRingConsumer &operator=(const FrameRingConsumer &) = delete;
+
+  bool open(const std::string &name);
+  uint64_t publishedFrames() const;
+  bool producerAlive() const;
+  uint32_t slotCount() const { return header ? header->nSlots : 0; }
+
+  // The newest complete frame; false if there is none yet.
+  bool acquireLatest(FrameView &view) const;
+  // Frame `frame` if it is still in the ring.
+  bool acquireFrame(uint64_t frame, FrameView &view) const;
+  // True if the producer did not touch the frame since it was acquired,
+  // i.e. everything read from view.pixels so far is consistent.
+  bool stillValid(const FrameView &view) const;
+};
+
+} // namespace raytracer_cu
+
+#endif
@@ -0,0 +1,114 @@
+#include "frame_writer.h"
+
+#include <chrono>
+#include <iostream>
+
+#include "profiler.h"
+
+namespace raytracer_cu {
+
+FrameWriter::FrameWriter(bool threaded, int maxQueued)
+    : maxQueued(maxQueued < 1 ? 1 : maxQueued) {
+  if (threaded) {
+    ioThread = std::thread(&FrameWriter::ioLoop, this);
+  }
+}
+
+FrameWriter::~FrameWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  changed.notify_all();
+  if (ioThread.joinable()) {
+    ioThread.join();
+  }
+}
+
+void FrameWriter::write(Frame &frame) {
+  PROFILE_SCOPE("write frame", "io");
+  auto start = std::chrono::steady_clock::now();
+  bool ok = writeFile(frame.path, encodeImage(frame.format, frame.pixels.data(),
+                                              frame.w, frame.h));
+  double ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  if (!ok) {
+    std::cerr << "FrameWriter: can not write " << frame.path << std::endl;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  writerStats.framesWritten += ok ? 1 : 0;
+  writerStats.failedWrites += ok ? 0 : 1;
+  writerStats.writeMs += ms;
+  freeBuffers.push_back(std::move(frame.pixels));
+}
+
+void FrameWriter::ioLoop() {
+  PROFILE_THREAD_NAME("frame writer");
+  while (true) {
+    Frame frame;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [this] { return stopping || !queue.empty(); });
+      if (queue.empty()) {
+        return; // stopping, everything is written
+      }
+      frame = std::move(queue.front());
+      queue.pop_front();
+      writing = true;
+    }
+    changed.notify_all();
+    write(frame);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      writing = false;
+    }
+    changed.notify_all();
+  }
+}
+
+std::vector<uint8_t> FrameWriter::takeBuffer(size_t size) {
+  std::vector<uint8_t> buffer;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!freeBuffers.empty()) {
+      buffer = std::move(freeBuffers.back());
+      freeBuffers.pop_back();
+    }
+  }
+  buffer.resize(size);
+  return buffer;
+}
+
+void FrameWriter::submit(std::vector<uint8_t> &&pixels, int w, int h,
+                         ImageFormat format, const std::string &path) {
+  Frame frame = {std::move(pixels), w, h, format, path};
+  if (!ioThread.joinable()) {
+    write(frame);
+    return;
+  }
+
+  PROFILE_SCOPE("submit", "io");
+  auto start = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [this] { return int(queue.size()) < maxQueued; });
+  writerStats.stalledMs += std::chrono::duration<double, std::milli>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+  queue.push_back(std::move(frame));
+  lock.unlock();
+  changed.notify_all();
+}
+
+void FrameWriter::flush() {
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [this] { return queue.empty() && !writing; });
+}
+
+FrameWriterStats FrameWriter::stats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return writerStats;
+}
+
+} // namespace raytracer_cu
@@ -0,0 +1,71 @@
+#ifndef FRAME_WRITER_H
+#define FRAME_WRITER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "image_io.h"
+
+namespace raytracer_cu {
+
+struct FrameWriterStats {
+  int framesWritten = 0;
+  int failedWrites = 0;
+  double writeMs = 0.0;   // encoding and writing, on the I/O thread
+  double stalledMs = 0.0; // submit() waiting for a free queue slot
+};
+
+/*
+Encodes and writes frames on a background thread, so writing frame N
+overlaps with rendering frame N + 1.
+
+The renderer takes a buffer with takeBuffer(), renders into it and hands it
+back with submit(). Written buffers are recycled by takeBuffer(). At most
+maxQueued frames wait for the disk; submit() blocks beyond that, so a slow
+disk throttles the renderer instead of piling up memory.
+
+With threaded = false submit() writes in the calling thread (the
+unpipelined baseline).
+*/
+class FrameWriter {
+private:
+  struct Frame {
+    std::vector<uint8_t> pixels;
+    int w, h;
+    ImageFormat format;
+    std::string path;
+  };
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<Frame> queue;
+  std::vector<std::vector<uint8_t>> freeBuffers;
+  bool writing = false;
+  bool stopping = false;
+  FrameWriterStats writerStats;
+  std::thread ioThread;
+
+  void ioLoop();
+  void write(Frame &frame);
+
+public:
+  const int maxQueued;
+
+  explicit FrameWriter(bool threaded = true, int maxQueued = 2);
+  ~FrameWriter(); // writes the queued frames
+
+  std::vector<uint8_t> takeBuffer(size_t size);
+  void submit(std::vector<uint8_t> &&pixels, int w, int h, ImageFormat format,
+              const std::string &path);
+  void flush();
+  FrameWriterStats stats();
+};
+
+} // namespace raytracer_cu
+
+#endif
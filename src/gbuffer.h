@@ -0,0 +1,22 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include "cuda_runtime.h"
+
+namespace raytracer_cu {
+
+// Per-pixel primary hit info written by the trace kernel next to the color.
+// objectId is the index into Scene::sceneObjects, -1 if the eye ray missed.
+typedef struct {
+  float3 position;
+  float3 normal;
+  float depth;
+  int objectId;
+  // Diffuse color of the hit (SurfaceResponse), what the denoiser divides
+  // out; only the trace kernel writes it.
+  float3 albedo;
+} GBufferTexel;
+
+} // namespace raytracer_cu
+
+#endif
@@ -0,0 +1,90 @@
+#include "host_renderer.h"
+
+#include "irradiance_cache.h"
+#include "profiler.h"
+#include "random.h"
+
+namespace raytracer_cu {
+
+void HostRenderer::render(const Camera &camera, int2 size, uint32_t frameIndex,
+                          uint8_t *colorBuffer, GBufferTexel *gBuffer) {
+  renderRegion(camera, size, frameIndex, 0, 0, size.x, size.y, colorBuffer,
+               gBuffer);
+}
+
+void HostRenderer::renderRegion(const Camera &camera, int2 size,
+                                uint32_t frameIndex, int x0, int y0, int w,
+                                int h, uint8_t *colorBuffer,
+                                GBufferTexel *gBuffer) {
+  PROFILE_SCOPE("HostRenderer::renderRegion", "host");
+  if (scene->irradianceCache) {
+    scene->irradianceCache->validate(*scene);
+  }
+  pool.parallelFor(0, h, rowsPerTask, [&](int rowBegin, int rowEnd) {
+    PROFILE_SCOPE_ARG("rows", "host", y0 + rowBegin);
+    for (int row = rowBegin; row < rowEnd; row++) {
+      for (int col = 0; col < w; col++) {
+        int linIdx = row * w + col;
+        GBufferTexel texel;
+        int x = x0 + col;
+        int y = y0 + row;
+        float3 color = tracePixel(camera, size, frameIndex,
+                                  bouncesOf(size, x, y), x, y, &texel);
+        storePixel(colorBuffer, linIdx, color);
+        if (gBuffer) {
+          gBuffer[linIdx] = texel;
+        }
+      }
+    }
+  });
+}
+
+void HostRenderer::renderPixels(const Camera &camera, int2 size,
+                                uint32_t frameIndex,
+                                const std::vector<int> &pixels,
+                                uint8_t *colorBuffer, GBufferTexel *gBuffer) {
+  PROFILE_SCOPE("HostRenderer::renderPixels", "host");
+  if (scene->irradianceCache) {
+    scene->irradianceCache->validate(*scene);
+  }
+  pool.parallelFor(0, int(pixels.size()), 256, [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      int linIdx = pixels[i];
+      int x = linIdx % size.x, y = linIdx / size.x;
+      GBufferTexel texel;
+      float3 color = tracePixel(camera, size, frameIndex,
+                                bouncesOf(size, x, y), x, y, &texel);
+      storePixel(colorBuffer, linIdx, color);
+      if (gBuffer) {
+        gBuffer[linIdx] = texel;
+      }
+    }
+  });
+}
+
+float3 HostRenderer::tracePixel(const Camera &camera, int2 size,
+                                uint32_t frameIndex, int bounces, int x, int y,
+                                GBufferTexel *texel, RayCost *cost) const {
+  Ray eyeRay = camera.primaryRay(x, y, size, bounces);
+  eyeRay.seed = pixelSeed(x, y, frameIndex);
+  if (cost) {
+    cost->primaryBounces = bounces;
+    eyeRay.cost = cost;
+  }
+
+  float3 color = make_float3(0.0f, 0.0f, 0.0f);
+  Intersection primaryHit;
+  bool hit = scene->trace(eyeRay, color, primaryHit);
+  if (texel) {
+    texel->objectId = -1;
+    if (hit) {
+      texel->position = primaryHit.surfacePoint;
+      texel->normal = primaryHit.surfaceNormal;
+      texel->depth = length(primaryHit.surfacePoint - camera.eye);
+      texel->objectId = primaryHit.objectId;
+    }
+  }
+  return color;
+}
+
+} // namespace raytracer_cu
@@ -0,0 +1,86 @@
+#ifndef HOST_RENDERER_H
+#define HOST_RENDERER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "cuda_runtime.h"
+
+#include "camera.h"
+#include "gbuffer.h"
+#include "math.h"
+#include "raytracer_basics.h"
+#include "thread_pool.h"
+
+namespace raytracer_cu {
+
+// Writes a color into an RGBA8888 frame buffer with the layout of the
+// device renderer (byte 0 alpha, then blue, green, red).
+inline void storePixel(uint8_t *colorBuffer, int linIdx, float3 color) {
+  auto toByte = [](float c) {
+    c = c < 0.0f ? 0.0f : (c > 1.0f ? 1.0f : c);
+    return uint8_t(c * 255.0f + 0.5f);
+  };
+  colorBuffer[linIdx * 4 + 0] = 255;
+  colorBuffer[linIdx * 4 + 1] = toByte(color.z);
+  colorBuffer[linIdx * 4 + 2] = toByte(color.y);
+  colorBuffer[linIdx * 4 + 3] = toByte(color.x);
+}
+
+/*
+Renders a host resident scene on the CPU, one recursive Scene::trace per
+pixel (the same "megakernel" the device renderer runs), rows distributed
+over the thread pool. The scene must be built with host new (e.g. a
+RoomScene constructed and built on the host), device scenes can not be
+traced here.
+
+render(camera, size, frameIndex, color, gBuffer):
+  color is RGBA8888 with size.x * size.y pixels, gBuffer is optional.
+renderRegion(camera, size, frameIndex, x0, y0, w, h, color, gBuffer):
+  the w * h pixels starting at (x0, y0) of the same image, color and
+  gBuffer hold only the region. The pixels are identical to the ones of a
+  full render (rays and random streams depend on the image coordinates).
+renderPixels(camera, size, frameIndex, pixels, color, gBuffer):
+  only the listed pixels (y * size.x + x) of a full size image, the others
+  keep what they had (see dirty_region.h).
+
+With an irradiance cache on the scene, every call validates it against the
+lights first (see irradiance_cache.h).
+
+Bounce budget of a pixel: pixelBounces[y * size.x + x] if set (size.x *
+size.y entries over the full image), else maxBounces, else (-1) the scene's
+Scene::maxBounces.
+*/
+class HostRenderer {
+private:
+  Scene *scene;
+  ThreadPool &pool;
+
+public:
+  int maxBounces = -1;
+  const uint8_t *pixelBounces = nullptr;
+  int rowsPerTask = 4;
+
+  HostRenderer(Scene *scene, ThreadPool &pool) : scene(scene), pool(pool) {}
+  void render(const Camera &camera, int2 size, uint32_t frameIndex,
+              uint8_t *colorBuffer, GBufferTexel *gBuffer = nullptr);
+  void renderRegion(const Camera &camera, int2 size, uint32_t frameIndex,
+                    int x0, int y0, int w, int h, uint8_t *colorBuffer,
+                    GBufferTexel *gBuffer = nullptr);
+  void renderPixels(const Camera &camera, int2 size, uint32_t frameIndex,
+                    const std::vector<int> &pixels, uint8_t *colorBuffer,
+                    GBufferTexel *gBuffer = nullptr);
+  // One pixel of the image, for callers that schedule the work themselves.
+  // cost, if given, counts the work done for the pixel.
+  float3 tracePixel(const Camera &camera, int2 size, uint32_t frameIndex,
+                    int bounces, int x, int y, GBufferTexel *texel = nullptr,
+                    RayCost *cost = nullptr) const;
+  int bouncesOf(int2 size, int x, int y) const {
+    return pixelBounces ? pixelBounces[y * size.x + x]
+                        : (maxBounces >= 0 ? maxBounces : scene->maxBounces);
+  }
+};
+
+} // namespace raytracer_cu
+
+#endif
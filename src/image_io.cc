@@ -0,0 +1,137 @@
+#include "image_io.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace raytracer_cu {
+
+std::vector<uint8_t> encodeImage(ImageFormat format,
+                                 const uint8_t *colorBuffer, int w, int h) {
+  switch (format) {
+  case ImageFormat::QOI:
+    return encodeQOI(colorBuffer, w, h);
+  case ImageFormat::PPM:
+  default:
+    return encodePPM(colorBuffer, w, h);
+  }
+}
+
+std::vector<uint8_t> encodePPM(const uint8_t *colorBuffer, int w, int h) {
+  char header[64];
+  int headerSize = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", w, h);
+  std::vector<uint8_t> out(headerSize + size_t(w) * h * 3);
+  memcpy(out.data(), header, headerSize);
+  uint8_t *dst = out.data() + headerSize;
+  for (int i = 0; i < w * h; i++) {
+    const uint8_t *pixel = colorBuffer + i * 4;
+    dst[i * 3 + 0] = pixel[3];
+    dst[i * 3 + 1] = pixel[2];
+    dst[i * 3 + 2] = pixel[1];
+  }
+  return out;
+}
+
+std::vector<uint8_t> encodeQOI(const uint8_t *colorBuffer, int w, int h) {
+  const uint8_t opIndex = 0x00, opDiff = 0x40, opLuma = 0x80, opRun = 0xc0,
+                opRGB = 0xfe;
+  std::vector<uint8_t> out;
+  out.reserve(14 + size_t(w) * h * 2 + 8);
+
+  auto put32 = [&out](uint32_t v) {
+    out.push_back(uint8_t(v >> 24));
+    out.push_back(uint8_t(v >> 16));
+    out.push_back(uint8_t(v >> 8));
+    out.push_back(uint8_t(v));
+  };
+  out.insert(out.end(), {'q', 'o', 'i', 'f'});
+  put32(uint32_t(w));
+  put32(uint32_t(h));
+  out.push_back(3); // RGB
+  out.push_back(0); // sRGB with linear alpha
+
+  // Seen colors by hash; alpha is always 255.
+  uint32_t index[64];
+  memset(index, 0, sizeof(index));
+  uint8_t pr = 0, pg = 0, pb = 0;
+  int run = 0;
+  int nPixels = w * h;
+  for (int i = 0; i < nPixels; i++) {
+    const uint8_t *pixel = colorBuffer + i * 4;
+    uint8_t r = pixel[3], g = pixel[2], b = pixel[1];
+
+    if (r == pr && g == pg && b == pb) {
+      run++;
+      if (run == 62 || i == nPixels - 1) {
+        out.push_back(uint8_t(opRun | (run - 1)));
+        run = 0;
+      }
+      continue;
+    }
+    if (run > 0) {
+      out.push_back(uint8_t(opRun | (run - 1)));
+      run = 0;
+    }
+
+    uint32_t packed = (uint32_t(r) << 24) | (uint32_t(g) << 16) |
+                      (uint32_t(b) << 8) | 0xffu;
+    int hash = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+    if (index[hash] == packed) {
+      out.push_back(uint8_t(opIndex | hash));
+    } else {
+      index[hash] = packed;
+      int dr = int8_t(r - pr), dg = int8_t(g - pg), db = int8_t(b - pb);
+      int drdg = dr - dg, dbdg = db - dg;
+      if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+        out.push_back(
+            uint8_t(opDiff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+      } else if (dg >= -32 && dg <= 31 && drdg >= -8 && drdg <= 7 &&
+                 dbdg >= -8 && dbdg <= 7) {
+        out.push_back(uint8_t(opLuma | (dg + 32)));
+        out.push_back(uint8_t((drdg + 8) << 4 | (dbdg + 8)));
+      } else {
+        out.insert(out.end(), {opRGB, r, g, b});
+      }
+    }
+    pr = r;
+    pg = g;
+    pb = b;
+  }
+  out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+  return out;
+}
+
+std::vector<uint8_t> encodePFM(const float *values, int w, int h) {
+  char header[64];
+  // A negative scale means little endian.
+  uint16_t probe = 1;
+  uint8_t firstByte;
+  memcpy(&firstByte, &probe, 1);
+  bool littleEndian = firstByte == 1;
+  int headerSize = snprintf(header, sizeof(header), "Pf\n%d %d\n%s\n", w, h,
+                            littleEndian ? "-1.0" : "1.0");
+  std::vector<uint8_t> out(headerSize + size_t(w) * h * sizeof(float));
+  memcpy(out.data(), header, headerSize);
+  // PFM stores the bottom row first.
+  uint8_t *dst = out.data() + headerSize;
+  for (int y = 0; y < h; y++) {
+    memcpy(dst + size_t(h - 1 - y) * w * sizeof(float), values + size_t(y) * w,
+           w * sizeof(float));
+  }
+  return out;
+}
+
+bool writeFile(const std::string &path, const std::vector<uint8_t> &data) {
+  FILE *f = fopen(path.c_str(), "wb");
+  if (!f) {
+    return false;
+  }
+  bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+  return fclose(f) == 0 && ok;
+}
+
+bool writePPM(const std::string &path, const uint8_t *colorBuffer, int w,
+              int h) {
+  return writeFile(path, encodePPM(colorBuffer, w, h));
+}
+
+} // namespace raytracer_cu
@@ -0,0 +1,36 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace raytracer_cu {
+
+/*
+Encoders for RGBA8888 frame buffers in the renderer layout (byte 0 alpha,
+then blue, green, red). The alpha channel is always opaque and dropped.
+
+PPM: binary P6, uncompressed
+QOI: "Quite OK Image" format (https://qoiformat.org), lossless and cheap to
+     encode, a fraction of the PPM size on rendered frames
+*/
+enum class ImageFormat : uint32_t { PPM = 0, QOI = 1 };
+
+std::vector<uint8_t> encodeImage(ImageFormat format,
+                                 const uint8_t *colorBuffer, int w, int h);
+std::vector<uint8_t> encodePPM(const uint8_t *colorBuffer, int w, int h);
+std::vector<uint8_t> encodeQOI(const uint8_t *colorBuffer, int w, int h);
+
+// Single channel float image (Portable FloatMap, "Pf"), values[y * w + x]
+// with row 0 at the top; for raw per-pixel data such as cost maps.
+std::vector<uint8_t> encodePFM(const float *values, int w, int h);
+
+// Returns false if the file can not be written.
+bool writeFile(const std::string &path, const std::vector<uint8_t> &data);
+bool writePPM(const std::string &path, const uint8_t *colorBuffer, int w,
+              int h);
+
+} // namespace raytracer_cu
+
+#endif
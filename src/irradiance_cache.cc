@@ -0,0 +1,191 @@
+#include "irradiance_cache.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "random.h"
+
+namespace raytracer_cu {
+
+namespace {
+
+const float minError = 1e-4f;
+// How far (in record radii) a point may lie behind a record's tangent plane.
+const float behindTolerance = 0.05f;
+
+uint32_t floatBits(float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  return bits;
+}
+
+void appendLight(std::vector<float> &state, const Light &light) {
+  const float3 *vectors[] = {&light.lightPosition, &light.lightColor,
+                             &light.edge1, &light.edge2};
+  for (const float3 *v : vectors) {
+    state.push_back(v->x);
+    state.push_back(v->y);
+    state.push_back(v->z);
+  }
+  state.push_back(float(light.nShadowSamples));
+}
+
+} // namespace
+
+IrradianceCache::IrradianceCache(float radius, float maxError, int bucketBits)
+    : nBuckets(size_t(1) << bucketBits),
+      buckets(new std::atomic<Record *>[size_t(1) << bucketBits]),
+      radius(radius), maxError(maxError) {
+  cellSize = maxError * radius;
+  for (size_t i = 0; i < nBuckets; i++) {
+    buckets[i].store(nullptr);
+  }
+}
+
+IrradianceCache::~IrradianceCache() { clear(); }
+
+void IrradianceCache::cellOf(float3 point, int cell[3]) const {
+  cell[0] = int(std::floor(point.x / cellSize));
+  cell[1] = int(std::floor(point.y / cellSize));
+  cell[2] = int(std::floor(point.z / cellSize));
+}
+
+size_t IrradianceCache::bucketOf(const int cell[3]) const {
+  uint32_t h = pcgHash(uint32_t(cell[0]) ^
+                       pcgHash(uint32_t(cell[1]) ^ pcgHash(uint32_t(cell[2]))));
+  return size_t(h) & (nBuckets - 1);
+}
+
+void IrradianceCache::insert(Record *record) {
+  std::atomic<Record *> &head = buckets[bucketOf(record->cell)];
+  record->next = head.load(std::memory_order_relaxed);
+  while (!head.compare_exchange_weak(record->next, record,
+                                     std::memory_order_release,
+                                     std::memory_order_relaxed)) {
+  }
+  records.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool IrradianceCache::interpolate(float3 point, float3 normal, bool shadows,
+                                  float3 &irradiance) const {
+  int center[3];
+  cellOf(point, center);
+  float3 sum = make_float3(0.0f, 0.0f, 0.0f);
+  float totalWeight = 0.0f;
+  int cell[3];
+  for (cell[2] = center[2] - 1; cell[2] <= center[2] + 1; cell[2]++) {
+    for (cell[1] = center[1] - 1; cell[1] <= center[1] + 1; cell[1]++) {
+      for (cell[0] = center[0] - 1; cell[0] <= center[0] + 1; cell[0]++) {
+        const Record *record =
+            buckets[bucketOf(cell)].load(std::memory_order_acquire);
+        for (; record; record = record->next) {
+          // Other cells of the same hash list are skipped, they are
+          // visited as themselves (or are too far).
+          if (record->cell[0] != cell[0] || record->cell[1] != cell[1] ||
+              record->cell[2] != cell[2] || record->shadows != shadows) {
+            continue;
+          }
+          float3 offset = point - record->point;
+          float cosine = dot(normal, record->normal);
+          float error = length(offset) / record->radius +
+                        std::sqrt(maxf(1.0f - cosine, 0.0f));
+          if (error >= maxError ||
+              0.5f * dot(offset, normal + record->normal) <
+                  -behindTolerance * record->radius) {
+            continue;
+          }
+          float weight = 1.0f / maxf(error, minError) - 1.0f / maxError;
+          sum = sum + weight * record->irradiance;
+          totalWeight += weight;
+        }
+      }
+    }
+  }
+  if (totalWeight <= 0.0f) {
+    return false;
+  }
+  irradiance = sum * (1.0f / totalWeight);
+  return true;
+}
+
+float3 IrradianceCache::lookup(Scene &scene, float3 point, float3 normal,
+                               bool shadows, const Ray &shadowRay) {
+  lookups.fetch_add(1, std::memory_order_relaxed);
+  float3 irradiance;
+  if (interpolate(point, normal, shadows, irradiance)) {
+    hits.fetch_add(1, std::memory_order_relaxed);
+    return irradiance;
+  }
+
+  // Light points from the position, so a record does not depend on the
+  // pixel that asked for it. The unshadowed irradiance with the same light
+  // points tells whether any shadow ray was blocked.
+  uint32_t seed = pcgHash(floatBits(point.x) ^
+                          pcgHash(floatBits(point.y) ^
+                                  pcgHash(floatBits(point.z))));
+  uint32_t unshadowedSeed = seed;
+  float3 white = make_float3(1.0f, 1.0f, 1.0f);
+  Record *record = new Record;
+  record->point = point;
+  record->normal = normal;
+  record->irradiance = scene.directLighting(point, normal, white, shadows,
+                                            seed, shadowRay, recordSamples);
+  record->radius = radius;
+  if (shadows) {
+    float3 unshadowed = scene.directLighting(point, normal, white, false,
+                                             unshadowedSeed, Ray(),
+                                             recordSamples);
+    float3 blocked = unshadowed - record->irradiance;
+    if (maxf(maxf(blocked.x, blocked.y), blocked.z) > 1e-6f) {
+      record->radius = radius * penumbraScale;
+    }
+  }
+  record->shadows = shadows;
+  cellOf(point, record->cell);
+  insert(record);
+  return record->irradiance;
+}
+
+void IrradianceCache::validate(Scene &scene) {
+  std::vector<float> state;
+  for (uint64_t i = 0; i < scene.lights.size(); i++) {
+    appendLight(state, *scene.lights[i]);
+  }
+  std::lock_guard<std::mutex> lock(lightsMutex);
+  if (state != lightState) {
+    if (!lightState.empty()) {
+      invalidations.fetch_add(1, std::memory_order_relaxed);
+    }
+    clear();
+    lightState.swap(state);
+  }
+}
+
+void IrradianceCache::clear() {
+  for (size_t i = 0; i < nBuckets; i++) {
+    Record *record = buckets[i].exchange(nullptr);
+    while (record) {
+      Record *next = record->next;
+      delete record;
+      record = next;
+    }
+  }
+  records.store(0);
+}
+
+IrradianceCacheStats IrradianceCache::stats() const {
+  IrradianceCacheStats s;
+  s.lookups = lookups.load();
+  s.hits = hits.load();
+  s.records = records.load();
+  s.invalidations = invalidations.load();
+  return s;
+}
+
+void IrradianceCache::resetStats() {
+  lookups.store(0);
+  hits.store(0);
+  invalidations.store(0);
+}
+
+} // namespace raytracer_cu
@@ -0,0 +1,104 @@
+#ifndef IRRADIANCE_CACHE_H
+#define IRRADIANCE_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "cuda_runtime.h"
+
+#include "math.h"
+#include "raytracer_basics.h"
+
+namespace raytracer_cu {
+
+struct IrradianceCacheStats {
+  uint64_t lookups = 0;
+  uint64_t hits = 0; // answered from the records around the point
+  uint64_t records = 0;
+  uint64_t invalidations = 0; // cleared because a light changed
+
+  double hitRate() const { return lookups ? double(hits) / lookups : 0.0; }
+};
+
+/*
+Cache of the direct diffuse lighting of a scene (Scene::directLighting with
+a white surface, i.e. the irradiance the surface color is multiplied with),
+after Ward et al., "A Ray Tracing Solution for Diffuse Interreflection",
+1988. Set as Scene::irradianceCache, every diffuse hit of the host
+renderers asks it instead of casting its shadow rays.
+
+A record stores the irradiance at a point and normal, computed with
+recordSamples shadow rays per area light (so it carries no sampling noise),
+and a radius R. It stands for a point x with normal n at the error
+
+  e = |x - x_i| / R_i + sqrt(1 - n . n_i)
+
+if e < maxError and x is not behind the record's tangent plane. A lookup
+returns the average of the valid records weighted by 1 / e - 1 / maxError
+(so the weights fade to 0 at the bound), or computes and stores a new
+record when there is none. R is `radius`, or radius * penumbraScale when
+the record's point is partly or fully shadowed, where the lighting changes
+fastest. Lit records next to a shadow edge are where the error is left.
+
+Records persist across frames. validate(scene), which the host renderers
+call once per frame, clears them when a light moved or changed; call
+clear() after moving objects. Lookups and inserts are lock free (records
+are pushed onto the lists of a spatial hash), any number of render threads
+may share the cache. Which records exist depends on the order the threads
+reach the points, so multi-threaded images vary slightly between runs.
+Host only.
+*/
+class IrradianceCache {
+private:
+  struct Record {
+    float3 point, normal, irradiance;
+    float radius;
+    bool shadows;
+    int cell[3];
+    Record *next;
+  };
+
+  float cellSize; // records reach at most maxError * radius
+  size_t nBuckets;
+  std::unique_ptr<std::atomic<Record *>[]> buckets;
+  std::mutex lightsMutex;
+  std::vector<float> lightState;
+  std::atomic<uint64_t> lookups{0}, hits{0}, records{0}, invalidations{0};
+
+  void cellOf(float3 point, int cell[3]) const;
+  size_t bucketOf(const int cell[3]) const;
+  void insert(Record *record);
+  // Weighted sum of the valid records around point, false if there is none.
+  bool interpolate(float3 point, float3 normal, bool shadows,
+                   float3 &irradiance) const;
+
+public:
+  const float radius;
+  const float maxError;
+  float penumbraScale = 0.25f;
+  int recordSamples = 32;
+
+  // radius in world units; 2^bucketBits lists in the spatial hash.
+  IrradianceCache(float radius, float maxError = 0.3f, int bucketBits = 16);
+  ~IrradianceCache();
+  IrradianceCache(const IrradianceCache &) = delete;
+  IrradianceCache &operator=(const IrradianceCache &) = delete;
+
+  // The irradiance at point (surface normal normal) for
+  // Scene::computeDiffuseComponent, a new record casts shadowRay.
+  float3 lookup(Scene &scene, float3 point, float3 normal, bool shadows,
+                const Ray &shadowRay);
+  // Clears the records if the lights of scene differ from the last call.
+  // Not while lookups run.
+  void validate(Scene &scene);
+  void clear();
+  IrradianceCacheStats stats() const;
+  void resetStats();
+};
+
+} // namespace raytracer_cu
+
+#endif
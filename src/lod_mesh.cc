@@ -0,0 +1,550 @@
+#include "lod_mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <queue>
+#include <unordered_map>
+
+namespace raytracer_cu {
+
+namespace {
+
+// Border edges are held in place by a plane through them, perpendicular
+// to their triangle, weighted this much more than a triangle's plane.
+const double borderWeight = 4.0;
+// A collapse may turn a triangle's normal by at most acos of this.
+const float minNormalCosine = 0.2f;
+// A level that removes less than this share of the triangles of the
+// previous one ends the chain.
+const float minProgress = 0.1f;
+// Input triangles sampled per level for its normal error.
+const int normalSamples = 1024;
+
+// Symmetric 4x4 matrix of the squared distances to a set of planes, and
+// the total weight of the planes.
+struct Quadric {
+  double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0,
+         zw = 0, ww = 0;
+  double weight = 0;
+
+  void addPlane(double a, double b, double c, double d, double weight) {
+    xx += weight * a * a;
+    xy += weight * a * b;
+    xz += weight * a * c;
+    xw += weight * a * d;
+    yy += weight * b * b;
+    yz += weight * b * c;
+    yw += weight * b * d;
+    zz += weight * c * c;
+    zw += weight * c * d;
+    ww += weight * d * d;
+    this->weight += weight;
+  }
+
+  Quadric &operator+=(const Quadric &q) {
+    xx += q.xx;
+    xy += q.xy;
+    xz += q.xz;
+    xw += q.xw;
+    yy += q.yy;
+    yz += q.yz;
+    yw += q.yw;
+    zz += q.zz;
+    zw += q.zw;
+    ww += q.ww;
+    weight += q.weight;
+    return *this;
+  }
+
+  double error(float3 p) const {
+    double x = p.x, y = p.y, z = p.z;
+    return xx * x * x + 2 * xy * x * y + 2 * xz * x * z + 2 * xw * x +
+           yy * y * y + 2 * yz * y * z + 2 * yw * y + zz * z * z +
+           2 * zw * z + ww;
+  }
+};
+
+struct PositionKey {
+  uint32_t bits[3];
+  bool operator==(const PositionKey &o) const {
+    return bits[0] == o.bits[0] && bits[1] == o.bits[1] &&
+           bits[2] == o.bits[2];
+  }
+};
+
+struct PositionHash {
+  size_t operator()(const PositionKey &k) const {
+    return size_t(k.bits[0]) * 73856093u ^ size_t(k.bits[1]) * 19349663u ^
+           size_t(k.bits[2]) * 83492791u;
+  }
+};
+
+PositionKey keyOf(float3 p) {
+  PositionKey key;
+  memcpy(&key.bits[0], &p.x, 4);
+  memcpy(&key.bits[1], &p.y, 4);
+  memcpy(&key.bits[2], &p.z, 4);
+  return key;
+}
+
+uint64_t edgeKey(int a, int b) {
+  return a < b ? (uint64_t(a) << 32) | uint32_t(b)
+               : (uint64_t(b) << 32) | uint32_t(a);
+}
+
+/*
+Edge collapses on the triangles of build() with the vertices welded by
+position, cheapest first by the quadric error of the merged vertex. The
+merged vertex goes to whichever of the two ends or their midpoint has the
+least error. A collapse is skipped if it would make the mesh
+non-manifold (the ends share more neighbors than the triangles on the
+edge) or flip or degenerate a triangle; the edges of the merged vertex are
+queued again with new costs after every collapse.
+*/
+class Simplifier {
+private:
+  struct Vertex {
+    float3 p;
+    float2 uv;
+    Quadric q;
+    int version = 0;
+    bool alive = true;
+    std::vector<int> faces;
+  };
+  struct Face {
+    int v[3];
+    float3 normal;
+    bool alive = true;
+  };
+  struct Collapse {
+    double cost;
+    double meanSquared; // cost per plane
+    int a, b;
+    int versionA, versionB;
+    float3 target;
+    float2 uv;
+    bool operator<(const Collapse &o) const { return cost > o.cost; }
+  };
+
+  std::vector<Vertex> vertices;
+  std::vector<Face> faces;
+  std::priority_queue<Collapse> queue;
+  int nFaces = 0;
+  double worstMeanSquared = 0.0;
+
+  float3 faceNormal(float3 p0, float3 p1, float3 p2) const {
+    float3 n = cross(p1 - p0, p2 - p0);
+    float l = length(n);
+    return l > 0.0f ? n * (1.0f / l) : make_float3(0.0f, 0.0f, 0.0f);
+  }
+
+  void queueEdge(int a, int b) {
+    const Vertex &va = vertices[a], &vb = vertices[b];
+    Quadric q = va.q;
+    q += vb.q;
+    float3 candidates[3] = {va.p, vb.p, 0.5f * (va.p + vb.p)};
+    float2 uvs[3] = {va.uv, vb.uv,
+                     make_float2(0.5f * (va.uv.x + vb.uv.x),
+                                 0.5f * (va.uv.y + vb.uv.y))};
+    Collapse c;
+    c.cost = 1e300;
+    for (int k = 0; k < 3; k++) {
+      double cost = q.error(candidates[k]);
+      if (cost < c.cost) {
+        c.cost = cost;
+        c.target = candidates[k];
+        c.uv = uvs[k];
+      }
+    }
+    c.cost = std::max(c.cost, 0.0);
+    c.meanSquared = q.weight > 0 ? c.cost / q.weight : 0.0;
+    c.a = a;
+    c.b = b;
+    c.versionA = va.version;
+    c.versionB = vb.version;
+    queue.push(c);
+  }
+
+  void neighbors(int v, std::vector<int> &out) const {
+    out.clear();
+    for (int f : vertices[v].faces) {
+      for (int k = 0; k < 3; k++) {
+        if (faces[f].v[k] != v) {
+          out.push_back(faces[f].v[k]);
+        }
+      }
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+  }
+
+  bool sharesEdge(const Face &f, int a, int b) const {
+    bool hasA = false, hasB = false;
+    for (int k = 0; k < 3; k++) {
+      hasA |= f.v[k] == a;
+      hasB |= f.v[k] == b;
+    }
+    return hasA && hasB;
+  }
+
+  // Whether moving v to target keeps its faces (but those on the edge to
+  // other) oriented and non-degenerate.
+  bool keepsShape(int v, int other, float3 target) const {
+    for (int f : vertices[v].faces) {
+      const Face &face = faces[f];
+      if (sharesEdge(face, v, other)) {
+        continue;
+      }
+      float3 p[3];
+      for (int k = 0; k < 3; k++) {
+        p[k] = face.v[k] == v ? target : vertices[face.v[k]].p;
+      }
+      float3 n = faceNormal(p[0], p[1], p[2]);
+      if (dot(n, n) == 0.0f || dot(n, face.normal) < minNormalCosine) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool collapse(const Collapse &c) {
+    Vertex &va = vertices[c.a], &vb = vertices[c.b];
+    if (!va.alive || !vb.alive || va.version != c.versionA ||
+        vb.version != c.versionB) {
+      return false;
+    }
+    int shared = 0;
+    for (int f : va.faces) {
+      shared += sharesEdge(faces[f], c.a, c.b);
+    }
+    std::vector<int> na, nb, common;
+    neighbors(c.a, na);
+    neighbors(c.b, nb);
+    std::set_intersection(na.begin(), na.end(), nb.begin(), nb.end(),
+                          std::back_inserter(common));
+    if (shared == 0 || int(common.size()) != shared ||
+        !keepsShape(c.a, c.b, c.target) || !keepsShape(c.b, c.a, c.target)) {
+      return false;
+    }
+
+    for (int f : va.faces) {
+      if (sharesEdge(faces[f], c.a, c.b)) {
+        faces[f].alive = false;
+        nFaces--;
+      }
+    }
+    for (int f : vb.faces) {
+      Face &face = faces[f];
+      if (!face.alive) {
+        continue;
+      }
+      for (int k = 0; k < 3; k++) {
+        if (face.v[k] == c.b) {
+          face.v[k] = c.a;
+        }
+      }
+      va.faces.push_back(f);
+    }
+    va.p = c.target;
+    va.uv = c.uv;
+    va.q += vb.q;
+    va.version++;
+    vb.alive = false;
+    vb.version++;
+    vb.faces.clear();
+    std::vector<int> alive;
+    for (int f : va.faces) {
+      if (faces[f].alive) {
+        Face &face = faces[f];
+        face.normal = faceNormal(vertices[face.v[0]].p, vertices[face.v[1]].p,
+                                 vertices[face.v[2]].p);
+        alive.push_back(f);
+      }
+    }
+    va.faces.swap(alive);
+    worstMeanSquared = std::max(worstMeanSquared, c.meanSquared);
+
+    neighbors(c.a, na);
+    for (int n : na) {
+      queueEdge(c.a, n);
+    }
+    return true;
+  }
+
+public:
+  explicit Simplifier(const std::vector<MeshTriangle> &input) {
+    std::unordered_map<PositionKey, int, PositionHash> ids;
+    for (const MeshTriangle &t : input) {
+      Face face;
+      for (int k = 0; k < 3; k++) {
+        auto inserted = ids.emplace(keyOf(t.v[k]), int(vertices.size()));
+        if (inserted.second) {
+          Vertex v;
+          v.p = t.v[k];
+          v.uv = t.uv[k];
+          vertices.push_back(v);
+        }
+        face.v[k] = inserted.first->second;
+      }
+      if (face.v[0] == face.v[1] || face.v[1] == face.v[2] ||
+          face.v[0] == face.v[2]) {
+        continue;
+      }
+      face.normal = faceNormal(t.v[0], t.v[1], t.v[2]);
+      if (dot(face.normal, face.normal) == 0.0f) {
+        continue;
+      }
+      faces.push_back(face);
+    }
+    nFaces = int(faces.size());
+
+    std::unordered_map<uint64_t, int> edgeFaces;
+    for (int f = 0; f < int(faces.size()); f++) {
+      const Face &face = faces[f];
+      float3 n = face.normal;
+      double d = -dot(n, vertices[face.v[0]].p);
+      for (int k = 0; k < 3; k++) {
+        vertices[face.v[k]].faces.push_back(f);
+        vertices[face.v[k]].q.addPlane(n.x, n.y, n.z, d, 1.0);
+        edgeFaces[edgeKey(face.v[k], face.v[(k + 1) % 3])]++;
+      }
+    }
+    for (const Face &face : faces) {
+      for (int k = 0; k < 3; k++) {
+        int a = face.v[k], b = face.v[(k + 1) % 3];
+        if (edgeFaces[edgeKey(a, b)] != 1) {
+          continue;
+        }
+        float3 pa = vertices[a].p, pb = vertices[b].p;
+        float3 side = cross(pb - pa, face.normal);
+        float l = length(side);
+        if (l == 0.0f) {
+          continue;
+        }
+        side = side * (1.0f / l);
+        double d = -dot(side, pa);
+        vertices[a].q.addPlane(side.x, side.y, side.z, d, borderWeight);
+        vertices[b].q.addPlane(side.x, side.y, side.z, d, borderWeight);
+      }
+    }
+    for (const auto &edge : edgeFaces) {
+      queueEdge(int(edge.first >> 32), int(edge.first & 0xffffffffu));
+    }
+  }
+
+  int faceCount() const { return nFaces; }
+  // The largest RMS distance of a merged vertex to the planes of the
+  // input triangles it stands for, over the collapses so far.
+  float error() const { return float(std::sqrt(worstMeanSquared)); }
+
+  // Collapses until at most target faces are left or no edge can be
+  // collapsed.
+  void reduce(int target) {
+    while (nFaces > target && !queue.empty()) {
+      Collapse c = queue.top();
+      queue.pop();
+      collapse(c);
+    }
+  }
+
+  std::vector<MeshTriangle> triangles() const {
+    std::vector<MeshTriangle> out;
+    out.reserve(nFaces);
+    for (const Face &face : faces) {
+      if (!face.alive) {
+        continue;
+      }
+      MeshTriangle t;
+      for (int k = 0; k < 3; k++) {
+        t.v[k] = vertices[face.v[k]].p;
+        t.uv[k] = vertices[face.v[k]].uv;
+      }
+      t.normal = make_float3(0.0f, 0.0f, 0.0f);
+      out.push_back(t);
+    }
+    return out;
+  }
+};
+
+float distanceTo(const AABB &box, float3 p) {
+  float dx = maxf(maxf(box.lo.x - p.x, p.x - box.hi.x), 0.0f);
+  float dy = maxf(maxf(box.lo.y - p.y, p.y - box.hi.y), 0.0f);
+  float dz = maxf(maxf(box.lo.z - p.z, p.z - box.hi.z), 0.0f);
+  return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+// RMS angle between the normals of (a sample of) the input triangles and
+// of the level's surface under their centers, found by a ray along the
+// input normal through the center from distance reach on either side.
+float measureNormalError(CompressedMesh &level,
+                         const std::vector<MeshTriangle> &input,
+                         float reach) {
+  int stride = std::max(1, int(input.size()) / normalSamples);
+  double sum = 0.0;
+  int count = 0;
+  for (size_t i = 0; i < input.size(); i += stride) {
+    const MeshTriangle &t = input[i];
+    float3 n = cross(t.v[1] - t.v[0], t.v[2] - t.v[0]);
+    float l = length(n);
+    if (l == 0.0f) {
+      continue;
+    }
+    n = n * (1.0f / l);
+    float3 center = (t.v[0] + t.v[1] + t.v[2]) * (1.0f / 3.0f);
+    Ray ray(center + n * reach, n * -1.0f);
+    float3 point, normal, color;
+    if (!level.intersect(ray, point, normal, color) ||
+        length(point - ray.origin) > 2.0f * reach) {
+      continue;
+    }
+    float cosine = std::fabs(dot(normal, n)) / length(normal);
+    float angle = std::acos(std::min(cosine, 1.0f));
+    sum += double(angle) * angle;
+    count++;
+  }
+  return count > 0 ? float(std::sqrt(sum / count)) : 0.0f;
+}
+
+} // namespace
+
+void LodMesh::build(const std::vector<MeshTriangle> &input, int maxLevels,
+                    float reduction, int minTriangles) {
+  levels.clear();
+  errors.clear();
+  normalErrors.clear();
+  box = AABB();
+  levels.emplace_back(new CompressedMesh(color));
+  levels.back()->build(input);
+  errors.push_back(0.0f);
+  normalErrors.push_back(0.0f);
+  // Rays for the normal errors start this far out at least.
+  AABB inputBox = levels[0]->bounds();
+  float minReach = 1e-4f * length(inputBox.hi - inputBox.lo);
+
+  Simplifier simplifier(input);
+  int full = simplifier.faceCount();
+  int previous = full;
+  while (int(levels.size()) < maxLevels && previous > minTriangles) {
+    simplifier.reduce(std::max(minTriangles, int(previous * reduction)));
+    int count = simplifier.faceCount();
+    if (count > previous * (1.0f - minProgress)) {
+      break;
+    }
+    // About as many blocks as level 0: the tests per ray drop with the
+    // triangles instead of growing with the looser blocks of the coarser
+    // triangles.
+    levels.emplace_back(new CompressedMesh(color));
+    levels.back()->leafSize = std::max(
+        1, int(CompressedMesh::maxBlockSize * float(count) / full + 0.5f));
+    levels.back()->build(simplifier.triangles());
+    errors.push_back(simplifier.error());
+    normalErrors.push_back(measureNormalError(
+        *levels.back(), input, std::max(4.0f * errors.back(), minReach)));
+    previous = count;
+  }
+  for (auto &level : levels) {
+    level->setShader(shader);
+    box.grow(level->bounds());
+  }
+}
+
+size_t LodMesh::memoryBytes() const {
+  size_t bytes = sizeof(*this);
+  for (const auto &level : levels) {
+    bytes += level->memoryBytes();
+  }
+  return bytes;
+}
+
+int LodMesh::selectLevel(const Ray &ray) const {
+  int last = int(levels.size()) - 1;
+  if (forcedLevel >= 0) {
+    return std::min(forcedLevel, last);
+  }
+  if (ray.source == this) {
+    return std::min(ray.sourceLevel, last);
+  }
+  if (ray.coneSpread <= 0.0f) {
+    return 0;
+  }
+  float distance = distanceTo(box, ray.origin);
+  float tolerance = pixelError * (ray.coneWidth + ray.coneSpread * distance);
+  float maxAngle = maxNormalError;
+  if (ray.generation > 0) {
+    tolerance *= secondaryScale;
+    maxAngle *= secondaryScale;
+  }
+  int level = 0;
+  while (level < last && errors[level + 1] <= tolerance &&
+         normalErrors[level + 1] <= maxAngle) {
+    level++;
+  }
+  return level;
+}
+
+void LodMesh::setShader(TriangleShader *triangleShader) {
+  shader = triangleShader;
+#ifndef __CUDA_ARCH__
+  for (auto &level : levels) {
+    level->setShader(triangleShader);
+  }
+#endif
+}
+
+bool LodMesh::intersect(Ray &ray, float3 &outIntersectionPoint,
+                        float3 &outNormal, float3 &outColor) {
+#ifndef __CUDA_ARCH__
+  if (levels.empty()) {
+    return false;
+  }
+  return levels[selectLevel(ray)]->intersect(ray, outIntersectionPoint,
+                                             outNormal, outColor);
+#else
+  return false;
+#endif
+}
+
+void LodMesh::transform(mat3x3 &transformMatrix) {
+#ifndef __CUDA_ARCH__
+  box = AABB();
+  for (auto &level : levels) {
+    level->transform(transformMatrix);
+    box.grow(level->bounds());
+  }
+#endif
+}
+
+float3 LodMesh::excite(Scene *scene, Ray &incidentRay,
+                       Intersection &intersection) {
+#ifndef __CUDA_ARCH__
+  if (!levels.empty()) {
+    // The same level as intersect; the rays the shader spawns leave it.
+    intersection.level = selectLevel(incidentRay);
+    return levels[intersection.level]->excite(scene, incidentRay,
+                                              intersection);
+  }
+#endif
+  return color;
+}
+
+SurfaceResponse LodMesh::respond(Ray &incidentRay,
+                                 Intersection &intersection) {
+#ifndef __CUDA_ARCH__
+  if (!levels.empty()) {
+    intersection.level = selectLevel(incidentRay);
+    return levels[intersection.level]->respond(incidentRay, intersection);
+  }
+#endif
+  SurfaceResponse response;
+  response.shaded = false;
+  response.diffuseColor = color;
+  response.reflect = false;
+  response.refract = false;
+  response.refractiveIndex = 1.0f;
+  return response;
+}
+
+} // namespace raytracer_cu
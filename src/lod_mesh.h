@@ -0,0 +1,90 @@
+#ifndef LOD_MESH_H
+#define LOD_MESH_H
+
+#include <memory>
+#include <vector>
+
+#include "cuda_runtime.h"
+
+#include "aabb.h"
+#include "compressed_mesh.h"
+#include "math.h"
+#include "raytracer_basics.h"
+#include "triangle.h"
+
+namespace raytracer_cu {
+
+/*
+A triangle mesh with precomputed levels of detail, as one Object. build()
+keeps the input as level 0 and simplifies it by edge collapses (Garland and
+Heckbert, "Surface Simplification Using Quadric Error Metrics", 1997) into
+coarser levels of about `reduction` times the triangles of the previous
+one, down to minTriangles. Every level is a CompressedMesh with its own
+BVH, with blocks of fewer triangles (CompressedMesh::leafSize) the fewer
+triangles it has: the simplified triangles are long and irregular and give
+looser blocks than the input, so that at full block size the coarse levels
+cost as many ray-triangle tests as level 0. levelError(i) is how far level
+i strays from the input: the largest RMS distance of a merged vertex to
+the planes of the input triangles it replaces (world units, before
+transforms). normalError(i) is the RMS angle between the input normals and
+the level's normals under them (radians).
+
+Each ray picks the coarsest level whose error is under pixelError times
+the width of its pixel cone (Ray::coneWidth, coneSpread) at the nearest
+point of the mesh bounds and whose normal error is under maxNormalError.
+The faces are shaded flat, so the normals bound the change in shading
+however small the mesh is on screen: a diffuse surface changes by about
+the angle, a mirror's reflection turns by twice the angle. Shadow,
+reflected and refracted rays (Ray::generation > 0) accept secondaryScale
+times both errors: detail seen in a reflection matters less. Rays leaving
+this mesh (Ray::source) use the level of the surface they leave, so that
+it does not shadow or reflect itself at another level; excite and respond
+put that level in the Intersection for the shader. Rays without a cone
+(queries, the wavefront queues) use level 0. The level only depends on the ray, so a ray hits the
+same surface whichever thread or batch traces it.
+
+The levels are different meshes, so the silhouettes of distant meshes
+shift slightly when the camera moves. Host only, like CompressedMesh.
+*/
+class LodMesh : public Object {
+private:
+  std::vector<std::unique_ptr<CompressedMesh>> levels;
+  std::vector<float> errors, normalErrors;
+  AABB box; // of all levels, in world space
+
+public:
+  TriangleShader *shader = nullptr;
+  float pixelError = 1.0f;
+  float maxNormalError = 0.03f; // radians, about 8 steps of 255 diffuse
+  float secondaryScale = 4.0f;
+  int forcedLevel = -1; // >= 0: every ray uses this level (clamped)
+
+  LodMesh(float3 color) : Object(color) {}
+  void build(const std::vector<MeshTriangle> &input, int maxLevels = 6,
+             float reduction = 0.5f, int minTriangles = 64);
+
+  int levelCount() const { return int(levels.size()); }
+  int triangleCount(int level) const {
+    return levels[level]->triangleCount();
+  }
+  float levelError(int level) const { return errors[level]; }
+  float normalError(int level) const { return normalErrors[level]; }
+  size_t memoryBytes() const;
+  // The level a ray would intersect.
+  int selectLevel(const Ray &ray) const;
+
+  CUDA_HOSTDEV void setShader(TriangleShader *triangleShader);
+  CUDA_HOSTDEV Shader *getShader() { return shader; }
+  CUDA_HOSTDEV bool intersect(Ray &ray, float3 &outIntersectionPoint,
+                              float3 &outNormal, float3 &outColor);
+  CUDA_HOSTDEV void transform(mat3x3 &transformMatrix);
+  CUDA_HOSTDEV AABB bounds() { return box; }
+  CUDA_HOSTDEV float3 excite(Scene *scene, Ray &incidentRay,
+                             Intersection &intersection);
+  CUDA_HOSTDEV SurfaceResponse respond(Ray &incidentRay,
+                                       Intersection &intersection);
+};
+
+} // namespace raytracer_cu
+
+#endif
@@ -1,18 +1,69 @@
 #ifndef MATH_H
 #define MATH_H
 
+#include <cmath>
+#include <cstdio>
 #include <ostream>
 
 #include "cudastuff.h"
 #include "cuda_runtime.h"
 
+// The math library is header-only: every function is inline so the host
+// compiler can fold the vector operations into the intersection and shading
+// loops without relying on LTO, and nvcc sees the bodies in every TU.
+
 namespace raytracer_cu {
 
-CUDA_HOSTDEV void printv(float3& a);
+CUDA_HOSTDEV constexpr float sq(float x) { return x * x; }
+
+CUDA_HOSTDEV inline float abs(float x) {
+#ifdef __CUDA_ARCH__
+  return fabsf(x);
+#else
+  return std::abs(x);
+#endif
+}
+
+CUDA_HOSTDEV inline float sqrt(float x) {
+#ifdef __CUDA_ARCH__
+  return sqrtf(x);
+#else
+  return std::sqrt(x);
+#endif
+}
+
+CUDA_HOSTDEV inline void printv(float3 &a) {
+  printf("(%.2f %.2f %.2f) ", a.x, a.y, a.z);
+}
+
+// =======================================================
+// Matrix functions
+// =======================================================
+
+/*
+
+A, B: matrices
+s:    scalar
+v:    vector (float3)
 
-CUDA_HOSTDEV float sq(float x);
-CUDA_HOSTDEV float abs(float x);
-CUDA_HOSTDEV float sqrt(float x);
+C=mm(A,B): C=A*B, *: matrix multiplication
+C=A+B
+B=mm(A,s): B=A*s
+B=mm(s,A): B=s*A
+B=mm(A,v): B=A*v
+B=mm(v,A): B=v*A
+A=eye() for sqared matrices
+A=zeros() any shape
+B=inverse(A): 3x3 only, A must not be singular
+
+Affine transforms are stored as 3x4 matrices [R|t]:
+
+M=affine(R, t)
+M=mm(M1, M2): M=M1*M2 (the implicit last row is [0 0 0 1])
+p'=transformPoint(M, p):     p'=R*p+t
+v'=transformDirection(M, v): v'=R*v
+
+*/
 
 template <int N, int M> class Mat {
 public:
@@ -20,40 +71,303 @@ public:
   CUDA_HOSTDEV Mat() {}
 };
 typedef Mat<3, 3> mat3x3;
+typedef Mat<3, 4> mat3x4;
 
-CUDA_HOSTDEV void printm(mat3x3& a);
+CUDA_HOSTDEV inline void printm(mat3x3 &a) {
+  printf("Matrix:\n");
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      printf("%.2f ", a.data[i][j]);
+    }
+    printf("\n");
+  }
+}
 
 template <int N, int M, int K>
-CUDA_HOSTDEV Mat<N, K> mm(Mat<N, M> a, Mat<M, K> b);
-template <int N, int M> CUDA_HOSTDEV Mat<N, M> matadd(Mat<N, M> a, Mat<N, M> b);
-template <int N, int M> CUDA_HOSTDEV Mat<N, M> mm(Mat<N, M> a, float s);
-template <int N, int M> CUDA_HOSTDEV Mat<N, M> mm(float s, Mat<N, M> a);
-template <int N> CUDA_HOSTDEV float3 mm(mat3x3 a, float3 v);
-template <int N> CUDA_HOSTDEV float3 mm(float3 v, mat3x3 a);
-template <int N> CUDA_HOSTDEV Mat<N, N> eye();
-template <int N, int M> CUDA_HOSTDEV Mat<N, M> zeros();
-
-CUDA_HOSTDEV float dot(float3 a, float3 b);
-CUDA_HOSTDEV float3 cross(float3 a, float3 b);
-CUDA_HOSTDEV float3 operator+(float3 a, float3 b);
-CUDA_HOSTDEV float3 operator-(float3 a, float3 b);
-CUDA_HOSTDEV float3 operator*(float3 a, float3 b);
-CUDA_HOSTDEV float3 operator*(float a, float3 b);
-CUDA_HOSTDEV float3 operator*(float3 a, float b);
-//CUDA_HOSTDEV float3 operator/(float3 a, float b);
-CUDA_HOSTDEV float3 div(float3 a, float b);
-CUDA_HOSTDEV float3 operator/(float3 a, float3 b);
-CUDA_HOSTDEV float length(float3 a);
-CUDA_HOSTDEV float3 norm(float3 a);
-CUDA_HOST std::ostream &operator<<(std::ostream &os, float3 x);
-
-CUDA_HOSTDEV float2 operator+(float2 a, float2 b);
-CUDA_HOSTDEV float2 operator-(float2 a, float2 b);
-CUDA_HOSTDEV float2 operator*(float2 a, float2 b);
-CUDA_HOSTDEV float2 operator*(float a, float2 b);
-CUDA_HOSTDEV float2 operator*(float2 a, float b);
-CUDA_HOSTDEV float2 operator/(float2 a, float b);
+CUDA_HOSTDEV inline Mat<N, K> mm(const Mat<N, M> &a, const Mat<M, K> &b) {
+  Mat<N, K> c;
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < K; j++) {
+      float dot = 0.0f;
+      for (int k = 0; k < M; k++) {
+        dot += a.data[i][k] * b.data[k][j];
+      }
+      c.data[i][j] = dot;
+    }
+  }
+  return c;
+}
+
+// The 3x3 product is on the model and view transform path, spell it out.
+template <>
+CUDA_HOSTDEV inline mat3x3 mm<3, 3, 3>(const mat3x3 &a, const mat3x3 &b) {
+  mat3x3 c;
+  for (int i = 0; i < 3; i++) {
+    c.data[i][0] = a.data[i][0] * b.data[0][0] + a.data[i][1] * b.data[1][0] +
+                   a.data[i][2] * b.data[2][0];
+    c.data[i][1] = a.data[i][0] * b.data[0][1] + a.data[i][1] * b.data[1][1] +
+                   a.data[i][2] * b.data[2][1];
+    c.data[i][2] = a.data[i][0] * b.data[0][2] + a.data[i][1] * b.data[1][2] +
+                   a.data[i][2] * b.data[2][2];
+  }
+  return c;
+}
+
+template <int N, int M>
+CUDA_HOSTDEV inline Mat<N, M> matadd(const Mat<N, M> &a, const Mat<N, M> &b) {
+  Mat<N, M> c;
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < M; j++) {
+      c.data[i][j] = a.data[i][j] + b.data[i][j];
+    }
+  }
+  return c;
+}
+
+template <int N, int M>
+CUDA_HOSTDEV inline Mat<N, M> mm(const Mat<N, M> &a, float s) {
+  Mat<N, M> c;
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < M; j++) {
+      c.data[i][j] = a.data[i][j] * s;
+    }
+  }
+  return c;
+}
+
+template <int N, int M>
+CUDA_HOSTDEV inline Mat<N, M> mm(float s, const Mat<N, M> &a) {
+  return mm(a, s);
+}
+
+// N is kept for source compatibility with the mm<3>(A, v) call sites, only
+// the 3x3 case exists.
+template <int N> CUDA_HOSTDEV inline float3 mm(const mat3x3 &a, float3 v) {
+  return make_float3(a.data[0][0] * v.x + a.data[0][1] * v.y + a.data[0][2] * v.z,
+                     a.data[1][0] * v.x + a.data[1][1] * v.y + a.data[1][2] * v.z,
+                     a.data[2][0] * v.x + a.data[2][1] * v.y + a.data[2][2] * v.z);
+}
+
+template <int N> CUDA_HOSTDEV inline float3 mm(float3 v, const mat3x3 &a) {
+  return make_float3(v.x * a.data[0][0] + v.y * a.data[1][0] + v.z * a.data[2][0],
+                     v.x * a.data[0][1] + v.y * a.data[1][1] + v.z * a.data[2][1],
+                     v.x * a.data[0][2] + v.y * a.data[1][2] + v.z * a.data[2][2]);
+}
+
+template <int N> CUDA_HOSTDEV inline Mat<N, N> eye() {
+  Mat<N, N> result;
+  for (int i = 0; i < N; i++) {
+    result.data[i][i] = 1;
+  }
+  return result;
+}
+
+template <int N, int M> CUDA_HOSTDEV inline Mat<N, M> zeros() {
+  return Mat<N, M>();
+}
+
+CUDA_HOSTDEV inline mat3x3 inverse(const mat3x3 &a) {
+  const float(*m)[3] = a.data;
+  float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+  float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+  float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+  float invDet = 1.0f / (m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02);
+  mat3x3 r;
+  r.data[0][0] = c00 * invDet;
+  r.data[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet;
+  r.data[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet;
+  r.data[1][0] = c01 * invDet;
+  r.data[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet;
+  r.data[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet;
+  r.data[2][0] = c02 * invDet;
+  r.data[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet;
+  r.data[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet;
+  return r;
+}
+
+CUDA_HOSTDEV inline mat3x3 getRotationMatrixX(float rotRad) {
+  // Rotates around the X axis
+  mat3x3 rot;
+  rot.data[0][0] = 1.;
+  rot.data[1][1] = cos(rotRad);
+  rot.data[1][2] = -sin(rotRad);
+  rot.data[2][1] = sin(rotRad);
+  rot.data[2][2] = cos(rotRad);
+  return rot;
+}
+
+CUDA_HOSTDEV inline mat3x3 getRotationMatrixY(float rotRad) {
+  // Rotates around the Y axis
+  mat3x3 rot;
+  rot.data[1][1] = 1.;
+  rot.data[0][0] = cos(rotRad);
+  rot.data[2][0] = -sin(rotRad);
+  rot.data[0][2] = sin(rotRad);
+  rot.data[2][2] = cos(rotRad);
+  return rot;
+}
+
+CUDA_HOSTDEV inline mat3x3 getRotationMatrixZ(float rotRad) {
+  // Rotates around the z axis
+  mat3x3 rot;
+  rot.data[2][2] = 1.;
+  rot.data[0][0] = cos(rotRad);
+  rot.data[1][0] = -sin(rotRad);
+  rot.data[0][1] = sin(rotRad);
+  rot.data[1][1] = cos(rotRad);
+  return rot;
+}
+
+CUDA_HOSTDEV inline mat3x4 affine(const mat3x3 &rot, float3 t) {
+  mat3x4 m;
+  for (int i = 0; i < 3; i++) {
+    m.data[i][0] = rot.data[i][0];
+    m.data[i][1] = rot.data[i][1];
+    m.data[i][2] = rot.data[i][2];
+  }
+  m.data[0][3] = t.x;
+  m.data[1][3] = t.y;
+  m.data[2][3] = t.z;
+  return m;
+}
+
+CUDA_HOSTDEV inline mat3x4 mm(const mat3x4 &a, const mat3x4 &b) {
+  mat3x4 c;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 4; j++) {
+      c.data[i][j] = a.data[i][0] * b.data[0][j] + a.data[i][1] * b.data[1][j] +
+                     a.data[i][2] * b.data[2][j];
+    }
+    c.data[i][3] += a.data[i][3];
+  }
+  return c;
+}
+
+CUDA_HOSTDEV inline float3 transformPoint(const mat3x4 &m, float3 p) {
+  return make_float3(
+      m.data[0][0] * p.x + m.data[0][1] * p.y + m.data[0][2] * p.z + m.data[0][3],
+      m.data[1][0] * p.x + m.data[1][1] * p.y + m.data[1][2] * p.z + m.data[1][3],
+      m.data[2][0] * p.x + m.data[2][1] * p.y + m.data[2][2] * p.z + m.data[2][3]);
+}
+
+CUDA_HOSTDEV inline float3 transformDirection(const mat3x4 &m, float3 v) {
+  return make_float3(m.data[0][0] * v.x + m.data[0][1] * v.y + m.data[0][2] * v.z,
+                     m.data[1][0] * v.x + m.data[1][1] * v.y + m.data[1][2] * v.z,
+                     m.data[2][0] * v.x + m.data[2][1] * v.y + m.data[2][2] * v.z);
+}
+
+// =======================================================
+// float3 overloads
+// =======================================================
+
+/*
+v, v1, v2:  float3
+s:          scalar
+
+s=dot(v1, v2): v=v1.v2
+v=cross(v1, v2) v=v1xv2
+  see: https://registry.khronos.org/OpenGL-Refpages/gl4/html/cross.xhtml
+v=v1+v2
+v=v1-v2
+v=v1*v2 (elementwise multiplication)
+v'=s*v
+v'=v*s
+v'=v/s
+v'=length(v): v'=|v| (L2 of V)
+v'=norm(v): v'=v/|v|
+
+*/
+
+CUDA_HOSTDEV constexpr float dot(float3 a, float3 b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+CUDA_HOSTDEV inline float3 cross(float3 a, float3 b) {
+  return make_float3(a.y * b.z - b.y * a.z, a.z * b.x - b.z * a.x,
+                     a.x * b.y - b.x * a.y);
+}
+
+CUDA_HOSTDEV inline float3 operator+(float3 a, float3 b) {
+  return make_float3(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+CUDA_HOSTDEV inline float3 operator-(float3 a, float3 b) {
+  return make_float3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+CUDA_HOSTDEV inline float3 operator*(float3 a, float3 b) {
+  return make_float3(a.x * b.x, a.y * b.y, a.z * b.z);
+}
+
+CUDA_HOSTDEV inline float3 operator*(float a, float3 b) {
+  return make_float3(a * b.x, a * b.y, a * b.z);
+}
+
+CUDA_HOSTDEV inline float3 operator*(float3 a, float b) {
+  return make_float3(a.x * b, a.y * b, a.z * b);
+}
+
+CUDA_HOSTDEV inline float3 div(float3 a, float b) {
+  return make_float3(a.x / b, a.y / b, a.z / b);
+}
+
+CUDA_HOSTDEV inline float3 operator/(float3 a, float3 b) {
+  return make_float3(a.x / b.x, a.y / b.y, a.z / b.z);
+}
+
+CUDA_HOSTDEV inline float length(float3 a) {
+#ifdef __CUDA_ARCH__
+  return norm3df(a.x, a.y, a.z);
+#else
+  return std::sqrt(sq(a.x) + sq(a.y) + sq(a.z));
+#endif
+}
+
+CUDA_HOSTDEV inline float3 norm(float3 a) {
+#ifdef __CUDA_ARCH__
+  float invLen = rnorm3df(a.x, a.y, a.z);
+  return a * invLen;
+#else
+  float len = std::sqrt(sq(a.x) + sq(a.y) + sq(a.z));
+  return div(a, len);
+#endif
+}
+
+CUDA_HOST inline std::ostream &operator<<(std::ostream &os, float3 v) {
+  os << v.x << "," << v.y << "," << v.z;
+  return os;
+}
+
+// =======================================================
+// float2 overloads
+// =======================================================
+
+CUDA_HOSTDEV inline float2 operator+(float2 a, float2 b) {
+  return make_float2(a.x + b.x, a.y + b.y);
+}
+
+CUDA_HOSTDEV inline float2 operator-(float2 a, float2 b) {
+  return make_float2(a.x - b.x, a.y - b.y);
+}
+
+CUDA_HOSTDEV inline float2 operator*(float2 a, float2 b) {
+  return make_float2(a.x * b.x, a.y * b.y);
+}
+
+CUDA_HOSTDEV inline float2 operator*(float a, float2 b) {
+  return make_float2(a * b.x, a * b.y);
+}
+
+CUDA_HOSTDEV inline float2 operator*(float2 a, float b) {
+  return make_float2(a.x * b, a.y * b);
+}
+
+CUDA_HOSTDEV inline float2 operator/(float2 a, float b) {
+  return make_float2(a.x / b, a.y / b);
+}
+
+// =======================================================
 
 } // namespace raytracer_cu
 
-#endif
\ No newline at end of file
+#endif
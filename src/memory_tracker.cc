@@ -0,0 +1,161 @@
+#include "memory_tracker.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace raytracer_cu {
+
+namespace {
+
+const char *tagNames[nMemoryTags] = {
+    "geometry",     "materials", "textures", "framebuffers",
+    "accel struct", "transient", "other"};
+
+std::string formatBytes(int64_t bytes) {
+  char text[32];
+  if (bytes >= (int64_t(1) << 20) || bytes <= -(int64_t(1) << 20)) {
+    snprintf(text, sizeof(text), "%.2f MB", bytes / double(1 << 20));
+  } else if (bytes >= 1024 || bytes <= -1024) {
+    snprintf(text, sizeof(text), "%.1f kB", bytes / 1024.0);
+  } else {
+    snprintf(text, sizeof(text), "%lld B", (long long)bytes);
+  }
+  return text;
+}
+
+} // namespace
+
+const char *memoryTagName(MemoryTag tag) { return tagNames[int(tag)]; }
+
+MemoryTracker &MemoryTracker::instance() {
+  // Never destroyed: objects freed by static destructors after main still
+  // find it.
+  static MemoryTracker *tracker = new MemoryTracker();
+  return *tracker;
+}
+
+bool MemoryTracker::enabled() {
+#ifdef RAYTRACER_MEMORY_TRACKING
+  return true;
+#else
+  return false;
+#endif
+}
+
+void MemoryTracker::allocated(const void *p, size_t bytes, MemoryTag tag,
+                              const char *site) {
+  if (!p) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    live[p] = Allocation{tag, bytes, site};
+  }
+  Counters &c = counters[int(tag)];
+  c.allocations.fetch_add(1, std::memory_order_relaxed);
+  int64_t current = c.currentBytes.fetch_add(int64_t(bytes)) + int64_t(bytes);
+  int64_t peak = c.peakBytes.load();
+  while (current > peak && !c.peakBytes.compare_exchange_weak(peak, current)) {
+  }
+}
+
+void MemoryTracker::freed(const void *p) {
+  if (!p) {
+    return;
+  }
+  Allocation allocation;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = live.find(p);
+    if (it == live.end()) {
+      return;
+    }
+    allocation = it->second;
+    live.erase(it);
+  }
+  Counters &c = counters[int(allocation.tag)];
+  c.frees.fetch_add(1, std::memory_order_relaxed);
+  c.currentBytes.fetch_sub(int64_t(allocation.bytes));
+}
+
+MemoryTagStats MemoryTracker::stats(MemoryTag tag) const {
+  const Counters &c = counters[int(tag)];
+  MemoryTagStats s;
+  s.currentBytes = c.currentBytes.load();
+  s.peakBytes = c.peakBytes.load();
+  s.allocations = c.allocations.load();
+  s.frees = c.frees.load();
+  return s;
+}
+
+void MemoryTracker::resetPeaks() {
+  for (Counters &c : counters) {
+    c.peakBytes.store(c.currentBytes.load());
+  }
+}
+
+void MemoryTracker::printStats(std::ostream &os) const {
+  char line[128];
+  snprintf(line, sizeof(line), "%-14s %12s %12s %10s %10s\n", "memory",
+           "current", "peak", "allocs", "frees");
+  os << line;
+  MemoryTagStats total;
+  for (int t = 0; t < nMemoryTags; t++) {
+    MemoryTagStats s = stats(MemoryTag(t));
+    snprintf(line, sizeof(line), "%-14s %12s %12s %10llu %10llu\n",
+             tagNames[t], formatBytes(s.currentBytes).c_str(),
+             formatBytes(s.peakBytes).c_str(),
+             (unsigned long long)s.allocations, (unsigned long long)s.frees);
+    os << line;
+    total.currentBytes += s.currentBytes;
+    total.peakBytes += s.peakBytes;
+    total.allocations += s.allocations;
+    total.frees += s.frees;
+  }
+  // The peaks of the tags need not coincide, their sum bounds the total.
+  snprintf(line, sizeof(line), "%-14s %12s %12s %10llu %10llu\n", "total",
+           formatBytes(total.currentBytes).c_str(),
+           formatBytes(total.peakBytes).c_str(),
+           (unsigned long long)total.allocations,
+           (unsigned long long)total.frees);
+  os << line;
+}
+
+size_t MemoryTracker::printLeaks(std::ostream &os) {
+  struct Group {
+    size_t count = 0;
+    size_t bytes = 0;
+  };
+  std::map<std::pair<int, std::string>, Group> groups;
+  size_t nLive;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    nLive = live.size();
+    for (const auto &entry : live) {
+      Group &g = groups[std::make_pair(int(entry.second.tag),
+                                       std::string(entry.second.site))];
+      g.count++;
+      g.bytes += entry.second.bytes;
+    }
+  }
+  std::vector<std::pair<std::pair<int, std::string>, Group>> sorted(
+      groups.begin(), groups.end());
+  std::sort(sorted.begin(), sorted.end(),
+            [](const std::pair<std::pair<int, std::string>, Group> &a,
+               const std::pair<std::pair<int, std::string>, Group> &b) {
+              return a.second.bytes > b.second.bytes;
+            });
+  os << nLive << " allocations still live\n";
+  for (const auto &group : sorted) {
+    os << "  " << tagNames[group.first.first] << ", " << group.second.count
+       << " x, " << formatBytes(int64_t(group.second.bytes)) << ": "
+       << group.first.second << "\n";
+  }
+  return nLive;
+}
+
+} // namespace raytracer_cu
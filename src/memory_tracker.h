@@ -0,0 +1,146 @@
+#ifndef MEMORY_TRACKER_H
+#define MEMORY_TRACKER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <unordered_map>
+
+#include "cudastuff.h"
+
+namespace raytracer_cu {
+
+// What an allocation is for.
+enum class MemoryTag : int {
+  geometry,               // objects and the arrays holding them
+  materials,              // shaders
+  textures,               // texel arrays, host and device
+  framebuffers,           // color and G-buffers
+  accelerationStructures, // BVH nodes and their build state
+  transient,              // per frame scratch (queues, keys)
+  other,
+};
+const int nMemoryTags = int(MemoryTag::other) + 1;
+const char *memoryTagName(MemoryTag tag);
+
+struct MemoryTagStats {
+  int64_t currentBytes = 0;
+  int64_t peakBytes = 0;
+  uint64_t allocations = 0;
+  uint64_t frees = 0;
+};
+
+/*
+Byte counts of the allocations of the host code and of the device buffers
+the host allocates (cudaMalloc), per MemoryTag. allocated() / freed() are
+called through the MEMORY_* macros below at the allocation sites:
+
+  EasyVector       its tag (other unless the owner sets one: the scene's
+                   objects are geometry, the BVH arrays acceleration
+                   structures, ...)
+  ColorBuffer      textures (the texels it owns)
+  Object, Shader   geometry, materials (class operator new)
+  Renderer         frame buffers, transient queues, texture data
+
+Every live allocation is kept with its tag, size and site (file:line, or
+the element type for EasyVector), so leaks can be listed; current and peak
+bytes per tag are kept as atomics, stats() reads them at any time. Allocations made by device code (new in a
+kernel, e.g. the scene the device renderer builds) are not counted.
+
+The macros compile to nothing unless RAYTRACER_MEMORY_TRACKING is defined
+(the CMake option of the same name, off in Release builds); the tracker
+itself is always there, it then stays empty.
+*/
+class MemoryTracker {
+private:
+  struct Counters {
+    std::atomic<int64_t> currentBytes{0};
+    std::atomic<int64_t> peakBytes{0};
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> frees{0};
+  };
+  struct Allocation {
+    MemoryTag tag;
+    size_t bytes;
+    const char *site;
+  };
+
+  Counters counters[nMemoryTags];
+  std::mutex mutex;
+  std::unordered_map<const void *, Allocation> live;
+
+public:
+  static MemoryTracker &instance();
+  // Whether the MEMORY_* macros record anything in this build.
+  static bool enabled();
+
+  void allocated(const void *p, size_t bytes, MemoryTag tag,
+                 const char *site);
+  // p of an earlier allocated(), unknown pointers are ignored.
+  void freed(const void *p);
+
+  MemoryTagStats stats(MemoryTag tag) const;
+  // Peaks start over at the current bytes, e.g. once per frame.
+  void resetPeaks();
+  // Current and peak bytes per tag.
+  void printStats(std::ostream &os) const;
+  // The live allocations grouped by tag and site, largest first; returns
+  // how many there are.
+  size_t printLeaks(std::ostream &os);
+};
+
+#define MEMORY_STRINGIZE_(x) #x
+#define MEMORY_STRINGIZE(x) MEMORY_STRINGIZE_(x)
+#define MEMORY_SITE __FILE__ ":" MEMORY_STRINGIZE(__LINE__)
+
+#if defined(RAYTRACER_MEMORY_TRACKING) && !defined(__CUDA_ARCH__)
+#define MEMORY_ALLOCATED_AT(p, bytes, tag, site)                              \
+  ::raytracer_cu::MemoryTracker::instance().allocated(p, bytes, tag, site)
+#define MEMORY_FREED(p) ::raytracer_cu::MemoryTracker::instance().freed(p)
+#else
+#define MEMORY_ALLOCATED_AT(p, bytes, tag, site) ((void)0)
+#define MEMORY_FREED(p) ((void)0)
+#endif
+#define MEMORY_ALLOCATED(p, bytes, tag)                                       \
+  MEMORY_ALLOCATED_AT(p, bytes, tag, MEMORY_SITE)
+
+// Allocation for class operator new, from the device heap in device code.
+CUDA_HOSTDEV inline void *taggedNew(size_t bytes, MemoryTag tag,
+                                    const char *site) {
+  (void)tag; // only recorded when tracking
+  (void)site;
+#ifdef __CUDA_ARCH__
+  return malloc(bytes);
+#else
+  void *p = ::operator new(bytes);
+  MEMORY_ALLOCATED_AT(p, bytes, tag, site);
+  return p;
+#endif
+}
+
+CUDA_HOSTDEV inline void taggedDelete(void *p) {
+#ifdef __CUDA_ARCH__
+  free(p);
+#else
+  MEMORY_FREED(p);
+  ::operator delete(p);
+#endif
+}
+
+// Counts the objects of a class and of its subclasses under tag, the site
+// is the class definition.
+#define MEMORY_TAGGED_NEW(tag)                                                \
+  CUDA_HOSTDEV static void *operator new(size_t bytes) {                      \
+    return ::raytracer_cu::taggedNew(bytes, tag, MEMORY_SITE);                \
+  }                                                                           \
+  CUDA_HOSTDEV static void operator delete(void *p) {                         \
+    ::raytracer_cu::taggedDelete(p);                                          \
+  }
+
+} // namespace raytracer_cu
+
+#endif
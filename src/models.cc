@@ -1,5 +1,6 @@
 #include "models.h"
 
+#include <cmath>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -85,4 +86,45 @@ EasyVector<Triangle *> Models::createBox(float3 center, float edgeSize,
   return mesh;
 }
 
+EasyVector<Triangle *> Models::createSphereMesh(float3 center, float radius,
+                                                int rings, int segments,
+                                                const float3 &color) {
+  const float pi = 3.14159265f;
+  EasyVector<Triangle *> mesh;
+  for (int ring = 0; ring < rings; ring++) {
+    float theta0 = pi * ring / rings;
+    float theta1 = pi * (ring + 1) / rings;
+    for (int segment = 0; segment < segments; segment++) {
+      float phi0 = 2.0f * pi * segment / segments;
+      float phi1 = 2.0f * pi * (segment + 1) / segments;
+      float3 corners[4];
+      float2 uvs[4];
+      float thetas[4] = {theta0, theta1, theta1, theta0};
+      float phis[4] = {phi0, phi0, phi1, phi1};
+      for (int k = 0; k < 4; k++) {
+        corners[k] = center + radius * make_float3(sinf(thetas[k]) * cosf(phis[k]),
+                                                   cosf(thetas[k]),
+                                                   sinf(thetas[k]) * sinf(phis[k]));
+        uvs[k] = make_float2(phis[k] / (2.0f * pi), thetas[k] / pi);
+      }
+      // Wound so that the normals point outwards.
+      if (ring > 0) {
+        Triangle *t = new Triangle(corners[0], corners[3], corners[1], color);
+        t->texCoord0 = uvs[0];
+        t->texCoord1 = uvs[3];
+        t->texCoord2 = uvs[1];
+        mesh.push_back(t);
+      }
+      if (ring < rings - 1) {
+        Triangle *t = new Triangle(corners[1], corners[3], corners[2], color);
+        t->texCoord0 = uvs[1];
+        t->texCoord1 = uvs[3];
+        t->texCoord2 = uvs[2];
+        mesh.push_back(t);
+      }
+    }
+  }
+  return mesh;
+}
+
 } // namespace raytracer_cu
\ No newline at end of file
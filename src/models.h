@@ -16,6 +16,11 @@ public:
                 float3 bottomLeft, const float3 &color);
   CUDA_HOSTDEV static EasyVector<Triangle *> createBox(float3 center, float edgeSize,
                                                EasyVector<float3> &colors);
+  // Latitude-longitude sphere: rings bands of segments quads, split in two
+  // triangles except at the poles, 2 * segments * (rings - 1) triangles.
+  CUDA_HOSTDEV static EasyVector<Triangle *>
+  createSphereMesh(float3 center, float radius, int rings, int segments,
+                   const float3 &color);
 };
 
 } // namespace raytracer_cu
@@ -0,0 +1,187 @@
+#include "net.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace raytracer_cu {
+
+int listenTcp(int port, int backlog) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(uint16_t(port));
+  if (bind(fd, (sockaddr *)&address, sizeof(address)) < 0 ||
+      listen(fd, backlog) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int acceptConnection(int listenFd) {
+  int fd;
+  do {
+    fd = accept(listenFd, nullptr, nullptr);
+  } while (fd < 0 && errno == EINTR);
+  if (fd >= 0) {
+    // Messages are written header first, do not wait for more data.
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+  }
+  return fd;
+}
+
+namespace {
+
+bool unixAddress(const std::string &path, sockaddr_un &address) {
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+  memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+} // namespace
+
+int listenUnix(const std::string &path, int backlog) {
+  sockaddr_un address;
+  if (!unixAddress(path, address)) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  // A socket file left behind by a previous server blocks the bind.
+  unlink(path.c_str());
+  if (bind(fd, (sockaddr *)&address, sizeof(address)) < 0 ||
+      listen(fd, backlog) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int connectUnix(const std::string &path) {
+  sockaddr_un address;
+  if (!unixAddress(path, address)) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, (sockaddr *)&address, sizeof(address)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int connectTcp(const std::string &host, int port) {
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *addresses = nullptr;
+  std::string service = std::to_string(port);
+  if (getaddrinfo(host.c_str(), service.c_str(), &hints, &addresses) != 0) {
+    return -1;
+  }
+
+  int fd = -1;
+  for (addrinfo *a = addresses; a; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    if (connect(fd, a->ai_addr, a->ai_addrlen) == 0) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(addresses);
+
+  if (fd >= 0) {
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+  }
+  return fd;
+}
+
+int localPort(int fd) {
+  sockaddr_in address;
+  socklen_t length = sizeof(address);
+  if (getsockname(fd, (sockaddr *)&address, &length) < 0) {
+    return -1;
+  }
+  return ntohs(address.sin_port);
+}
+
+bool sendAll(int fd, const void *data, size_t n) {
+  const char *bytes = (const char *)data;
+  while (n > 0) {
+    ssize_t sent = send(fd, bytes, n, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    bytes += sent;
+    n -= size_t(sent);
+  }
+  return true;
+}
+
+bool recvAll(int fd, void *data, size_t n) {
+  char *bytes = (char *)data;
+  while (n > 0) {
+    ssize_t received = recv(fd, bytes, n, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return false;
+    }
+    bytes += received;
+    n -= size_t(received);
+  }
+  return true;
+}
+
+void setReceiveTimeout(int fd, int milliseconds) {
+  timeval timeout;
+  timeout.tv_sec = milliseconds / 1000;
+  timeout.tv_usec = (milliseconds % 1000) * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+void closeSocket(int fd) {
+  if (fd >= 0) {
+    shutdown(fd, SHUT_RDWR);
+    close(fd);
+  }
+}
+
+} // namespace raytracer_cu
@@ -0,0 +1,37 @@
+#ifndef NET_H
+#define NET_H
+
+#include <cstddef>
+#include <string>
+
+namespace raytracer_cu {
+
+/*
+Thin blocking POSIX socket helpers for the host tools. Functions returning
+a file descriptor return -1 on failure (errno is left set), the transfer
+functions return false if the peer closed the connection or an error or a
+receive timeout occurred.
+
+listenTcp(port):        listening socket on all interfaces, port 0 picks a
+                        free port (see localPort)
+connectTcp(host, port): connected socket, host is a name or an address
+listenUnix(path):       listening local (AF_UNIX) socket, replaces a stale
+                        socket file at path
+connectUnix(path):      connected local socket
+sendAll / recvAll:      transfer exactly n bytes
+setReceiveTimeout(fd, milliseconds): 0 disables the timeout
+*/
+int listenTcp(int port, int backlog = 16);
+int acceptConnection(int listenFd);
+int connectTcp(const std::string &host, int port);
+int listenUnix(const std::string &path, int backlog = 16);
+int connectUnix(const std::string &path);
+int localPort(int fd);
+bool sendAll(int fd, const void *data, size_t n);
+bool recvAll(int fd, void *data, size_t n);
+void setReceiveTimeout(int fd, int milliseconds);
+void closeSocket(int fd);
+
+} // namespace raytracer_cu
+
+#endif
@@ -0,0 +1,741 @@
+#include "paged_geometry.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "aabb.h"
+#include "host_renderer.h"
+
+namespace raytracer_cu {
+
+namespace {
+
+const char magic[4] = {'G', 'E', 'O', '1'};
+const uint64_t pageSize = 4096;
+const int nBins = 12;
+const int maxLeafTriangles = 4;
+const int scratchBufferTriangles = 64; // per grid cell while bucketing
+const int traversalStackSize = 96;
+const float boundsPadding = 1e-3f;
+const float EPSILON = 0.0000001;
+
+struct FileHeader {
+  char magic[4];
+  uint32_t nChunks;
+  uint64_t nTriangles;
+};
+
+float axisOf(float3 v, int axis) {
+  return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+float3 f3(const float v[3]) { return make_float3(v[0], v[1], v[2]); }
+
+void store(float3 v, float out[3]) {
+  out[0] = v.x;
+  out[1] = v.y;
+  out[2] = v.z;
+}
+
+AABB boxOf(const float lo[3], const float hi[3]) {
+  AABB box;
+  box.lo = f3(lo);
+  box.hi = f3(hi);
+  return box;
+}
+
+uint64_t alignUp(uint64_t offset) {
+  return (offset + pageSize - 1) / pageSize * pageSize;
+}
+
+ChunkTriangle makeTriangle(const float3 v[3]) {
+  ChunkTriangle tri;
+  float3 e1 = v[1] - v[0], e2 = v[2] - v[0];
+  float3 n = cross(e1, e2);
+  float l = length(n);
+  store(v[0], tri.v0);
+  store(e1, tri.e1);
+  store(e2, tri.e2);
+  store(l > 0.0f ? n * (1.0f / l) : make_float3(0.0f, -1.0f, 0.0f),
+        tri.normal);
+  return tri;
+}
+
+AABB boundsOf(const ChunkTriangle &tri) {
+  AABB box;
+  float3 v0 = f3(tri.v0);
+  box.grow(v0);
+  box.grow(v0 + f3(tri.e1));
+  box.grow(v0 + f3(tri.e2));
+  box.pad(boundsPadding);
+  return box;
+}
+
+// Binned SAH BVH over boxes in the ChunkNode layout (depth first, the left
+// child follows its parent). Reorders `order`, leaves index into it.
+class NodeBuilder {
+private:
+  const std::vector<AABB> &boxes;
+  std::vector<int> &order;
+  std::vector<ChunkNode> &nodes;
+  int maxLeaf;
+
+  // Partitions order[first, first + count), returns the end of the left
+  // side.
+  int split(int first, int count, const AABB &centroids) {
+    int bestAxis = -1, bestBin = 0;
+    float bestCost = 1e30f;
+    for (int axis = 0; axis < 3; axis++) {
+      float lo = axisOf(centroids.lo, axis);
+      float extent = axisOf(centroids.hi, axis) - lo;
+      if (extent <= 0.0f) {
+        continue;
+      }
+      AABB binBounds[nBins];
+      int binCount[nBins] = {0};
+      for (int i = first; i < first + count; i++) {
+        const AABB &box = boxes[order[i]];
+        int bin = std::min(
+            nBins - 1, int(nBins * (axisOf(box.center(), axis) - lo) / extent));
+        binCount[bin]++;
+        binBounds[bin].grow(box);
+      }
+      float rightArea[nBins];
+      int rightCount[nBins];
+      AABB right;
+      int nRight = 0;
+      for (int b = nBins - 1; b > 0; b--) {
+        right.grow(binBounds[b]);
+        nRight += binCount[b];
+        rightArea[b] = right.surfaceArea();
+        rightCount[b] = nRight;
+      }
+      AABB left;
+      int nLeft = 0;
+      for (int b = 0; b < nBins - 1; b++) {
+        left.grow(binBounds[b]);
+        nLeft += binCount[b];
+        if (nLeft == 0 || rightCount[b + 1] == 0) {
+          continue;
+        }
+        float cost = left.surfaceArea() * nLeft +
+                     rightArea[b + 1] * rightCount[b + 1];
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestBin = b;
+        }
+      }
+    }
+
+    if (bestAxis >= 0) {
+      float lo = axisOf(centroids.lo, bestAxis);
+      float extent = axisOf(centroids.hi, bestAxis) - lo;
+      int *mid = std::partition(
+          order.data() + first, order.data() + first + count, [&](int i) {
+            float c = axisOf(boxes[i].center(), bestAxis);
+            return std::min(nBins - 1, int(nBins * (c - lo) / extent)) <=
+                   bestBin;
+          });
+      int m = int(mid - order.data());
+      if (m > first && m < first + count) {
+        return m;
+      }
+    }
+    // All centroids in one bin: halve by count.
+    int m = first + count / 2;
+    float3 d = centroids.hi - centroids.lo;
+    int axis = d.x > d.y ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+    std::nth_element(order.begin() + first, order.begin() + m,
+                     order.begin() + first + count, [&](int a, int b) {
+                       return axisOf(boxes[a].center(), axis) <
+                              axisOf(boxes[b].center(), axis);
+                     });
+    return m;
+  }
+
+public:
+  NodeBuilder(const std::vector<AABB> &boxes, std::vector<int> &order,
+              std::vector<ChunkNode> &nodes, int maxLeaf)
+      : boxes(boxes), order(order), nodes(nodes), maxLeaf(maxLeaf) {}
+
+  int build(int first, int count) {
+    int index = int(nodes.size());
+    nodes.push_back(ChunkNode());
+    AABB bounds, centroids;
+    for (int i = first; i < first + count; i++) {
+      bounds.grow(boxes[order[i]]);
+      centroids.grow(boxes[order[i]].center());
+    }
+    store(bounds.lo, nodes[index].lo);
+    store(bounds.hi, nodes[index].hi);
+    if (count <= maxLeaf) {
+      nodes[index].first = uint32_t(first);
+      nodes[index].count = uint32_t(count);
+      return index;
+    }
+    int mid = split(first, count, centroids);
+    build(first, mid - first);
+    int right = build(mid, first + count - mid);
+    nodes[index].first = uint32_t(right);
+    nodes[index].count = 0;
+    return index;
+  }
+};
+
+// Builds the BVH of a chunk, puts the triangles in leaf order.
+void buildChunk(std::vector<ChunkTriangle> &triangles,
+                std::vector<ChunkNode> &nodes) {
+  std::vector<AABB> boxes(triangles.size());
+  std::vector<int> order(triangles.size());
+  for (size_t i = 0; i < triangles.size(); i++) {
+    boxes[i] = boundsOf(triangles[i]);
+    order[i] = int(i);
+  }
+  nodes.clear();
+  NodeBuilder(boxes, order, nodes, maxLeafTriangles)
+      .build(0, int(triangles.size()));
+  std::vector<ChunkTriangle> sorted(triangles.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    sorted[i] = triangles[order[i]];
+  }
+  triangles.swap(sorted);
+}
+
+bool writeAll(int fd, const void *data, size_t bytes, uint64_t offset) {
+  const char *p = static_cast<const char *>(data);
+  while (bytes > 0) {
+    ssize_t n = pwrite(fd, p, bytes, off_t(offset));
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    bytes -= size_t(n);
+    offset += uint64_t(n);
+  }
+  return true;
+}
+
+bool readAll(int fd, void *data, size_t bytes, uint64_t offset) {
+  char *p = static_cast<char *>(data);
+  while (bytes > 0) {
+    ssize_t n = pread(fd, p, bytes, off_t(offset));
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    bytes -= size_t(n);
+    offset += uint64_t(n);
+  }
+  return true;
+}
+
+// Möller–Trumbore as in triangle.cc, returns the ray parameter.
+bool hitTriangle(float3 origin, float3 direction, const ChunkTriangle &tri,
+                 float &t) {
+  float3 edge1 = f3(tri.e1), edge2 = f3(tri.e2);
+  float3 h = cross(direction, edge2);
+  float a = dot(edge1, h);
+  if (a > -EPSILON && a < EPSILON)
+    return false;
+  float f = 1.0f / a;
+  float3 s = origin - f3(tri.v0);
+  float u = f * dot(s, h);
+  if (u < 0.0f || u > 1.0f)
+    return false;
+  float3 q = cross(s, edge1);
+  float v = f * dot(direction, q);
+  if (v < 0.0f || u + v > 1.0f)
+    return false;
+  t = f * dot(edge2, q);
+  return t > EPSILON;
+}
+
+// Chunks are visited in increasing (entry, index).
+bool before(float entryA, int chunkA, float entryB, int chunkB) {
+  return entryA < entryB || (entryA == entryB && chunkA < chunkB);
+}
+
+} // namespace
+
+// ---------- baking ----------
+
+bool bakePagedGeometry(
+    const std::string &path, uint64_t nTriangles, int trianglesPerChunk,
+    const std::function<void(uint64_t i, float3 v[3])> &triangle) {
+  if (nTriangles == 0 || trianglesPerChunk <= 0) {
+    return false;
+  }
+
+  float3 v[3];
+  auto centroidOf = [&]() { return (v[0] + v[1] + v[2]) * (1.0f / 3.0f); };
+  AABB centroids;
+  for (uint64_t i = 0; i < nTriangles; i++) {
+    triangle(i, v);
+    centroids.grow(centroidOf());
+  }
+
+  // Halve the cells along their longest side until there are enough.
+  uint64_t target = (nTriangles + trianglesPerChunk - 1) / trianglesPerChunk;
+  float3 extent = centroids.hi - centroids.lo;
+  int dims[3] = {1, 1, 1};
+  while (uint64_t(dims[0]) * dims[1] * dims[2] < target) {
+    int axis = 0;
+    for (int a = 1; a < 3; a++) {
+      if (axisOf(extent, a) / dims[a] > axisOf(extent, axis) / dims[axis]) {
+        axis = a;
+      }
+    }
+    if (axisOf(extent, axis) <= 0.0f) {
+      break; // all centroids in one point
+    }
+    dims[axis] *= 2;
+  }
+  auto cellOf = [&](float3 c) {
+    int cell[3];
+    for (int a = 0; a < 3; a++) {
+      float e = axisOf(extent, a);
+      int k = e > 0.0f ? int((axisOf(c, a) - axisOf(centroids.lo, a)) / e *
+                             dims[a])
+                       : 0;
+      cell[a] = std::max(0, std::min(dims[a] - 1, k));
+    }
+    return (size_t(cell[2]) * dims[1] + cell[1]) * dims[0] + cell[0];
+  };
+  size_t nCells = size_t(dims[0]) * dims[1] * dims[2];
+
+  std::vector<uint64_t> cellCount(nCells, 0);
+  for (uint64_t i = 0; i < nTriangles; i++) {
+    triangle(i, v);
+    cellCount[cellOf(centroidOf())]++;
+  }
+
+  // Bucket into the scratch file, cell after cell.
+  std::string scratchPath = path + ".scratch";
+  int scratch = ::open(scratchPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (scratch < 0) {
+    return false;
+  }
+  unlink(scratchPath.c_str());
+  std::vector<uint64_t> cellFirst(nCells), cursor(nCells);
+  uint64_t nChunks = 0;
+  for (size_t c = 0, first = 0; c < nCells; c++) {
+    cellFirst[c] = cursor[c] = first;
+    first += cellCount[c];
+    nChunks += cellCount[c] > 0;
+  }
+  std::vector<std::vector<ChunkTriangle>> pending(nCells);
+  bool ok = true;
+  auto flush = [&](size_t c) {
+    std::vector<ChunkTriangle> &buffer = pending[c];
+    ok = ok && writeAll(scratch, buffer.data(),
+                        buffer.size() * sizeof(ChunkTriangle),
+                        cursor[c] * sizeof(ChunkTriangle));
+    cursor[c] += buffer.size();
+    buffer.clear();
+  };
+  for (uint64_t i = 0; i < nTriangles && ok; i++) {
+    triangle(i, v);
+    size_t c = cellOf(centroidOf());
+    pending[c].push_back(makeTriangle(v));
+    if (pending[c].size() >= size_t(scratchBufferTriangles)) {
+      flush(c);
+    }
+  }
+  for (size_t c = 0; c < nCells; c++) {
+    flush(c);
+    std::vector<ChunkTriangle>().swap(pending[c]);
+  }
+
+  int out = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (!ok || out < 0) {
+    close(scratch);
+    if (out >= 0) {
+      close(out);
+    }
+    return false;
+  }
+
+  FileHeader header;
+  memcpy(header.magic, magic, 4);
+  header.nChunks = uint32_t(nChunks);
+  header.nTriangles = nTriangles;
+  std::vector<ChunkInfo> table;
+  table.reserve(nChunks);
+  uint64_t offset =
+      alignUp(sizeof(header) + nChunks * sizeof(ChunkInfo));
+  std::vector<ChunkTriangle> triangles;
+  std::vector<ChunkNode> nodes;
+  for (size_t c = 0; c < nCells && ok; c++) {
+    if (cellCount[c] == 0) {
+      continue;
+    }
+    triangles.resize(cellCount[c]);
+    ok = readAll(scratch, triangles.data(),
+                 triangles.size() * sizeof(ChunkTriangle),
+                 cellFirst[c] * sizeof(ChunkTriangle));
+    buildChunk(triangles, nodes);
+
+    ChunkInfo info;
+    memcpy(info.lo, nodes[0].lo, sizeof(info.lo));
+    memcpy(info.hi, nodes[0].hi, sizeof(info.hi));
+    info.offset = offset;
+    info.nNodes = uint32_t(nodes.size());
+    info.nTriangles = uint32_t(triangles.size());
+    size_t nodeBytes = nodes.size() * sizeof(ChunkNode);
+    size_t triangleBytes = triangles.size() * sizeof(ChunkTriangle);
+    info.bytes = nodeBytes + triangleBytes;
+    ok = ok && writeAll(out, nodes.data(), nodeBytes, offset) &&
+         writeAll(out, triangles.data(), triangleBytes, offset + nodeBytes);
+    table.push_back(info);
+    offset = alignUp(offset + info.bytes);
+  }
+  ok = ok && writeAll(out, &header, sizeof(header), 0) &&
+       writeAll(out, table.data(), table.size() * sizeof(ChunkInfo),
+                sizeof(header));
+  close(scratch);
+  return close(out) == 0 && ok;
+}
+
+// ---------- PagedGeometry ----------
+
+std::unique_ptr<PagedGeometry> PagedGeometry::open(const std::string &path,
+                                                   size_t budgetBytes) {
+  std::unique_ptr<PagedGeometry> geometry(new PagedGeometry(budgetBytes));
+  geometry->fd = ::open(path.c_str(), O_RDONLY);
+  if (geometry->fd < 0) {
+    return nullptr;
+  }
+  FileHeader header;
+  if (!readAll(geometry->fd, &header, sizeof(header), 0) ||
+      memcmp(header.magic, magic, 4) != 0 || header.nChunks == 0) {
+    return nullptr;
+  }
+  std::vector<ChunkInfo> table(header.nChunks);
+  if (!readAll(geometry->fd, table.data(), table.size() * sizeof(ChunkInfo),
+               sizeof(header))) {
+    return nullptr;
+  }
+  geometry->nTriangles = header.nTriangles;
+  geometry->chunks.resize(table.size());
+  std::vector<AABB> boxes(table.size());
+  std::vector<int> order(table.size());
+  for (size_t i = 0; i < table.size(); i++) {
+    geometry->chunks[i].info = table[i];
+    boxes[i] = boxOf(table[i].lo, table[i].hi);
+    order[i] = int(i);
+  }
+  NodeBuilder(boxes, order, geometry->topNodes, 1).build(0, int(order.size()));
+  for (ChunkNode &node : geometry->topNodes) {
+    if (node.count > 0) {
+      node.first = uint32_t(order[node.first]);
+    }
+  }
+  geometry->lastUse.reset(new std::atomic<uint64_t>[table.size()]);
+  for (size_t i = 0; i < table.size(); i++) {
+    geometry->lastUse[i].store(0);
+  }
+  geometry->counters.budgetBytes = budgetBytes;
+  return geometry;
+}
+
+PagedGeometry::~PagedGeometry() {
+  evictAll();
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+uint64_t PagedGeometry::fileBytes() const {
+  uint64_t end = 0;
+  for (const Chunk &chunk : chunks) {
+    end = std::max(end, chunk.info.offset + chunk.info.bytes);
+  }
+  return end;
+}
+
+int PagedGeometry::nextChunk(const PagedRay &ray, float3 invDir,
+                             float &entry) const {
+  float limit = ray.chunk >= 0 ? ray.t : ray.tMax;
+  int best = -1;
+  float bestEntry = 1e30f;
+  int stack[traversalStackSize];
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    const ChunkNode &node = topNodes[stack[--top]];
+    float tNear;
+    if (!boxOf(node.lo, node.hi).intersect(ray.origin, invDir, limit, tNear) ||
+        tNear > bestEntry) {
+      continue;
+    }
+    if (node.count == 0) {
+      int left = int(&node - topNodes.data()) + 1;
+      stack[top++] = int(node.first);
+      stack[top++] = left;
+      continue;
+    }
+    int c = int(node.first);
+    if (before(ray.lastEntry, ray.lastChunk, tNear, c) &&
+        before(tNear, c, bestEntry, best < 0 ? 0x7fffffff : best)) {
+      best = c;
+      bestEntry = tNear;
+    }
+  }
+  entry = bestEntry;
+  return best;
+}
+
+void PagedGeometry::intersectChunk(const Chunk &chunk, int index,
+                                   PagedRay &ray) const {
+  float3 invDir = make_float3(1.0f / ray.direction.x, 1.0f / ray.direction.y,
+                              1.0f / ray.direction.z);
+  int stack[traversalStackSize];
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    int i = stack[--top];
+    const ChunkNode &node = chunk.nodes[i];
+    float limit = ray.chunk >= 0 ? ray.t : ray.tMax;
+    float tNear;
+    if (!boxOf(node.lo, node.hi).intersect(ray.origin, invDir, limit, tNear)) {
+      continue;
+    }
+    if (node.count == 0) {
+      stack[top++] = int(node.first);
+      stack[top++] = i + 1;
+      continue;
+    }
+    for (uint32_t k = node.first; k < node.first + node.count; k++) {
+      const ChunkTriangle &tri = chunk.triangles[k];
+      float t;
+      if (hitTriangle(ray.origin, ray.direction, tri, t) &&
+          t < (ray.chunk >= 0 ? ray.t : ray.tMax)) {
+        ray.t = t;
+        ray.chunk = index;
+        ray.normal = f3(tri.normal);
+        if (ray.anyHit) {
+          return;
+        }
+      }
+    }
+  }
+}
+
+int PagedGeometry::advance(PagedRay &ray) const {
+  float3 invDir = make_float3(1.0f / ray.direction.x, 1.0f / ray.direction.y,
+                              1.0f / ray.direction.z);
+  for (;;) {
+    float entry;
+    int c = nextChunk(ray, invDir, entry);
+    if (c < 0) {
+      return -1;
+    }
+    const Chunk &chunk = chunks[c];
+    if (!chunk.nodes) {
+      return c;
+    }
+    if (lastUse[c].load(std::memory_order_relaxed) != round) {
+      lastUse[c].store(round, std::memory_order_relaxed);
+    }
+    intersectChunk(chunk, c, ray);
+    ray.lastEntry = entry;
+    ray.lastChunk = c;
+    if (ray.anyHit && ray.chunk >= 0) {
+      return -1;
+    }
+  }
+}
+
+bool PagedGeometry::load(int c) {
+  Chunk &chunk = chunks[c];
+  int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+  flags |= MAP_POPULATE; // read it all now, not fault by fault
+#endif
+  void *mapping = mmap(nullptr, chunk.info.bytes, PROT_READ, flags, fd,
+                       off_t(chunk.info.offset));
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  chunk.mapping = mapping;
+  chunk.nodes = static_cast<const ChunkNode *>(mapping);
+  chunk.triangles = reinterpret_cast<const ChunkTriangle *>(
+      chunk.nodes + chunk.info.nNodes);
+  lastUse[c].store(round);
+  resident += chunk.info.bytes;
+  counters.chunksLoaded++;
+  counters.bytesPagedIn += chunk.info.bytes;
+  counters.peakResidentBytes = std::max(counters.peakResidentBytes, resident);
+  return true;
+}
+
+void PagedGeometry::evict(int c) {
+  Chunk &chunk = chunks[c];
+  munmap(chunk.mapping, chunk.info.bytes);
+  chunk.mapping = nullptr;
+  chunk.nodes = nullptr;
+  chunk.triangles = nullptr;
+  resident -= chunk.info.bytes;
+  counters.evictions++;
+}
+
+void PagedGeometry::evictAll() {
+  for (int c = 0; c < chunkCount(); c++) {
+    if (chunks[c].nodes) {
+      evict(c);
+    }
+  }
+}
+
+void PagedGeometry::trace(std::vector<PagedRay> &rays, ThreadPool &pool) {
+  counters.rays += rays.size();
+  std::vector<int> active(rays.size());
+  std::vector<int> waitFor(rays.size());
+  for (size_t i = 0; i < rays.size(); i++) {
+    PagedRay &ray = rays[i];
+    ray.chunk = -1;
+    ray.lastEntry = -1.0f;
+    ray.lastChunk = -1;
+    active[i] = int(i);
+  }
+
+  std::vector<int> candidates;
+  while (!active.empty()) {
+    pool.parallelFor(0, int(active.size()), 256, [&](int begin, int end) {
+      for (int k = begin; k < end; k++) {
+        waitFor[active[k]] = advance(rays[active[k]]);
+      }
+    });
+    for (int i : active) {
+      if (waitFor[i] >= 0) {
+        chunks[waitFor[i]].waiting.push_back(i);
+        counters.deferrals++;
+      }
+    }
+    active.clear();
+
+    candidates.clear();
+    for (int c = 0; c < chunkCount(); c++) {
+      if (!chunks[c].waiting.empty()) {
+        candidates.push_back(c);
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(), [&](int a, int b) {
+      size_t na = chunks[a].waiting.size(), nb = chunks[b].waiting.size();
+      return na > nb || (na == nb && a < b);
+    });
+
+    // Page in the most wanted chunks that fit next to each other; chunks
+    // used in earlier rounds make room, least recently used first.
+    round++;
+    counters.passes += !candidates.empty();
+    size_t roundBytes = 0;
+    for (int c : candidates) {
+      size_t bytes = chunks[c].info.bytes;
+      if (roundBytes > 0 && roundBytes + bytes > budget) {
+        break;
+      }
+      while (resident + bytes > budget) {
+        int victim = -1;
+        for (int r = 0; r < chunkCount(); r++) {
+          if (chunks[r].nodes && lastUse[r].load() < round &&
+              (victim < 0 || lastUse[r].load() < lastUse[victim].load())) {
+            victim = r;
+          }
+        }
+        if (victim < 0) {
+          break;
+        }
+        evict(victim);
+      }
+      // A chunk that can not be mapped is dropped by the rays waiting for
+      // it, they keep the hit found so far.
+      if (load(c)) {
+        active.insert(active.end(), chunks[c].waiting.begin(),
+                      chunks[c].waiting.end());
+        roundBytes += bytes;
+      }
+      chunks[c].waiting.clear();
+    }
+  }
+}
+
+PagingStats PagedGeometry::stats() const {
+  PagingStats s = counters;
+  s.residentBytes = resident;
+  s.budgetBytes = budget;
+  return s;
+}
+
+void PagedGeometry::resetStats() {
+  counters = PagingStats();
+  counters.peakResidentBytes = resident;
+}
+
+// ---------- PagedRenderer ----------
+
+void PagedRenderer::render(const Camera &camera, int2 size,
+                           uint8_t *colorBuffer) {
+  int nPixels = size.x * size.y;
+  rays.resize(nPixels);
+  sunlight.assign(nPixels, 0.0f);
+  pool.parallelFor(0, size.y, 4, [&](int rowBegin, int rowEnd) {
+    for (int y = rowBegin; y < rowEnd; y++) {
+      for (int x = 0; x < size.x; x++) {
+        Ray eyeRay = camera.primaryRay(x, y, size, 0);
+        PagedRay &ray = rays[y * size.x + x];
+        ray = PagedRay();
+        ray.origin = eyeRay.origin;
+        ray.direction = eyeRay.direction;
+      }
+    }
+  });
+  geometry.trace(rays, pool);
+
+  shadowRays.clear();
+  shadowPixel.clear();
+  for (int i = 0; i < nPixels; i++) {
+    PagedRay &ray = rays[i];
+    if (ray.chunk < 0) {
+      continue;
+    }
+    if (dot(ray.normal, ray.direction) > 0.0f) {
+      ray.normal = -1.0f * ray.normal; // facing the eye
+    }
+    float cosine = dot(ray.normal, sunDirection);
+    if (cosine <= 0.0f) {
+      continue;
+    }
+    sunlight[i] = cosine;
+    if (shadows) {
+      float3 point = ray.origin + ray.t * ray.direction;
+      PagedRay shadow;
+      shadow.origin = point + (1e-4f * (1.0f + length(point))) * ray.normal;
+      shadow.direction = sunDirection;
+      shadow.anyHit = true;
+      shadowRays.push_back(shadow);
+      shadowPixel.push_back(i);
+    }
+  }
+  geometry.trace(shadowRays, pool);
+  for (size_t k = 0; k < shadowRays.size(); k++) {
+    if (shadowRays[k].chunk >= 0) {
+      sunlight[shadowPixel[k]] = 0.0f;
+    }
+  }
+
+  for (int i = 0; i < nPixels; i++) {
+    float3 color = rays[i].chunk < 0
+                       ? sky
+                       : albedo * (ambient + (1.0f - ambient) * sunlight[i]);
+    storePixel(colorBuffer, i, color);
+  }
+}
+
+} // namespace raytracer_cu
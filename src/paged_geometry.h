@@ -0,0 +1,191 @@
+#ifndef PAGED_GEOMETRY_H
+#define PAGED_GEOMETRY_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cuda_runtime.h"
+
+#include "camera.h"
+#include "math.h"
+#include "thread_pool.h"
+
+namespace raytracer_cu {
+
+/*
+Chunked geometry file, written by bakePagedGeometry():
+
+  header   "GEO1", nChunks (uint32), nTriangles (uint64)
+  chunks   nChunks ChunkInfo
+  data     per chunk, at a page aligned offset: nNodes ChunkNode (the BVH
+           of the chunk, root first), then nTriangles ChunkTriangle in leaf
+           order
+
+A chunk is mapped as it is, there is nothing to build or unpack at page in.
+
+triangle(i, v) gives the vertices of triangle i of n. The triangles are
+bucketed into a grid over their centroids with about trianglesPerChunk
+triangles per cell (cells are halved along their longest side until there
+are enough), every non empty cell becomes a chunk. Uneven scenes give
+uneven chunks. The input is never in memory as a whole: it is generated
+three times (bounds, cell counts, then written to a scratch file next to
+`path` cell by cell), and the chunks are built one at a time from the
+scratch file.
+*/
+bool bakePagedGeometry(
+    const std::string &path, uint64_t nTriangles, int trianglesPerChunk,
+    const std::function<void(uint64_t i, float3 v[3])> &triangle);
+
+struct ChunkInfo {
+  float lo[3], hi[3]; // bounds of the triangles
+  uint64_t offset, bytes;
+  uint32_t nNodes, nTriangles;
+};
+
+// count == 0: inner node, the left child follows it, first is the right one.
+struct ChunkNode {
+  float lo[3], hi[3];
+  uint32_t first, count;
+};
+
+struct ChunkTriangle {
+  float v0[3];
+  float e1[3], e2[3]; // vertex1 - vertex0, vertex2 - vertex0
+  float normal[3];
+};
+
+// A ray of PagedGeometry::trace; the results are filled in.
+struct PagedRay {
+  float3 origin, direction;
+  float tMax = 1e30f;  // hits at or beyond are ignored
+  bool anyHit = false; // occlusion: stop at the first hit
+  // Results: t of the closest hit (or of the first one found for anyHit),
+  // chunk -1 if there was none.
+  float t = 0.0f;
+  int chunk = -1;
+  float3 normal;
+  // Traversal state: the last chunk intersected, chunks are visited in
+  // (entry distance, index) order.
+  float lastEntry = -1.0f;
+  int lastChunk = -1;
+};
+
+struct PagingStats {
+  uint64_t rays = 0;
+  uint64_t deferrals = 0;  // times a ray waited for a chunk
+  uint64_t passes = 0;     // rounds of page ins
+  uint64_t chunksLoaded = 0;
+  uint64_t bytesPagedIn = 0;
+  uint64_t evictions = 0;
+  size_t residentBytes = 0;
+  size_t peakResidentBytes = 0;
+  size_t budgetBytes = 0;
+
+  double raysPerPageIn() const {
+    return chunksLoaded ? double(deferrals) / chunksLoaded : 0.0;
+  }
+};
+
+/*
+Geometry of a bakePagedGeometry() file, paged in chunk by chunk under a
+memory budget. Only the chunk table and a BVH over the chunk bounds are
+resident, a chunk is mapped (mmap, populated) when rays need it and
+unmapped again, least recently used first, when the mapped chunks would
+exceed the budget. A single chunk larger than the budget is still mapped.
+
+trace() runs a batch of rays to completion in rounds:
+
+  1. every active ray walks the chunks its segment overlaps in order of
+     entry distance, intersecting the resident ones, until it is done or
+     reaches a chunk that is not resident; it then waits for that chunk
+  2. the chunks with the most waiting rays are paged in, as many as fit in
+     the budget next to each other (at least one), and the rays waiting
+     for them become the active ones
+
+so a page in serves every ray of the batch that needs the chunk, instead
+of every ray faulting its pages in on its own. Step 1 runs on the thread
+pool against a fixed set of resident chunks, paging happens between.
+
+The results are those of tracing every ray against all the triangles.
+Host only.
+*/
+class PagedGeometry {
+private:
+  struct Chunk {
+    ChunkInfo info;
+    void *mapping = nullptr;
+    const ChunkNode *nodes = nullptr; // null: not resident
+    const ChunkTriangle *triangles = nullptr;
+    std::vector<int> waiting;
+  };
+
+  int fd = -1;
+  uint64_t nTriangles = 0;
+  std::vector<Chunk> chunks;
+  std::vector<ChunkNode> topNodes; // leaves hold one chunk index each
+  // Round each chunk was last intersected in, for the LRU eviction.
+  std::unique_ptr<std::atomic<uint64_t>[]> lastUse;
+  size_t budget;
+  size_t resident = 0;
+  uint64_t round = 0;
+  PagingStats counters;
+
+  explicit PagedGeometry(size_t budgetBytes) : budget(budgetBytes) {}
+  // The next chunk of the ray to intersect, -1 if there is none.
+  int nextChunk(const PagedRay &ray, float3 invDir, float &entry) const;
+  void intersectChunk(const Chunk &chunk, int index, PagedRay &ray) const;
+  // Returns the chunk the ray waits for, -1 when it is done.
+  int advance(PagedRay &ray) const;
+  bool load(int chunk);
+  void evict(int chunk);
+
+public:
+  // Returns nullptr if the file can not be read.
+  static std::unique_ptr<PagedGeometry> open(const std::string &path,
+                                             size_t budgetBytes);
+  ~PagedGeometry();
+  PagedGeometry(const PagedGeometry &) = delete;
+  PagedGeometry &operator=(const PagedGeometry &) = delete;
+
+  int chunkCount() const { return int(chunks.size()); }
+  uint64_t triangleCount() const { return nTriangles; }
+  uint64_t fileBytes() const;
+
+  void trace(std::vector<PagedRay> &rays, ThreadPool &pool);
+  void evictAll();
+  PagingStats stats() const;
+  void resetStats();
+};
+
+/*
+Renders a PagedGeometry in two batches per frame: the primary rays, then
+a shadow ray toward the sun for every hit. Lambert shading with one color,
+misses show the sky.
+*/
+class PagedRenderer {
+private:
+  PagedGeometry &geometry;
+  ThreadPool &pool;
+  std::vector<PagedRay> rays, shadowRays;
+  std::vector<int> shadowPixel;
+  std::vector<float> sunlight; // cosine of the sun, 0 in shadow
+
+public:
+  float3 albedo = make_float3(0.55f, 0.5f, 0.4f);
+  float3 sky = make_float3(0.45f, 0.6f, 0.85f);
+  float3 sunDirection = norm(make_float3(0.4f, -0.8f, 0.3f)); // toward it
+  float ambient = 0.2f;
+  bool shadows = true;
+
+  PagedRenderer(PagedGeometry &geometry, ThreadPool &pool)
+      : geometry(geometry), pool(pool) {}
+  void render(const Camera &camera, int2 size, uint8_t *colorBuffer);
+};
+
+} // namespace raytracer_cu
+
+#endif
@@ -0,0 +1,374 @@
+#include "parallel_bvh.h"
+
+#include <algorithm>
+
+#include "thread_pool.h"
+
+namespace raytracer_cu {
+
+namespace {
+
+const int nBins = 16;
+// Upper tree levels past this halve the cluster range, so that with the
+// LBVH levels below the trees stay within the traversal stacks of Bvh and
+// CompressedMesh (96).
+const int maxSahDepth = 24;
+const int chunkSize = 1 << 14; // primitives per parallelFor chunk
+const int clusterGrain = 16;   // clusters per parallelFor chunk
+const int radixBits = 8;
+const int radix = 1 << radixBits;
+
+float axisOf(float3 v, int axis) {
+  return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+// 10 bits to every third bit of 30.
+uint32_t expandBits(uint32_t v) {
+  v = (v * 0x00010001u) & 0xFF0000FFu;
+  v = (v * 0x00000101u) & 0x0F00F00Fu;
+  v = (v * 0x00000011u) & 0xC30C30C3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+uint32_t mortonCode(float3 p, const AABB &box) {
+  uint32_t q[3];
+  for (int axis = 0; axis < 3; axis++) {
+    float lo = axisOf(box.lo, axis);
+    float extent = axisOf(box.hi, axis) - lo;
+    float x =
+        extent > 0.0f ? (axisOf(p, axis) - lo) / extent * 1024.0f : 0.0f;
+    q[axis] = uint32_t(std::min(1023.0f, std::max(0.0f, x)));
+  }
+  return expandBits(q[0]) << 2 | expandBits(q[1]) << 1 | expandBits(q[2]);
+}
+
+uint32_t codeOf(uint64_t key) { return uint32_t(key >> 32); }
+int primitiveOf(uint64_t key) { return int(uint32_t(key)); }
+
+// The size of the left part of keys[first, first + count): where the
+// highest bit that differs in the range flips, or half of a run of equal
+// codes.
+int lbvhSplit(const uint64_t *keys, int first, int count) {
+  uint32_t a = codeOf(keys[first]), b = codeOf(keys[first + count - 1]);
+  if (a == b) {
+    return count / 2;
+  }
+  uint32_t bit = 1u << (31 - __builtin_clz(a ^ b));
+  const uint64_t *middle = std::partition_point(
+      keys + first, keys + first + count,
+      [bit](uint64_t key) { return !(codeOf(key) & bit); });
+  return int(middle - keys) - first;
+}
+
+// Nodes of the subtree over keys[first, first + count).
+int lbvhNodeCount(const uint64_t *keys, int first, int count, int leafSize) {
+  if (count <= leafSize) {
+    return 1;
+  }
+  if (leafSize == 1) {
+    return 2 * count - 1;
+  }
+  int leftCount = lbvhSplit(keys, first, count);
+  return 1 + lbvhNodeCount(keys, first, leftCount, leafSize) +
+         lbvhNodeCount(keys, first + leftCount, count - leftCount, leafSize);
+}
+
+// Writes the subtree over keys[first, first + count) depth first from
+// nodes[index], primitive positions moved by primitiveShift; returns the
+// index after it.
+int buildLbvh(ParallelBvhNode *nodes, int index, const uint64_t *keys,
+              const AABB *bounds, int first, int count, int primitiveShift,
+              int leafSize) {
+  ParallelBvhNode &node = nodes[index];
+  node.first = first + primitiveShift;
+  node.count = count;
+  if (count <= leafSize) {
+    node.bounds = AABB();
+    for (int i = first; i < first + count; i++) {
+      node.bounds.grow(bounds[primitiveOf(keys[i])]);
+    }
+    node.left = node.right = -1;
+    node.cost = node.bounds.surfaceArea() * count;
+    return index + 1;
+  }
+  int leftCount = lbvhSplit(keys, first, count);
+  node.left = index + 1;
+  node.right = buildLbvh(nodes, node.left, keys, bounds, first, leftCount,
+                         primitiveShift, leafSize);
+  int end = buildLbvh(nodes, node.right, keys, bounds, first + leftCount,
+                      count - leftCount, primitiveShift, leafSize);
+  const ParallelBvhNode &left = nodes[node.left], &right = nodes[node.right];
+  node.bounds = merge(left.bounds, right.bounds);
+  node.cost = node.bounds.surfaceArea() + left.cost + right.cost;
+  return end;
+}
+
+} // namespace
+
+void ParallelBvhBuilder::build(const AABB *bounds, int n, ThreadPool &pool) {
+  nodes.clear();
+  order.clear();
+  if (n <= 0) {
+    return;
+  }
+  int nChunks = (n + chunkSize - 1) / chunkSize;
+
+  // Morton codes in the bounds of the centers.
+  std::vector<AABB> chunkBounds(nChunks);
+  pool.parallelFor(0, nChunks, 1, [&](int begin, int end) {
+    for (int c = begin; c < end; c++) {
+      for (int i = c * chunkSize; i < std::min(n, (c + 1) * chunkSize); i++) {
+        chunkBounds[c].grow(bounds[i].center());
+      }
+    }
+  });
+  AABB centerBounds;
+  for (const AABB &box : chunkBounds) {
+    centerBounds.grow(box);
+  }
+  keys.resize(n);
+  pool.parallelFor(0, n, chunkSize, [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      keys[i] = uint64_t(mortonCode(bounds[i].center(), centerBounds)) << 32 |
+                uint32_t(i);
+    }
+  });
+  sortKeys(pool);
+
+  // Clusters: runs of equal top bits.
+  int shift = 32 + 30 - clusterBits;
+  auto startsCluster = [&](int i) {
+    return i == 0 || keys[i] >> shift != keys[i - 1] >> shift;
+  };
+  std::vector<int> chunkStarts(nChunks + 1, 0);
+  pool.parallelFor(0, nChunks, 1, [&](int begin, int end) {
+    for (int c = begin; c < end; c++) {
+      for (int i = c * chunkSize; i < std::min(n, (c + 1) * chunkSize); i++) {
+        chunkStarts[c + 1] += startsCluster(i);
+      }
+    }
+  });
+  for (int c = 0; c < nChunks; c++) {
+    chunkStarts[c + 1] += chunkStarts[c];
+  }
+  clusters.clear();
+  clusters.resize(chunkStarts[nChunks]);
+  pool.parallelFor(0, nChunks, 1, [&](int begin, int end) {
+    for (int c = begin; c < end; c++) {
+      int k = chunkStarts[c];
+      for (int i = c * chunkSize; i < std::min(n, (c + 1) * chunkSize); i++) {
+        if (startsCluster(i)) {
+          clusters[k++].first = i;
+        }
+      }
+    }
+  });
+  int nClusters = int(clusters.size());
+  for (int k = 0; k < nClusters; k++) {
+    int next = k + 1 < nClusters ? clusters[k + 1].first : n;
+    clusters[k].count = next - clusters[k].first;
+  }
+  // The bounds and node counts of the clusters place them in the layout
+  // before their subtrees are built.
+  pool.parallelFor(0, nClusters, clusterGrain, [&](int begin, int end) {
+    for (int k = begin; k < end; k++) {
+      Cluster &cluster = clusters[k];
+      cluster.bounds = AABB();
+      for (int i = cluster.first; i < cluster.first + cluster.count; i++) {
+        cluster.bounds.grow(bounds[primitiveOf(keys[i])]);
+      }
+      cluster.nodeCount =
+          lbvhNodeCount(keys.data(), cluster.first, cluster.count, leafSize);
+    }
+  });
+  upper.clear();
+  std::vector<int> clusterIds(nClusters);
+  for (int k = 0; k < nClusters; k++) {
+    clusterIds[k] = k;
+  }
+  buildUpper(clusterIds, 0, nClusters, 0);
+  nodes.resize(upper[0].nodeCount);
+  order.resize(n);
+  layoutUpper(0, 0, 0);
+
+  pool.parallelFor(0, nClusters, clusterGrain, [&](int begin, int end) {
+    for (int k = begin; k < end; k++) {
+      const Cluster &cluster = clusters[k];
+      buildLbvh(nodes.data(), cluster.nodeOffset, keys.data(), bounds,
+                cluster.first, cluster.count,
+                cluster.primitiveOffset - cluster.first, leafSize);
+      for (int i = 0; i < cluster.count; i++) {
+        order[cluster.primitiveOffset + i] =
+            primitiveOf(keys[cluster.first + i]);
+      }
+    }
+  });
+  // Upper costs once the subtrees below are known, children first.
+  for (int i = int(upper.size()) - 1; i >= 0; i--) {
+    const UpperNode &node = upper[i];
+    if (node.cluster < 0) {
+      ParallelBvhNode &out = nodes[node.nodeIndex];
+      out.cost = out.bounds.surfaceArea() + nodes[out.left].cost +
+                 nodes[out.right].cost;
+    }
+  }
+
+  std::vector<uint64_t>().swap(keys);
+  std::vector<Cluster>().swap(clusters);
+  std::vector<UpperNode>().swap(upper);
+}
+
+// LSD radix sort of the codes, radixBits per pass. Every chunk histograms
+// and scatters its own keys in order, which keeps the sort stable.
+void ParallelBvhBuilder::sortKeys(ThreadPool &pool) {
+  int n = int(keys.size());
+  int nChunks = (n + chunkSize - 1) / chunkSize;
+  std::vector<uint64_t> sorted(n);
+  std::vector<int> offsets(size_t(nChunks) * radix);
+  for (int shift = 32; shift < 62; shift += radixBits) {
+    pool.parallelFor(0, nChunks, 1, [&](int begin, int end) {
+      for (int c = begin; c < end; c++) {
+        int *histogram = &offsets[size_t(c) * radix];
+        std::fill(histogram, histogram + radix, 0);
+        for (int i = c * chunkSize; i < std::min(n, (c + 1) * chunkSize); i++) {
+          histogram[(keys[i] >> shift) & (radix - 1)]++;
+        }
+      }
+    });
+    // Digit major, then chunk: where every chunk writes each digit.
+    int sum = 0;
+    bool oneDigit = false;
+    for (int d = 0; d < radix; d++) {
+      int digitCount = 0;
+      for (int c = 0; c < nChunks; c++) {
+        int count = offsets[size_t(c) * radix + d];
+        offsets[size_t(c) * radix + d] = sum;
+        sum += count;
+        digitCount += count;
+      }
+      oneDigit = oneDigit || digitCount == n;
+    }
+    if (oneDigit) {
+      continue; // the pass would not move anything
+    }
+    pool.parallelFor(0, nChunks, 1, [&](int begin, int end) {
+      for (int c = begin; c < end; c++) {
+        int *offset = &offsets[size_t(c) * radix];
+        for (int i = c * chunkSize; i < std::min(n, (c + 1) * chunkSize); i++) {
+          sorted[offset[(keys[i] >> shift) & (radix - 1)]++] = keys[i];
+        }
+      }
+    });
+    keys.swap(sorted);
+  }
+}
+
+// Binned SAH over clusterIds[first, first + count), every cluster as a box
+// of its count of primitives; returns the index in upper.
+int ParallelBvhBuilder::buildUpper(std::vector<int> &clusterIds, int first,
+                                   int count, int depth) {
+  int index = int(upper.size());
+  upper.emplace_back();
+  if (count == 1) {
+    const Cluster &cluster = clusters[clusterIds[first]];
+    upper[index] = {cluster.bounds, -1, -1, clusterIds[first], cluster.count,
+                    cluster.nodeCount, -1};
+    return index;
+  }
+
+  AABB centroidBounds;
+  for (int i = first; i < first + count; i++) {
+    centroidBounds.grow(clusters[clusterIds[i]].bounds.center());
+  }
+  int bestAxis = -1, bestBin = 0;
+  float bestCost = 1e30f;
+  for (int axis = 0; axis < 3 && depth < maxSahDepth; axis++) {
+    float lo = axisOf(centroidBounds.lo, axis);
+    float extent = axisOf(centroidBounds.hi, axis) - lo;
+    if (extent <= 0.0f) {
+      continue;
+    }
+    AABB binBounds[nBins];
+    int binCount[nBins] = {0};
+    for (int i = first; i < first + count; i++) {
+      const Cluster &cluster = clusters[clusterIds[i]];
+      float center = axisOf(cluster.bounds.center(), axis);
+      int bin = std::min(nBins - 1, int(nBins * (center - lo) / extent));
+      binCount[bin] += cluster.count;
+      binBounds[bin].grow(cluster.bounds);
+    }
+    float rightArea[nBins];
+    int rightCount[nBins];
+    AABB right;
+    int nRight = 0;
+    for (int bin = nBins - 1; bin > 0; bin--) {
+      right.grow(binBounds[bin]);
+      nRight += binCount[bin];
+      rightArea[bin] = right.surfaceArea();
+      rightCount[bin] = nRight;
+    }
+    AABB left;
+    int nLeft = 0;
+    for (int bin = 1; bin < nBins; bin++) {
+      left.grow(binBounds[bin - 1]);
+      nLeft += binCount[bin - 1];
+      if (nLeft == 0 || rightCount[bin] == 0) {
+        continue;
+      }
+      float cost =
+          left.surfaceArea() * nLeft + rightArea[bin] * rightCount[bin];
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestAxis = axis;
+        bestBin = bin;
+      }
+    }
+  }
+  int leftCount = count / 2;
+  if (bestAxis >= 0) {
+    float lo = axisOf(centroidBounds.lo, bestAxis);
+    float extent = axisOf(centroidBounds.hi, bestAxis) - lo;
+    auto middle = std::partition(
+        clusterIds.begin() + first, clusterIds.begin() + first + count,
+        [&](int id) {
+          return int(nBins *
+                     (axisOf(clusters[id].bounds.center(), bestAxis) - lo) /
+                     extent) < bestBin;
+        });
+    leftCount = int(middle - clusterIds.begin()) - first;
+  }
+
+  int left = buildUpper(clusterIds, first, leftCount, depth + 1);
+  int right = buildUpper(clusterIds, first + leftCount, count - leftCount,
+                         depth + 1);
+  UpperNode &node = upper[index];
+  node.bounds = merge(upper[left].bounds, upper[right].bounds);
+  node.left = left;
+  node.right = right;
+  node.cluster = -1;
+  node.count = upper[left].count + upper[right].count;
+  node.nodeCount = 1 + upper[left].nodeCount + upper[right].nodeCount;
+  return index;
+}
+
+// Places the upper nodes depth first and tells every cluster where its
+// nodes and primitives go.
+void ParallelBvhBuilder::layoutUpper(int index, int nodeOffset,
+                                     int primitiveOffset) {
+  UpperNode &node = upper[index];
+  node.nodeIndex = nodeOffset;
+  if (node.cluster >= 0) {
+    clusters[node.cluster].nodeOffset = nodeOffset;
+    clusters[node.cluster].primitiveOffset = primitiveOffset;
+    return;
+  }
+  const UpperNode &left = upper[node.left];
+  int rightOffset = nodeOffset + 1 + left.nodeCount;
+  nodes[nodeOffset] = {node.bounds, nodeOffset + 1, rightOffset,
+                       primitiveOffset, node.count, 0.0f};
+  layoutUpper(node.left, nodeOffset + 1, primitiveOffset);
+  layoutUpper(node.right, rightOffset, primitiveOffset + left.count);
+}
+
+} // namespace raytracer_cu
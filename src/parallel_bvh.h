@@ -0,0 +1,83 @@
+#ifndef PARALLEL_BVH_H
+#define PARALLEL_BVH_H
+
+#include <cstdint>
+#include <vector>
+
+#include "aabb.h"
+
+namespace raytracer_cu {
+
+class ThreadPool;
+
+struct ParallelBvhNode {
+  AABB bounds;
+  int left, right;  // -1 in leaves
+  int first, count; // the primitives below are order[first, first + count)
+  float cost;       // SAH cost of the subtree, as in Bvh
+};
+
+/*
+BVH build over many primitive boxes on a ThreadPool, for meshes of millions
+of triangles (HLBVH, Pantaleoni and Luebke, "HLBVH: Hierarchical LBVH
+Construction for Real-Time Ray Tracing of Dynamic Geometry", 2010):
+
+  1. 30 bit Morton codes of the box centers in the bounds of the centers,
+     sorted by a parallel radix sort (stable, so equal codes keep the input
+     order and the tree does not depend on the thread count)
+  2. the primitives sharing the top clusterBits bits of their code form a
+     cluster; every cluster gets its own LBVH subtree, split where the
+     highest differing bit of the codes flips (halving runs of equal codes),
+     down to leaves of at most leafSize primitives
+  3. a binned SAH tree over the clusters, each weighted by its primitive
+     count, joins the subtrees (halving after maxSahDepth levels)
+  4. the nodes are laid out depth first, as in Bvh: the subtree of node i
+     is a contiguous range starting at i, the left child is i + 1. order
+     lists the primitives in leaf order, so the leaf data can be stored in
+     that order.
+
+Steps 1, 2 and the layout run as parallelFor chunks; step 3 only sees the
+clusters (at most 2^clusterBits) and runs on the calling thread. The tree
+is somewhat worse than a full binned SAH build below the clusters, see
+bvh_build_bench. Host only.
+*/
+class ParallelBvhBuilder {
+private:
+  struct Cluster {
+    AABB bounds;
+    int first, count; // in Morton order
+    int nodeCount;
+    int nodeOffset, primitiveOffset; // in the final layout
+  };
+  struct UpperNode {
+    AABB bounds;
+    int left, right, cluster; // cluster >= 0 in leaves
+    int count, nodeCount;     // primitives and nodes below
+    int nodeIndex;            // in nodes
+  };
+
+  std::vector<uint64_t> keys; // code << 32 | primitive
+  std::vector<Cluster> clusters;
+  std::vector<UpperNode> upper;
+
+  void sortKeys(ThreadPool &pool);
+  int buildUpper(std::vector<int> &clusterIds, int first, int count,
+                 int depth);
+  void layoutUpper(int node, int nodeOffset, int primitiveOffset);
+
+public:
+  int leafSize = 1;
+  int clusterBits = 15;
+
+  std::vector<ParallelBvhNode> nodes;
+  std::vector<int> order; // primitives in leaf order
+
+  void build(const AABB *bounds, int n, ThreadPool &pool);
+  float sahCost() const {
+    return nodes.empty() ? 0.0f : nodes[0].cost / nodes[0].bounds.surfaceArea();
+  }
+};
+
+} // namespace raytracer_cu
+
+#endif
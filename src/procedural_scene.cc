@@ -0,0 +1,275 @@
+#include "procedural_scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "lod_mesh.h"
+#include "models.h"
+#include "random.h"
+#include "shader.h"
+#include "sphere.h"
+#include "triangle.h"
+
+namespace raytracer_cu {
+
+namespace {
+
+// Share of the cube's volume the objects take together.
+const float fillFraction = 0.15f;
+
+enum class Material { diffuse, mirror, glass };
+
+Material drawMaterial(const ProceduralSceneParams &params, uint32_t &state) {
+  float total = params.diffuse + params.mirror + params.glass;
+  float u = randomFloat(state) * (total > 0.0f ? total : 1.0f);
+  if (total <= 0.0f || u < params.diffuse) {
+    return Material::diffuse;
+  }
+  return u < params.diffuse + params.mirror ? Material::mirror
+                                            : Material::glass;
+}
+
+float3 drawColor(uint32_t &state) {
+  float r = 0.3f + 0.7f * randomFloat(state);
+  float g = 0.3f + 0.7f * randomFloat(state);
+  float b = 0.3f + 0.7f * randomFloat(state);
+  return make_float3(r, g, b);
+}
+
+template <class S>
+void setMaterial(S *shader, Material material, bool shadows) {
+  switch (material) {
+  case Material::diffuse:
+    shader->setProfile(1.0f, 0.0f, 0.0f);
+    break;
+  case Material::mirror:
+    shader->color = make_float3(0.9f, 0.9f, 0.9f);
+    shader->setProfile(0.1f, 0.9f, 0.0f);
+    break;
+  case Material::glass:
+    shader->setProfile(0.0f, 0.1f, 0.9f);
+    shader->refractiveIndex = 1.5f;
+    break;
+  }
+  shader->enableShadows = shadows;
+}
+
+bool parseInt(const std::string &text, int &value) {
+  char *end;
+  long v = strtol(text.c_str(), &end, 10);
+  if (text.empty() || *end != '\0' || v < 0) {
+    return false;
+  }
+  value = int(v);
+  return true;
+}
+
+bool parseFloat(const std::string &text, float &value) {
+  char *end;
+  float v = strtof(text.c_str(), &end);
+  if (text.empty() || *end != '\0' || v < 0.0f) {
+    return false;
+  }
+  value = v;
+  return true;
+}
+
+} // namespace
+
+void ProceduralScene::meshResolution(int meshTriangles, int &rings,
+                                     int &segments) {
+  // 4 * rings * (rings - 1) triangles
+  rings = std::max(2, int(std::lround(0.5 + std::sqrt(meshTriangles / 4.0))));
+  segments = 2 * rings;
+}
+
+ProceduralScene::~ProceduralScene() {
+#ifndef __CUDA_ARCH__
+  clear();
+#endif
+}
+
+void ProceduralScene::clear() {
+  for (uint64_t i = 0; i < sceneObjects.size(); i++) {
+    delete sceneObjects[i];
+  }
+  for (uint64_t i = 0; i < lights.size(); i++) {
+    delete lights[i];
+  }
+  for (Shader *shader : shaders) {
+    delete shader;
+  }
+  sceneObjects = EasyVector<Object *>(MemoryTag::geometry);
+  lights = EasyVector<Light *>(MemoryTag::geometry);
+  shaders.clear();
+}
+
+void ProceduralScene::buildScene() {
+#ifndef __CUDA_ARCH__
+  clear();
+  uint32_t state = pcgHash(params.seed);
+  float e = params.extent;
+
+  // The floor, the bottom face of the cube (+y is down) and twice as wide,
+  // facing up.
+  EasyVector<Triangle *> floor = Models::createSquare(
+      make_float3(-2.0f * e, e, -2.0f * e),
+      make_float3(2.0f * e, e, -2.0f * e), make_float3(2.0f * e, e, 2.0f * e),
+      make_float3(-2.0f * e, e, 2.0f * e), make_float3(0.8f, 0.8f, 0.8f));
+  auto floorMaterial = new GenericTriangleShader(make_float3(0.8f, 0.8f, 0.8f));
+  floorMaterial->setProfile(1.0f, 0.0f, 0.0f);
+  floorMaterial->enableShadows = params.shadows;
+  shaders.push_back(floorMaterial);
+  for (uint64_t i = 0; i < floor.size(); i++) {
+    floor[i]->setShader(floorMaterial);
+    sceneObjects.push_back(floor[i]);
+  }
+
+  int nObjects = params.nSpheres + params.nMeshes;
+  float meanRadius =
+      e * std::cbrt(6.0f * fillFraction / (3.14159265f * std::max(1, nObjects)));
+  auto drawCenter = [&](float radius) {
+    float x = -e + radius + randomFloat(state) * 2.0f * (e - radius);
+    float y = -e + radius + randomFloat(state) * 2.0f * (e - radius);
+    float z = -e + radius + randomFloat(state) * 2.0f * (e - radius);
+    return make_float3(x, y, z);
+  };
+  auto drawRadius = [&]() {
+    return std::min(0.5f * e, meanRadius * (0.5f + randomFloat(state)));
+  };
+
+  for (int i = 0; i < params.nSpheres; i++) {
+    float radius = drawRadius();
+    float3 center = drawCenter(radius);
+    float3 color = drawColor(state);
+    auto sphere = new Sphere(center, radius, color);
+    auto material = new GenericSphereShader(color);
+    setMaterial(material, drawMaterial(params, state), params.shadows);
+    shaders.push_back(material);
+    sphere->setShader(material);
+    sceneObjects.push_back(sphere);
+  }
+
+  int rings, segments;
+  meshResolution(params.meshTriangles, rings, segments);
+  for (int i = 0; i < params.nMeshes; i++) {
+    float radius = drawRadius();
+    float3 center = drawCenter(radius);
+    float3 color = drawColor(state);
+    auto material = new GenericTriangleShader(color);
+    setMaterial(material, drawMaterial(params, state), params.shadows);
+    shaders.push_back(material);
+    EasyVector<Triangle *> mesh =
+        Models::createSphereMesh(center, radius, rings, segments, color);
+    if (!params.lod) {
+      for (uint64_t t = 0; t < mesh.size(); t++) {
+        mesh[t]->setShader(material);
+        sceneObjects.push_back(mesh[t]);
+      }
+      continue;
+    }
+    std::vector<MeshTriangle> triangles(mesh.size());
+    for (uint64_t t = 0; t < mesh.size(); t++) {
+      triangles[t].v[0] = mesh[t]->vertex0;
+      triangles[t].v[1] = mesh[t]->vertex1;
+      triangles[t].v[2] = mesh[t]->vertex2;
+      triangles[t].uv[0] = mesh[t]->texCoord0;
+      triangles[t].uv[1] = mesh[t]->texCoord1;
+      triangles[t].uv[2] = mesh[t]->texCoord2;
+      triangles[t].normal = make_float3(0.0f, 0.0f, 0.0f);
+      delete mesh[t];
+    }
+    auto lodMesh = new LodMesh(color);
+    lodMesh->setShader(material);
+    lodMesh->build(triangles);
+    sceneObjects.push_back(lodMesh);
+  }
+
+  // Small area lights above the cube.
+  float lightSize = 0.25f * e;
+  for (int i = 0; i < params.nLights; i++) {
+    float x = (2.0f * randomFloat(state) - 1.0f) * e;
+    float z = (2.0f * randomFloat(state) - 1.0f) * e;
+    lights.push_back(new Light(make_float3(x, -1.5f * e, z),
+                               make_float3(1.0f, 1.0f, 1.0f),
+                               make_float3(lightSize, 0.0f, 0.0f),
+                               make_float3(0.0f, 0.0f, lightSize),
+                               params.shadowSamples));
+  }
+
+  buildAccelerationStructure();
+#endif
+}
+
+bool parseProceduralScene(const std::string &spec,
+                          ProceduralSceneParams &params) {
+  size_t start = 0;
+  while (start < spec.size()) {
+    size_t end = spec.find(',', start);
+    if (end == std::string::npos) {
+      end = spec.size();
+    }
+    std::string item = spec.substr(start, end - start);
+    start = end + 1;
+    size_t eq = item.find('=');
+    if (eq == std::string::npos) {
+      return false;
+    }
+    std::string key = item.substr(0, eq);
+    std::string value = item.substr(eq + 1);
+    bool ok;
+    int seed;
+    if (key == "spheres") {
+      ok = parseInt(value, params.nSpheres);
+    } else if (key == "meshes") {
+      ok = parseInt(value, params.nMeshes);
+    } else if (key == "triangles") {
+      ok = parseInt(value, params.meshTriangles);
+    } else if (key == "lod") {
+      ok = value == "0" || value == "1";
+      params.lod = value == "1";
+    } else if (key == "lights") {
+      ok = parseInt(value, params.nLights);
+    } else if (key == "diffuse") {
+      ok = parseFloat(value, params.diffuse);
+    } else if (key == "mirror") {
+      ok = parseFloat(value, params.mirror);
+    } else if (key == "glass") {
+      ok = parseFloat(value, params.glass);
+    } else if (key == "shadows") {
+      ok = value == "0" || value == "1";
+      params.shadows = value == "1";
+    } else if (key == "samples") {
+      ok = parseInt(value, params.shadowSamples) && params.shadowSamples > 0;
+    } else if (key == "extent") {
+      ok = parseFloat(value, params.extent) && params.extent > 0.0f;
+    } else if (key == "seed") {
+      ok = parseInt(value, seed);
+      if (ok) {
+        params.seed = uint32_t(seed);
+      }
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string describeProceduralScene(const ProceduralSceneParams &params) {
+  char text[256];
+  snprintf(text, sizeof(text),
+           "spheres=%d,meshes=%d,triangles=%d,lod=%d,lights=%d,diffuse=%g,"
+           "mirror=%g,glass=%g,shadows=%d,samples=%d,extent=%g,seed=%u",
+           params.nSpheres, params.nMeshes, params.meshTriangles,
+           int(params.lod), params.nLights, params.diffuse, params.mirror,
+           params.glass, int(params.shadows), params.shadowSamples,
+           params.extent, params.seed);
+  return text;
+}
+
+} // namespace raytracer_cu
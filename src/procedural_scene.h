@@ -0,0 +1,81 @@
+#ifndef PROCEDURAL_SCENE_H
+#define PROCEDURAL_SCENE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cudastuff.h"
+#include "raytracer_basics.h"
+
+namespace raytracer_cu {
+
+struct ProceduralSceneParams {
+  int nSpheres = 64;
+  int nMeshes = 0;
+  int meshTriangles = 1024; // per mesh, rounded to whole rings
+  bool lod = false; // the meshes as LodMesh objects (lod_mesh.h)
+  int nLights = 1;
+  // Share of the objects that get each material, normalized by their sum:
+  // matte, a mirror with a touch of diffuse, or clear glass.
+  float diffuse = 0.6f;
+  float mirror = 0.3f;
+  float glass = 0.1f;
+  bool shadows = true;
+  int shadowSamples = 1; // per area light and diffuse hit
+  // The objects fill the cube [-extent, extent]^3 (the room scene's
+  // cameras look at that), the floor is its bottom face.
+  float extent = 128.0f;
+  uint32_t seed = 1;
+};
+
+/*
+Random scene for scaling measurements, built with Models: nSpheres
+spheres and nMeshes tessellated sphere meshes of meshTriangles triangles
+each at random positions (they may overlap), sized so that the objects
+cover about the same volume whatever their number, on a matte floor
+square, lit by nLights small area lights above them. Every object draws
+its material from the diffuse / mirror / glass mix. The same params and
+seed give the same scene.
+
+The shading sums the lights without their color, so many lights brighten
+the image up to white; the work per hit still grows with nLights.
+
+Object ids: 0-1 the floor, then the spheres, then the mesh triangles (or
+one LodMesh per mesh).
+buildScene() again starts over with the current params. Host only.
+*/
+class ProceduralScene : public Scene {
+private:
+  std::vector<Shader *> shaders; // one per sphere or mesh, and the floor's
+
+  void clear();
+
+public:
+  ProceduralSceneParams params;
+
+  explicit ProceduralScene(const ProceduralSceneParams &params)
+      : params(params) {}
+  // Deletes the objects, lights and shaders it built.
+  CUDA_HOSTDEV ~ProceduralScene();
+  ProceduralScene(const ProceduralScene &) = delete;
+  ProceduralScene &operator=(const ProceduralScene &) = delete;
+  // Does nothing in device code.
+  CUDA_HOSTDEV void buildScene();
+  // Resolution of the meshes closest to meshTriangles, with segments =
+  // 2 * rings; a mesh has 2 * segments * (rings - 1) triangles.
+  static void meshResolution(int meshTriangles, int &rings, int &segments);
+};
+
+// Reads "key=value,..." into params, keys as in ProceduralSceneParams
+// without the n: spheres, meshes, triangles, lod (0/1), lights, diffuse,
+// mirror, glass, shadows (0/1), samples, extent, seed. Unset keys keep their
+// values. False on an unknown key or a malformed value.
+bool parseProceduralScene(const std::string &spec,
+                          ProceduralSceneParams &params);
+// The params in the same format.
+std::string describeProceduralScene(const ProceduralSceneParams &params);
+
+} // namespace raytracer_cu
+
+#endif
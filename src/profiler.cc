@@ -0,0 +1,143 @@
+#include "profiler.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace raytracer_cu {
+
+namespace {
+
+std::atomic<uint32_t> nextThreadId{0};
+thread_local uint32_t currentThreadId = ~0u;
+
+// Span names are literals from this code base, only quotes and backslashes
+// would need escaping.
+void writeString(std::ostream &os, const char *s) {
+  os << '"';
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') {
+      os << '\\';
+    }
+    os << *s;
+  }
+  os << '"';
+}
+
+} // namespace
+
+Profiler::Profiler(int requestedCapacity)
+    : epoch(std::chrono::steady_clock::now()) {
+  capacity = 1;
+  while (capacity < uint64_t(requestedCapacity)) {
+    capacity *= 2;
+  }
+  slots.reset(new Slot[capacity]);
+  for (int i = 0; i < maxThreads; i++) {
+    threadNames[i] = nullptr;
+  }
+}
+
+Profiler &Profiler::instance() {
+  static Profiler profiler;
+  return profiler;
+}
+
+int64_t Profiler::nowNs() const {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - epoch)
+      .count();
+}
+
+uint32_t Profiler::threadId() {
+  if (currentThreadId == ~0u) {
+    currentThreadId = nextThreadId.fetch_add(1);
+  }
+  return currentThreadId;
+}
+
+void Profiler::setThreadName(const char *name) {
+  uint32_t id = threadId();
+  if (id < uint32_t(maxThreads)) {
+    threadNames[id] = name;
+  }
+}
+
+void Profiler::record(const char *name, const char *category, int64_t startNs,
+                      int64_t durationNs, int arg) {
+  if (!enabled.load(std::memory_order_relaxed)) {
+    return;
+  }
+  uint64_t index = nextSlot.fetch_add(1, std::memory_order_relaxed);
+  Slot &slot = slots[index & (capacity - 1)];
+  slot.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.event = ProfileEvent{name,
+                            category,
+                            startNs,
+                            durationNs,
+                            frame.load(std::memory_order_relaxed),
+                            threadId(),
+                            arg};
+  slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+std::string Profiler::chromeTraceJson() {
+  std::ostringstream os;
+  os << "{\"traceEvents\":[\n";
+  bool first = true;
+  uint64_t end = nextSlot.load(std::memory_order_acquire);
+  uint64_t begin = end > capacity ? end - capacity : 0;
+  uint32_t maxThreadId = 0;
+  bool anyEvent = false;
+  for (uint64_t index = begin; index < end; index++) {
+    Slot &slot = slots[index & (capacity - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != index + 1) {
+      continue;
+    }
+    ProfileEvent event = slot.event;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != index + 1) {
+      continue; // overwritten while copying
+    }
+    char times[96];
+    snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f",
+             event.startNs / 1000.0, event.durationNs / 1000.0);
+    os << (first ? "" : ",\n") << "{\"name\":";
+    writeString(os, event.name);
+    os << ",\"cat\":";
+    writeString(os, event.category);
+    os << ",\"ph\":\"X\"," << times << ",\"pid\":1,\"tid\":" << event.threadId
+       << ",\"args\":{\"frame\":" << event.frame;
+    if (event.arg >= 0) {
+      os << ",\"arg\":" << event.arg;
+    }
+    os << "}}";
+    first = false;
+    anyEvent = true;
+    maxThreadId = event.threadId > maxThreadId ? event.threadId : maxThreadId;
+  }
+
+  // Thread names as metadata events.
+  for (uint32_t id = 0; anyEvent && id <= maxThreadId; id++) {
+    const char *name =
+        id < uint32_t(maxThreads) ? threadNames[id].load() : nullptr;
+    std::string label = name ? name : "thread " + std::to_string(id);
+    os << (first ? "" : ",\n")
+       << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << id
+       << ",\"args\":{\"name\":";
+    writeString(os, label.c_str());
+    os << "}}";
+    first = false;
+  }
+  os << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  return os.str();
+}
+
+bool Profiler::writeChromeTrace(const std::string &path) {
+  std::ofstream file(path);
+  file << chromeTraceJson();
+  return bool(file);
+}
+
+} // namespace raytracer_cu
@@ -0,0 +1,121 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace raytracer_cu {
+
+struct ProfileEvent {
+  const char *name;     // string literal, stored by pointer
+  const char *category; // "frame", "host", "tile", ...
+  int64_t startNs;      // since the profiler was created
+  int64_t durationNs;
+  uint32_t frame;
+  uint32_t threadId;
+  int arg; // tile / row range start, -1 if none
+};
+
+/*
+Frame timeline of the host side, written as Chrome trace event JSON
+(chrome://tracing, ui.perfetto.dev).
+
+Spans are recorded by the PROFILE_* macros below into a fixed size ring
+buffer shared by all threads (one atomic increment and a store per span,
+no locks); the oldest spans are overwritten. beginFrame() starts the next
+frame, every span carries the frame it was recorded in.
+
+writeChromeTrace(path) dumps what the ring buffer holds, threads are listed
+under the names given by setThreadName() (or "thread N"). A span being
+written while the dump runs is skipped.
+
+The macros compile to nothing unless RAYTRACER_PROFILING is defined (the
+CMake option of the same name, off in Release builds); the profiler itself
+is always there, its dumps are empty then.
+*/
+class Profiler {
+private:
+  struct Slot {
+    std::atomic<uint64_t> sequence{0}; // index + 1 once written, 0 while
+                                       // being written
+    ProfileEvent event;
+  };
+
+  std::unique_ptr<Slot[]> slots;
+  uint64_t capacity;
+  std::atomic<uint64_t> nextSlot{0};
+  std::atomic<uint32_t> frame{0};
+  std::atomic<bool> enabled{true};
+  std::chrono::steady_clock::time_point epoch;
+
+  static const int maxThreads = 256;
+  std::atomic<uint32_t> nThreads{0};
+  std::atomic<const char *> threadNames[maxThreads];
+
+public:
+  // capacity is rounded up to a power of two
+  explicit Profiler(int capacity = 1 << 16);
+  static Profiler &instance();
+
+  int64_t nowNs() const;
+  void record(const char *name, const char *category, int64_t startNs,
+              int64_t durationNs, int arg = -1);
+  uint32_t threadId();
+  void setThreadName(const char *name); // of the calling thread, a literal
+
+  uint32_t beginFrame() { return frame.fetch_add(1) + 1; }
+  uint32_t currentFrame() const { return frame.load(); }
+  void setEnabled(bool on) { enabled = on; }
+  bool isEnabled() const { return enabled; }
+  void clear() { nextSlot = 0; }
+
+  std::string chromeTraceJson();
+  bool writeChromeTrace(const std::string &path);
+};
+
+// Records the span from construction to destruction.
+class ProfileScope {
+private:
+  const char *name;
+  const char *category;
+  int arg;
+  int64_t startNs;
+
+public:
+  ProfileScope(const char *name, const char *category, int arg = -1)
+      : name(name), category(category), arg(arg),
+        startNs(Profiler::instance().nowNs()) {}
+  ~ProfileScope() {
+    Profiler &profiler = Profiler::instance();
+    profiler.record(name, category, startNs, profiler.nowNs() - startNs, arg);
+  }
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+};
+
+} // namespace raytracer_cu
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifdef RAYTRACER_PROFILING
+#define PROFILE_SCOPE(name, category)                                         \
+  ::raytracer_cu::ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(name,  \
+                                                                       category)
+#define PROFILE_SCOPE_ARG(name, category, arg)                                \
+  ::raytracer_cu::ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(       \
+      name, category, arg)
+#define PROFILE_BEGIN_FRAME() ::raytracer_cu::Profiler::instance().beginFrame()
+#define PROFILE_THREAD_NAME(name)                                             \
+  ::raytracer_cu::Profiler::instance().setThreadName(name)
+#else
+#define PROFILE_SCOPE(name, category) ((void)0)
+#define PROFILE_SCOPE_ARG(name, category, arg) ((void)0)
+#define PROFILE_BEGIN_FRAME() ((void)0)
+#define PROFILE_THREAD_NAME(name) ((void)0)
+#endif
+
+#endif
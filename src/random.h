@@ -0,0 +1,39 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+#include "cudastuff.h"
+
+namespace raytracer_cu {
+
+// Small stateless-hash RNG usable from both the trace kernel and host code.
+// A pixel seeds its state with pixelSeed() and every ray spawned from that
+// pixel carries the state along (Ray::seed).
+
+// PCG hash, see Jarzynski and Olano, "Hash Functions for GPU Rendering", 2020.
+CUDA_HOSTDEV inline uint32_t pcgHash(uint32_t v) {
+  uint32_t state = v * 747796405u + 2891336453u;
+  uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+CUDA_HOSTDEV inline uint32_t pixelSeed(int x, int y, uint32_t frameIndex) {
+  return pcgHash(uint32_t(x) ^ pcgHash(uint32_t(y) ^ pcgHash(frameIndex)));
+}
+
+// Returns a float in [0, 1) and advances the state.
+CUDA_HOSTDEV inline float randomFloat(uint32_t &state) {
+  state = pcgHash(state);
+  return float(state >> 8) * (1.0f / 16777216.0f);
+}
+
+// Derives the state of a child ray and advances the parent state.
+CUDA_HOSTDEV inline uint32_t splitSeed(uint32_t &state) {
+  state = pcgHash(state);
+  return state ^ 0x5bd1e995u;
+}
+
+} // namespace raytracer_cu
+
+#endif
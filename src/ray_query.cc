@@ -0,0 +1,69 @@
+#include "ray_query.h"
+
+#include "profiler.h"
+
+namespace raytracer_cu {
+
+namespace {
+
+inline float maxDistanceOf(const RayBatch &rays, size_t i) {
+  return rays.maxDistances ? rays.maxDistances[i] : rays.maxDistance;
+}
+
+} // namespace
+
+// Calls fn(first, last) per block of grain rays on the pool; the block
+// index keeps batches beyond the int range of parallelFor usable.
+template <class Fn>
+void RayQuery::forEachBlock(size_t count, Fn fn) const {
+  size_t blockSize = grain > 0 ? grain : 1;
+  int nBlocks = int((count + blockSize - 1) / blockSize);
+  pool.parallelFor(0, nBlocks, 1, [&](int blockBegin, int blockEnd) {
+    for (int block = blockBegin; block < blockEnd; block++) {
+      size_t first = size_t(block) * blockSize;
+      size_t last = first + blockSize < count ? first + blockSize : count;
+      fn(first, last);
+    }
+  });
+}
+
+void RayQuery::closestHits(const RayBatch &rays, const HitBatch &hits) const {
+  PROFILE_SCOPE("RayQuery::closestHits", "host");
+  forEachBlock(rays.count, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; i++) {
+      Ray ray(rays.origins[i], rays.directions[i]);
+      Intersection hit;
+      int objectId = -1;
+      if (scene->closestIntersection(ray, hit)) {
+        float distance = length(hit.surfacePoint - ray.origin);
+        if (distance < maxDistanceOf(rays, i)) {
+          objectId = hit.objectId;
+          if (hits.distances) {
+            hits.distances[i] = distance;
+          }
+          if (hits.points) {
+            hits.points[i] = hit.surfacePoint;
+          }
+          if (hits.normals) {
+            hits.normals[i] = hit.surfaceNormal;
+          }
+        }
+      }
+      if (hits.objectIds) {
+        hits.objectIds[i] = objectId;
+      }
+    }
+  });
+}
+
+void RayQuery::occluded(const RayBatch &rays, uint8_t *flags) const {
+  PROFILE_SCOPE("RayQuery::occluded", "host");
+  forEachBlock(rays.count, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; i++) {
+      Ray ray(rays.origins[i], rays.directions[i]);
+      flags[i] = scene->occluded(ray, maxDistanceOf(rays, i)) ? 1 : 0;
+    }
+  });
+}
+
+} // namespace raytracer_cu
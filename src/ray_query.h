@@ -0,0 +1,80 @@
+#ifndef RAY_QUERY_H
+#define RAY_QUERY_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "cuda_runtime.h"
+
+#include "math.h"
+#include "raytracer_basics.h"
+#include "thread_pool.h"
+
+namespace raytracer_cu {
+
+/*
+A batch of query rays in structure of arrays layout: ray i starts at
+origins[i] and runs along directions[i] (any length but 0). Only hits
+closer than maxDistances[i] to the origin count, or closer than
+maxDistance for every ray if maxDistances is null. The scene ignores
+everything beyond 99999 units either way.
+*/
+struct RayBatch {
+  const float3 *origins = nullptr;
+  const float3 *directions = nullptr;
+  const float *maxDistances = nullptr;
+  float maxDistance = 1e30f;
+  size_t count = 0;
+};
+
+/*
+Where closestHits() writes its results, ray i into element i of every
+array that is not null:
+
+  objectIds  index into Scene::sceneObjects, -1 if nothing was hit (the
+             other arrays then keep what they had)
+  distances  from the ray origin to the hit, in world units
+  points     hit point
+  normals    surface normal at the hit, as the object reports it
+*/
+struct HitBatch {
+  int *objectIds = nullptr;
+  float *distances = nullptr;
+  float3 *points = nullptr;
+  float3 *normals = nullptr;
+};
+
+/*
+Batched visibility and nearest hit queries against a host resident scene,
+for callers that need the geometry but not the shading (occlusion for
+audio, sensor rays, picking). Results refer to objects by their index, not
+by pointer, and are the same as tracing the rays one by one with
+Scene::closestIntersection / Scene::occluded.
+
+closestHits(rays, hits):  nearest hit of every ray
+occluded(rays, flags):    flags[i] = 1 if anything is hit closer than the
+                          maximum distance of ray i, else 0; stops at the
+                          first hit found, which makes it the cheaper call
+
+The batch is cut into blocks of `grain` rays spread over the thread pool,
+each call returns when all rays are done. Any number of threads may query
+at the same time; the scene must not change while a query runs.
+*/
+class RayQuery {
+private:
+  Scene *scene;
+  ThreadPool &pool;
+
+  template <class Fn> void forEachBlock(size_t count, Fn fn) const;
+
+public:
+  size_t grain = 4096;
+
+  RayQuery(Scene *scene, ThreadPool &pool) : scene(scene), pool(pool) {}
+  void closestHits(const RayBatch &rays, const HitBatch &hits) const;
+  void occluded(const RayBatch &rays, uint8_t *flags) const;
+};
+
+} // namespace raytracer_cu
+
+#endif
@@ -4,6 +4,8 @@
 
 #include "basic_types.h"
 #include "cudastuff.h"
+#include "irradiance_cache.h"
+#include "random.h"
 
 namespace raytracer_cu {
 
@@ -54,41 +56,76 @@ CUDA_HOSTDEV bool _closestIntersection(Ray &ray, EasyVector<Object *> &objects,
 
 float3 Scene::computeDiffuseComponent(float3 &surfacePoint,
                                       float3 &surfaceNormal,
-                                      float3 &surfaceColor, bool shadows) {
+                                      float3 &surfaceColor, bool shadows,
+                                      uint32_t &seed,
+                                      const Ray &shadowRay) {
+#ifndef __CUDA_ARCH__
+  if (irradianceCache) {
+    return surfaceColor * irradianceCache->lookup(*this, surfacePoint,
+                                                  surfaceNormal, shadows,
+                                                  shadowRay);
+  }
+#endif
+  return directLighting(surfacePoint, surfaceNormal, surfaceColor, shadows,
+                        seed, shadowRay);
+}
+
+float3 Scene::directLighting(float3 &surfacePoint, float3 &surfaceNormal,
+                             float3 &surfaceColor, bool shadows,
+                             uint32_t &seed, const Ray &shadowRay,
+                             int samplesPerAreaLight) {
   float3 diffuseReflection = make_float3(0.0f, 0.0f, 0.0f);
 
   for (int lightId = 0; lightId < lights.size(); lightId++) {
 
     Light *light = lights[lightId];
-    float3 surfacePointToLight = light->lightPosition - surfacePoint;
-    float3 surfacePointToLightNormalized =
-        div(surfacePointToLight, length(surfacePointToLight));
-    float angle = dot(surfacePointToLightNormalized, surfaceNormal);
+    bool areaLight = light->isAreaLight();
+    int nSamples = areaLight ? (samplesPerAreaLight > 0
+                                    ? samplesPerAreaLight
+                                    : light->nShadowSamples)
+                             : 1;
 
-    // Generate shadow ray
-    bool rayOccluded = false;
-    if (shadows) {
+    // Area lights are estimated with a few random points per hit, the noise
+    // is left to the denoiser.
+    float3 lightContribution = make_float3(0.0f, 0.0f, 0.0f);
+    for (int sampleId = 0; sampleId < nSamples; sampleId++) {
+      float3 lightPoint = light->lightPosition;
+      if (areaLight) {
+        float u = randomFloat(seed);
+        float v = randomFloat(seed);
+        lightPoint = light->samplePoint(u, v);
+      }
 
-      // float3 occludedObjSurfPt;
-      // float3 unused;
-      // int occludedObjectId;
+      float3 surfacePointToLight = lightPoint - surfacePoint;
+      float3 surfacePointToLightNormalized =
+          div(surfacePointToLight, length(surfacePointToLight));
+      float angle = dot(surfacePointToLightNormalized, surfaceNormal);
 
-      Ray shadowRay(surfacePoint, surfacePointToLight);
+      // Generate shadow ray
+      bool rayOccluded = false;
+      if (shadows && angle >= 0.) {
+        Ray ray = shadowRay;
+        ray.origin = surfacePoint;
+        ray.direction = surfacePointToLight;
 
-      Intersection closestObject;
-      bool occlusion = closestIntersection(shadowRay, closestObject);
+        Intersection closestObject;
+        bool occlusion = closestIntersection(ray, closestObject, true);
 
-      float occludedObjDist = length(closestObject.surfacePoint - surfacePoint);
+        float occludedObjDist =
+            length(closestObject.surfacePoint - surfacePoint);
 
-      float lightDist = length(surfacePointToLight);
-      if (occlusion && occludedObjDist < lightDist) {
-        rayOccluded = true;
+        float lightDist = length(surfacePointToLight);
+        if (occlusion && occludedObjDist < lightDist) {
+          rayOccluded = true;
+        }
       }
-    }
 
-    if (angle >= 0. && !rayOccluded) {
-      diffuseReflection = diffuseReflection + surfaceColor * angle;
+      if (angle >= 0. && !rayOccluded) {
+        lightContribution = lightContribution + surfaceColor * angle;
+      }
     }
+    diffuseReflection =
+        diffuseReflection + div(lightContribution, float(nSamples));
   }
   return diffuseReflection;
 }
@@ -99,20 +136,72 @@ bool Scene::closestIntersection(Ray &incidentRay,
 
   float3 unused;
 
+  RayCost *cost = incidentRay.cost;
+  if (cost) {
+    cost->rays++;
+    if (!shadowRay) {
+      uint32_t depth = cost->primaryBounces - incidentRay.bounces + 1;
+      cost->maxDepth = depth > cost->maxDepth ? depth : cost->maxDepth;
+    }
+  }
+
   int intersectedObjectId;
-  bool hit = _closestIntersection(incidentRay, sceneObjects,
-                                  surfaceIntersection.surfacePoint,
-                                  surfaceIntersection.surfaceNormal, unused,
-                                  intersectedObjectId, shadowRay);
+  bool hit;
+  if (bvh.objectCount() == int(sceneObjects.size())) {
+    hit = bvh.closestHit(incidentRay, sceneObjects,
+                         surfaceIntersection.surfacePoint,
+                         surfaceIntersection.surfaceNormal, unused,
+                         intersectedObjectId);
+  } else {
+    if (cost) {
+      cost->intersectionTests += sceneObjects.size();
+    }
+    hit = _closestIntersection(incidentRay, sceneObjects,
+                               surfaceIntersection.surfacePoint,
+                               surfaceIntersection.surfaceNormal, unused,
+                               intersectedObjectId, shadowRay);
+  }
   if (hit) {
     surfaceIntersection.object = sceneObjects[intersectedObjectId];
+    surfaceIntersection.objectId = intersectedObjectId;
+    surfaceIntersection.level = 0;
+    surfaceIntersection.footprint =
+        incidentRay.coneWidth +
+        incidentRay.coneSpread *
+            length(surfaceIntersection.surfacePoint - incidentRay.origin);
   }
   return hit;
 }
 
+bool Scene::occluded(Ray &ray, float maxDistance) {
+  if (ray.cost) {
+    ray.cost->rays++;
+  }
+  if (bvh.objectCount() == int(sceneObjects.size())) {
+    return bvh.anyHit(ray, sceneObjects, maxDistance);
+  }
+  maxDistance = maxDistance < 99999.0f ? maxDistance : 99999.0f;
+  int nObjects = int(sceneObjects.size());
+  for (int o_id = 0; o_id < nObjects; o_id++) {
+    if (ray.cost) {
+      ray.cost->intersectionTests++;
+    }
+    float3 point, n, c;
+    if (sceneObjects[o_id]->intersect(ray, point, n, c) &&
+        length(point - ray.origin) < maxDistance) {
+      return true;
+    }
+  }
+  return false;
+}
+
 bool Scene::trace(Ray &ray, float3 &emittedColor) {
   Intersection surfaceIntersection;
+  return trace(ray, emittedColor, surfaceIntersection);
+}
 
+bool Scene::trace(Ray &ray, float3 &emittedColor,
+                  Intersection &surfaceIntersection) {
   bool hit = closestIntersection(ray, surfaceIntersection);
   if (hit) {
     emittedColor =
@@ -121,15 +210,35 @@ bool Scene::trace(Ray &ray, float3 &emittedColor) {
   return hit;
 }
 
+void Scene::buildAccelerationStructure() {
+#ifndef __CUDA_ARCH__
+  if (buildPool) {
+    bvh.build(sceneObjects, *buildPool);
+    return;
+  }
+#endif
+  bvh.build(sceneObjects);
+}
+
+BvhUpdateStats Scene::updateAccelerationStructure() {
+  return bvh.update(sceneObjects);
+}
+
 void Scene::transform(mat3x3 trans) {
   for (int i = 0; i < sceneObjects.size(); i++) {
     Object *o = sceneObjects[i];
     o->transform(trans);
   }
+  if (bvh.objectCount() > 0) {
+    bvh.markAllDirty();
+    bvh.update(sceneObjects);
+  }
 
   for (int i = 0; i < lights.size(); i++) {
     Light *l = lights[i];
     l->lightPosition = mm<3>(trans, l->lightPosition);
+    l->edge1 = mm<3>(trans, l->edge1);
+    l->edge2 = mm<3>(trans, l->edge2);
   }
 }
 
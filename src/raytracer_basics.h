@@ -4,8 +4,11 @@
 #include <memory>
 #include <vector>
 
+#include "aabb.h"
 #include "basic_types.h"
+#include "bvh.h"
 #include "cudastuff.h"
+#include "memory_tracker.h"
 
 #include "math.h"
 #include "cuda_runtime.h"
@@ -47,19 +50,66 @@ public:
 
 #endif
 
+class IrradianceCache;
 class Object;
+class Shader;
+class ThreadPool;
+class VirtualTexture;
 
 typedef struct {
   float3 surfacePoint;
   float3 surfaceNormal;
   Object *object;
+  int objectId;
+  float footprint; // width of the ray's pixel cone at the hit, 0 if unknown
+  int level;       // level of detail of the hit (LodMesh), 0 otherwise
 } Intersection;
 
+// How a surface responds to a ray without tracing anything further: the
+// color the diffuse term is computed with and which secondary rays the
+// material would spawn. Unshaded objects (no shader) just show diffuseColor.
+// Used by renderers that schedule the secondary rays themselves.
+typedef struct {
+  bool shaded;
+  float3 diffuseColor;
+  bool reflect;
+  bool refract;
+  float refractiveIndex;
+} SurfaceResponse;
+
+// Work done for one pixel, counted by the rays that point to it (see
+// Ray::cost); secondary and shadow rays count into their parent's.
+struct RayCost {
+  uint32_t intersectionTests = 0; // ray-object tests, meshes add their
+                                  // ray-triangle tests
+  uint32_t nodeVisits = 0;        // BVH nodes visited, meshes add theirs
+  uint32_t rays = 0;              // primary, secondary and shadow rays
+  uint32_t maxDepth = 0;          // deepest bounce reached, primary = 1
+  uint32_t primaryBounces = 0;    // bounce budget of the primary ray
+};
+
 class Ray {
 public:
-  uint32_t bounces;
+  uint32_t bounces = 1;
   float3 origin;
   float3 direction;
+  uint32_t seed = 0; // RNG state of the pixel this ray belongs to
+  // Weight of the radiance this ray brings back in its pixel: the product of
+  // the shader weights along the path from the eye.
+  float throughput = 1.0f;
+  RayCost *cost = nullptr; // counters of the pixel, if it is being measured
+  // Pixel cone: width at the origin and its growth per unit of distance,
+  // for picking texture levels; 0 for rays that are not from a pixel.
+  float coneWidth = 0.0f;
+  float coneSpread = 0.0f;
+  // Surfaces between the eye and this ray: 0 for primary rays (and for
+  // rays that are not from a pixel), 1 for the reflection, refraction and
+  // shadow rays of their hits, and so on.
+  uint32_t generation = 0;
+  // The surface the ray leaves, its object and level of detail (as in
+  // Intersection), nullptr for rays from the eye and queries.
+  const Object *source = nullptr;
+  int sourceLevel = 0;
   CUDA_HOSTDEV Ray(){};
   CUDA_HOSTDEV Ray(float3 origin, float3 direction, uint32_t bounces = 1)
       : origin(origin), direction(direction), bounces(bounces) {}
@@ -70,48 +120,122 @@ CUDA_HOSTDEV bool _closestIntersection(Ray &ray, EasyVector<Object *> &objects,
                                        float3 &c, int &intersectedObjectId);
 
 std::ostream &operator<<(std::ostream &os, Ray r);
-std::ostream &operator<<(std::ostream &os, float3 o);
 CUDA_HOSTDEV float3 normalize(float3 &inp);
 template <typename T> int sgn(T val);
 
+// A point light, or a rectangular area light if the edges are non-zero.
+// Area lights are centered at lightPosition and spanned by edge1 and edge2;
+// each diffuse hit casts nShadowSamples shadow rays to random points on it.
 class Light {
 public:
+  MEMORY_TAGGED_NEW(MemoryTag::geometry)
+
   float3 lightPosition;
   float3 lightColor;
+  float3 edge1 = make_float3(0.0f, 0.0f, 0.0f);
+  float3 edge2 = make_float3(0.0f, 0.0f, 0.0f);
+  int nShadowSamples = 1;
   CUDA_HOSTDEV Light(float3 lightPosition, float3 lightColor)
       : lightPosition(lightPosition), lightColor(lightColor) {}
+  CUDA_HOSTDEV Light(float3 lightPosition, float3 lightColor, float3 edge1,
+                     float3 edge2, int nShadowSamples)
+      : lightPosition(lightPosition), lightColor(lightColor), edge1(edge1),
+        edge2(edge2), nShadowSamples(nShadowSamples) {}
+  CUDA_HOSTDEV bool isAreaLight() {
+    return dot(edge1, edge1) > 0.0f && dot(edge2, edge2) > 0.0f;
+  }
+  CUDA_HOSTDEV float3 samplePoint(float u, float v) {
+    return lightPosition + (u - 0.5f) * edge1 + (v - 0.5f) * edge2;
+  }
 };
 
+/*
+The scene owns a BVH over sceneObjects (see bvh.h), built by
+buildAccelerationStructure() once the objects are in place (on buildPool
+if the host set it before buildScene()). While the tree
+covers every object, closestIntersection() traverses it, otherwise it falls
+back to testing every object.
+
+Objects moved by anything else than Scene::transform() must be reported
+with markDirty(objectId); updateAccelerationStructure() then refits the
+tree (Scene::transform() refits by itself).
+*/
 class Scene {
 public:
-  EasyVector<Object *> sceneObjects;
-  EasyVector<Light *> lights;
-  EasyVector<ColorBuffer<float3> *> textures;
+  EasyVector<Object *> sceneObjects{MemoryTag::geometry};
+  EasyVector<Light *> lights{MemoryTag::geometry};
+  EasyVector<ColorBuffer<float3> *> textures{MemoryTag::textures};
+  // Streamed in place of textures[i] by the host renderers when set (see
+  // virtual_texture.h), never on the device.
+  EasyVector<VirtualTexture *> virtualTextures;
+  // Answers computeDiffuseComponent in the host renderers when set (see
+  // irradiance_cache.h), never on the device.
+  IrradianceCache *irradianceCache = nullptr;
+  // Builds the BVH in parallel on the host when set (Bvh::build(objects,
+  // pool)), never on the device.
+  ThreadPool *buildPool = nullptr;
   int nTextures;
-
+  Bvh bvh;
+  // Bounces left to primary rays unless the renderer asks for another
+  // budget, and the throughput below which secondary rays are not traced
+  // (their contribution stays under a fraction of an 8 bit step).
+  int maxBounces = 3;
+  float minThroughput = 1.0f / 512.0f;
+
+  CUDA_HOSTDEV void buildAccelerationStructure();
+  CUDA_HOSTDEV void markDirty(int objectId) { bvh.markDirty(objectId); }
+  CUDA_HOSTDEV BvhUpdateStats updateAccelerationStructure();
   CUDA_HOSTDEV void transform(mat3x3 trans);
   CUDA_HOSTDEV bool closestIntersection(Ray &ray, Intersection &result, bool shadowRay=false);
+  // Whether anything is hit closer than maxDistance, the first hit found
+  // ends the search.
+  CUDA_HOSTDEV bool occluded(Ray &ray, float maxDistance);
   CUDA_HOSTDEV bool trace(Ray &ray, float3 &result_color);
+  CUDA_HOSTDEV bool trace(Ray &ray, float3 &result_color,
+                          Intersection &hit);
+  // shadowRay is the prototype of the shadow rays (Shader::shadowRay), its
+  // origin and direction are set per light sample.
   CUDA_HOSTDEV float3 computeDiffuseComponent(float3 &surfPt,
                                                  float3 &srufN,
                                                  float3 &surfCol,
-                                                 bool shadows);
+                                                 bool shadows,
+                                                 uint32_t &seed,
+                                                 const Ray &shadowRay);
+  // computeDiffuseComponent without the irradiance cache, with
+  // samplesPerAreaLight shadow rays per area light (0: its nShadowSamples).
+  CUDA_HOSTDEV float3 directLighting(float3 &surfPt, float3 &surfN,
+                                     float3 &surfCol, bool shadows,
+                                     uint32_t &seed, const Ray &shadowRay,
+                                     int samplesPerAreaLight = 0);
   CUDA_HOSTDEV virtual void buildScene() = 0;
+  CUDA_HOSTDEV virtual ~Scene() {}
 };
 
 class Object {
 public:
+  MEMORY_TAGGED_NEW(MemoryTag::geometry)
+
   float3 color;
 
   CUDA_HOSTDEV Object() {}
+  CUDA_HOSTDEV virtual ~Object() {}
 
   CUDA_HOSTDEV Object(float3 color) : color(color) {}
   CUDA_HOSTDEV virtual bool intersect(Ray &ray, float3 &outIntersectionPoint,
                                       float3 &outNormal,
                                       float3 &outColor) = 0;
   CUDA_HOSTDEV virtual void transform(mat3x3 &transformMatrix) = 0;
+  CUDA_HOSTDEV virtual AABB bounds() = 0;
   CUDA_HOSTDEV virtual float3 excite(Scene *scene, Ray &incidentRay,
                                         Intersection &intersection) = 0;
+  CUDA_HOSTDEV virtual Shader *getShader() = 0;
+  CUDA_HOSTDEV virtual SurfaceResponse respond(Ray &incidentRay,
+                                               Intersection &intersection) = 0;
+  // The plane dot(normal, p) = offset of a flat object as (normal, offset),
+  // false if it is not flat.
+  CUDA_HOSTDEV virtual bool plane(float3 &, float &) {
+    return false;
+  }
 };
 } // namespace raytracer_cu
 
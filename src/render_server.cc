@@ -0,0 +1,265 @@
+#include "render_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "net.h"
+
+namespace raytracer_cu {
+
+namespace {
+
+float millisecondsBetween(std::chrono::steady_clock::time_point from,
+                          std::chrono::steady_clock::time_point to) {
+  return std::chrono::duration<float, std::milli>(to - from).count();
+}
+
+bool sendResponse(int fd, const RenderResponseHeader &header,
+                  const std::vector<uint8_t> &image) {
+  return sendAll(fd, &header, sizeof(header)) &&
+         (image.empty() || sendAll(fd, image.data(), image.size()));
+}
+
+} // namespace
+
+RenderServer::Client::~Client() { closeSocket(fd); }
+
+RenderServer::RenderServer(Scene *scene, ThreadPool &pool,
+                           const std::string &socketPath)
+    : pool(pool), renderer(scene, pool), socketPath(socketPath) {
+  listenFd = listenUnix(socketPath);
+  if (listenFd < 0) {
+    std::cerr << "RenderServer: can not listen on " << socketPath << ": "
+              << strerror(errno) << std::endl;
+    return;
+  }
+  acceptThread = std::thread(&RenderServer::acceptLoop, this);
+  batchThread = std::thread(&RenderServer::batchLoop, this);
+}
+
+RenderServer::~RenderServer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    // Wakes the readers blocked in recv, the descriptors stay valid until
+    // the last job of the client is gone.
+    for (auto &client : clients) {
+      shutdown(client->fd, SHUT_RDWR);
+    }
+  }
+  queued.notify_all();
+  if (listenFd >= 0) {
+    shutdown(listenFd, SHUT_RDWR);
+  }
+  if (acceptThread.joinable()) {
+    acceptThread.join();
+  }
+  if (batchThread.joinable()) {
+    batchThread.join();
+  }
+  for (auto &client : clients) {
+    client->reader.join();
+  }
+  closeSocket(listenFd);
+  if (listenFd >= 0) {
+    unlink(socketPath.c_str());
+  }
+}
+
+RenderServerStats RenderServer::stats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return serverStats;
+}
+
+void RenderServer::acceptLoop() {
+  while (true) {
+    int fd = acceptConnection(listenFd);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping) {
+      closeSocket(fd);
+      return;
+    }
+    if (fd < 0) {
+      continue;
+    }
+
+    // Forget the clients that hung up, their pending jobs keep them alive.
+    auto done = std::partition(
+        clients.begin(), clients.end(),
+        [](const std::shared_ptr<Client> &client) { return !client->finished; });
+    for (auto it = done; it != clients.end(); ++it) {
+      (*it)->reader.join();
+    }
+    clients.erase(done, clients.end());
+
+    std::shared_ptr<Client> client = std::make_shared<Client>();
+    client->fd = fd;
+    client->reader = std::thread(&RenderServer::readRequests, this, client);
+    clients.push_back(client);
+  }
+}
+
+bool RenderServer::validRequest(const RenderRequest &request) const {
+  return request.width > 0 && request.height > 0 &&
+         int64_t(request.width) * request.height <= maxPixels &&
+         request.samples > 0 && request.samples <= maxSamples &&
+         request.maxBounces >= 0 && request.maxBounces <= maxBounces &&
+         (request.format == ImageFormat::PPM ||
+          request.format == ImageFormat::QOI);
+}
+
+void RenderServer::readRequests(std::shared_ptr<Client> client) {
+  RenderRequest request;
+  while (recvAll(client->fd, &request, sizeof(request))) {
+    if (!validRequest(request)) {
+      RenderResponseHeader header = {};
+      header.requestId = request.requestId;
+      header.status = RenderStatus::BadRequest;
+      std::lock_guard<std::mutex> sendLock(client->sendMutex);
+      sendResponse(client->fd, header, std::vector<uint8_t>());
+      continue;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping) {
+      break;
+    }
+    Job job;
+    job.client = client;
+    job.request = request;
+    job.received = Clock::now();
+    queue.push_back(std::move(job));
+    queued.notify_all();
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  client->finished = true;
+}
+
+void RenderServer::batchLoop() {
+  std::vector<Job> batch;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      queued.wait(lock, [this] { return stopping || !queue.empty(); });
+      if (stopping) {
+        return;
+      }
+      // Give concurrent clients a moment to add to the batch.
+      auto deadline =
+          queue.front().received + std::chrono::milliseconds(batchWindowMs);
+      queued.wait_until(lock, deadline, [this] {
+        return stopping || int(queue.size()) >= maxBatchSize;
+      });
+      if (stopping) {
+        return;
+      }
+      int n = std::min(int(queue.size()), maxBatchSize);
+      for (int i = 0; i < n; i++) {
+        batch.push_back(std::move(queue.front()));
+        queue.pop_front();
+      }
+    }
+    renderBatch(batch);
+    batch.clear();
+  }
+}
+
+void RenderServer::renderBatch(std::vector<Job> &batch) {
+  auto start = Clock::now();
+
+  // Rows of all requests, numbered consecutively. A request is rendered
+  // when its last row is done, its render time ends there.
+  std::vector<int> firstRow(batch.size() + 1, 0);
+  std::unique_ptr<std::atomic<int>[]> rowsLeft(
+      new std::atomic<int>[batch.size()]);
+  std::vector<float> renderMs(batch.size());
+  for (size_t i = 0; i < batch.size(); i++) {
+    const RenderRequest &request = batch[i].request;
+    batch[i].pixels.resize(size_t(request.width) * request.height * 4);
+    firstRow[i + 1] = firstRow[i] + request.height;
+    rowsLeft[i] = request.height;
+  }
+
+  pool.parallelFor(0, firstRow.back(), renderer.rowsPerTask,
+                   [&](int rowBegin, int rowEnd) {
+    for (int row = rowBegin; row < rowEnd; row++) {
+      int i = int(std::upper_bound(firstRow.begin(), firstRow.end(), row) -
+                  firstRow.begin()) - 1;
+      const RenderRequest &request = batch[i].request;
+      int2 size = make_int2(request.width, request.height);
+      int y = row - firstRow[i];
+      for (int x = 0; x < request.width; x++) {
+        float3 color = make_float3(0.0f, 0.0f, 0.0f);
+        for (int s = 0; s < request.samples; s++) {
+          color = color + renderer.tracePixel(request.camera, size, uint32_t(s),
+                                              request.maxBounces, x, y);
+        }
+        storePixel(batch[i].pixels.data(), y * request.width + x,
+                   color * (1.0f / request.samples));
+      }
+      if (rowsLeft[i].fetch_sub(1) == 1) {
+        renderMs[i] = millisecondsBetween(start, Clock::now());
+      }
+    }
+  });
+  float batchMs = millisecondsBetween(start, Clock::now());
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    serverStats.requests += batch.size();
+    serverStats.batches++;
+    serverStats.renderMs += batchMs;
+  }
+
+  std::vector<std::vector<uint8_t>> images(batch.size());
+  std::vector<float> encodeMs(batch.size());
+  pool.parallelFor(0, int(batch.size()), 1, [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      auto encodeStart = Clock::now();
+      const RenderRequest &request = batch[i].request;
+      images[i] = encodeImage(request.format, batch[i].pixels.data(),
+                              request.width, request.height);
+      encodeMs[i] = millisecondsBetween(encodeStart, Clock::now());
+    }
+  });
+
+  for (size_t i = 0; i < batch.size(); i++) {
+    RenderResponseHeader header;
+    header.requestId = batch[i].request.requestId;
+    header.status = RenderStatus::Ok;
+    header.queueMs = millisecondsBetween(batch[i].received, start);
+    header.renderMs = renderMs[i];
+    header.encodeMs = encodeMs[i];
+    header.batchSize = uint32_t(batch.size());
+    header.size = uint32_t(images[i].size());
+    Client &client = *batch[i].client;
+    // A client that hung up only loses its own responses.
+    std::lock_guard<std::mutex> sendLock(client.sendMutex);
+    sendResponse(client.fd, header, images[i]);
+  }
+}
+
+int connectRenderServer(const std::string &socketPath) {
+  return connectUnix(socketPath);
+}
+
+bool sendRenderRequest(int fd, const RenderRequest &request) {
+  return sendAll(fd, &request, sizeof(request));
+}
+
+bool receiveRenderResponse(int fd, RenderResponseHeader &header,
+                           std::vector<uint8_t> &image) {
+  if (!recvAll(fd, &header, sizeof(header))) {
+    return false;
+  }
+  image.resize(header.size);
+  return header.size == 0 || recvAll(fd, image.data(), image.size());
+}
+
+} // namespace raytracer_cu
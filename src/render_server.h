@@ -0,0 +1,131 @@
+#ifndef RENDER_SERVER_H
+#define RENDER_SERVER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cuda_runtime.h"
+
+#include "camera.h"
+#include "host_renderer.h"
+#include "image_io.h"
+
+namespace raytracer_cu {
+
+/*
+Long running render service over a local (AF_UNIX) stream socket.
+
+A client writes RenderRequests and reads one RenderResponseHeader followed
+by `size` encoded image bytes per request. A client may send any number of
+requests before reading the responses. Rendered frames come back in request
+order, requests out of the server limits are answered with BadRequest (and
+no image) as soon as they are read. The structs are sent as they are in
+memory (the client is the same build on the same machine).
+
+samples > 1 averages that many frames of the stochastic effects (area
+lights), frame s of the average uses frameIndex s.
+*/
+enum class RenderStatus : uint32_t { Ok = 0, BadRequest = 1 };
+
+struct RenderRequest {
+  uint32_t requestId;
+  Camera camera;
+  int32_t width, height;
+  int32_t maxBounces;
+  int32_t samples;
+  ImageFormat format;
+};
+
+struct RenderResponseHeader {
+  uint32_t requestId;
+  RenderStatus status;
+  float queueMs;  // received until its batch started rendering
+  float renderMs; // its batch started until its last row was rendered
+  float encodeMs;
+  uint32_t batchSize;
+  uint32_t size;
+};
+
+struct RenderServerStats {
+  uint64_t requests = 0;
+  uint64_t batches = 0;
+  double renderMs = 0.0; // of whole batches
+};
+
+/*
+The scene is built once by the caller and shared by every request.
+Requests from all clients go into one queue. A batcher thread takes up to
+maxBatchSize of them, waiting at most batchWindowMs after the oldest one
+arrived for more to show up, and renders all rows of the batch in one
+parallelFor over the pool, so small requests do not leave threads idle.
+Each client has a reader thread, responses are sent by the batcher.
+*/
+class RenderServer {
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Client {
+    int fd = -1;
+    std::thread reader;
+    bool finished = false; // the reader returned
+    std::mutex sendMutex;
+    ~Client();
+  };
+
+  struct Job {
+    std::shared_ptr<Client> client;
+    RenderRequest request;
+    Clock::time_point received;
+    std::vector<uint8_t> pixels;
+  };
+
+  ThreadPool &pool;
+  HostRenderer renderer;
+  std::string socketPath;
+  int listenFd = -1;
+
+  std::mutex mutex;
+  std::condition_variable queued;
+  bool stopping = false;
+  std::deque<Job> queue;
+  std::vector<std::shared_ptr<Client>> clients;
+  RenderServerStats serverStats;
+
+  std::thread acceptThread;
+  std::thread batchThread;
+
+  void acceptLoop();
+  void readRequests(std::shared_ptr<Client> client);
+  void batchLoop();
+  void renderBatch(std::vector<Job> &batch);
+  bool validRequest(const RenderRequest &request) const;
+
+public:
+  int maxBatchSize = 8;
+  int batchWindowMs = 2;
+  int maxPixels = 4096 * 4096;
+  int maxSamples = 64;
+  int maxBounces = 16;
+
+  RenderServer(Scene *scene, ThreadPool &pool, const std::string &socketPath);
+  ~RenderServer();
+  bool listening() const { return listenFd >= 0; }
+  RenderServerStats stats();
+};
+
+// Client side of the protocol, -1 / false on failure.
+int connectRenderServer(const std::string &socketPath);
+bool sendRenderRequest(int fd, const RenderRequest &request);
+bool receiveRenderResponse(int fd, RenderResponseHeader &header,
+                           std::vector<uint8_t> &image);
+
+} // namespace raytracer_cu
+
+#endif
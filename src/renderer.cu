@@ -13,8 +13,13 @@
 #include "basic_types.h"
 #include "cudastuff.h"
 #include "math.h"
+#include "memory_tracker.h"
+#include "profiler.h"
 #include "raytracer_basics.h"
+#include "random.h"
+#include "reprojection.h"
 #include "room_scene.h"
+#include "upscale.h"
 
 namespace raytracer_cu {
 
@@ -52,55 +57,125 @@ CUDA_GLOBAL void sceneTransform(mat3x3 transform, ScenePtr_t* aScene){
   }
 }
 
+CUDA_GLOBAL void objectTransform(mat3x3 transform, int objectId,
+    ScenePtr_t* aScene,
+    Camera camera,
+    int2 displaySize,
+    float reflectiveWeight,
+    DirtyRegion* region){
+  int x = threadIdx.x + blockIdx.x * blockDim.x;
+  int y = threadIdx.y + blockIdx.y * blockDim.y;
+
+  if(x == 0 && y == 0){
+    Scene* scene = aScene[0];
+    *region = DirtyRegion();
+    if (objectId < 0 || objectId >= int(scene->sceneObjects.size())) {
+      return;
+    }
+    Object* object = scene->sceneObjects[objectId];
+    AABB before = object->bounds();
+    object->transform(transform);
+    scene->markDirty(objectId);
+    scene->updateAccelerationStructure();
+    addObjectMove(scene, objectId, before, object->bounds(), camera,
+                  displaySize, reflectiveWeight, *region);
+  }
+}
+
 CUDA_GLOBAL void _addTexture(ScenePtr_t* devScenePtr, int texWidth, int texHeight, float3* texData){
   int x = threadIdx.x + blockIdx.x * blockDim.x;
   int y = threadIdx.y + blockIdx.y * blockDim.y;
   
-  ColorBuffer<float3>* texture = new ColorBuffer<float3>(texWidth, texHeight);
-  texture -> c = texData;
-
   if(x == 0 && y == 0){  
+    // The texels stay owned by the renderer, which frees them.
+    ColorBuffer<float3>* texture =
+        new ColorBuffer<float3>(texWidth, texHeight, texData);
     Scene* scene = devScenePtr[0];
     scene -> textures.push_back(texture);
   }
 }
 
+CUDA_DEVICE void tracePixel(uint8_t* cDevColorBuffer,
+    GBufferTexel* gBuffer,
+    Scene* scene,
+    Camera camera,
+    int2 displaySize,
+    int x, int y,
+    uint32_t frameIndex) {
+  float3 resultCol = make_float3(0.0f, 0.0f, 0.0f);
+  
+  Ray eyeRay = camera.primaryRay(x, y, displaySize, scene->maxBounces);
+  eyeRay.seed = pixelSeed(x, y, frameIndex);
+  int linIdx = idx(x, y, displaySize.x, displaySize.y);
+  
+  Intersection primaryHit;
+  GBufferTexel texel;
+  if (scene->trace(eyeRay, resultCol, primaryHit)) {
+    cDevColorBuffer[linIdx*4+1] = uint8_t(__float2int_rn (resultCol.z*255));
+    cDevColorBuffer[linIdx*4+2] = uint8_t(__float2int_rn (resultCol.y*255));
+    cDevColorBuffer[linIdx*4+3] = uint8_t(__float2int_rn (resultCol.x*255));
+    texel.position = primaryHit.surfacePoint;
+    texel.normal = primaryHit.surfaceNormal;
+    texel.depth = length(primaryHit.surfacePoint - camera.eye);
+    texel.objectId = primaryHit.objectId;
+    texel.albedo =
+        primaryHit.object->respond(eyeRay, primaryHit).diffuseColor;
+  } else {
+    cDevColorBuffer[linIdx*4+1] = 0;
+    cDevColorBuffer[linIdx*4+2] = 0;
+    cDevColorBuffer[linIdx*4+3] = 0;
+    texel.objectId = -1;
+  }
+  cDevColorBuffer[linIdx*4+0] = 255;
+  gBuffer[linIdx] = texel;
+}
+
 CUDA_GLOBAL void traceScene(uint8_t* cDevColorBuffer,
+    GBufferTexel* gBuffer,
     ScenePtr_t* aScene, 
-    float3 viewport_tl,
-    float3 viewport_v1,
-    float3 viewport_v2,
-    float3 eye,
-    int2 displaySize) {
+    Camera camera,
+    int2 displaySize,
+    uint32_t frameIndex) {
   int x = threadIdx.x + blockIdx.x * blockDim.x;
   int y = threadIdx.y + blockIdx.y * blockDim.y;
 
-  if(x > 0 && x < displaySize.x && y > 0 &&  y < displaySize.y){
-    Scene* scene = aScene[0];
-    
-    float3 screen = viewport_tl +
-                        (float(x) / displaySize.x) * viewport_v1 +
-                        (float(y) / displaySize.y) * viewport_v2;
-
-    float3 resultCol = make_float3(0.0f, 0.0f, 0.0f);
-    
-    int maxBounces = 3;
-    Ray eyeRay(screen, screen-eye, maxBounces);
-    int linIdx = idx(x, y, displaySize.x, displaySize.y);
-    
-    if (scene->trace(eyeRay, resultCol)) {
-      cDevColorBuffer[linIdx*4+1] = uint8_t(__float2int_rn (resultCol.z*255));
-      cDevColorBuffer[linIdx*4+2] = uint8_t(__float2int_rn (resultCol.y*255));
-      cDevColorBuffer[linIdx*4+3] = uint8_t(__float2int_rn (resultCol.x*255));
-    } else {
-      cDevColorBuffer[linIdx*4+1] = 0;
-      cDevColorBuffer[linIdx*4+2] = 0;
-      cDevColorBuffer[linIdx*4+3] = 0;
-    }
-    cDevColorBuffer[linIdx*4+0] = 255;
+  if(x < displaySize.x && y < displaySize.y){
+    tracePixel(cDevColorBuffer, gBuffer, aScene[0], camera, displaySize, x, y,
+               frameIndex);
   }
 }
 
+CUDA_GLOBAL void traceQueue(uint8_t* cDevColorBuffer,
+    GBufferTexel* gBuffer,
+    ScenePtr_t* aScene,
+    Camera camera,
+    int2 displaySize,
+    uint32_t frameIndex,
+    const int* queue,
+    int queueLength) {
+  int i = threadIdx.x + blockIdx.x * blockDim.x;
+
+  if (i < queueLength) {
+    int linIdx = queue[i];
+    tracePixel(cDevColorBuffer, gBuffer, aScene[0], camera, displaySize,
+               linIdx % displaySize.x, linIdx / displaySize.x, frameIndex);
+  }
+}
+
+// cudaMalloc / cudaFree counted in the MemoryTracker.
+template <class T>
+void deviceAlloc(T **p, size_t bytes, MemoryTag tag, const char *site) {
+  (void)tag; // only recorded when tracking
+  (void)site;
+  cudaMalloc((void **)p, bytes);
+  MEMORY_ALLOCATED_AT(*p, bytes, tag, site);
+}
+
+void deviceFree(void *p) {
+  MEMORY_FREED(p);
+  cudaFree(p);
+}
+
 void checkCudaErr() {
   cudaDeviceSynchronize();
   cudaError_t err;
@@ -114,47 +189,12 @@ void Renderer::addTexture(int texWidth, int texHeight, float3* texData){
   
   float3* dTexData;
   int nTexBytes = texWidth*texHeight*sizeof(float3);
-  cudaMalloc((void**)&dTexData, nTexBytes);
+  deviceAlloc(&dTexData, nTexBytes, MemoryTag::textures, MEMORY_SITE);
+  devTextureData.push_back(dTexData);
   cudaMemcpy(dTexData, texData, nTexBytes, cudaMemcpyHostToDevice);
   _addTexture<<<1, 1>>>(devScenePtr, texWidth, texHeight, dTexData);
 }
 
-CUDA_HOSTDEV mat3x3 getRotationMatrixX(float rotRad) {
-  // Rotates around the X axis
-  
-  mat3x3 rot;
-  rot.data[0][0] = 1.;
-  rot.data[1][1] = cos(rotRad);
-  rot.data[1][2] = -sin(rotRad);
-  rot.data[2][1] = sin(rotRad);
-  rot.data[2][2] = cos(rotRad);
-  return rot;
-}
-
-CUDA_HOSTDEV mat3x3 getRotationMatrixY(float rotRad) {
-  // Rotates around the Y axis
-
-  mat3x3 rot;
-  rot.data[1][1] = 1.;
-  rot.data[0][0] = cos(rotRad);
-  rot.data[2][0] = -sin(rotRad);
-  rot.data[0][2] = sin(rotRad);
-  rot.data[2][2] = cos(rotRad);
-  return rot;
-}
-
-CUDA_HOSTDEV mat3x3 getRotationMatrixZ(float rotRad) {
-  // Rotates around the z axis
-  
-  mat3x3 rot;
-  rot.data[2][2] = 1.;
-  rot.data[0][0] = cos(rotRad);
-  rot.data[1][0] = -sin(rotRad);
-  rot.data[0][1] = sin(rotRad);
-  rot.data[1][1] = cos(rotRad);
-  return rot;
-}
-
 void Renderer::mouseMoveInput(int x, int y){
   horizontalDisplacement = x;
   verticalDisplacement = y;
@@ -172,38 +212,19 @@ void Renderer::buildScene(){
   _buildScene<<<1, 1>>>(devScenePtr);
 }
 
-std::tuple<float3, float3, float3> getViewport(int2 viewport_size,
-                                               float viewport_z) {
-  // The viewport is an (assumed) square surface that is on the xy and the
-  // center is at the origin.
-  float3 vp = make_float3(viewport_size.x, viewport_size.y, viewport_z);
-
-  // Define the top-left, top-right, bottom-lroteft points
-  float3 viewport_tl = make_float3(-(vp.x / 2.0f), -(vp.y / 2.0f), vp.z);
-  float3 viewport_tr = make_float3(vp.x / 2.0f, -(vp.y / 2.0f), vp.z);
-  float3 viewport_bl = make_float3(-(vp.x / 2.0f), vp.y / 2.0f, vp.z);
-
-  // Compute the directions
-  float3 viewport_v1 = (viewport_tr - viewport_tl);
-  float3 viewport_v2 = (viewport_bl - viewport_tl);
-
-  return {viewport_tl, viewport_v1, viewport_v2};
-}
-
 Renderer::Renderer(uint32_t screen_width, uint32_t screen_height)
-    : textures(EasyVector<ColorBuffer<float3> *, int>(12)) {
+    : denoiser(screen_width, screen_height),
+      hostGBuffer(screen_width * screen_height),
+      textures(EasyVector<ColorBuffer<float3> *, int>(12)) {
 
   displaySize = make_int2(screen_width, screen_height);
+  renderSize = displaySize;
+  denoiser.pool = &hostPool;
 
   textures = EasyVector<ColorBuffer<float3> *, int>(12);
 
-  // Eye position
-  float eye_z = -200.0f;
-  eye = make_float3(0.0f, 0.0f, eye_z);
-
-  // Config viewport
-  auto viewport = getViewport(make_int2(256.0f, 256.0f), eye_z + 100.0f);
-  std::tie(viewport_tl, viewport_v1, viewport_v2) = viewport;
+  camera = Camera::initialView();
+  previousCamera = camera;
 
   // Initialize CUDA stack
   size_t s;
@@ -214,26 +235,61 @@ Renderer::Renderer(uint32_t screen_width, uint32_t screen_height)
   checkCudaErr();
   std::cout << "Stack size: " << s << std::endl;
 
-  // Initialize the color buffer
-  cColBuffSizeBytes = displaySize.x * displaySize.y * 4;
-  cudaMalloc((void **)&cDevColorBuffer, cColBuffSizeBytes);
+  // Initialize the color and primary hit buffers as black misses.
+  int nPixels = displaySize.x * displaySize.y;
+  cColBuffSizeBytes = nPixels * 4;
+  int gBufferSizeBytes = nPixels * sizeof(GBufferTexel);
+  for (int i = 0; i < 2; i++) {
+    deviceAlloc(&cDevColorBuffers[i], cColBuffSizeBytes,
+                MemoryTag::framebuffers, MEMORY_SITE);
+    cudaMemset(cDevColorBuffers[i], 0, cColBuffSizeBytes);
+    deviceAlloc(&devGBuffers[i], gBufferSizeBytes, MemoryTag::framebuffers,
+                MEMORY_SITE);
+    cudaMemset(devGBuffers[i], 0xff, gBufferSizeBytes);
+  }
+  checkCudaErr();
+
+  // Upscaled output when tracing below the display resolution
+  deviceAlloc(&cDevOutputBuffer, cColBuffSizeBytes, MemoryTag::framebuffers,
+              MEMORY_SITE);
+  deviceAlloc(&devOutputGBuffer, gBufferSizeBytes, MemoryTag::framebuffers,
+              MEMORY_SITE);
+  checkCudaErr();
+
+  // Reprojection buffers
+  deviceAlloc(&devReprojectionKeys, nPixels * sizeof(unsigned long long),
+              MemoryTag::transient, MEMORY_SITE);
+  deviceAlloc(&devTraceQueue, nPixels * sizeof(int), MemoryTag::transient,
+              MEMORY_SITE);
+  deviceAlloc(&devTraceQueueLength, sizeof(int), MemoryTag::transient,
+              MEMORY_SITE);
+  deviceAlloc(&devDirtyRegion, sizeof(DirtyRegion), MemoryTag::transient,
+              MEMORY_SITE);
+  checkCudaErr();
+
+  // Trace kernel timing, reused every frame
+  cudaEventCreate(&traceStart);
+  cudaEventCreate(&traceStop);
   checkCudaErr();
 
   // Initialize the scene
-  cudaMalloc((ScenePtr_t **)&devScenePtr, sizeof(ScenePtr_t));
+  deviceAlloc(&devScenePtr, sizeof(ScenePtr_t), MemoryTag::geometry,
+              MEMORY_SITE);
   initScene<<<1, 1>>>(devScenePtr);
   checkCudaErr();
 }
 
 void Renderer::modelTransform() {
+  // Note: a non-identity model transform moves the scene under the
+  // reprojected pixels, call invalidateHistory() when animating it.
   mat3x3 rot1 = getRotationMatrixX(0.);
   mat3x3 rot2 = getRotationMatrixY(0.);
   mat3x3 transform = mm(rot2, rot1);
   sceneTransform<<<1, 1>>>(transform, devScenePtr);
 }
 
-void Renderer::viewTransform(){
-  // Transform camera and eye
+bool Renderer::viewTransform(){
+  // Transform camera and eye. Returns true if the view has changed.
 
   sensitivity = 500.0f;
 
@@ -241,48 +297,246 @@ void Renderer::viewTransform(){
   mat3x3 rot2 = getRotationMatrixX(-verticalDisplacement/sensitivity);
   mat3x3 transform = mm(rot2, rot1);
 
-  viewport_tl = mm<3>(transform, viewport_tl);
-  viewport_v1 = mm<3>(transform, viewport_v1);
-  viewport_v2 = mm<3>(transform, viewport_v2);
-  eye = mm<3>(transform, eye);
+  camera.transform(transform);
+
+  bool viewChanged = horizontalDisplacement != 0 || verticalDisplacement != 0;
+
+  // Accumulated shadow samples are only valid for the view they came from.
+  if (viewChanged) {
+    denoiser.resetHistory();
+  }
 
   horizontalDisplacement = 0;
   verticalDisplacement = 0;
+  return viewChanged;
 }
 
-void Renderer::render(uint8_t* frameBuffer) {
-  modelTransform();
-  viewTransform();
+dim3 blocksFor(int2 size, dim3 threadsPerBlock) {
+  return dim3((size.x + threadsPerBlock.x - 1) / threadsPerBlock.x,
+              (size.y + threadsPerBlock.y - 1) / threadsPerBlock.y);
+}
+
+void Renderer::renderFull() {
+  currentBuffer ^= 1;
 
-  // 32x32 blocks, 16x16 threads per block
+  // 16x16 threads per block
   dim3 threadsPerBlock(16, 16);
-  dim3 numBlocks(displaySize.x / threadsPerBlock.x,
-                 displaySize.y / threadsPerBlock.y);
-  
-  cudaEvent_t start, stop;
-  cudaEventCreate(&start);
-  cudaEventCreate(&stop);
-  cudaEventRecord(start);
-
-  traceScene<<<numBlocks, threadsPerBlock>>>(cDevColorBuffer, devScenePtr,
-                                         viewport_tl, viewport_v1, viewport_v2,
-                                         eye, displaySize);
-  
-  cudaEventRecord(stop);
-  cudaEventSynchronize(stop);
-  float milliseconds = 0;
-  cudaEventElapsedTime(&milliseconds, start, stop);
+  dim3 numBlocks = blocksFor(renderSize, threadsPerBlock);
+
+  traceScene<<<numBlocks, threadsPerBlock>>>(cDevColorBuffers[currentBuffer],
+                                         devGBuffers[currentBuffer],
+                                         devScenePtr, camera, renderSize,
+                                         frameIndex);
+}
+
+int Renderer::renderReprojected() {
+  int previousBuffer = currentBuffer;
+  currentBuffer ^= 1;
+
+  int nPixels = renderSize.x * renderSize.y;
+  dim3 threadsPerBlock(16, 16);
+  dim3 numBlocks = blocksFor(renderSize, threadsPerBlock);
+
+  clearReprojection<<<(nPixels + 255) / 256, 256>>>(devReprojectionKeys, nPixels);
+  reprojectScatter<<<numBlocks, threadsPerBlock>>>(devGBuffers[previousBuffer],
+                                                   devReprojectionKeys,
+                                                   camera, renderSize);
+
+  cudaMemset(devTraceQueueLength, 0, sizeof(int));
+  reprojectResolve<<<numBlocks, threadsPerBlock>>>(
+      cDevColorBuffers[currentBuffer], devGBuffers[currentBuffer],
+      cDevColorBuffers[previousBuffer], devGBuffers[previousBuffer],
+      devReprojectionKeys, devScenePtr, camera, renderSize, frameIndex,
+      refreshPeriod, viewDependentWeight, devTraceQueue, devTraceQueueLength);
+
+  int queueLength = 0;
+  cudaMemcpy(&queueLength, devTraceQueueLength, sizeof(int),
+             cudaMemcpyDeviceToHost);
+
+  if (queueLength > 0) {
+    traceQueue<<<(queueLength + 127) / 128, 128>>>(
+        cDevColorBuffers[currentBuffer], devGBuffers[currentBuffer],
+        devScenePtr, camera, renderSize, frameIndex, devTraceQueue,
+        queueLength);
+  }
+  return queueLength;
+}
+
+void Renderer::transformObject(int objectId, mat3x3 transform) {
+  DirtyRegion region;
+  objectTransform<<<1, 1>>>(transform, objectId, devScenePtr, camera,
+                            renderSize, viewDependentWeight, devDirtyRegion);
+  cudaMemcpy(&region, devDirtyRegion, sizeof(DirtyRegion),
+             cudaMemcpyDeviceToHost);
   checkCudaErr();
 
-  std::cout << "Trace kernel execution time: " << milliseconds << " ms." << std::endl;
+  if (!sceneEdited) {
+    dirtyTiles.clear();
+    editSize = renderSize;
+  }
+  sceneEdited = true;
+  editFullFrame = editFullFrame || region.fullFrame ||
+                  editSize.x != renderSize.x || editSize.y != renderSize.y;
+  markDirtyTiles(region, renderSize, dirtyTileSize, dirtyTiles);
+}
+
+int Renderer::renderDirty() {
+  // The current buffer holds the previous frame, the dirty tiles are
+  // traced over it.
+  dirtyTilePixels(dirtyTiles, renderSize, dirtyTileSize, dirtyPixels);
+  int queueLength = int(dirtyPixels.size());
+  if (queueLength > 0) {
+    cudaMemcpy(devTraceQueue, dirtyPixels.data(), queueLength * sizeof(int),
+               cudaMemcpyHostToDevice);
+    traceQueue<<<(queueLength + 127) / 128, 128>>>(
+        cDevColorBuffers[currentBuffer], devGBuffers[currentBuffer],
+        devScenePtr, camera, renderSize, frameIndex, devTraceQueue,
+        queueLength);
+  }
+  return queueLength;
+}
+
+void Renderer::render(uint8_t* frameBuffer) {
+  PROFILE_SCOPE("Renderer::render", "frame");
+  bool viewChanged;
+  {
+    PROFILE_SCOPE("modelTransform", "frame");
+    modelTransform();
+  }
+  {
+    PROFILE_SCOPE("viewTransform", "frame");
+    previousCamera = camera;
+    viewChanged = viewTransform();
+  }
+
+  // Pick the resolution from the last frame's trace time. The history of a
+  // different resolution cannot be reprojected.
+  int2 newRenderSize = displaySize;
+  if (dynamicResolution) {
+    resolutionController.update(lastTraceMs, viewChanged);
+    newRenderSize = resolutionController.renderSize(displaySize, 16);
+  }
+  if (newRenderSize.x != renderSize.x || newRenderSize.y != renderSize.y) {
+    renderSize = newRenderSize;
+    invalidateHistory();
+  }
+
+  // While the camera moves most primary hits are already known from the
+  // previous frame; when it is still every pixel is traced so the area light
+  // samples keep converging in the denoiser. A frame after objects moved
+  // under a still camera retraces only their dirty tiles, any other edited
+  // frame is traced in full (reprojected pixels would show the old scene).
+  int nPixels = renderSize.x * renderSize.y;
+  int tracedPixels = nPixels;
+  float milliseconds = 0;
+  {
+    PROFILE_SCOPE("trace", "frame");
+    cudaEventRecord(traceStart);
+    bool dirtyOnly = sceneEdited && dirtyRegions && historyValid &&
+                     !viewChanged && !editFullFrame &&
+                     editSize.x == renderSize.x && editSize.y == renderSize.y;
+    if (dirtyOnly) {
+      tracedPixels = renderDirty();
+    } else if (reprojection && historyValid && viewChanged && !sceneEdited) {
+      tracedPixels = renderReprojected();
+    } else {
+      renderFull();
+    }
+    if (sceneEdited) {
+      denoiser.resetHistory();
+    }
+    sceneEdited = false;
+    editFullFrame = false;
+    historyValid = true;
+
+    cudaEventRecord(traceStop);
+    cudaEventSynchronize(traceStop);
+    cudaEventElapsedTime(&milliseconds, traceStart, traceStop);
+    checkCudaErr();
+    lastTraceMs = milliseconds;
+  }
 
-  cudaMemcpy(frameBuffer, cDevColorBuffer,
-             cColBuffSizeBytes, cudaMemcpyDeviceToHost);
+  std::cout << "Trace kernel execution time: " << milliseconds << " ms"
+            << " at " << renderSize.x << "x" << renderSize.y
+            << " (traced " << 100.0f * tracedPixels / nPixels
+            << "% of the pixels)." << std::endl;
+
+  uint8_t *outputBuffer = cDevColorBuffers[currentBuffer];
+  GBufferTexel *outputGBuffer = devGBuffers[currentBuffer];
+  if (renderSize.x != displaySize.x || renderSize.y != displaySize.y) {
+    PROFILE_SCOPE("upscale", "frame");
+    dim3 threadsPerBlock(16, 16);
+    upscaleEdgeAware<<<blocksFor(displaySize, threadsPerBlock), threadsPerBlock>>>(
+        outputBuffer, outputGBuffer, renderSize, cDevOutputBuffer,
+        devOutputGBuffer, displaySize);
+    outputBuffer = cDevOutputBuffer;
+    outputGBuffer = devOutputGBuffer;
+  }
+
+  {
+    // Includes waiting for the upscaling kernel.
+    PROFILE_SCOPE("readback", "frame");
+    cudaMemcpy(frameBuffer, outputBuffer,
+               cColBuffSizeBytes, cudaMemcpyDeviceToHost);
+  }
+
+  if (denoise) {
+    PROFILE_SCOPE("denoise", "frame");
+    cudaMemcpy(hostGBuffer.data(), outputGBuffer,
+               hostGBuffer.size() * sizeof(GBufferTexel),
+               cudaMemcpyDeviceToHost);
+    denoiser.denoise(frameBuffer, hostGBuffer.data());
+  }
+
+  frameIndex++;
+}
 
+void Renderer::setDenoise(bool enabled) {
+  denoise = enabled;
+  denoiser.resetHistory();
+}
+
+void Renderer::setReprojection(bool enabled) {
+  reprojection = enabled;
+  invalidateHistory();
+}
+
+void Renderer::setDynamicResolution(bool enabled) {
+  dynamicResolution = enabled;
+}
+
+void Renderer::setFrameBudget(float milliseconds) {
+  resolutionController.frameBudgetMs = milliseconds;
+}
+
+void Renderer::setDirtyRegions(bool enabled) {
+  dirtyRegions = enabled;
+}
+
+void Renderer::invalidateHistory() {
+  historyValid = false;
+  denoiser.resetHistory();
 }
 
 Renderer::~Renderer(){
-  cudaFree(cDevColorBuffer);
+  for (int i = 0; i < 2; i++) {
+    deviceFree(cDevColorBuffers[i]);
+    deviceFree(devGBuffers[i]);
+  }
+  deviceFree(cDevOutputBuffer);
+  deviceFree(devOutputGBuffer);
+  deviceFree(devReprojectionKeys);
+  deviceFree(devTraceQueue);
+  deviceFree(devTraceQueueLength);
+  deviceFree(devDirtyRegion);
+  // The scene on the device heap is not freed (its objects are not owned
+  // by anything), only the texels it points to.
+  for (size_t i = 0; i < devTextureData.size(); i++) {
+    deviceFree(devTextureData[i]);
+  }
+  deviceFree(devScenePtr);
+  cudaEventDestroy(traceStart);
+  cudaEventDestroy(traceStop);
 }
 
 } // namespace raytracer_cu
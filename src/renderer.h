@@ -2,9 +2,16 @@
 #define RENDERER_H
 
 #include <memory>
+#include <vector>
 
 #include "basic_types.h"
+#include "camera.h"
+#include "denoiser.h"
+#include "dirty_region.h"
+#include "gbuffer.h"
 #include "raytracer_basics.h"
+#include "resolution_controller.h"
+#include "thread_pool.h"
 
 #include "cuda_runtime.h"
 #include "math.h"
@@ -14,15 +21,35 @@ typedef Scene* ScenePtr_t;
 void checkCudaErr();
 void traceCUDA(ColorBuffer<float3> &cb);
 CUDA_GLOBAL void initScene(ScenePtr_t* devScenePtr);
+CUDA_DEVICE void tracePixel(uint8_t* cDevColorBuffer,
+    GBufferTexel* gBuffer,
+    Scene* scene,
+    Camera camera,
+    int2 displaySize,
+    int x, int y,
+    uint32_t frameIndex);
 CUDA_GLOBAL void traceScene(uint8_t* cDevColorBuffer,
+    GBufferTexel* gBuffer,
     ScenePtr_t* aScene, 
-    float3 viewport_tl,
-    float3 viewport_v1,
-    float3 viewport_v2,
-    float3 eye,
-    int2 displaySize);
+    Camera camera,
+    int2 displaySize,
+    uint32_t frameIndex);
+CUDA_GLOBAL void traceQueue(uint8_t* cDevColorBuffer,
+    GBufferTexel* gBuffer,
+    ScenePtr_t* aScene,
+    Camera camera,
+    int2 displaySize,
+    uint32_t frameIndex,
+    const int* queue,
+    int queueLength);
 
 CUDA_GLOBAL void sceneTransform(mat3x3 transform, ScenePtr_t* aScene);
+CUDA_GLOBAL void objectTransform(mat3x3 transform, int objectId,
+    ScenePtr_t* aScene,
+    Camera camera,
+    int2 displaySize,
+    float reflectiveWeight,
+    DirtyRegion* region);
 
 class Renderer {
 private:
@@ -32,15 +59,62 @@ private:
   int verticalNavigation = 0;
   float sensitivity = 0.1f;
   int2 displaySize;
-  float3 viewport_tl, viewport_v1, viewport_v2;
-  float3 eye;
+  Camera camera;
   CUDA_HOST void modelTransform();
-  CUDA_HOST void viewTransform();
+  CUDA_HOST bool viewTransform();
   bool first = true;
   EasyVector<int> **devSceneObjects;
   ScenePtr_t *devScenePtr;
-  uint8_t *cDevColorBuffer;
   int cColBuffSizeBytes;
+  uint32_t frameIndex = 0;
+
+  // Color and primary hit buffers are double buffered, the previous frame
+  // is the source of the reprojection.
+  uint8_t *cDevColorBuffers[2];
+  GBufferTexel *devGBuffers[2];
+  int currentBuffer = 0;
+
+  // The host denoising pass, off by default: it runs on the host after the
+  // readback, on hostPool.
+  ThreadPool hostPool;
+  Denoiser denoiser;
+  std::vector<GBufferTexel> hostGBuffer;
+  bool denoise = false;
+
+  // Temporal reprojection state
+  bool reprojection = true;
+  bool historyValid = false;
+  Camera previousCamera;
+  unsigned long long *devReprojectionKeys;
+  int *devTraceQueue;
+  int *devTraceQueueLength;
+  CUDA_HOST void renderFull();
+  CUDA_HOST int renderReprojected();
+
+  // Objects moved since the last frame: the tiles to retrace, or all of
+  // them, at the render size and camera they were marked for.
+  static const int dirtyTileSize = 16;
+  bool sceneEdited = false;
+  bool editFullFrame = false;
+  int2 editSize;
+  std::vector<uint8_t> dirtyTiles;
+  std::vector<int> dirtyPixels;
+  DirtyRegion *devDirtyRegion;
+  bool dirtyRegions = true;
+  CUDA_HOST int renderDirty();
+
+  // Dynamic resolution: the frame is traced at renderSize <= displaySize and
+  // upscaled into the output buffers when smaller.
+  bool dynamicResolution = true;
+  ResolutionController resolutionController;
+  int2 renderSize;
+  float lastTraceMs = 0.0f;
+  cudaEvent_t traceStart, traceStop;
+  uint8_t *cDevOutputBuffer;
+  GBufferTexel *devOutputGBuffer;
+
+  // Device texels of the scene textures, freed with the renderer.
+  std::vector<float3 *> devTextureData;
 
 public:
   EasyVector<ColorBuffer<float3> *, int> textures;
@@ -53,6 +127,23 @@ public:
   CUDA_HOST void mouseWheelInput(int w);
   CUDA_HOST void keyboardArrowsInput(int x, int y);
   CUDA_HOST void buildScene();
+  // Transforms one scene object. While the camera stays still the next
+  // frame retraces only the tiles the move can affect (see
+  // dirty_region.h) and keeps the rest of the previous one.
+  CUDA_HOST void transformObject(int objectId, mat3x3 transform);
+  CUDA_HOST void setDirtyRegions(bool enabled);
+  CUDA_HOST void setDenoise(bool enabled);
+  CUDA_HOST void setReprojection(bool enabled);
+  CUDA_HOST void invalidateHistory();
+  CUDA_HOST void setDynamicResolution(bool enabled);
+  CUDA_HOST void setFrameBudget(float milliseconds);
+
+  // Reprojection tuning: every pixel is retraced once per refreshPeriod
+  // frames, and pixels of objects whose reflected plus refracted weight is
+  // above viewDependentWeight are always retraced. The dirty regions treat
+  // the objects at or below it as matte too.
+  int refreshPeriod = 8;
+  float viewDependentWeight = 0.25f;
 };
 } // namespace raytracer_cu
 
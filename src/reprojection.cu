@@ -0,0 +1,113 @@
+#include "reprojection.h"
+
+#include "cuda_runtime.h"
+
+#include "math.h"
+#include "random.h"
+#include "raytracer_basics.h"
+#include "shader.h"
+
+namespace raytracer_cu {
+
+CUDA_GLOBAL void clearReprojection(unsigned long long *keys, int n) {
+  int i = threadIdx.x + blockIdx.x * blockDim.x;
+  if (i < n) {
+    keys[i] = emptyReprojectionKey;
+  }
+}
+
+CUDA_GLOBAL void reprojectScatter(const GBufferTexel *previousGBuffer,
+                                  unsigned long long *keys, Camera camera,
+                                  int2 displaySize) {
+  int x = threadIdx.x + blockIdx.x * blockDim.x;
+  int y = threadIdx.y + blockIdx.y * blockDim.y;
+
+  if (x < displaySize.x && y < displaySize.y) {
+    int srcIdx = y * displaySize.x + x;
+    GBufferTexel texel = previousGBuffer[srcIdx];
+    if (texel.objectId < 0) {
+      return;
+    }
+
+    float2 pixel;
+    if (!camera.project(texel.position, displaySize, pixel)) {
+      return;
+    }
+    int dstX = __float2int_rn(pixel.x);
+    int dstY = __float2int_rn(pixel.y);
+    if (dstX < 0 || dstX >= displaySize.x || dstY < 0 ||
+        dstY >= displaySize.y) {
+      return;
+    }
+
+    // Positive floats order the same as their bit patterns, so the closest
+    // surface has the smallest key.
+    float depth = length(texel.position - camera.eye);
+    unsigned long long key =
+        (static_cast<unsigned long long>(__float_as_uint(depth)) << 32) |
+        static_cast<unsigned int>(srcIdx);
+    atomicMin(&keys[dstY * displaySize.x + dstX], key);
+  }
+}
+
+CUDA_GLOBAL void reprojectResolve(uint8_t *colorBuffer, GBufferTexel *gBuffer,
+                                  const uint8_t *previousColorBuffer,
+                                  const GBufferTexel *previousGBuffer,
+                                  const unsigned long long *keys,
+                                  ScenePtr_t *aScene, Camera camera,
+                                  int2 displaySize, uint32_t frameIndex,
+                                  int refreshPeriod, float viewDependentWeight,
+                                  int *queue, int *queueLength) {
+  int x = threadIdx.x + blockIdx.x * blockDim.x;
+  int y = threadIdx.y + blockIdx.y * blockDim.y;
+
+  if (x < displaySize.x && y < displaySize.y) {
+    Scene *scene = aScene[0];
+    int linIdx = y * displaySize.x + x;
+    unsigned long long key = keys[linIdx];
+
+    bool retrace = key == emptyReprojectionKey ||
+                   (pcgHash(linIdx) + frameIndex) % refreshPeriod == 0;
+
+    if (!retrace) {
+      int srcIdx = int(key & 0xffffffffull);
+      GBufferTexel previous = previousGBuffer[srcIdx];
+      Object *object = scene->sceneObjects[previous.objectId];
+      Shader *shader = object->getShader();
+
+      if (shader && shader->reflectedWeight + shader->refractedWeight >
+                        viewDependentWeight) {
+        retrace = true;
+      } else {
+        // Validate against the one object the pixel is expected to show.
+        Ray eyeRay = camera.primaryRay(x, y, displaySize, 0);
+        float3 hitPoint, hitNormal, unused;
+        bool hit = object->intersect(eyeRay, hitPoint, hitNormal, unused);
+
+        float depth = length(hitPoint - camera.eye);
+        float pixelFootprint = length(camera.viewport_v1) / displaySize.x *
+                               depth / length(eyeRay.direction);
+        if (!hit || length(hitPoint - previous.position) > 2.0f * pixelFootprint) {
+          retrace = true;
+        } else {
+          for (int c = 0; c < 4; c++) {
+            colorBuffer[linIdx * 4 + c] = previousColorBuffer[srcIdx * 4 + c];
+          }
+          GBufferTexel texel;
+          texel.position = hitPoint;
+          texel.normal = hitNormal;
+          texel.depth = depth;
+          texel.objectId = previous.objectId;
+          texel.albedo = previous.albedo;
+          gBuffer[linIdx] = texel;
+        }
+      }
+    }
+
+    if (retrace) {
+      queue[atomicAdd(queueLength, 1)] = linIdx;
+    }
+  }
+}
+
+} // namespace raytracer_cu
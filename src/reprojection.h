@@ -0,0 +1,46 @@
+#ifndef REPROJECTION_H
+#define REPROJECTION_H
+
+#include "cuda_runtime.h"
+
+#include "camera.h"
+#include "cudastuff.h"
+#include "gbuffer.h"
+#include "renderer.h"
+
+namespace raytracer_cu {
+
+/*
+Temporal reprojection of the primary hits while the camera moves.
+
+1) reprojectScatter: every hit of the previous frame is projected into the
+   new view and the nearest one per pixel wins an atomicMin on a key that
+   packs (depth bits, source pixel).
+2) reprojectResolve: a pixel reuses its winner if the new eye ray still hits
+   the same object at (nearly) the same point, testing only that one object.
+   Pixels with no winner (disocclusions), a failed test, a view dependent
+   material or in this frame's rolling refresh set are appended to the trace
+   queue instead.
+3) traceQueue (renderer.cu) traces the queued pixels.
+*/
+
+const unsigned long long emptyReprojectionKey = ~0ull;
+
+CUDA_GLOBAL void clearReprojection(unsigned long long *keys, int n);
+
+CUDA_GLOBAL void reprojectScatter(const GBufferTexel *previousGBuffer,
+                                  unsigned long long *keys, Camera camera,
+                                  int2 displaySize);
+
+CUDA_GLOBAL void reprojectResolve(uint8_t *colorBuffer, GBufferTexel *gBuffer,
+                                  const uint8_t *previousColorBuffer,
+                                  const GBufferTexel *previousGBuffer,
+                                  const unsigned long long *keys,
+                                  ScenePtr_t *aScene, Camera camera,
+                                  int2 displaySize, uint32_t frameIndex,
+                                  int refreshPeriod, float viewDependentWeight,
+                                  int *queue, int *queueLength);
+
+} // namespace raytracer_cu
+
+#endif
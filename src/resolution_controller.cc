@@ -0,0 +1,68 @@
+#include "resolution_controller.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace raytracer_cu {
+
+void ResolutionController::setMovingScale(float scale) {
+  scale = std::min(std::max(scale, minScale), maxScale);
+  if (scale != movingScale) {
+    // Carry the estimate over to the new size instead of starting again.
+    filteredMs *= (scale * scale) / (movingScale * movingScale);
+    movingScale = scale;
+    framesSinceChange = 0;
+  }
+}
+
+float ResolutionController::update(float traceMs, bool cameraMoving) {
+  if (!cameraMoving) {
+    stillFrames++;
+    if (stillFrames >= stillFramesToRestore) {
+      currentScale = maxScale;
+      return currentScale;
+    }
+  } else {
+    stillFrames = 0;
+  }
+
+  // Only frames rendered at the moving scale say something about it (and
+  // the very first call has no measurement yet).
+  if (currentScale == movingScale && traceMs > 0.0f) {
+    if (filteredMs < 0.0f) {
+      filteredMs = traceMs;
+    } else {
+      filteredMs = (1.0f - smoothing) * filteredMs + smoothing * traceMs;
+    }
+    framesSinceChange++;
+
+    if (framesSinceChange >= cooldownFrames) {
+      if (filteredMs > frameBudgetMs * upperThreshold) {
+        // Jump straight to the size that fits, at least one step down.
+        float fit = movingScale * std::sqrt(frameBudgetMs * lowerThreshold /
+                                             filteredMs);
+        float steps = std::max(1.0f, std::ceil((movingScale - fit) / scaleStep));
+        setMovingScale(movingScale - steps * scaleStep);
+      } else if (movingScale < maxScale) {
+        float next = std::min(maxScale, movingScale + scaleStep);
+        float predictedMs =
+            filteredMs * (next * next) / (movingScale * movingScale);
+        if (predictedMs < frameBudgetMs * lowerThreshold) {
+          setMovingScale(next);
+        }
+      }
+    }
+  }
+
+  currentScale = movingScale;
+  return currentScale;
+}
+
+int2 ResolutionController::renderSize(int2 displaySize, int granularity) const {
+  int w = int(std::lround(displaySize.x * currentScale / granularity)) * granularity;
+  int h = int(std::lround(displaySize.y * currentScale / granularity)) * granularity;
+  return make_int2(std::min(std::max(w, granularity), displaySize.x),
+                   std::min(std::max(h, granularity), displaySize.y));
+}
+
+} // namespace raytracer_cu
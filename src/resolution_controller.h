@@ -0,0 +1,55 @@
+#ifndef RESOLUTION_CONTROLLER_H
+#define RESOLUTION_CONTROLLER_H
+
+#include "cuda_runtime.h"
+
+namespace raytracer_cu {
+
+/*
+Picks the internal render resolution frame by frame so the trace time stays
+within a budget while the camera moves.
+
+The measured trace time is smoothed with an exponential moving average.
+The scale drops (by as many steps as the overshoot needs) once the smoothed
+time exceeds budget * upperThreshold, and rises one step only if the time
+predicted for the larger size (cost ~ pixel count) stays below
+budget * lowerThreshold. The gap between the two thresholds plus a cooldown
+after every change is the hysteresis that keeps it from oscillating.
+
+When the camera has been still for stillFramesToRestore frames the full
+resolution is returned; the scale used while moving is kept for the next
+time the camera moves.
+*/
+class ResolutionController {
+private:
+  float movingScale = 1.0f;
+  float filteredMs = -1.0f;
+  int framesSinceChange = 0;
+  int stillFrames = 0;
+  float currentScale = 1.0f;
+
+  void setMovingScale(float scale);
+
+public:
+  float frameBudgetMs = 16.0f;
+  float minScale = 0.5f;
+  float maxScale = 1.0f;
+  float scaleStep = 0.125f;
+  float upperThreshold = 1.0f;
+  float lowerThreshold = 0.75f;
+  float smoothing = 0.3f;
+  int cooldownFrames = 4;
+  int stillFramesToRestore = 2;
+
+  // Feeds the trace time of the last frame, returns the scale for the next.
+  float update(float traceMs, bool cameraMoving);
+  float scale() const { return currentScale; }
+
+  // Render size for the current scale, rounded to a multiple of
+  // `granularity` (the kernel block size).
+  int2 renderSize(int2 displaySize, int granularity) const;
+};
+
+} // namespace raytracer_cu
+
+#endif
@@ -1,5 +1,6 @@
 #include "room_scene.h"
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 
@@ -11,6 +12,27 @@
 
 namespace raytracer_cu {
 
+CUDA_HOSTDEV RoomScene::~RoomScene() {
+#ifndef __CUDA_ARCH__
+  // The two triangles of the transparent square share their material.
+  std::vector<Shader *> shaders;
+  for (uint64_t i = 0; i < sceneObjects.size(); i++) {
+    Shader *shader = sceneObjects[i]->getShader();
+    if (shader &&
+        std::find(shaders.begin(), shaders.end(), shader) == shaders.end()) {
+      shaders.push_back(shader);
+    }
+    delete sceneObjects[i];
+  }
+  for (Shader *shader : shaders) {
+    delete shader;
+  }
+  for (uint64_t i = 0; i < lights.size(); i++) {
+    delete lights[i];
+  }
+#endif
+}
+
 CUDA_HOSTDEV void RoomScene::buildScene() {
   sceneObjects = EasyVector<Object *>();
 
@@ -38,6 +60,9 @@ CUDA_HOSTDEV void RoomScene::buildScene() {
       if (textures.size() > 0) {
         boxSideMaterial->texture = textures[0];
       }
+      if (virtualTextures.size() > 0) {
+        boxSideMaterial->virtualTexture = virtualTextures[0];
+      }
     }
 
     if (
@@ -46,9 +71,14 @@ CUDA_HOSTDEV void RoomScene::buildScene() {
       i == 2 * 2 || i == 2 * 2 + 1
       ) { // Floor triangles, apply the floor texture
       boxSideMaterial->setProfile(1.0f, 0.0f, 0.0f);
-      if (textures.size() > 0) {
+      if (textures.size() > 1) {
         boxSideMaterial->texture = textures[1];
-        boxSideMaterial->normals = textures[2];
+        if (textures.size() > 2) {
+          boxSideMaterial->normals = textures[2];
+        }
+      }
+      if (virtualTextures.size() > 1) {
+        boxSideMaterial->virtualTexture = virtualTextures[1];
       }
     }
 
@@ -58,7 +88,12 @@ CUDA_HOSTDEV void RoomScene::buildScene() {
 
     if (i == 5 * 2 || i == 5 * 2 + 1) {
       boxSideMaterial->setProfile(1.0f, 0.0f, 0.0f);
-      boxSideMaterial->texture = textures[2];
+      if (textures.size() > 2) {
+        boxSideMaterial->texture = textures[2];
+      }
+      if (virtualTextures.size() > 2) {
+        boxSideMaterial->virtualTexture = virtualTextures[2];
+      }
     }
 
     boxSideMaterial->enableShadows = false;
@@ -125,8 +160,13 @@ CUDA_HOSTDEV void RoomScene::buildScene() {
   sceneObjects.push_back(matteSphere);
   sceneObjects.push_back(slightlyShinySphere);
 
-  // Add lights
+  // Add lights: a 64x64 area light, one shadow ray per hit, the renderer's
+  // denoiser removes the sampling noise from the soft shadows.
   lights.push_back(new Light(make_float3(0.0f, 0.0f, -128.0f),
-                             make_float3(1.0f, 1.0f, 1.0f)));
+                             make_float3(1.0f, 1.0f, 1.0f),
+                             make_float3(64.0f, 0.0f, 0.0f),
+                             make_float3(0.0f, 64.0f, 0.0f), 1));
+
+  buildAccelerationStructure();
 }
 } // namespace raytracer_cu
@@ -8,7 +8,19 @@ namespace raytracer_cu {
 
   class RoomScene : public Scene {
   public:
+    // Indices in sceneObjects: 12 box triangles and the 2 of the
+    // transparent square come first.
+    enum ObjectId {
+      shinySphereId = 14,
+      glassSphereId,
+      matteSphereId,
+      slightlyShinySphereId
+    };
+
     CUDA_HOSTDEV RoomScene(){};
+    // Deletes the objects, their materials and the lights (host only), not
+    // the textures: whoever added them owns them.
+    CUDA_HOSTDEV ~RoomScene();
     CUDA_HOSTDEV void buildScene();
   };
 
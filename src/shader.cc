@@ -3,6 +3,7 @@
 #include <iostream>
 #include <memory>
 
+#include "random.h"
 #include "raytracer_basics.h"
 
 namespace raytracer_cu {
@@ -27,10 +28,8 @@ CUDA_HOSTDEV float3 computeReflectionDirection(Ray &incidentRay,
   return projectedVector + 2.0f * surfaceNormal;           // R in the paper
 }
 
-bool Shader::computeRefractiveComponent(Scene *scene, Ray &incidentRay,
-                                        Intersection &surfaceIntersection,
-                                        float refractiveIndex,
-                                        float3 &refractedColor) {
+Ray Shader::refractionRay(Ray &incidentRay, Intersection &surfaceIntersection,
+                          float refractiveIndex) {
   float adjustNormSign = 1.0f;
   if (dot(surfaceIntersection.surfaceNormal, incidentRay.direction) > -0.001f) {
     adjustNormSign = -1.0f;
@@ -42,15 +41,66 @@ bool Shader::computeRefractiveComponent(Scene *scene, Ray &incidentRay,
   float3 fixedSurfPt =
       surfaceIntersection.surfacePoint - bounceSurfDist * adjustedNormal;
   Ray refractionRay(fixedSurfPt, refrDir, incidentRay.bounces - 1);
-  float3 tmpRefractedColor;
-  bool result = scene->trace(refractionRay, tmpRefractedColor);
+  refractionRay.seed = splitSeed(incidentRay.seed);
+  refractionRay.throughput = incidentRay.throughput * refractedWeight;
+  refractionRay.cost = incidentRay.cost;
+  refractionRay.coneWidth = surfaceIntersection.footprint;
+  refractionRay.coneSpread = incidentRay.coneSpread;
+  refractionRay.generation = incidentRay.generation + 1;
+  refractionRay.source = surfaceIntersection.object;
+  refractionRay.sourceLevel = surfaceIntersection.level;
+  return refractionRay;
+}
+
+Ray Shader::reflectionRay(Ray &incidentRay,
+                          Intersection &surfaceIntersection) {
+  float3 fixedSurfPt = surfaceIntersection.surfacePoint +
+                       bounceSurfDist * surfaceIntersection.surfaceNormal;
+  float3 refDir = computeReflectionDirection(incidentRay,
+                                             surfaceIntersection.surfaceNormal);
+
+  Ray reflectionRay(fixedSurfPt, refDir, incidentRay.bounces - 1);
+  reflectionRay.seed = splitSeed(incidentRay.seed);
+  reflectionRay.throughput = incidentRay.throughput * reflectedWeight;
+  reflectionRay.cost = incidentRay.cost;
+  reflectionRay.coneWidth = surfaceIntersection.footprint;
+  reflectionRay.coneSpread = incidentRay.coneSpread;
+  reflectionRay.generation = incidentRay.generation + 1;
+  reflectionRay.source = surfaceIntersection.object;
+  reflectionRay.sourceLevel = surfaceIntersection.level;
+  return reflectionRay;
+}
+
+Ray Shader::shadowRay(Ray &incidentRay, Intersection &surfaceIntersection) {
+  Ray shadowRay;
+  shadowRay.cost = incidentRay.cost;
+  shadowRay.coneWidth = surfaceIntersection.footprint;
+  shadowRay.coneSpread = incidentRay.coneSpread;
+  shadowRay.generation = incidentRay.generation + 1;
+  shadowRay.source = surfaceIntersection.object;
+  shadowRay.sourceLevel = surfaceIntersection.level;
+  return shadowRay;
+}
+
+bool Shader::computeRefractiveComponent(Scene *scene, Ray &incidentRay,
+                                        Intersection &surfaceIntersection,
+                                        float refractiveIndex,
+                                        float3 &refractedColor) {
+  Ray refracted =
+      refractionRay(incidentRay, surfaceIntersection, refractiveIndex);
+  if (refracted.throughput < scene->minThroughput) {
+    refractedColor = make_float3(0.0f, 0.0f, 0.0f);
+    return false;
+  }
+  float3 tmpRefractedColor = make_float3(0.0f, 0.0f, 0.0f);
+  bool result = scene->trace(refracted, tmpRefractedColor);
 
   float debugEps = .0001f;
   if (abs(incidentRay.direction.x) < debugEps &&
       abs(incidentRay.direction.y) < debugEps) {
 #ifdef DEBUG_STDOUT
-    std::cout << "Normal: " << adjustedNormal << "Incoming: " << incidentRay
-              << " refracted: " << refractionRay
+    std::cout << "Incoming: " << incidentRay
+              << " refracted: " << refracted
               << " color: " << tmpRefractedColor << " [" << incidentRay.bounces
               << "]" << std::endl;
 #endif
@@ -63,15 +113,14 @@ bool Shader::computeRefractiveComponent(Scene *scene, Ray &incidentRay,
 bool Shader::computeReflectiveComponent(Scene *scene, Ray &incidentRay,
                                         Intersection &surfaceIntersection,
                                         float3 &reflectedColor) {
-  float3 fixedSurfPt = surfaceIntersection.surfacePoint +
-                       bounceSurfDist * surfaceIntersection.surfaceNormal;
-  float3 refDir = computeReflectionDirection(incidentRay,
-                                             surfaceIntersection.surfaceNormal);
-
-  Ray reflectionRay(fixedSurfPt, refDir, incidentRay.bounces - 1);
-  float3 reflectedColorTmp;
+  Ray reflected = reflectionRay(incidentRay, surfaceIntersection);
+  if (reflected.throughput < scene->minThroughput) {
+    reflectedColor = make_float3(0.0f, 0.0f, 0.0f);
+    return false;
+  }
+  float3 reflectedColorTmp = make_float3(0.0f, 0.0f, 0.0f);
 
-  bool result = scene->trace(reflectionRay, reflectedColorTmp);
+  bool result = scene->trace(reflected, reflectedColorTmp);
   reflectedColor = reflectedColorTmp;
   return result;
 }
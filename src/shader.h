@@ -7,8 +7,16 @@
 
 namespace raytracer_cu {
 
+CUDA_HOSTDEV float3 computeRafractionDirection(Ray &incidentRay,
+                                               float3 &surfaceNormal,
+                                               float &kn);
+CUDA_HOSTDEV float3 computeReflectionDirection(Ray &incidentRay,
+                                               float3 &surfaceNormal);
+
 class Shader {
 public:
+  MEMORY_TAGGED_NEW(MemoryTag::materials)
+
   float3 color;
   float diffuseWeight = 0.5f;
   float reflectedWeight = 0.5f;
@@ -20,6 +28,7 @@ public:
 
   CUDA_HOSTDEV Shader() {}
   CUDA_HOSTDEV Shader(float3 color) : color(color) {}
+  CUDA_HOSTDEV virtual ~Shader() {}
 
   CUDA_HOSTDEV void setProfile(float a_diffuseWeight, float a_reflectedWeight,
                                float a_refractedWeight) {
@@ -27,6 +36,20 @@ public:
     reflectedWeight = a_reflectedWeight;
     refractedWeight = a_refractedWeight;
   }
+  // The secondary rays leaving the surface, used by the recursive
+  // compute*Component functions and by the wavefront renderer. Their
+  // throughput is the incident one times the reflected / refracted weight.
+  CUDA_HOSTDEV Ray reflectionRay(Ray &incidentRay,
+                                 Intersection &surfaceIntersection);
+  CUDA_HOSTDEV Ray refractionRay(Ray &incidentRay,
+                                 Intersection &surfaceIntersection,
+                                 float refractiveIndex);
+  // The prototype of the shadow rays of the surface, for
+  // Scene::computeDiffuseComponent.
+  CUDA_HOSTDEV Ray shadowRay(Ray &incidentRay,
+                             Intersection &surfaceIntersection);
+  // Trace the secondary ray, or return false with a black color when its
+  // throughput is below Scene::minThroughput.
   CUDA_HOSTDEV virtual bool
   computeReflectiveComponent(Scene *scene, Ray &incidentRay,
                              Intersection &surfaceIntersection,
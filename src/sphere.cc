@@ -80,6 +80,13 @@ namespace raytracer_cu {
   void Sphere::transform( mat3x3 &transformMatrix) {
     center = mm<3>(transformMatrix, center);
   }
+
+  AABB Sphere::bounds() {
+    AABB box;
+    box.grow(center - make_float3(r, r, r));
+    box.grow(center + make_float3(r, r, r));
+    return box;
+  }
  
   float3 Sphere::excite(Scene * scene,
                            Ray &incidentRay,
@@ -93,6 +100,28 @@ namespace raytracer_cu {
 
   void Sphere::setShader(SphereShader* sphereShader) { this->shader = sphereShader; }
 
+  SurfaceResponse Sphere::respond(Ray &incidentRay, Intersection &) {
+    SurfaceResponse response;
+    response.shaded = shader != nullptr;
+    response.reflect = false;
+    response.refract = false;
+    response.refractiveIndex = 1.0f;
+    if (!shader) {
+      response.diffuseColor = color;
+      return response;
+    }
+    // Mirrors GenericSphereShader::shade
+    response.diffuseColor = shader->color;
+    bool inside = r > length(incidentRay.origin - center);
+    if (incidentRay.bounces) {
+      response.reflect = shader->reflectedWeight > shader->weightThreshold && !inside;
+      response.refract = shader->refractedWeight > shader->weightThreshold;
+    }
+    response.refractiveIndex =
+        inside ? 1.0f / shader->refractiveIndex : shader->refractiveIndex;
+    return response;
+  }
+
   float3 GenericSphereShader::shade(Scene * scene,
                                        Ray &incidentRay,
                                        Intersection &intersection)  {
@@ -130,7 +159,8 @@ namespace raytracer_cu {
     if (diffuseWeight > weightThreshold) {
       float3 fixedSurfPt = intersection.surfacePoint + .1f * intersection.surfaceNormal;
       diffuseComponent = s->computeDiffuseComponent(
-          fixedSurfPt, intersection.surfaceNormal, color, enableShadows);
+          fixedSurfPt, intersection.surfaceNormal, color, enableShadows,
+          incidentRay.seed, shadowRay(incidentRay, intersection));
     }
     return diffuseWeight * diffuseComponent +
           reflectedWeight * reflectiveComponent +
@@ -27,7 +27,7 @@ namespace raytracer_cu {
 
   class Sphere : public Object {
   public:
-    SphereShader* shader;
+    SphereShader* shader = nullptr;
     float3 center;
     float r;
 
@@ -35,10 +35,14 @@ namespace raytracer_cu {
         : center(center), r(r), Object(color){};
     CUDA_HOSTDEV float3 excite(Scene * scene,  Ray &incidentRay,
                     Intersection &intersection) ;
+    CUDA_HOSTDEV SurfaceResponse respond(Ray &incidentRay,
+                                         Intersection &intersection);
     CUDA_HOSTDEV void setShader(SphereShader* sphereShader);
+    CUDA_HOSTDEV Shader* getShader() { return shader; }
     CUDA_HOSTDEV bool intersect( Ray &ray, float3 &outIntersectionPoint, float3 &n,
                   float3 &c);
     CUDA_HOSTDEV void transform( mat3x3 &transformMatrix);
+    CUDA_HOSTDEV AABB bounds();
   };
 }
 
@@ -0,0 +1,110 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "profiler.h"
+
+namespace raytracer_cu {
+
+ThreadPool::ThreadPool(int nWorkers) {
+  if (nWorkers < 0) {
+    nWorkers = std::max(1, int(std::thread::hardware_concurrency()) - 1);
+  }
+  for (int i = 0; i < nWorkers; i++) {
+    workers.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  taskAvailable.notify_all();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::workerLoop() {
+  PROFILE_THREAD_NAME("pool worker");
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      taskAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+      if (stopping && tasks.empty()) {
+        return;
+      }
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    task();
+  }
+}
+
+std::future<void> ThreadPool::enqueue(std::function<void()> task) {
+  auto packaged = std::make_shared<std::packaged_task<void()>>(std::move(task));
+  std::future<void> result = packaged->get_future();
+  if (workers.empty()) {
+    (*packaged)();
+    return result;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.emplace_back([packaged] { (*packaged)(); });
+  }
+  taskAvailable.notify_one();
+  return result;
+}
+
+void ThreadPool::parallelFor(int begin, int end, int grain,
+                             const std::function<void(int, int)> &fn) {
+  if (end <= begin) {
+    return;
+  }
+  grain = std::max(grain, 1);
+  int nChunks = (end - begin + grain - 1) / grain;
+  if (nChunks == 1) {
+    fn(begin, end);
+    return;
+  }
+
+  // Chunks are claimed from a shared counter by the helpers and the caller,
+  // so the caller never blocks on work nobody picked up.
+  struct Shared {
+    std::atomic<int> nextChunk{0};
+    std::atomic<int> doneChunks{0};
+    std::mutex doneMutex;
+    std::condition_variable allDone;
+  };
+  auto shared = std::make_shared<Shared>();
+  auto runChunks = [shared, begin, end, grain, nChunks, &fn] {
+    int chunk;
+    while ((chunk = shared->nextChunk.fetch_add(1)) < nChunks) {
+      int chunkBegin = begin + chunk * grain;
+      fn(chunkBegin, std::min(chunkBegin + grain, end));
+      if (shared->doneChunks.fetch_add(1) + 1 == nChunks) {
+        std::lock_guard<std::mutex> lock(shared->doneMutex);
+        shared->allDone.notify_all();
+      }
+    }
+  };
+
+  int nHelpers = std::min<int>(nChunks - 1, int(workers.size()));
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int i = 0; i < nHelpers; i++) {
+      tasks.emplace_back(runChunks);
+    }
+  }
+  taskAvailable.notify_all();
+
+  runChunks();
+  std::unique_lock<std::mutex> lock(shared->doneMutex);
+  shared->allDone.wait(lock, [&] { return shared->doneChunks.load() == nChunks; });
+}
+
+} // namespace raytracer_cu
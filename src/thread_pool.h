@@ -0,0 +1,52 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace raytracer_cu {
+
+/*
+Task based thread pool for the host backends.
+
+enqueue(task):  runs task on a worker, the future becomes ready when done
+parallelFor(begin, end, grain, fn):
+                splits [begin, end) into chunks of `grain` indices, calls
+                fn(chunkBegin, chunkEnd) on the workers and the calling thread
+                and returns when all chunks are done
+
+Tasks may enqueue further tasks, but must not wait on them from a worker
+(parallelFor from a worker is fine, the caller takes part in the work).
+*/
+class ThreadPool {
+private:
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable taskAvailable;
+  bool stopping = false;
+
+  void workerLoop();
+
+public:
+  // nWorkers < 0 starts hardware_concurrency() - 1 workers (parallelFor
+  // callers work too), with 0 workers everything runs on the caller.
+  explicit ThreadPool(int nWorkers = -1);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  unsigned size() const { return unsigned(workers.size()); }
+  std::future<void> enqueue(std::function<void()> task);
+  void parallelFor(int begin, int end, int grain,
+                   const std::function<void(int, int)> &fn);
+};
+
+} // namespace raytracer_cu
+
+#endif
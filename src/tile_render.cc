@@ -0,0 +1,296 @@
+#include "tile_render.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "net.h"
+#include "profiler.h"
+
+namespace raytracer_cu {
+
+namespace {
+
+bool sendMessage(int fd, TileMessage type, const void *payload,
+                 uint32_t size) {
+  TileMessageHeader header = {type, size};
+  return sendAll(fd, &header, sizeof(header)) &&
+         (size == 0 || sendAll(fd, payload, size));
+}
+
+} // namespace
+
+// ---------- TileCoordinator ----------
+
+TileCoordinator::TileCoordinator(int port) {
+  listenFd = listenTcp(port);
+  if (listenFd < 0) {
+    std::cerr << "TileCoordinator: can not listen on port " << port << ": "
+              << strerror(errno) << std::endl;
+    return;
+  }
+  acceptThread = std::thread(&TileCoordinator::acceptLoop, this);
+}
+
+TileCoordinator::~TileCoordinator() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  changed.notify_all();
+  closeSocket(listenFd);
+  if (acceptThread.joinable()) {
+    acceptThread.join();
+  }
+  // The connection list only changes on the accept thread, which is gone.
+  for (auto &connection : connections) {
+    connection->thread.join();
+  }
+}
+
+int TileCoordinator::port() const { return localPort(listenFd); }
+
+void TileCoordinator::acceptLoop() {
+  while (true) {
+    int fd = acceptConnection(listenFd);
+    if (fd < 0) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (stopping) {
+        return;
+      }
+      continue;
+    }
+
+    // A worker announces itself before it gets any work.
+    setReceiveTimeout(fd, tileTimeoutMs);
+    TileMessageHeader header;
+    TileHello hello;
+    if (!recvAll(fd, &header, sizeof(header)) ||
+        header.type != TileMessage::Hello || header.size != sizeof(hello) ||
+        !recvAll(fd, &hello, sizeof(hello))) {
+      closeSocket(fd);
+      continue;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping) {
+      sendMessage(fd, TileMessage::Shutdown, nullptr, 0);
+      closeSocket(fd);
+      return;
+    }
+    std::unique_ptr<Connection> connection(new Connection());
+    connection->fd = fd;
+    connection->stats.workerId = int(connections.size());
+    connection->stats.nThreads = hello.nThreads;
+    connection->thread =
+        std::thread(&TileCoordinator::serveWorker, this, connection.get());
+    connections.push_back(std::move(connection));
+    changed.notify_all();
+  }
+}
+
+void TileCoordinator::serveWorker(Connection *connection) {
+  while (true) {
+    Tile tile;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [this] { return stopping || !pendingTiles.empty(); });
+      if (stopping) {
+        break;
+      }
+      tile = pendingTiles.front();
+      pendingTiles.pop_front();
+    }
+
+    bool ok = renderTile(connection, tile);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!ok) {
+      std::cerr << "TileCoordinator: worker " << connection->stats.workerId
+                << " failed, reissuing tile " << tile.x << "," << tile.y
+                << std::endl;
+      pendingTiles.push_front(tile);
+      connection->stats.failed = true;
+      connection->closed = true;
+      changed.notify_all();
+      closeSocket(connection->fd);
+      return;
+    }
+    remainingTiles--;
+    changed.notify_all();
+  }
+
+  sendMessage(connection->fd, TileMessage::Shutdown, nullptr, 0);
+  std::lock_guard<std::mutex> lock(mutex);
+  connection->closed = true;
+  closeSocket(connection->fd);
+}
+
+bool TileCoordinator::renderTile(Connection *connection, const Tile &tile) {
+  // The frame does not change while one of its tiles is out.
+  TileRequest request;
+  uint8_t *colorBuffer;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    request = frame;
+    colorBuffer = frameBuffer;
+  }
+  request.x = tile.x;
+  request.y = tile.y;
+  request.w = tile.w;
+  request.h = tile.h;
+  PROFILE_SCOPE_ARG("tile round trip", "tile",
+                    tile.y * request.imageWidth + tile.x);
+
+  int fd = connection->fd;
+  if (!sendMessage(fd, TileMessage::RenderTile, &request, sizeof(request))) {
+    return false;
+  }
+
+  TileMessageHeader header;
+  TileResultHeader result;
+  std::vector<uint8_t> pixels(tile.w * tile.h * 4);
+  if (!recvAll(fd, &header, sizeof(header)) ||
+      header.type != TileMessage::TileResult ||
+      header.size != sizeof(result) + pixels.size() ||
+      !recvAll(fd, &result, sizeof(result)) ||
+      !recvAll(fd, pixels.data(), pixels.size())) {
+    return false;
+  }
+  if (result.frameId != request.frameId || result.x != tile.x ||
+      result.y != tile.y || result.w != tile.w || result.h != tile.h) {
+    return false;
+  }
+
+  for (int row = 0; row < tile.h; row++) {
+    memcpy(colorBuffer + ((tile.y + row) * request.imageWidth + tile.x) * 4,
+           pixels.data() + row * tile.w * 4, tile.w * 4);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  connection->stats.tilesRendered++;
+  connection->stats.renderMs += result.renderMs;
+  return true;
+}
+
+int TileCoordinator::connectedWorkers() {
+  std::lock_guard<std::mutex> lock(mutex);
+  int n = 0;
+  for (auto &connection : connections) {
+    n += connection->closed ? 0 : 1;
+  }
+  return n;
+}
+
+bool TileCoordinator::waitForWorkers(int n, int timeoutMs) {
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+  std::unique_lock<std::mutex> lock(mutex);
+  return changed.wait_until(lock, deadline, [this, n] {
+    int connected = 0;
+    for (auto &connection : connections) {
+      connected += connection->closed ? 0 : 1;
+    }
+    return connected >= n;
+  });
+}
+
+void TileCoordinator::renderFrame(const Camera &camera, int2 size,
+                                  int maxBounces, uint32_t frameIndex,
+                                  uint8_t *colorBuffer) {
+  std::unique_lock<std::mutex> lock(mutex);
+  frame.frameId = ++frameId;
+  frame.imageWidth = size.x;
+  frame.imageHeight = size.y;
+  frame.maxBounces = maxBounces;
+  frame.frameIndex = frameIndex;
+  frame.camera = camera;
+  frameBuffer = colorBuffer;
+
+  pendingTiles.clear();
+  for (int y = 0; y < size.y; y += tileSize) {
+    for (int x = 0; x < size.x; x += tileSize) {
+      Tile tile = {x, y, std::min(tileSize, size.x - x),
+                   std::min(tileSize, size.y - y)};
+      pendingTiles.push_back(tile);
+    }
+  }
+  remainingTiles = int(pendingTiles.size());
+  changed.notify_all();
+  changed.wait(lock, [this] { return remainingTiles == 0; });
+  frameBuffer = nullptr;
+}
+
+std::vector<TileWorkerStats> TileCoordinator::workerStats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::vector<TileWorkerStats> stats;
+  for (auto &connection : connections) {
+    stats.push_back(connection->stats);
+  }
+  return stats;
+}
+
+// ---------- TileWorker ----------
+
+TileWorker::TileWorker(Scene *scene, ThreadPool &pool)
+    : renderer(scene, pool), nThreads(pool.size() + 1) {}
+
+int TileWorker::serve(const std::string &host, int port) {
+  int fd = connectTcp(host, port);
+  if (fd < 0) {
+    std::cerr << "TileWorker: can not connect to " << host << ":" << port
+              << std::endl;
+    return 0;
+  }
+  TileHello hello = {nThreads};
+  int tilesRendered = 0;
+  std::vector<uint8_t> pixels;
+
+  bool ok = sendMessage(fd, TileMessage::Hello, &hello, sizeof(hello));
+  while (ok) {
+    TileMessageHeader header;
+    TileRequest request;
+    if (!recvAll(fd, &header, sizeof(header)) ||
+        header.type != TileMessage::RenderTile ||
+        header.size != sizeof(request) ||
+        !recvAll(fd, &request, sizeof(request))) {
+      break; // Shutdown, lost connection or protocol error
+    }
+
+    // The span argument is the pixel index of the tile corner.
+    PROFILE_SCOPE_ARG("tile", "tile",
+                      request.y * request.imageWidth + request.x);
+    auto start = std::chrono::steady_clock::now();
+    pixels.resize(request.w * request.h * 4);
+    renderer.maxBounces = request.maxBounces;
+    renderer.renderRegion(request.camera,
+                          make_int2(request.imageWidth, request.imageHeight),
+                          request.frameIndex, request.x, request.y, request.w,
+                          request.h, pixels.data());
+    TileResultHeader result;
+    result.frameId = request.frameId;
+    result.x = request.x;
+    result.y = request.y;
+    result.w = request.w;
+    result.h = request.h;
+    result.renderMs = std::chrono::duration<float, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+
+    if (tilesRendered == failAfterTiles) {
+      break;
+    }
+    header.type = TileMessage::TileResult;
+    header.size = uint32_t(sizeof(result) + pixels.size());
+    ok = sendAll(fd, &header, sizeof(header)) &&
+         sendAll(fd, &result, sizeof(result)) &&
+         sendAll(fd, pixels.data(), pixels.size());
+    tilesRendered += ok ? 1 : 0;
+  }
+  closeSocket(fd);
+  return tilesRendered;
+}
+
+} // namespace raytracer_cu
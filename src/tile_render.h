@@ -0,0 +1,160 @@
+#ifndef TILE_RENDER_H
+#define TILE_RENDER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cuda_runtime.h"
+
+#include "camera.h"
+#include "host_renderer.h"
+
+namespace raytracer_cu {
+
+/*
+Distributed tile rendering over TCP.
+
+Every message is a TileMessageHeader followed by `size` payload bytes. The
+structs are sent as they are in memory, coordinator and workers must share
+the byte order and the struct layout (same build on the same architecture).
+
+  worker -> coordinator  Hello       TileHello
+  coordinator -> worker  RenderTile  TileRequest
+  worker -> coordinator  TileResult  TileResultHeader + w * h * 4 RGBA bytes
+  coordinator -> worker  Shutdown    (empty)
+
+A tile is a rectangle of the pixel grid of a size.x * size.y image. The
+pixels only depend on their image coordinates (see
+HostRenderer::renderRegion), so a frame assembled from tiles is identical to
+a frame rendered in one piece, whichever worker rendered which tile.
+*/
+enum class TileMessage : uint32_t {
+  Hello = 1,
+  RenderTile = 2,
+  TileResult = 3,
+  Shutdown = 4
+};
+
+struct TileMessageHeader {
+  TileMessage type;
+  uint32_t size;
+};
+
+struct TileHello {
+  uint32_t nThreads;
+};
+
+struct TileRequest {
+  uint32_t frameId;
+  int32_t x, y, w, h;
+  int32_t imageWidth, imageHeight;
+  int32_t maxBounces;
+  uint32_t frameIndex;
+  Camera camera;
+};
+
+struct TileResultHeader {
+  uint32_t frameId;
+  int32_t x, y, w, h;
+  float renderMs;
+};
+
+struct TileWorkerStats {
+  int workerId;
+  unsigned nThreads;
+  int tilesRendered = 0;
+  double renderMs = 0.0; // time spent tracing on the worker
+  bool failed = false;
+};
+
+/*
+Coordinator: accepts worker connections on a TCP port and splits frames into
+tiles. Every connected worker is served by its own thread that takes the
+next unassigned tile as soon as its previous one came back, so faster
+workers render more tiles. If a worker disconnects or misses
+tileTimeoutMs, its tile goes back to the front of the queue and the worker
+is dropped. Workers may connect at any time, also during a frame.
+
+renderFrame() blocks until every tile is back. It never returns while no
+worker is connected, use waitForWorkers() first.
+*/
+class TileCoordinator {
+private:
+  struct Connection {
+    int fd;
+    TileWorkerStats stats;
+    std::thread thread;
+    bool closed = false;
+  };
+
+  struct Tile {
+    int x, y, w, h;
+  };
+
+  int listenFd = -1;
+  std::thread acceptThread;
+  std::mutex mutex;
+  std::condition_variable changed;
+  bool stopping = false;
+  std::vector<std::unique_ptr<Connection>> connections;
+
+  // The frame being rendered
+  std::deque<Tile> pendingTiles;
+  int remainingTiles = 0;
+  uint32_t frameId = 0;
+  TileRequest frame;
+  uint8_t *frameBuffer = nullptr;
+
+  void acceptLoop();
+  void serveWorker(Connection *connection);
+  bool renderTile(Connection *connection, const Tile &tile);
+
+public:
+  int tileSize = 64;
+  int tileTimeoutMs = 60000;
+
+  // port 0 picks a free port, see port().
+  explicit TileCoordinator(int port);
+  ~TileCoordinator();
+  TileCoordinator(const TileCoordinator &) = delete;
+  TileCoordinator &operator=(const TileCoordinator &) = delete;
+
+  bool listening() const { return listenFd >= 0; }
+  int port() const;
+  int connectedWorkers();
+  // Waits until at least n workers are connected, false on timeout.
+  bool waitForWorkers(int n, int timeoutMs);
+  void renderFrame(const Camera &camera, int2 size, int maxBounces,
+                   uint32_t frameIndex, uint8_t *colorBuffer);
+  std::vector<TileWorkerStats> workerStats();
+};
+
+/*
+Worker: connects to a coordinator and renders the tiles it is sent with a
+HostRenderer on its own copy of the scene, until the coordinator shuts it
+down or the connection is lost. Returns the number of tiles rendered.
+
+failAfterTiles >= 0 drops the connection after that many tiles without
+sending the last result, to exercise the coordinator's reissue path.
+*/
+class TileWorker {
+private:
+  HostRenderer renderer;
+  unsigned nThreads;
+
+public:
+  int failAfterTiles = -1;
+
+  TileWorker(Scene *scene, ThreadPool &pool);
+  int serve(const std::string &host, int port);
+};
+
+} // namespace raytracer_cu
+
+#endif
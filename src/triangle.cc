@@ -3,6 +3,7 @@
 #include <memory>
 
 #include "raytracer_basics.h"
+#include "virtual_texture.h"
 
 namespace raytracer_cu {
 /*
@@ -75,8 +76,6 @@ float3 GenericTriangleShader::shade(Scene *scene, Ray &incidentRay,
   float3 reflectedColor = make_float3(0.0f, 0.0f, 0.0f);
   float3 refractedColor = make_float3(0.0f, 0.0f, 0.0f);
 
-  float weightThreshold = 0.001f;
-
   float3 fixedSurfacePoint =
       intersection.surfacePoint + 0.1f * intersection.surfaceNormal;
   if (incidentRay.bounces > 0) {
@@ -91,35 +90,66 @@ float3 GenericTriangleShader::shade(Scene *scene, Ray &incidentRay,
   }
 
   if (diffuseWeight > weightThreshold) {
-    float3 diffuseBaseColor = color;
-    if (texture) {
-
-      // Barycentric coefficients
-      float vertex0Bar, vertex1Bar, vertex2Bar;
-      Barycentric(intersection.surfacePoint, vertex0, vertex1, vertex2,
-                  vertex0Bar, vertex1Bar, vertex2Bar);
-
-      // The unnormalized texture sampling coordinate
-      float2 sampleCoord = texCoord0 * vertex0Bar + texCoord1 * vertex1Bar +
-                           texCoord2 * vertex2Bar;
-
-      // The sampled color (should be bilinear at least)
-      float3 textureColor = texture->getPixel(int(sampleCoord.x * texture->w) % texture->w,
-                                              int(sampleCoord.y * texture->h) % texture->h);
-
-      diffuseBaseColor = textureColor;
-    }
+    float3 diffuseBaseColor = albedo(intersection, vertex0, vertex1, vertex2,
+                                     texCoord0, texCoord1, texCoord2);
 
     // Blend the diffuse component.
     diffuseColor = s->computeDiffuseComponent(fixedSurfacePoint,
                                               intersection.surfaceNormal,
-                                              diffuseBaseColor, enableShadows);
+                                              diffuseBaseColor, enableShadows,
+                                              incidentRay.seed,
+                                              shadowRay(incidentRay,
+                                                        intersection));
   }
 
   return diffuseWeight * diffuseColor + reflectedWeight * reflectedColor +
          refractedWeight * refractedColor;
 }
 
+float3 GenericTriangleShader::albedo(Intersection &intersection,
+                                     float3 vertex0, float3 vertex1,
+                                     float3 vertex2, float2 texCoord0,
+                                     float2 texCoord1, float2 texCoord2) {
+  if (!texture && !virtualTexture) {
+    return color;
+  }
+
+  // Barycentric coefficients
+  float vertex0Bar, vertex1Bar, vertex2Bar;
+  Barycentric(intersection.surfacePoint, vertex0, vertex1, vertex2,
+              vertex0Bar, vertex1Bar, vertex2Bar);
+
+  // The unnormalized texture sampling coordinate
+  float2 sampleCoord = texCoord0 * vertex0Bar + texCoord1 * vertex1Bar +
+                       texCoord2 * vertex2Bar;
+
+#ifndef __CUDA_ARCH__
+  if (virtualTexture) {
+    // The level whose texels are about as wide as the pixel cone: texels
+    // per unit of surface from the texture and triangle areas.
+    int level = 0;
+    if (intersection.footprint > 0.0f) {
+      float2 uv1 = texCoord1 - texCoord0, uv2 = texCoord2 - texCoord0;
+      float uvArea = abs(uv1.x * uv2.y - uv1.y * uv2.x) *
+                     float(virtualTexture->width()) *
+                     float(virtualTexture->height());
+      float area = length(cross(vertex1 - vertex0, vertex2 - vertex0));
+      float texels = area > 0.0f
+                         ? intersection.footprint * sqrt(uvArea / area)
+                         : 0.0f;
+      while (texels >= 2.0f) {
+        texels *= 0.5f;
+        level++;
+      }
+    }
+    return virtualTexture->sample(sampleCoord.x, sampleCoord.y, level);
+  }
+#endif
+  // The sampled color (should be bilinear at least)
+  return texture->getPixel(int(sampleCoord.x * texture->w) % texture->w,
+                           int(sampleCoord.y * texture->h) % texture->h);
+}
+
 // ---------- Triangle definitions ----------
 
 float3 Triangle::normal() {
@@ -135,6 +165,14 @@ void Triangle::transform(mat3x3 &transformMatrix) {
   normal_ = normal();
 }
 
+AABB Triangle::bounds() {
+  AABB box;
+  box.grow(vertex0);
+  box.grow(vertex1);
+  box.grow(vertex2);
+  return box;
+}
+
 bool Triangle::intersect(Ray &incidentRay, float3 &intersectionPoint,
                          float3 &surfaceNormal, float3 &surfaceColor) {
   bool is = RayIntersectsTriangle(incidentRay, this, intersectionPoint);
@@ -158,4 +196,27 @@ float3 Triangle::excite(Scene *scene, Ray &incidentRay,
     return color;
   }
 }
+
+SurfaceResponse Triangle::respond(Ray &incidentRay,
+                                  Intersection &intersection) {
+  SurfaceResponse response;
+  response.shaded = shader != nullptr;
+  response.reflect = false;
+  response.refract = false;
+  response.refractiveIndex = 1.0f;
+  if (!shader) {
+    response.diffuseColor = color;
+    return response;
+  }
+  // Mirrors GenericTriangleShader::shade
+  response.diffuseColor = shader->albedo(intersection, vertex0, vertex1,
+                                         vertex2, texCoord0, texCoord1,
+                                         texCoord2);
+  if (incidentRay.bounces > 0) {
+    response.reflect = shader->reflectedWeight > shader->weightThreshold;
+    response.refract = shader->refractedWeight > shader->weightThreshold;
+  }
+  response.refractiveIndex = shader->refractiveIndex;
+  return response;
+}
 } // namespace raytracer_cu
\ No newline at end of file
@@ -19,22 +19,31 @@ public:
   CUDA_HOSTDEV virtual float3 shade(Scene *scene, Ray &incidentRay,
                                     Intersection &intersection, float3 vertex0,
                                     float3 vertex1, float3 vertex2, float2 texCoord0, float2 texCoord1, float2 texCoord2) = 0;
+  // Color of the diffuse term at the intersection (e.g. a texture lookup).
+  CUDA_HOSTDEV virtual float3 albedo(Intersection &, float3, float3, float3,
+                                     float2, float2, float2) {
+    return color;
+  }
 };
 
 class GenericTriangleShader : public TriangleShader {
 public:
-  ColorBuffer<float3> *texture;
-  ColorBuffer<float3> *normals;
+  ColorBuffer<float3> *texture = nullptr;
+  ColorBuffer<float3> *normals = nullptr;
+  VirtualTexture *virtualTexture = nullptr; // host only, before texture
   CUDA_HOSTDEV GenericTriangleShader(float3 color) : TriangleShader(color){};
   CUDA_HOSTDEV float3 shade(Scene *scene, Ray &incidentRay,
                             Intersection &intersection, float3 vertex0,
                             float3 vertex1, float3 vertex2, float2 texCoord0,
                             float2 texCoord1, float2 texCoord2);
+  CUDA_HOSTDEV float3 albedo(Intersection &intersection, float3 vertex0,
+                             float3 vertex1, float3 vertex2, float2 texCoord0,
+                             float2 texCoord1, float2 texCoord2);
 };
 
 class Triangle : public Object {
 public:
-  TriangleShader *shader;
+  TriangleShader *shader = nullptr;
   float3 vertex0;
   float3 vertex1;
   float3 vertex2;
@@ -45,14 +54,25 @@ public:
 
   CUDA_HOSTDEV Triangle(float3 vertex0, float3 vertex1, float3 vertex2,
                         float3 color)
-      : vertex0(vertex0), vertex1(vertex1), vertex2(vertex2), Object(color) {}
+      : vertex0(vertex0), vertex1(vertex1), vertex2(vertex2), Object(color) {
+    normal_ = normal();
+  }
   CUDA_HOSTDEV void setShader(TriangleShader *triangleShader);
+  CUDA_HOSTDEV Shader *getShader() { return shader; }
   CUDA_HOSTDEV float3 excite(Scene *scene, Ray &incidentRay,
                              Intersection &intersection);
+  CUDA_HOSTDEV SurfaceResponse respond(Ray &incidentRay,
+                                       Intersection &intersection);
   CUDA_HOSTDEV bool intersect(Ray &incidentRay, float3 &intersectionPoint,
                               float3 &surfaceNormal, float3 &surfaceColor);
   CUDA_HOSTDEV void transform(mat3x3 &transformMatrix);
+  CUDA_HOSTDEV AABB bounds();
   CUDA_HOSTDEV float3 normal();
+  CUDA_HOSTDEV bool plane(float3 &planeNormal, float &offset) {
+    planeNormal = normal();
+    offset = dot(planeNormal, vertex0);
+    return true;
+  }
 };
 } // namespace raytracer_cu
 
@@ -0,0 +1,66 @@
+#include "upscale.h"
+
+#include "cuda_runtime.h"
+
+#include "math.h"
+
+namespace raytracer_cu {
+
+CUDA_GLOBAL void upscaleEdgeAware(const uint8_t *lowColor,
+                                  const GBufferTexel *lowGBuffer,
+                                  int2 lowSize, uint8_t *outColor,
+                                  GBufferTexel *outGBuffer, int2 outSize) {
+  int x = threadIdx.x + blockIdx.x * blockDim.x;
+  int y = threadIdx.y + blockIdx.y * blockDim.y;
+
+  if (x < outSize.x && y < outSize.y) {
+    // Position of the output pixel center in low resolution pixels
+    float u = (x + 0.5f) * lowSize.x / outSize.x - 0.5f;
+    float v = (y + 0.5f) * lowSize.y / outSize.y - 0.5f;
+    int x0 = min(max(int(floorf(u)), 0), lowSize.x - 1);
+    int y0 = min(max(int(floorf(v)), 0), lowSize.y - 1);
+    int x1 = min(x0 + 1, lowSize.x - 1);
+    int y1 = min(y0 + 1, lowSize.y - 1);
+    float fx = fminf(fmaxf(u - x0, 0.0f), 1.0f);
+    float fy = fminf(fmaxf(v - y0, 0.0f), 1.0f);
+
+    int nearestX = fx < 0.5f ? x0 : x1;
+    int nearestY = fy < 0.5f ? y0 : y1;
+    int nearestIdx = nearestY * lowSize.x + nearestX;
+    GBufferTexel reference = lowGBuffer[nearestIdx];
+
+    int taps[4] = {y0 * lowSize.x + x0, y0 * lowSize.x + x1,
+                   y1 * lowSize.x + x0, y1 * lowSize.x + x1};
+    float weights[4] = {(1.0f - fx) * (1.0f - fy), fx * (1.0f - fy),
+                        (1.0f - fx) * fy, fx * fy};
+
+    float sum[3] = {0.0f, 0.0f, 0.0f};
+    float weightSum = 0.0f;
+    for (int t = 0; t < 4; t++) {
+      GBufferTexel texel = lowGBuffer[taps[t]];
+      if (texel.objectId != reference.objectId) {
+        continue;
+      }
+      float w = weights[t];
+      if (reference.objectId >= 0 &&
+          fabsf(texel.depth - reference.depth) > 0.05f * reference.depth) {
+        continue;
+      }
+      for (int c = 0; c < 3; c++) {
+        sum[c] += w * lowColor[taps[t] * 4 + 1 + c];
+      }
+      weightSum += w;
+    }
+
+    int outIdx = y * outSize.x + x;
+    outColor[outIdx * 4 + 0] = 255;
+    for (int c = 0; c < 3; c++) {
+      outColor[outIdx * 4 + 1 + c] =
+          weightSum > 0.0f ? uint8_t(__float2int_rn(sum[c] / weightSum))
+                           : lowColor[nearestIdx * 4 + 1 + c];
+    }
+    outGBuffer[outIdx] = reference;
+  }
+}
+
+} // namespace raytracer_cu
@@ -0,0 +1,28 @@
+#ifndef UPSCALE_H
+#define UPSCALE_H
+
+#include "cuda_runtime.h"
+
+#include "cudastuff.h"
+#include "gbuffer.h"
+
+namespace raytracer_cu {
+
+/*
+Edge-aware upscaling of a frame traced at a reduced resolution.
+
+Each output pixel blends the four low resolution samples around it with
+bilinear weights, but only samples showing the same object as the nearest
+sample, and at a similar depth, take part. Object silhouettes stay sharp
+instead of bleeding into the background. The nearest sample's G-buffer
+texel is written to the output G-buffer so the denoiser keeps working at
+the display resolution.
+*/
+CUDA_GLOBAL void upscaleEdgeAware(const uint8_t *lowColor,
+                                  const GBufferTexel *lowGBuffer,
+                                  int2 lowSize, uint8_t *outColor,
+                                  GBufferTexel *outGBuffer, int2 outSize);
+
+} // namespace raytracer_cu
+
+#endif
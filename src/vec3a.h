@@ -0,0 +1,180 @@
+#ifndef VEC3A_H
+#define VEC3A_H
+
+#include "cudastuff.h"
+#include "math.h"
+
+#include "cuda_runtime.h"
+
+// Optional 16 byte aligned 3-vector. The fourth lane is padding (kept at 0)
+// so a vec3a is exactly one SSE/NEON register on the host and one 128 bit
+// load on the device. Host builds use the intrinsics when RAYTRACER_SIMD is
+// defined (see CMakeLists.txt), otherwise the scalar code below is used and
+// left to the autovectorizer.
+
+#if defined(RAYTRACER_SIMD) && !defined(__CUDA_ARCH__)
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define VEC3A_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VEC3A_NEON
+#endif
+#endif
+
+namespace raytracer_cu {
+
+struct alignas(16) vec3a {
+  float x, y, z, w;
+
+  CUDA_HOSTDEV vec3a() : x(0.0f), y(0.0f), z(0.0f), w(0.0f) {}
+  CUDA_HOSTDEV vec3a(float x, float y, float z) : x(x), y(y), z(z), w(0.0f) {}
+  CUDA_HOSTDEV explicit vec3a(float3 v) : x(v.x), y(v.y), z(v.z), w(0.0f) {}
+#if defined(VEC3A_SSE)
+  explicit vec3a(__m128 r) { _mm_store_ps(&x, r); }
+  __m128 reg() const { return _mm_load_ps(&x); }
+#elif defined(VEC3A_NEON)
+  explicit vec3a(float32x4_t r) { vst1q_f32(&x, r); }
+  float32x4_t reg() const { return vld1q_f32(&x); }
+#endif
+
+  CUDA_HOSTDEV float3 xyz() const { return make_float3(x, y, z); }
+};
+
+/*
+Same notation as the float3 overloads in math.h:
+
+v=v1+v2, v=v1-v2, v=v1*v2 (elementwise), v'=s*v, v'=v*s
+s=dot(v1, v2), v=cross(v1, v2), s=length(v), v'=norm(v)
+v=vmin(v1, v2), v=vmax(v1, v2) (elementwise)
+*/
+
+#if defined(VEC3A_SSE)
+
+inline vec3a operator+(const vec3a &a, const vec3a &b) {
+  return vec3a(_mm_add_ps(a.reg(), b.reg()));
+}
+
+inline vec3a operator-(const vec3a &a, const vec3a &b) {
+  return vec3a(_mm_sub_ps(a.reg(), b.reg()));
+}
+
+inline vec3a operator*(const vec3a &a, const vec3a &b) {
+  return vec3a(_mm_mul_ps(a.reg(), b.reg()));
+}
+
+inline vec3a operator*(float s, const vec3a &a) {
+  return vec3a(_mm_mul_ps(_mm_set1_ps(s), a.reg()));
+}
+
+inline vec3a vmin(const vec3a &a, const vec3a &b) {
+  return vec3a(_mm_min_ps(a.reg(), b.reg()));
+}
+
+inline vec3a vmax(const vec3a &a, const vec3a &b) {
+  return vec3a(_mm_max_ps(a.reg(), b.reg()));
+}
+
+inline float dot(const vec3a &a, const vec3a &b) {
+  // w is 0 in both operands, so a horizontal sum of all four lanes is safe.
+  __m128 m = _mm_mul_ps(a.reg(), b.reg());
+  __m128 shuf = _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1));
+  __m128 sums = _mm_add_ps(m, shuf);
+  shuf = _mm_movehl_ps(shuf, sums);
+  return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+}
+
+inline vec3a cross(const vec3a &a, const vec3a &b) {
+  __m128 ra = a.reg();
+  __m128 rb = b.reg();
+  __m128 aYZX = _mm_shuffle_ps(ra, ra, _MM_SHUFFLE(3, 0, 2, 1));
+  __m128 bYZX = _mm_shuffle_ps(rb, rb, _MM_SHUFFLE(3, 0, 2, 1));
+  __m128 c = _mm_sub_ps(_mm_mul_ps(ra, bYZX), _mm_mul_ps(aYZX, rb));
+  return vec3a(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1)));
+}
+
+#elif defined(VEC3A_NEON)
+
+inline vec3a operator+(const vec3a &a, const vec3a &b) {
+  return vec3a(vaddq_f32(a.reg(), b.reg()));
+}
+
+inline vec3a operator-(const vec3a &a, const vec3a &b) {
+  return vec3a(vsubq_f32(a.reg(), b.reg()));
+}
+
+inline vec3a operator*(const vec3a &a, const vec3a &b) {
+  return vec3a(vmulq_f32(a.reg(), b.reg()));
+}
+
+inline vec3a operator*(float s, const vec3a &a) {
+  return vec3a(vmulq_n_f32(a.reg(), s));
+}
+
+inline vec3a vmin(const vec3a &a, const vec3a &b) {
+  return vec3a(vminq_f32(a.reg(), b.reg()));
+}
+
+inline vec3a vmax(const vec3a &a, const vec3a &b) {
+  return vec3a(vmaxq_f32(a.reg(), b.reg()));
+}
+
+inline float dot(const vec3a &a, const vec3a &b) {
+  float32x4_t m = vmulq_f32(a.reg(), b.reg());
+  float32x2_t s = vadd_f32(vget_low_f32(m), vget_high_f32(m));
+  return vget_lane_f32(vpadd_f32(s, s), 0);
+}
+
+inline vec3a cross(const vec3a &a, const vec3a &b) {
+  return vec3a(a.y * b.z - b.y * a.z, a.z * b.x - b.z * a.x,
+               a.x * b.y - b.x * a.y);
+}
+
+#else
+
+CUDA_HOSTDEV inline vec3a operator+(const vec3a &a, const vec3a &b) {
+  return vec3a(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+CUDA_HOSTDEV inline vec3a operator-(const vec3a &a, const vec3a &b) {
+  return vec3a(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+CUDA_HOSTDEV inline vec3a operator*(const vec3a &a, const vec3a &b) {
+  return vec3a(a.x * b.x, a.y * b.y, a.z * b.z);
+}
+
+CUDA_HOSTDEV inline vec3a operator*(float s, const vec3a &a) {
+  return vec3a(s * a.x, s * a.y, s * a.z);
+}
+
+CUDA_HOSTDEV inline vec3a vmin(const vec3a &a, const vec3a &b) {
+  return vec3a(fminf(a.x, b.x), fminf(a.y, b.y), fminf(a.z, b.z));
+}
+
+CUDA_HOSTDEV inline vec3a vmax(const vec3a &a, const vec3a &b) {
+  return vec3a(fmaxf(a.x, b.x), fmaxf(a.y, b.y), fmaxf(a.z, b.z));
+}
+
+CUDA_HOSTDEV inline float dot(const vec3a &a, const vec3a &b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+CUDA_HOSTDEV inline vec3a cross(const vec3a &a, const vec3a &b) {
+  return vec3a(a.y * b.z - b.y * a.z, a.z * b.x - b.z * a.x,
+               a.x * b.y - b.x * a.y);
+}
+
+#endif
+
+CUDA_HOSTDEV inline vec3a operator*(const vec3a &a, float s) { return s * a; }
+
+CUDA_HOSTDEV inline float length(const vec3a &a) { return sqrt(dot(a, a)); }
+
+CUDA_HOSTDEV inline vec3a norm(const vec3a &a) {
+  return (1.0f / length(a)) * a;
+}
+
+} // namespace raytracer_cu
+
+#endif
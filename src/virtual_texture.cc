@@ -0,0 +1,428 @@
+#include "virtual_texture.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "profiler.h"
+
+namespace raytracer_cu {
+
+namespace {
+
+const char magic[4] = {'V', 'T', 'X', '1'};
+
+struct FileHeader {
+  char magic[4];
+  uint32_t width, height, tileSize, nLevels;
+};
+
+int levelCountFor(int width, int height, int tileSize) {
+  int n = 1;
+  while (width > tileSize || height > tileSize) {
+    width = std::max(1, width / 2);
+    height = std::max(1, height / 2);
+    n++;
+  }
+  return n;
+}
+
+uint8_t toByte(float c) {
+  c = c < 0.0f ? 0.0f : (c > 1.0f ? 1.0f : c);
+  return uint8_t(c * 255.0f + 0.5f);
+}
+
+// Box filtered half size of an RGB8 image, odd edges are clamped.
+std::vector<uint8_t> downsample(const uint8_t *src, int w, int h, int &outW,
+                                int &outH) {
+  outW = std::max(1, w / 2);
+  outH = std::max(1, h / 2);
+  std::vector<uint8_t> dst(size_t(outW) * outH * 3);
+  for (int y = 0; y < outH; y++) {
+    int y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+    for (int x = 0; x < outW; x++) {
+      int x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+      for (int c = 0; c < 3; c++) {
+        int sum = src[(size_t(y0) * w + x0) * 3 + c] +
+                  src[(size_t(y0) * w + x1) * 3 + c] +
+                  src[(size_t(y1) * w + x0) * 3 + c] +
+                  src[(size_t(y1) * w + x1) * 3 + c];
+        dst[(size_t(y) * outW + x) * 3 + c] = uint8_t((sum + 2) / 4);
+      }
+    }
+  }
+  return dst;
+}
+
+// Writes the tiles of rows [y0, y0 + rows) of a w wide RGB8 image, rows is
+// at most tileSize; tiles are padded by repeating the edge texels.
+bool writeTileRow(FILE *f, const uint8_t *rows, int w, int nRows,
+                  int tileSize) {
+  std::vector<uint8_t> tile(size_t(tileSize) * tileSize * 3);
+  int tilesX = (w + tileSize - 1) / tileSize;
+  for (int tx = 0; tx < tilesX; tx++) {
+    for (int y = 0; y < tileSize; y++) {
+      int srcY = std::min(y, nRows - 1);
+      for (int x = 0; x < tileSize; x++) {
+        int srcX = std::min(tx * tileSize + x, w - 1);
+        memcpy(&tile[(size_t(y) * tileSize + x) * 3],
+               &rows[(size_t(srcY) * w + srcX) * 3], 3);
+      }
+    }
+    if (fwrite(tile.data(), 1, tile.size(), f) != tile.size()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool writeLevel(FILE *f, const uint8_t *texels, int w, int h, int tileSize) {
+  for (int y0 = 0; y0 < h; y0 += tileSize) {
+    if (!writeTileRow(f, texels + size_t(y0) * w * 3, w,
+                      std::min(tileSize, h - y0), tileSize)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+bool bakeTiledTexture(const std::string &path, int width, int height,
+                      int tileSize,
+                      const std::function<float3(int x, int y)> &texel) {
+  if (width <= 0 || height <= 0 || tileSize <= 0 || tileSize % 2 != 0) {
+    return false;
+  }
+  FILE *f = fopen(path.c_str(), "wb");
+  if (!f) {
+    return false;
+  }
+
+  int nLevels = levelCountFor(width, height, tileSize);
+  FileHeader header;
+  memcpy(header.magic, magic, 4);
+  header.width = uint32_t(width);
+  header.height = uint32_t(height);
+  header.tileSize = uint32_t(tileSize);
+  header.nLevels = uint32_t(nLevels);
+  std::vector<uint64_t> offsets(nLevels);
+  uint64_t offset = sizeof(header) + nLevels * sizeof(uint64_t);
+  size_t tileBytes = size_t(tileSize) * tileSize * 3;
+  for (int l = 0, w = width, h = height; l < nLevels; l++) {
+    offsets[l] = offset;
+    offset += uint64_t((w + tileSize - 1) / tileSize) *
+              ((h + tileSize - 1) / tileSize) * tileBytes;
+    w = std::max(1, w / 2);
+    h = std::max(1, h / 2);
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(offsets.data(), sizeof(uint64_t), nLevels, f) ==
+                size_t(nLevels);
+
+  // Level 0 one band of tiles at a time, downsampled into level 1 on the
+  // way (the band is an even number of rows).
+  int w1 = std::max(1, width / 2), h1 = std::max(1, height / 2);
+  std::vector<uint8_t> level1(nLevels > 1 ? size_t(w1) * h1 * 3 : 0);
+  std::vector<uint8_t> band(size_t(width) * tileSize * 3);
+  for (int y0 = 0; ok && y0 < height; y0 += tileSize) {
+    int nRows = std::min(tileSize, height - y0);
+    for (int y = 0; y < nRows; y++) {
+      for (int x = 0; x < width; x++) {
+        float3 c = texel(x, y0 + y);
+        uint8_t *dst = &band[(size_t(y) * width + x) * 3];
+        dst[0] = toByte(c.x);
+        dst[1] = toByte(c.y);
+        dst[2] = toByte(c.z);
+      }
+    }
+    ok = writeTileRow(f, band.data(), width, nRows, tileSize);
+    if (nLevels > 1) {
+      int bandW, bandH;
+      std::vector<uint8_t> half =
+          downsample(band.data(), width, nRows, bandW, bandH);
+      int firstRow = y0 / 2;
+      int copyRows = std::min(bandH, h1 - firstRow);
+      if (copyRows > 0) {
+        memcpy(&level1[size_t(firstRow) * w1 * 3], half.data(),
+               size_t(copyRows) * w1 * 3);
+      }
+    }
+  }
+
+  std::vector<uint8_t> level = std::move(level1);
+  int w = w1, h = h1;
+  for (int l = 1; ok && l < nLevels; l++) {
+    ok = writeLevel(f, level.data(), w, h, tileSize);
+    int nextW, nextH;
+    level = downsample(level.data(), w, h, nextW, nextH);
+    w = nextW;
+    h = nextH;
+  }
+  return fclose(f) == 0 && ok;
+}
+
+// ---------- TileCache ----------
+
+TileCache::TileCache(size_t capacityBytes, bool asynchronous, size_t maxQueued)
+    : shardCapacity(capacityBytes / nShards), asynchronous(asynchronous),
+      maxQueued(maxQueued) {
+  if (asynchronous) {
+    loader = std::thread(&TileCache::loaderLoop, this);
+  }
+}
+
+TileCache::~TileCache() {
+  if (loader.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      stopping = true;
+    }
+    queueChanged.notify_all();
+    loader.join();
+  }
+}
+
+uint32_t TileCache::registerTexture(VirtualTexture *texture) {
+  textures.push_back(texture);
+  return uint32_t(textures.size() - 1);
+}
+
+bool TileCache::lookup(uint64_t key, int texelIndex, uint8_t *rgb,
+                       bool count) {
+  Shard &shard = shardOf(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.tiles.find(key);
+  shard.lookups += count ? 1 : 0;
+  if (it == shard.tiles.end()) {
+    return false;
+  }
+  shard.hits += count ? 1 : 0;
+  if (it->second != shard.lru.begin()) {
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  }
+  memcpy(rgb, &it->second->second[size_t(texelIndex) * 3], 3);
+  return true;
+}
+
+bool TileCache::miss(uint64_t key) {
+  if (!asynchronous) {
+    load(key);
+    return true;
+  }
+  requestLoad(key);
+  return false;
+}
+
+void TileCache::requestLoad(uint64_t key) {
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (queued.count(key)) {
+      return;
+    }
+    if (loadQueue.size() >= maxQueued) {
+      droppedRequests++;
+      return;
+    }
+    queued.insert(key);
+    loadQueue.push_back(key);
+  }
+  queueChanged.notify_one();
+}
+
+void TileCache::loaderLoop() {
+  PROFILE_THREAD_NAME("tile loader");
+  std::unique_lock<std::mutex> lock(queueMutex);
+  while (true) {
+    queueChanged.wait(lock, [this] { return stopping || !loadQueue.empty(); });
+    if (stopping) {
+      return;
+    }
+    uint64_t key = loadQueue.front();
+    loadQueue.pop_front();
+    loading++;
+    lock.unlock();
+    load(key);
+    lock.lock();
+    loading--;
+    queued.erase(key);
+    queueChanged.notify_all();
+  }
+}
+
+void TileCache::load(uint64_t key) {
+  PROFILE_SCOPE("load tile", "io");
+  uint32_t texture = uint32_t(key >> 48);
+  int level = int((key >> 40) & 0xff);
+  int tileY = int((key >> 20) & 0xfffff);
+  int tileX = int(key & 0xfffff);
+  std::vector<uint8_t> texels;
+  if (texture >= textures.size() ||
+      !textures[texture]->readTile(level, tileX, tileY, texels)) {
+    return;
+  }
+  tilesLoaded++;
+  bytesRead += texels.size();
+  insert(key, std::move(texels));
+}
+
+void TileCache::insert(uint64_t key, std::vector<uint8_t> &&texels) {
+  Shard &shard = shardOf(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  if (shard.tiles.count(key)) {
+    return; // loaded twice (synchronous misses on several threads)
+  }
+  size_t size = texels.size();
+  shard.lru.emplace_front(key, std::move(texels));
+  shard.tiles[key] = shard.lru.begin();
+  shard.bytes += size;
+  size_t resident = residentBytes += size;
+  size_t peak = peakResidentBytes.load();
+  while (resident > peak &&
+         !peakResidentBytes.compare_exchange_weak(peak, resident)) {
+  }
+
+  // The tile just inserted stays even if it alone is over the capacity.
+  while (shard.bytes > shardCapacity && shard.lru.size() > 1) {
+    auto &victim = shard.lru.back();
+    shard.bytes -= victim.second.size();
+    residentBytes -= victim.second.size();
+    shard.tiles.erase(victim.first);
+    shard.lru.pop_back();
+    evictions++;
+  }
+}
+
+void TileCache::waitForLoads() {
+  std::unique_lock<std::mutex> lock(queueMutex);
+  queueChanged.wait(lock,
+                    [this] { return loadQueue.empty() && loading == 0; });
+}
+
+TileCacheStats TileCache::stats() {
+  TileCacheStats s;
+  for (Shard &shard : shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    s.lookups += shard.lookups;
+    s.hits += shard.hits;
+  }
+  s.fallbacks = fallbacks;
+  s.tilesLoaded = tilesLoaded;
+  s.bytesRead = bytesRead;
+  s.evictions = evictions;
+  s.droppedRequests = droppedRequests;
+  s.residentBytes = residentBytes;
+  s.peakResidentBytes = peakResidentBytes;
+  s.capacityBytes = shardCapacity * nShards;
+  return s;
+}
+
+void TileCache::resetStats() {
+  for (Shard &shard : shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.lookups = shard.hits = 0;
+  }
+  fallbacks = tilesLoaded = bytesRead = evictions = droppedRequests = 0;
+  peakResidentBytes = residentBytes.load();
+}
+
+// ---------- VirtualTexture ----------
+
+std::unique_ptr<VirtualTexture> VirtualTexture::open(const std::string &path,
+                                                     TileCache &cache) {
+  std::unique_ptr<VirtualTexture> texture(new VirtualTexture(cache));
+  texture->fd = ::open(path.c_str(), O_RDONLY);
+  if (texture->fd < 0) {
+    return nullptr;
+  }
+  FileHeader header;
+  if (pread(texture->fd, &header, sizeof(header), 0) != sizeof(header) ||
+      memcmp(header.magic, magic, 4) != 0 || header.tileSize == 0 ||
+      header.nLevels == 0 || header.nLevels > 32 ||
+      int(header.nLevels) != levelCountFor(int(header.width),
+                                           int(header.height),
+                                           int(header.tileSize))) {
+    return nullptr;
+  }
+  std::vector<uint64_t> offsets(header.nLevels);
+  size_t offsetBytes = offsets.size() * sizeof(uint64_t);
+  if (pread(texture->fd, offsets.data(), offsetBytes, sizeof(header)) !=
+      ssize_t(offsetBytes)) {
+    return nullptr;
+  }
+
+  int ts = int(header.tileSize);
+  texture->tileSize = ts;
+  int w = int(header.width), h = int(header.height);
+  for (uint32_t l = 0; l < header.nLevels; l++) {
+    texture->levels.push_back(
+        Level{w, h, (w + ts - 1) / ts, (h + ts - 1) / ts, offsets[l]});
+    w = std::max(1, w / 2);
+    h = std::max(1, h / 2);
+  }
+  if (!texture->readTile(texture->levelCount() - 1, 0, 0,
+                         texture->lastLevel)) {
+    return nullptr;
+  }
+  texture->id = cache.registerTexture(texture.get());
+  return texture;
+}
+
+VirtualTexture::~VirtualTexture() {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+bool VirtualTexture::readTile(int level, int tileX, int tileY,
+                              std::vector<uint8_t> &texels) {
+  const Level &l = levels[level];
+  if (tileX >= l.tilesX || tileY >= l.tilesY) {
+    return false;
+  }
+  texels.resize(tileBytes());
+  off_t offset = off_t(l.offset + (uint64_t(tileY) * l.tilesX + tileX) *
+                                      tileBytes());
+  return pread(fd, texels.data(), texels.size(), offset) ==
+         ssize_t(texels.size());
+}
+
+float3 VirtualTexture::sample(float u, float v, int level) {
+  int x = int(u * width()) % width();
+  int y = int(v * height()) % height();
+  x = x < 0 ? x + width() : x;
+  y = y < 0 ? y + height() : y;
+
+  uint8_t rgb[3];
+  int last = levelCount() - 1;
+  level = std::max(0, std::min(level, last));
+  for (int l = level; l < last; l++) {
+    int lx = std::min(x >> l, levels[l].width - 1);
+    int ly = std::min(y >> l, levels[l].height - 1);
+    uint64_t tileKey =
+        TileCache::key(id, l, lx / tileSize, ly / tileSize);
+    int texelIndex = (ly % tileSize) * tileSize + lx % tileSize;
+    bool resident = cache.lookup(tileKey, texelIndex, rgb, l == level);
+    if (l == level && !resident) {
+      resident = cache.miss(tileKey) && cache.lookup(tileKey, texelIndex, rgb);
+    }
+    if (resident) {
+      if (l > level) {
+        cache.countFallback();
+      }
+      return make_float3(rgb[0], rgb[1], rgb[2]) * (1.0f / 255.0f);
+    }
+  }
+  if (last > level) {
+    cache.countFallback();
+  }
+  int lx = std::min(x >> last, levels[last].width - 1);
+  int ly = std::min(y >> last, levels[last].height - 1);
+  const uint8_t *texel = &lastLevel[size_t(ly * tileSize + lx) * 3];
+  return make_float3(texel[0], texel[1], texel[2]) * (1.0f / 255.0f);
+}
+
+} // namespace raytracer_cu
@@ -0,0 +1,183 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "cuda_runtime.h"
+
+#include "math.h"
+
+namespace raytracer_cu {
+
+class VirtualTexture;
+
+/*
+Tiled texture file, written by bakeTiledTexture():
+
+  header      "VTX1", width, height, tileSize, nLevels (uint32 each)
+  offsets     nLevels uint64, file offset of the first tile of each level
+  tiles       per level row major, tileSize^2 RGB8 texels each (edge tiles
+              padded)
+
+Level l is (width >> l) x (height >> l) (at least 1), every texel the
+average of 2x2 texels of the level below; the last level fits in one tile.
+
+texel(x, y) gives the level 0 texels, it is called band by band (tileSize
+rows at a time), so level 0 is never in memory as a whole; the coarser
+levels are built in memory (a quarter of the level 0 size, as RGB8).
+*/
+bool bakeTiledTexture(const std::string &path, int width, int height,
+                      int tileSize,
+                      const std::function<float3(int x, int y)> &texel);
+
+struct TileCacheStats {
+  uint64_t lookups = 0; // samples, at the level they asked for
+  uint64_t hits = 0;
+  uint64_t fallbacks = 0; // misses answered from a coarser level
+  uint64_t tilesLoaded = 0;
+  uint64_t bytesRead = 0;
+  uint64_t evictions = 0;
+  uint64_t droppedRequests = 0; // load queue full, asked again on next miss
+  size_t residentBytes = 0;
+  size_t peakResidentBytes = 0;
+  size_t capacityBytes = 0;
+
+  double hitRate() const { return lookups ? double(hits) / lookups : 1.0; }
+};
+
+/*
+Bounded LRU cache of texture tiles, shared by the virtual textures that
+register with it. The capacity bounds the memory of all of them together,
+whatever the size of the textures on disk.
+
+The cache is split into shards by tile key, each with its own mutex and
+LRU list (capacity / nShards bytes), so the render threads rarely contend.
+Texels are copied out under the shard lock, an evicted tile is never read.
+
+Asynchronous (default): a miss queues the tile for the loader thread and
+the sample falls back to the finest coarser level that is resident (the
+last level of every texture always is), the tile is there a few samples or
+frames later. Synchronous: the sampling thread loads the missing tile
+itself, the images are then the same as with every tile resident.
+*/
+class TileCache {
+private:
+  struct Shard {
+    std::mutex mutex;
+    // Most recently used first.
+    std::list<std::pair<uint64_t, std::vector<uint8_t>>> lru;
+    std::unordered_map<uint64_t, decltype(lru)::iterator> tiles;
+    size_t bytes = 0;
+    uint64_t lookups = 0, hits = 0; // samples at the level asked for
+  };
+
+  static const int nShards = 16;
+  Shard shards[nShards];
+  size_t shardCapacity;
+  const bool asynchronous;
+  const size_t maxQueued;
+
+  std::vector<VirtualTexture *> textures;
+
+  std::mutex queueMutex;
+  std::condition_variable queueChanged;
+  std::deque<uint64_t> loadQueue;
+  std::unordered_set<uint64_t> queued;
+  int loading = 0;
+  bool stopping = false;
+  std::thread loader;
+
+  std::atomic<uint64_t> fallbacks{0}, tilesLoaded{0}, bytesRead{0},
+      evictions{0}, droppedRequests{0};
+  std::atomic<size_t> residentBytes{0}, peakResidentBytes{0};
+
+  Shard &shardOf(uint64_t key) {
+    return shards[(key * 0x9E3779B97F4A7C15ull) >> 60];
+  }
+  void loaderLoop();
+  void load(uint64_t key);
+  void insert(uint64_t key, std::vector<uint8_t> &&texels);
+  void requestLoad(uint64_t key);
+
+public:
+  explicit TileCache(size_t capacityBytes, bool asynchronous = true,
+                     size_t maxQueued = 1024);
+  ~TileCache();
+  TileCache(const TileCache &) = delete;
+  TileCache &operator=(const TileCache &) = delete;
+
+  static uint64_t key(uint32_t texture, int level, int tileX, int tileY) {
+    return (uint64_t(texture) << 48) | (uint64_t(level) << 40) |
+           (uint64_t(tileY) << 20) | uint64_t(tileX);
+  }
+
+  uint32_t registerTexture(VirtualTexture *texture);
+  // Copies the RGB8 texel texelIndex of the tile if resident; count makes
+  // it a sample in the hit rate.
+  bool lookup(uint64_t key, int texelIndex, uint8_t *rgb, bool count = false);
+  // Queues a tile that missed for the loader (synchronous: loads it in the
+  // calling thread). Returns true if it was loaded.
+  bool miss(uint64_t key);
+  void countFallback() { fallbacks++; }
+  void waitForLoads(); // until the load queue is empty
+  TileCacheStats stats();
+  void resetStats();
+};
+
+/*
+A texture stored with bakeTiledTexture(), sampled through a TileCache.
+Only the last (coarsest) level is read at open, everything else is loaded
+tile by tile as it is sampled.
+
+sample(u, v, level): nearest texel of the level at (u * width, v * height)
+in level 0 texels, wrapped like the ColorBuffer lookups in
+GenericTriangleShader::albedo (which picks the level from the pixel cone,
+see Ray::coneWidth). Thread safe.
+*/
+class VirtualTexture {
+private:
+  struct Level {
+    int width, height, tilesX, tilesY;
+    uint64_t offset;
+  };
+
+  int fd = -1;
+  int tileSize = 0;
+  std::vector<Level> levels;
+  std::vector<uint8_t> lastLevel; // resident, one tile
+  TileCache &cache;
+  uint32_t id = 0;
+
+  VirtualTexture(TileCache &cache) : cache(cache) {}
+
+public:
+  // Returns nullptr if the file can not be read.
+  static std::unique_ptr<VirtualTexture> open(const std::string &path,
+                                              TileCache &cache);
+  ~VirtualTexture();
+
+  int width() const { return levels[0].width; }
+  int height() const { return levels[0].height; }
+  int levelCount() const { return int(levels.size()); }
+  size_t tileBytes() const { return size_t(tileSize) * tileSize * 3; }
+
+  float3 sample(float u, float v, int level = 0);
+  // Reads a tile from the file, false on a short read.
+  bool readTile(int level, int tileX, int tileY, std::vector<uint8_t> &texels);
+};
+
+} // namespace raytracer_cu
+
+#endif
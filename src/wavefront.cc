@@ -0,0 +1,360 @@
+#include "wavefront.h"
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+#include "host_renderer.h"
+#include "profiler.h"
+#include "random.h"
+#include "shader.h"
+
+namespace raytracer_cu {
+
+namespace {
+
+double msSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+double raysPerSecond(long long rays, double ms) {
+  return ms > 0.0 ? double(rays) / ms * 1e3 : 0.0;
+}
+
+float maxComponent(float3 v) {
+  return v.x > v.y ? (v.x > v.z ? v.x : v.z) : (v.y > v.z ? v.y : v.z);
+}
+
+} // namespace
+
+// ---------- RayQueue ----------
+
+void RayQueue::reset(int n) {
+  if (n > capacity) {
+    capacity = n;
+    origin.resize(n);
+    direction.resize(n);
+    throughput.resize(n);
+    maxDistance.resize(n);
+    pixel.resize(n);
+    bounces.resize(n);
+    seed.resize(n);
+  }
+  count.store(0);
+}
+
+int RayQueue::push(const Ray &ray, float3 rayThroughput, int rayPixel,
+                   float rayMaxDistance) {
+  int i = count.fetch_add(1);
+  if (i >= capacity) {
+    return -1;
+  }
+  origin[i] = ray.origin;
+  direction[i] = ray.direction;
+  throughput[i] = rayThroughput;
+  maxDistance[i] = rayMaxDistance;
+  pixel[i] = rayPixel;
+  bounces[i] = ray.bounces;
+  seed[i] = ray.seed;
+  return i;
+}
+
+void RayQueue::fill(int n) { count.store(std::min(n, capacity)); }
+
+Ray RayQueue::ray(int i) const {
+  Ray r(origin[i], direction[i], bounces[i]);
+  r.seed = seed[i];
+  return r;
+}
+
+// ---------- WavefrontStats ----------
+
+void WavefrontStats::print(std::ostream &os) const {
+  os << "wavefront: " << bounces << " bounces, " << nMaterials
+     << " materials, " << totalMs() << " ms\n";
+  os << "  intersect " << intersectMs << " ms, " << pathRays << " rays, "
+     << raysPerSecond(pathRays, intersectMs) * 1e-6 << " Mrays/s\n";
+  os << "  sort      " << sortMs << " ms, " << shadedHits << " hits, "
+     << raysPerSecond(shadedHits, sortMs) * 1e-6 << " Mhits/s\n";
+  os << "  shade     " << shadeMs << " ms, " << shadedHits << " hits, "
+     << raysPerSecond(shadedHits, shadeMs) * 1e-6 << " Mhits/s\n";
+  os << "  shadow    " << shadowMs << " ms, " << shadowRays << " rays, "
+     << raysPerSecond(shadowRays, shadowMs) * 1e-6 << " Mrays/s\n";
+  os << "  generate " << generateMs << " ms, resolve " << resolveMs << " ms\n";
+}
+
+// ---------- WavefrontRenderer ----------
+
+WavefrontRenderer::WavefrontRenderer(Scene *scene, ThreadPool &pool)
+    : scene(scene), pool(pool) {
+  sceneChanged();
+}
+
+void WavefrontRenderer::sceneChanged() {
+  // Objects sharing a shader instance share a material.
+  std::unordered_map<Shader *, int> materialIds;
+  int nObjects = int(scene->sceneObjects.size());
+  objectMaterial.resize(nObjects);
+  nMaterials = 1;
+  for (int i = 0; i < nObjects; i++) {
+    Shader *shader = scene->sceneObjects[i]->getShader();
+    if (!shader) {
+      objectMaterial[i] = 0;
+      continue;
+    }
+    auto it = materialIds.find(shader);
+    if (it == materialIds.end()) {
+      it = materialIds.emplace(shader, nMaterials++).first;
+    }
+    objectMaterial[i] = it->second;
+  }
+
+  shadowRaysPerHit = 0;
+  int nLights = int(scene->lights.size());
+  for (int i = 0; i < nLights; i++) {
+    Light *light = scene->lights[i];
+    shadowRaysPerHit += light->isAreaLight() ? light->nShadowSamples : 1;
+  }
+}
+
+void WavefrontRenderer::addToFilm(int pixel, float3 color) {
+  float components[3] = {color.x, color.y, color.z};
+  for (int c = 0; c < 3; c++) {
+    std::atomic<float> &target = film[pixel * 3 + c];
+    float current = target.load(std::memory_order_relaxed);
+    while (!target.compare_exchange_weak(current, current + components[c],
+                                         std::memory_order_relaxed)) {
+    }
+  }
+}
+
+void WavefrontRenderer::intersect(RayQueue &queue, bool primary,
+                                  const Camera &camera,
+                                  GBufferTexel *gBuffer) {
+  int nRays = queue.size();
+  if (int(hits.size()) < nRays) {
+    hits.resize(nRays);
+    hitMaterial.resize(nRays);
+  }
+  pool.parallelFor(0, nRays, grain, [&](int begin, int end) {
+    PROFILE_SCOPE_ARG("intersect chunk", "host", begin);
+    for (int i = begin; i < end; i++) {
+      Ray ray = queue.ray(i);
+      Intersection &hit = hits[i];
+      bool isHit = scene->closestIntersection(ray, hit);
+      hitMaterial[i] = isHit ? objectMaterial[hit.objectId] : -1;
+
+      // Primary rays are queued in pixel order.
+      if (primary && gBuffer) {
+        GBufferTexel texel;
+        texel.objectId = -1;
+        if (isHit) {
+          texel.position = hit.surfacePoint;
+          texel.normal = hit.surfaceNormal;
+          texel.depth = length(hit.surfacePoint - camera.eye);
+          texel.objectId = hit.objectId;
+        }
+        gBuffer[i] = texel;
+      }
+    }
+  });
+}
+
+int WavefrontRenderer::sortByMaterial(int nRays) {
+  materialOffsets.assign(nMaterials + 1, 0);
+  for (int i = 0; i < nRays; i++) {
+    if (hitMaterial[i] >= 0) {
+      materialOffsets[hitMaterial[i] + 1]++;
+    }
+  }
+  for (int m = 0; m < nMaterials; m++) {
+    materialOffsets[m + 1] += materialOffsets[m];
+  }
+  int nHits = materialOffsets[nMaterials];
+  if (int(sortedHits.size()) < nHits) {
+    sortedHits.resize(nHits);
+  }
+  std::vector<int> next(materialOffsets.begin(), materialOffsets.end() - 1);
+  for (int i = 0; i < nRays; i++) {
+    if (hitMaterial[i] >= 0) {
+      sortedHits[next[hitMaterial[i]]++] = i;
+    }
+  }
+  return nHits;
+}
+
+void WavefrontRenderer::shade(RayQueue &queue, int nHits,
+                              RayQueue &nextQueue) {
+  pool.parallelFor(0, nHits, grain, [&](int begin, int end) {
+    PROFILE_SCOPE_ARG("shade chunk", "host", begin);
+    for (int k = begin; k < end; k++) {
+      int i = sortedHits[k];
+      Ray ray = queue.ray(i);
+      Intersection &hit = hits[i];
+      float3 throughput = queue.throughput[i];
+      int pixel = queue.pixel[i];
+
+      SurfaceResponse response = hit.object->respond(ray, hit);
+      if (!response.shaded) {
+        addToFilm(pixel, throughput * response.diffuseColor);
+        continue;
+      }
+      Shader *shader = hit.object->getShader();
+
+      // Same order as the recursive shaders: the secondary rays split the
+      // seed before the light samples are drawn.
+      // The seed is split even for pruned rays, as in the recursive trace.
+      if (response.reflect) {
+        Ray reflected = shader->reflectionRay(ray, hit);
+        float3 weight = shader->reflectedWeight * throughput;
+        if (maxComponent(weight) >= scene->minThroughput) {
+          nextQueue.push(reflected, weight, pixel);
+        }
+      }
+      if (response.refract) {
+        Ray refracted =
+            shader->refractionRay(ray, hit, response.refractiveIndex);
+        float3 weight = shader->refractedWeight * throughput;
+        if (maxComponent(weight) >= scene->minThroughput) {
+          nextQueue.push(refracted, weight, pixel);
+        }
+      }
+      if (shader->diffuseWeight <= shader->weightThreshold) {
+        continue;
+      }
+
+      // Scene::computeDiffuseComponent with the shadow test deferred.
+      float3 surfacePoint = hit.surfacePoint + 0.1f * hit.surfaceNormal;
+      int nLights = int(scene->lights.size());
+      for (int lightId = 0; lightId < nLights; lightId++) {
+        Light *light = scene->lights[lightId];
+        bool areaLight = light->isAreaLight();
+        int nSamples = areaLight ? light->nShadowSamples : 1;
+        float3 weight = (shader->diffuseWeight / float(nSamples)) * throughput *
+                        response.diffuseColor;
+        for (int sampleId = 0; sampleId < nSamples; sampleId++) {
+          float3 lightPoint = light->lightPosition;
+          if (areaLight) {
+            float u = randomFloat(ray.seed);
+            float v = randomFloat(ray.seed);
+            lightPoint = light->samplePoint(u, v);
+          }
+          float3 toLight = lightPoint - surfacePoint;
+          float lightDist = length(toLight);
+          float angle = dot(div(toLight, lightDist), hit.surfaceNormal);
+          if (angle < 0.0f) {
+            continue;
+          }
+          if (shader->enableShadows) {
+            shadowQueue.push(Ray(surfacePoint, toLight), angle * weight, pixel,
+                             lightDist);
+          } else {
+            addToFilm(pixel, angle * weight);
+          }
+        }
+      }
+    }
+  });
+}
+
+void WavefrontRenderer::traceShadows() {
+  int nRays = shadowQueue.size();
+  pool.parallelFor(0, nRays, grain, [&](int begin, int end) {
+    PROFILE_SCOPE_ARG("shadow chunk", "host", begin);
+    for (int i = begin; i < end; i++) {
+      Ray ray = shadowQueue.ray(i);
+      Intersection occluder;
+      bool occluded =
+          scene->closestIntersection(ray, occluder) &&
+          length(occluder.surfacePoint - ray.origin) < shadowQueue.maxDistance[i];
+      if (!occluded) {
+        addToFilm(shadowQueue.pixel[i], shadowQueue.throughput[i]);
+      }
+    }
+  });
+}
+
+void WavefrontRenderer::render(const Camera &camera, int2 size,
+                               uint32_t frameIndex, uint8_t *colorBuffer,
+                               GBufferTexel *gBuffer) {
+  PROFILE_SCOPE("WavefrontRenderer::render", "host");
+  stats = WavefrontStats();
+  stats.nMaterials = nMaterials;
+  int nPixels = size.x * size.y;
+
+  auto start = std::chrono::steady_clock::now();
+  if (filmPixels != nPixels) {
+    film.reset(new std::atomic<float>[nPixels * 3]);
+    filmPixels = nPixels;
+  }
+  RayQueue *queue = &pathQueues[0];
+  RayQueue *nextQueue = &pathQueues[1];
+  queue->reset(nPixels);
+  int bounces = maxBounces >= 0 ? maxBounces : scene->maxBounces;
+  pool.parallelFor(0, size.y, 4, [&](int rowBegin, int rowEnd) {
+    for (int y = rowBegin; y < rowEnd; y++) {
+      for (int x = 0; x < size.x; x++) {
+        int linIdx = y * size.x + x;
+        for (int c = 0; c < 3; c++) {
+          film[linIdx * 3 + c].store(0.0f, std::memory_order_relaxed);
+        }
+        // Primary rays are written in pixel order instead of pushed.
+        Ray eyeRay = camera.primaryRay(x, y, size, bounces);
+        queue->origin[linIdx] = eyeRay.origin;
+        queue->direction[linIdx] = eyeRay.direction;
+        queue->throughput[linIdx] = make_float3(1.0f, 1.0f, 1.0f);
+        queue->maxDistance[linIdx] = 0.0f;
+        queue->pixel[linIdx] = linIdx;
+        queue->bounces[linIdx] = eyeRay.bounces;
+        queue->seed[linIdx] = pixelSeed(x, y, frameIndex);
+      }
+    }
+  });
+  queue->fill(nPixels);
+  stats.generateMs = msSince(start);
+
+  for (bool primary = true; queue->size() > 0; primary = false) {
+    int nRays = queue->size();
+    stats.bounces++;
+    stats.pathRays += nRays;
+
+    PROFILE_SCOPE_ARG("bounce", "host", stats.bounces - 1);
+    start = std::chrono::steady_clock::now();
+    intersect(*queue, primary, camera, gBuffer);
+    stats.intersectMs += msSince(start);
+
+    start = std::chrono::steady_clock::now();
+    int nHits = sortByMaterial(nRays);
+    stats.sortMs += msSince(start);
+    stats.shadedHits += nHits;
+
+    // A hit spawns at most a reflection and a refraction ray.
+    start = std::chrono::steady_clock::now();
+    nextQueue->reset(2 * nHits);
+    shadowQueue.reset(nHits * shadowRaysPerHit);
+    shade(*queue, nHits, *nextQueue);
+    stats.shadeMs += msSince(start);
+
+    start = std::chrono::steady_clock::now();
+    stats.shadowRays += shadowQueue.size();
+    traceShadows();
+    stats.shadowMs += msSince(start);
+
+    std::swap(queue, nextQueue);
+  }
+
+  start = std::chrono::steady_clock::now();
+  pool.parallelFor(0, nPixels, grain, [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      storePixel(colorBuffer, i,
+                 make_float3(film[i * 3 + 0].load(std::memory_order_relaxed),
+                             film[i * 3 + 1].load(std::memory_order_relaxed),
+                             film[i * 3 + 2].load(std::memory_order_relaxed)));
+    }
+  });
+  stats.resolveMs = msSince(start);
+}
+
+} // namespace raytracer_cu
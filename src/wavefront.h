@@ -0,0 +1,133 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "cuda_runtime.h"
+
+#include "camera.h"
+#include "gbuffer.h"
+#include "math.h"
+#include "raytracer_basics.h"
+#include "thread_pool.h"
+
+namespace raytracer_cu {
+
+/*
+Ray queue in structure of arrays layout. Every queued ray carries the
+pixel it contributes to and the throughput (the product of the shader
+weights along its path) its radiance is scaled with. Shadow rays also carry
+the distance to the light point, closer hits occlude.
+
+push() is thread safe and returns the slot, or -1 if the queue is full.
+*/
+class RayQueue {
+private:
+  int capacity = 0;
+  std::atomic<int> count{0};
+
+public:
+  std::vector<float3> origin;
+  std::vector<float3> direction;
+  std::vector<float3> throughput;
+  std::vector<float> maxDistance;
+  std::vector<int> pixel;
+  std::vector<uint32_t> bounces;
+  std::vector<uint32_t> seed;
+
+  // Grows the arrays to hold at least n rays and empties the queue.
+  void reset(int n);
+  int size() const { return count.load() < capacity ? count.load() : capacity; }
+  int push(const Ray &ray, float3 rayThroughput, int rayPixel,
+           float rayMaxDistance = 0.0f);
+  // Marks the first n slots used, for callers that write the arrays directly.
+  void fill(int n);
+  Ray ray(int i) const;
+};
+
+// Per frame counters, accumulated over all bounces.
+struct WavefrontStats {
+  int bounces = 0;
+  long long pathRays = 0;   // primary and secondary rays intersected
+  long long shadedHits = 0; // hits shaded, after the material sort
+  long long shadowRays = 0;
+  int nMaterials = 0;
+  double generateMs = 0.0;
+  double intersectMs = 0.0;
+  double sortMs = 0.0;
+  double shadeMs = 0.0;
+  double shadowMs = 0.0;
+  double resolveMs = 0.0;
+
+  double totalMs() const {
+    return generateMs + intersectMs + sortMs + shadeMs + shadowMs + resolveMs;
+  }
+  void print(std::ostream &os) const;
+};
+
+/*
+Wavefront renderer: instead of following each path recursively, every bounce
+runs as a sequence of stages over all live rays.
+
+  generate   primary rays into the path queue
+  intersect  closest hit of every queued ray
+  sort       hits bucketed by material (counting sort on the shader), so
+             the shade stage runs the same material code back to back
+  shade      Object::respond per hit; the diffuse term becomes shadow rays,
+             reflection and refraction become the next path queue
+  shadow     occlusion test of the shadow queue, unoccluded rays add their
+             contribution to the film
+  resolve    film to RGBA8888
+
+Stages are data parallel over the thread pool. Contributions are summed in a
+float film with atomic adds, so the image matches HostRenderer up to the
+order of the floating point additions (the per pixel random streams are
+consumed in the same order as the recursive shaders).
+
+Runs on host resident scenes like HostRenderer.
+*/
+class WavefrontRenderer {
+private:
+  Scene *scene;
+  ThreadPool &pool;
+
+  // Material id per scene object; id 0 is reserved for unshaded objects.
+  std::vector<int> objectMaterial;
+  int nMaterials = 1;
+  int shadowRaysPerHit = 0;
+
+  RayQueue pathQueues[2];
+  RayQueue shadowQueue;
+  std::vector<Intersection> hits;
+  std::vector<int> hitMaterial; // -1 for rays that missed
+  std::vector<int> sortedHits;
+  std::vector<int> materialOffsets;
+  std::unique_ptr<std::atomic<float>[]> film;
+  int filmPixels = 0;
+
+  void addToFilm(int pixel, float3 color);
+  void intersect(RayQueue &queue, bool primary, const Camera &camera,
+                 GBufferTexel *gBuffer);
+  int sortByMaterial(int nRays);
+  void shade(RayQueue &queue, int nHits, RayQueue &nextQueue);
+  void traceShadows();
+
+public:
+  int maxBounces = -1; // -1: Scene::maxBounces
+  int grain = 1024;
+  WavefrontStats stats;
+
+  WavefrontRenderer(Scene *scene, ThreadPool &pool);
+  // Rebuilds the material table, call after objects or lights were added.
+  void sceneChanged();
+  void render(const Camera &camera, int2 size, uint32_t frameIndex,
+              uint8_t *colorBuffer, GBufferTexel *gBuffer = nullptr);
+};
+
+} // namespace raytracer_cu
+
+#endif
@@ -0,0 +1,105 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "camera_path.h"
+#include "checker_textures.h"
+#include "compiled_scene.h"
+#include "image_io.h"
+#include "thread_pool.h"
+
+// Renders the scene compiled into this binary by scene_compiler (see
+// compiled_scene.h), without building a Scene.
+//
+// compiled_render [--size WxH] [--frames F] [--bounces B] [--threads T]
+//                 [--out frame.ppm]
+//
+// Renders F frames of a turntable (default 48) and prints the frame
+// times; --out writes the first frame. The textures are the checkerboards
+// of the host tools.
+
+using namespace raytracer_cu;
+
+namespace {
+
+struct Options {
+  int2 size = make_int2(640, 480);
+  int frames = 48;
+  int bounces = -1;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string out;
+};
+
+void usage() {
+  fprintf(stderr, "usage: compiled_render [--size WxH] [--frames F] "
+                  "[--bounces B] [--threads T] [--out frame.ppm]\n");
+  exit(1);
+}
+
+Options parseOptions(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (i + 1 >= argc) {
+      usage();
+    }
+    const char *value = argv[++i];
+    if (flag == "--size") {
+      if (sscanf(value, "%dx%d", &options.size.x, &options.size.y) != 2) {
+        usage();
+      }
+    } else if (flag == "--frames") {
+      options.frames = atoi(value);
+    } else if (flag == "--bounces") {
+      options.bounces = atoi(value);
+    } else if (flag == "--threads") {
+      options.threads = unsigned(std::max(1, atoi(value)));
+    } else if (flag == "--out") {
+      options.out = value;
+    } else {
+      usage();
+    }
+  }
+  return options;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options = parseOptions(argc, argv);
+  std::vector<ColorBuffer<float3> *> textures;
+  for (int t = 0; t < compiled::sceneInfo.nTextures; t++) {
+    textures.push_back(checkerTexture());
+  }
+  compiled::bindTextures(textures.data(), int(textures.size()));
+
+  ThreadPool pool(int(options.threads) - 1);
+  CompiledRenderer renderer(pool);
+  renderer.maxBounces = options.bounces;
+  CameraPath path = CameraPath::turntable(make_float3(0.0f, 0.0f, 0.0f),
+                                          200.0f, 0.0f, options.frames);
+
+  printf("%s: %d triangles, %d spheres, %d lights, %d materials\n",
+         compiled::sceneInfo.name, compiled::sceneInfo.nTriangles,
+         compiled::sceneInfo.nSpheres, compiled::sceneInfo.nLights,
+         compiled::sceneInfo.nMaterials);
+  std::vector<uint8_t> image(size_t(options.size.x) * options.size.y * 4);
+  auto start = std::chrono::steady_clock::now();
+  for (int frame = 0; frame < options.frames; frame++) {
+    renderer.render(path.at(float(frame)), options.size, uint32_t(frame),
+                    image.data());
+    if (frame == 0 && !options.out.empty()) {
+      writePPM(options.out, image.data(), options.size.x, options.size.y);
+    }
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  printf("%d frames of %dx%d in %.2f s (%.2f ms per frame)\n", options.frames,
+         options.size.x, options.size.y, seconds,
+         1000.0 * seconds / options.frames);
+  return 0;
+}
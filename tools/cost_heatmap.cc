@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "camera.h"
+#include "checker_textures.h"
+#include "cost_heatmap.h"
+#include "host_renderer.h"
+#include "image_io.h"
+#include "procedural_scene.h"
+#include "room_scene.h"
+#include "thread_pool.h"
+
+// Renders the per-pixel cost of the room scene (or of a generated one) as
+// a false color heatmap, see cost_heatmap.h.
+//
+// cost_heatmap [--metric tests|nodes|rays|depth|ns] [--scene room|SPEC]
+//              [--size WxH] [--bounces B] [--threads T] [--scale MAX]
+//              [--out name]
+//
+// --metric   what is counted per pixel (default tests)
+// --scene    room (default), or a ProceduralScene as key=value,... (see
+//            parseProceduralScene)
+// --scale    value drawn in red (default: the 99th percentile)
+// --out      writes name.ppm (heatmap) and name.pfm (raw values, one float
+//            per pixel, top row first once decoded); default cost
+//
+// Prints the distribution and the objects whose pixels cost the most.
+
+using namespace raytracer_cu;
+
+namespace {
+
+struct Options {
+  CostMetric metric = CostMetric::IntersectionTests;
+  std::string scene = "room";
+  int2 size = make_int2(640, 480);
+  int bounces = -1; // the scene's budget
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  float scale = 0.0f;
+  std::string out = "cost";
+};
+
+void usage() {
+  fprintf(stderr, "usage: cost_heatmap [--metric tests|nodes|rays|depth|ns] "
+                  "[--scene room|SPEC] [--size WxH] [--bounces B] "
+                  "[--threads T] [--scale MAX] [--out name]\n");
+  exit(1);
+}
+
+Options parseOptions(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (i + 1 >= argc) {
+      usage();
+    }
+    const char *value = argv[++i];
+    if (flag == "--metric") {
+      if (!parseCostMetric(value, options.metric)) {
+        usage();
+      }
+    } else if (flag == "--scene") {
+      options.scene = value;
+    } else if (flag == "--size") {
+      if (sscanf(value, "%dx%d", &options.size.x, &options.size.y) != 2) {
+        usage();
+      }
+    } else if (flag == "--bounces") {
+      options.bounces = atoi(value);
+    } else if (flag == "--threads") {
+      options.threads = unsigned(std::max(1, atoi(value)));
+    } else if (flag == "--scale") {
+      options.scale = float(atof(value));
+    } else if (flag == "--out") {
+      options.out = value;
+    } else {
+      usage();
+    }
+  }
+  return options;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options = parseOptions(argc, argv);
+
+  Scene *scene;
+  if (options.scene == "room") {
+    scene = new RoomScene();
+    addCheckerTextures(scene, 3);
+  } else {
+    ProceduralSceneParams params;
+    if (!parseProceduralScene(options.scene, params)) {
+      usage();
+    }
+    scene = new ProceduralScene(params);
+  }
+  scene->buildScene();
+  ThreadPool pool(int(options.threads) - 1);
+  HostRenderer renderer(scene, pool);
+  renderer.maxBounces = options.bounces;
+
+  CostMap costs;
+  costs.measure(renderer, pool, Camera::initialView(), options.size, 0,
+                options.metric);
+
+  std::vector<uint8_t> image(size_t(options.size.x) * options.size.y * 4);
+  costs.heatmap(image.data(), options.scale);
+  std::string imagePath = options.out + ".ppm";
+  std::string rawPath = options.out + ".pfm";
+  if (!writePPM(imagePath, image.data(), options.size.x, options.size.y) ||
+      !costs.writeRaw(rawPath)) {
+    fprintf(stderr, "can not write %s / %s\n", imagePath.c_str(),
+            rawPath.c_str());
+    return 1;
+  }
+
+  uint64_t total = costs.total();
+  int nPixels = options.size.x * options.size.y;
+  printf("%s per pixel, %dx%d: mean %.2f, median %u, p99 %u, max %u\n",
+         costMetricName(options.metric), options.size.x, options.size.y,
+         double(total) / nPixels, costs.percentile(0.5f),
+         costs.percentile(0.99f), costs.maxValue());
+
+  // The objects seen by the primary rays, most expensive first.
+  int nObjects = scene->sceneObjects.size();
+  std::vector<uint64_t> byObject = costs.totalByObject(nObjects);
+  std::vector<int> pixelsOf(nObjects, 0);
+  for (int object : costs.primaryObject) {
+    if (object >= 0) {
+      pixelsOf[object]++;
+    }
+  }
+  std::vector<int> order(nObjects);
+  for (int i = 0; i < nObjects; i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(),
+            [&](int a, int b) { return byObject[a] > byObject[b]; });
+  printf("%8s %10s %12s %10s\n", "object", "pixels", "mean", "share");
+  for (int i = 0; i < nObjects && i < 10; i++) {
+    int object = order[i];
+    if (pixelsOf[object] == 0) {
+      break;
+    }
+    printf("%8d %10d %12.2f %9.1f%%\n", object, pixelsOf[object],
+           double(byObject[object]) / pixelsOf[object],
+           total > 0 ? 100.0 * byObject[object] / total : 0.0);
+  }
+  printf("wrote %s and %s\n", imagePath.c_str(), rawPath.c_str());
+  return 0;
+}
@@ -0,0 +1,200 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "camera_path.h"
+#include "checker_textures.h"
+#include "frame_ring.h"
+#include "host_renderer.h"
+#include "image_io.h"
+#include "room_scene.h"
+#include "thread_pool.h"
+
+// Frames through shared memory, see frame_ring.h.
+//
+// frame_ring produce [--ring name] [--slots N] [--size WxH] [--frames F]
+//                    [--fps R] [--threads T]
+//   renders a turntable of the room scene on the CPU straight into the
+//   ring, at most R frames per second (0: as fast as possible)
+// frame_ring consume [--ring name] [--delay-ms D] [--out last.ppm]
+//   follows the newest frame until the producer exits; D simulates a slow
+//   consumer (it holds every frame D ms), --out writes the last frame
+//
+// The ring defaults to /raytracer_frames, 3 slots, 640x480, 120 frames.
+
+using namespace raytracer_cu;
+
+namespace {
+
+struct Options {
+  std::string mode;
+  std::string ring = "/raytracer_frames";
+  int slots = 3;
+  int2 size = make_int2(640, 480);
+  int frames = 120;
+  double fps = 0.0;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  int delayMs = 0;
+  std::string out;
+};
+
+void usage() {
+  fprintf(stderr, "usage: frame_ring produce|consume [--ring name] "
+                  "[--slots N] [--size WxH] [--frames F] [--fps R] "
+                  "[--threads T] [--delay-ms D] [--out last.ppm]\n");
+  exit(1);
+}
+
+Options parseOptions(int argc, char **argv) {
+  if (argc < 2) {
+    usage();
+  }
+  Options options;
+  options.mode = argv[1];
+  for (int i = 2; i < argc; i++) {
+    std::string flag = argv[i];
+    if (i + 1 >= argc) {
+      usage();
+    }
+    const char *value = argv[++i];
+    if (flag == "--ring") {
+      options.ring = value;
+    } else if (flag == "--slots") {
+      options.slots = atoi(value);
+    } else if (flag == "--size") {
+      if (sscanf(value, "%dx%d", &options.size.x, &options.size.y) != 2) {
+        usage();
+      }
+    } else if (flag == "--frames") {
+      options.frames = atoi(value);
+    } else if (flag == "--fps") {
+      options.fps = atof(value);
+    } else if (flag == "--threads") {
+      options.threads = unsigned(std::max(1, atoi(value)));
+    } else if (flag == "--delay-ms") {
+      options.delayMs = atoi(value);
+    } else if (flag == "--out") {
+      options.out = value;
+    } else {
+      usage();
+    }
+  }
+  return options;
+}
+
+int64_t steadyNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+int produce(const Options &options) {
+  FrameRingProducer ring;
+  if (!ring.create(options.ring, options.slots, options.size.x,
+                   options.size.y)) {
+    fprintf(stderr, "can not create the ring %s\n", options.ring.c_str());
+    return 1;
+  }
+  RoomScene *scene = new RoomScene();
+  addCheckerTextures(scene, 3);
+  scene->buildScene();
+  ThreadPool pool(int(options.threads) - 1);
+  HostRenderer renderer(scene, pool);
+  CameraPath path = CameraPath::turntable(make_float3(0.0f, 0.0f, 0.0f),
+                                          200.0f, 0.0f, options.frames);
+
+  printf("producing %d frames of %dx%d into %s (%d slots)\n", options.frames,
+         options.size.x, options.size.y, options.ring.c_str(), options.slots);
+  auto start = std::chrono::steady_clock::now();
+  auto next = start;
+  for (int frame = 0; frame < options.frames; frame++) {
+    uint8_t *pixels = ring.beginFrame(options.size.x, options.size.y);
+    renderer.render(path.at(float(frame)), options.size, uint32_t(frame),
+                    pixels);
+    ring.publish();
+    if (options.fps > 0.0) {
+      next += std::chrono::microseconds(int64_t(1e6 / options.fps));
+      std::this_thread::sleep_until(next);
+    }
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  printf("%d frames in %.2f s (%.1f fps)\n", options.frames, seconds,
+         options.frames / seconds);
+  // Leaves the last frames in place for a moment before unlinking.
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  return 0;
+}
+
+int consume(const Options &options) {
+  FrameRingConsumer ring;
+  while (!ring.open(options.ring)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  printf("following %s (%u slots)\n", options.ring.c_str(), ring.slotCount());
+
+  uint64_t lastFrame = 0, consumed = 0, skipped = 0, torn = 0;
+  bool any = false;
+  double latencyMs = 0.0;
+  std::vector<uint8_t> lastImage;
+  int2 lastSize = make_int2(0, 0);
+  while (true) {
+    FrameView frame;
+    if (!ring.acquireLatest(frame) || (any && frame.frameNumber == lastFrame)) {
+      if (!ring.producerAlive()) {
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+      continue;
+    }
+    latencyMs += (steadyNowNs() - frame.publishTimeNs) / 1e6;
+
+    // Work on the pixels in place, here a checksum.
+    uint64_t checksum = 0;
+    for (size_t i = 0; i < size_t(frame.stride) * frame.height; i += 64) {
+      checksum += frame.pixels[i];
+    }
+    if (options.delayMs > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(options.delayMs));
+    }
+    if (!options.out.empty()) {
+      lastImage.assign(frame.pixels,
+                       frame.pixels + size_t(frame.stride) * frame.height);
+      lastSize = make_int2(int(frame.width), int(frame.height));
+    }
+    if (!ring.stillValid(frame)) {
+      torn++; // the producer lapped us while we were reading
+      continue;
+    }
+    skipped += any ? frame.frameNumber - lastFrame - 1 : frame.frameNumber;
+    lastFrame = frame.frameNumber;
+    any = true;
+    consumed++;
+    (void)checksum;
+  }
+  printf("consumed %llu frames, skipped %llu, discarded %llu overwritten "
+         "while reading, mean latency %.2f ms\n",
+         (unsigned long long)consumed, (unsigned long long)skipped,
+         (unsigned long long)torn, consumed ? latencyMs / (consumed + torn) : 0.0);
+  if (!options.out.empty() && !lastImage.empty()) {
+    writePPM(options.out, lastImage.data(), lastSize.x, lastSize.y);
+  }
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options = parseOptions(argc, argv);
+  if (options.mode == "produce") {
+    return produce(options);
+  } else if (options.mode == "consume") {
+    return consume(options);
+  }
+  usage();
+  return 1;
+}
@@ -0,0 +1,251 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "camera.h"
+#include "image_io.h"
+#include "paged_geometry.h"
+#include "thread_pool.h"
+
+// Flies over a terrain paged in from disk, see paged_geometry.h.
+//
+// out_of_core [--triangles N] [--chunk T] [--budget MB] [--limit MB]
+//             [--frames F] [--size WxH] [--threads T] [--file path]
+//             [--out prefix] [--no-shadows]
+//
+// Bakes a heightfield of N triangles (default 32M, 1.5 GB on disk) in
+// chunks of about T triangles (default 32768) to --file unless it is
+// there, then renders F frames with at most --budget MB of chunks mapped
+// (default 64). Per frame it prints the chunks and megabytes paged in, the
+// evictions, the rays served per page in and the resident set of the
+// process. At the end the peak resident set (VmHWM, reset after baking) is
+// checked against --limit MB if given, the exit code is 2 if it was over.
+
+using namespace raytracer_cu;
+
+namespace {
+
+struct Options {
+  uint64_t triangles = uint64_t(32) << 20;
+  int chunkTriangles = 32768;
+  double budgetMb = 64.0;
+  double limitMb = 0.0;
+  int frames = 8;
+  int2 size = make_int2(640, 480);
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string file = "terrain.geo";
+  std::string out;
+  bool shadows = true;
+};
+
+void usage() {
+  fprintf(stderr, "usage: out_of_core [--triangles N] [--chunk T] "
+                  "[--budget MB] [--limit MB] [--frames F] [--size WxH] "
+                  "[--threads T] [--file path] [--out prefix] "
+                  "[--no-shadows]\n");
+  exit(1);
+}
+
+Options parseOptions(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (flag == "--no-shadows") {
+      options.shadows = false;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      usage();
+    }
+    const char *value = argv[++i];
+    if (flag == "--triangles") {
+      options.triangles = strtoull(value, nullptr, 10);
+    } else if (flag == "--chunk") {
+      options.chunkTriangles = atoi(value);
+    } else if (flag == "--budget") {
+      options.budgetMb = atof(value);
+    } else if (flag == "--limit") {
+      options.limitMb = atof(value);
+    } else if (flag == "--frames") {
+      options.frames = atoi(value);
+    } else if (flag == "--size") {
+      if (sscanf(value, "%dx%d", &options.size.x, &options.size.y) != 2) {
+        usage();
+      }
+    } else if (flag == "--threads") {
+      options.threads = unsigned(std::max(1, atoi(value)));
+    } else if (flag == "--file") {
+      options.file = value;
+    } else if (flag == "--out") {
+      options.out = value;
+    } else {
+      usage();
+    }
+  }
+  return options;
+}
+
+const float terrainSize = 20000.0f;
+
+// Height above the y = 0 plane (y points down, as in the room scene).
+float terrainHeight(float x, float z) {
+  float h = 0.0f, amplitude = 600.0f, frequency = 1.0f / 3000.0f;
+  for (int octave = 0; octave < 6; octave++) {
+    h += amplitude * std::sin(x * frequency + octave * 1.7f) *
+         std::cos(z * frequency * 1.3f + octave * 0.9f);
+    amplitude *= 0.45f;
+    frequency *= 2.1f;
+  }
+  return h;
+}
+
+// Triangle i of a side x side grid of quads, two triangles each.
+void terrainTriangle(uint64_t i, uint64_t side, float3 v[3]) {
+  uint64_t quad = i / 2;
+  float step = terrainSize / float(side);
+  float x0 = -0.5f * terrainSize + float(quad % side) * step;
+  float z0 = -0.5f * terrainSize + float(quad / side) * step;
+  auto point = [&](float x, float z) {
+    return make_float3(x, -terrainHeight(x, z), z);
+  };
+  if (i % 2 == 0) {
+    v[0] = point(x0, z0);
+    v[1] = point(x0 + step, z0);
+    v[2] = point(x0, z0 + step);
+  } else {
+    v[0] = point(x0 + step, z0);
+    v[1] = point(x0 + step, z0 + step);
+    v[2] = point(x0, z0 + step);
+  }
+}
+
+// Low over the terrain along the diagonal, looking ahead and down.
+Camera flightView(int frame, int nFrames) {
+  float s = -0.35f + 0.5f * float(frame) / float(std::max(1, nFrames));
+  float x = s * terrainSize, z = s * terrainSize;
+  float3 eye = make_float3(x, -terrainHeight(x, z) - 700.0f, z);
+  float3 ahead = make_float3(x + 3000.0f, 0.0f, z + 2000.0f);
+  ahead.y = -terrainHeight(ahead.x, ahead.z);
+  return Camera::lookAt(eye, ahead, make_float3(0.0f, 1.0f, 0.0f));
+}
+
+// VmRSS or VmHWM of /proc/self/status in MB, 0 if unknown.
+double statusMb(const char *field) {
+  FILE *f = fopen("/proc/self/status", "r");
+  if (!f) {
+    return 0.0;
+  }
+  char line[256];
+  double kb = 0.0;
+  size_t n = strlen(field);
+  while (fgets(line, sizeof(line), f)) {
+    if (strncmp(line, field, n) == 0 && line[n] == ':') {
+      kb = atof(line + n + 1);
+      break;
+    }
+  }
+  fclose(f);
+  return kb / 1024.0;
+}
+
+// Starts VmHWM over at the current resident set (Linux 4.0+).
+void resetPeakResident() {
+  FILE *f = fopen("/proc/self/clear_refs", "w");
+  if (f) {
+    fputs("5", f);
+    fclose(f);
+  }
+}
+
+bool fileExists(const std::string &path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options = parseOptions(argc, argv);
+  if (!fileExists(options.file)) {
+    uint64_t side = uint64_t(std::ceil(std::sqrt(options.triangles / 2.0)));
+    printf("baking %llu triangles to %s\n",
+           (unsigned long long)options.triangles, options.file.c_str());
+    auto start = std::chrono::steady_clock::now();
+    if (!bakePagedGeometry(options.file, options.triangles,
+                           options.chunkTriangles,
+                           [side](uint64_t i, float3 v[3]) {
+                             terrainTriangle(i, side, v);
+                           })) {
+      fprintf(stderr, "can not write %s\n", options.file.c_str());
+      return 1;
+    }
+    printf("baked in %.1f s\n", std::chrono::duration<double>(
+                                    std::chrono::steady_clock::now() - start)
+                                    .count());
+    resetPeakResident();
+  }
+
+  size_t budget = size_t(options.budgetMb * 1024.0 * 1024.0);
+  std::unique_ptr<PagedGeometry> geometry =
+      PagedGeometry::open(options.file, budget);
+  if (!geometry) {
+    fprintf(stderr, "can not read %s\n", options.file.c_str());
+    return 1;
+  }
+  ThreadPool pool(int(options.threads) - 1);
+  PagedRenderer renderer(*geometry, pool);
+  renderer.shadows = options.shadows;
+
+  printf("%llu triangles in %d chunks, %.1f MB on disk, budget %.1f MB, "
+         "%dx%d, %u threads\n",
+         (unsigned long long)geometry->triangleCount(), geometry->chunkCount(),
+         geometry->fileBytes() / double(1 << 20), options.budgetMb,
+         options.size.x, options.size.y, pool.size() + 1);
+  printf("%6s %9s %8s %11s %8s %12s %7s %11s %8s\n", "frame", "ms", "chunks",
+         "MB paged in", "evicted", "rays/page in", "rounds", "resident MB",
+         "RSS MB");
+  std::vector<uint8_t> image(size_t(options.size.x) * options.size.y * 4);
+  uint64_t totalPagedIn = 0;
+  for (int frame = 0; frame < options.frames; frame++) {
+    geometry->resetStats();
+    auto start = std::chrono::steady_clock::now();
+    renderer.render(flightView(frame, options.frames), options.size,
+                    image.data());
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    PagingStats stats = geometry->stats();
+    totalPagedIn += stats.bytesPagedIn;
+    printf("%6d %9.1f %8llu %11.1f %8llu %12.1f %7llu %11.1f %8.1f\n", frame,
+           ms, (unsigned long long)stats.chunksLoaded,
+           stats.bytesPagedIn / double(1 << 20),
+           (unsigned long long)stats.evictions, stats.raysPerPageIn(),
+           (unsigned long long)stats.passes,
+           stats.residentBytes / double(1 << 20), statusMb("VmRSS"));
+    if (!options.out.empty()) {
+      char name[32];
+      snprintf(name, sizeof(name), "%04d.ppm", frame);
+      writePPM(options.out + name, image.data(), options.size.x,
+               options.size.y);
+    }
+  }
+
+  double peakMb = statusMb("VmHWM");
+  printf("paged in %.1f MB in total, peak resident set %.1f MB",
+         totalPagedIn / double(1 << 20), peakMb);
+  if (options.limitMb > 0.0) {
+    bool within = peakMb <= options.limitMb;
+    printf(", %s the limit of %.1f MB\n", within ? "within" : "OVER",
+           options.limitMb);
+    return within ? 0 : 2;
+  }
+  printf("\n");
+  return 0;
+}
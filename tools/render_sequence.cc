@@ -0,0 +1,253 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "camera_path.h"
+#include "checker_textures.h"
+#include "frame_writer.h"
+#include "host_renderer.h"
+#include "memory_tracker.h"
+#include "procedural_scene.h"
+#include "profiler.h"
+#include "room_scene.h"
+#include "thread_pool.h"
+
+// Renders the frames of a camera path over the room scene or a generated
+// one, see camera_path.h, frame_writer.h and procedural_scene.h.
+//
+// render_sequence [--path keys.txt | --turntable N] [--linear]
+//                 [--scene room|SPEC] [--range FIRST-LAST] [--size WxH]
+//                 [--bounces B]
+//                 [--threads T] [--out pattern] [--sync] [--compare]
+//                 [--trace trace.json] [--memory]
+//
+// --turntable N   one orbit around the room in N frames (default 48)
+// --scene         room (default), or a ProceduralScene given as
+//                 key=value,... (e.g. spheres=1000,lights=4,mirror=0.5,
+//                 see parseProceduralScene)
+// --range         frames to render, inclusive (default: the whole path)
+// --out           printf pattern of the frame files, the extension picks
+//                 the format (frame_%04d.ppm; .qoi for QOI)
+// --sync          write every frame before rendering the next one
+// --compare       render the range unpipelined, then pipelined
+// --trace         write the frame timeline as Chrome trace JSON (see
+//                 profiler.h, needs a RAYTRACER_PROFILING build)
+// --memory        print the bytes per subsystem at the end and what is
+//                 still allocated after the scene was deleted (see
+//                 memory_tracker.h, needs a RAYTRACER_MEMORY_TRACKING build)
+
+using namespace raytracer_cu;
+
+namespace {
+
+struct Options {
+  std::string pathFile;
+  int turntableFrames = 48;
+  std::string scene = "room";
+  bool linear = false;
+  int first = -1, last = -1;
+  int2 size = make_int2(640, 480);
+  int bounces = 3;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string out = "frame_%04d.ppm";
+  bool sync = false;
+  bool compare = false;
+  std::string traceFile;
+  bool memory = false;
+};
+
+void usage() {
+  fprintf(stderr,
+          "usage: render_sequence [--path keys.txt | --turntable N] "
+          "[--linear] [--scene room|SPEC] [--range FIRST-LAST] "
+          "[--size WxH] [--bounces B] [--threads T] [--out pattern] "
+          "[--sync] [--compare] "
+          "[--trace trace.json] [--memory]\n");
+  exit(1);
+}
+
+Options parseOptions(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (flag == "--linear") {
+      options.linear = true;
+      continue;
+    } else if (flag == "--sync") {
+      options.sync = true;
+      continue;
+    } else if (flag == "--compare") {
+      options.compare = true;
+      continue;
+    } else if (flag == "--memory") {
+      options.memory = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      usage();
+    }
+    const char *value = argv[++i];
+    if (flag == "--path") {
+      options.pathFile = value;
+    } else if (flag == "--scene") {
+      options.scene = value;
+    } else if (flag == "--turntable") {
+      options.turntableFrames = atoi(value);
+    } else if (flag == "--range") {
+      if (sscanf(value, "%d-%d", &options.first, &options.last) != 2) {
+        usage();
+      }
+    } else if (flag == "--size") {
+      if (sscanf(value, "%dx%d", &options.size.x, &options.size.y) != 2) {
+        usage();
+      }
+    } else if (flag == "--bounces") {
+      options.bounces = atoi(value);
+    } else if (flag == "--threads") {
+      options.threads = unsigned(std::max(1, atoi(value)));
+    } else if (flag == "--out") {
+      options.out = value;
+    } else if (flag == "--trace") {
+      options.traceFile = value;
+    } else {
+      usage();
+    }
+  }
+  return options;
+}
+
+std::string framePath(const std::string &pattern, int frame) {
+  char path[4096];
+  snprintf(path, sizeof(path), pattern.c_str(), frame);
+  return path;
+}
+
+ImageFormat formatOf(const std::string &pattern) {
+  size_t dot = pattern.rfind('.');
+  return dot != std::string::npos && pattern.substr(dot) == ".qoi"
+             ? ImageFormat::QOI
+             : ImageFormat::PPM;
+}
+
+// Renders the range and returns the wall clock seconds.
+double renderSequence(const Options &options, const CameraPath &path,
+                      HostRenderer &renderer, bool pipelined) {
+  FrameWriter writer(pipelined);
+  ImageFormat format = formatOf(options.out);
+  size_t frameBytes = size_t(options.size.x) * options.size.y * 4;
+  double renderMs = 0.0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int frame = options.first; frame <= options.last; frame++) {
+    PROFILE_BEGIN_FRAME();
+    PROFILE_SCOPE_ARG("frame", "frame", frame);
+    auto frameStart = std::chrono::steady_clock::now();
+    std::vector<uint8_t> pixels = writer.takeBuffer(frameBytes);
+    renderer.render(path.at(float(frame)), options.size, uint32_t(frame),
+                    pixels.data());
+    renderMs += std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - frameStart)
+                    .count();
+    writer.submit(std::move(pixels), options.size.x, options.size.y, format,
+                  framePath(options.out, frame));
+  }
+  writer.flush();
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  FrameWriterStats stats = writer.stats();
+  int nFrames = options.last - options.first + 1;
+  printf("%-11s %d frames in %.2f s, %.0f frames/hour (render %.1f ms, "
+         "write %.1f ms, stalled %.1f ms per frame)%s\n",
+         pipelined ? "pipelined:" : "sequential:", nFrames, seconds,
+         nFrames / seconds * 3600.0, renderMs / nFrames,
+         stats.writeMs / nFrames, stats.stalledMs / nFrames,
+         stats.failedWrites ? ", WRITE ERRORS" : "");
+  return seconds;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options = parseOptions(argc, argv);
+  PROFILE_THREAD_NAME("main");
+
+  CameraPath path;
+  if (!options.pathFile.empty()) {
+    if (!path.load(options.pathFile)) {
+      fprintf(stderr, "can not read the camera path %s\n",
+              options.pathFile.c_str());
+      return 1;
+    }
+  } else {
+    path = CameraPath::turntable(make_float3(0.0f, 0.0f, 0.0f), 200.0f, 0.0f,
+                                 options.turntableFrames);
+  }
+  if (options.linear) {
+    path.interpolation = CameraPath::Interpolation::Linear;
+  }
+  if (options.first < 0) {
+    options.first = std::max(0, int(path.firstFrame()));
+    options.last = options.pathFile.empty() ? options.turntableFrames - 1
+                                            : int(path.lastFrame());
+  }
+  if (options.last < options.first) {
+    usage();
+  }
+
+  // Loaded once, every frame of the sequence reuses it.
+  Scene *scene;
+  if (options.scene == "room") {
+    scene = new RoomScene();
+    addCheckerTextures(scene, 3);
+  } else {
+    ProceduralSceneParams params;
+    if (!parseProceduralScene(options.scene, params)) {
+      usage();
+    }
+    scene = new ProceduralScene(params);
+    printf("scene %s\n", describeProceduralScene(params).c_str());
+  }
+  {
+    ThreadPool pool(int(options.threads) - 1);
+    scene->buildPool = &pool;
+    scene->buildScene();
+    HostRenderer renderer(scene, pool);
+    renderer.maxBounces = options.bounces;
+
+    printf("frames %d-%d, %dx%d, %d bounces, %u threads\n", options.first,
+           options.last, options.size.x, options.size.y, options.bounces,
+           options.threads);
+    if (options.compare) {
+      double sequential = renderSequence(options, path, renderer, false);
+      double pipelined = renderSequence(options, path, renderer, true);
+      printf("pipelined output: %.2fx\n", sequential / pipelined);
+    } else {
+      renderSequence(options, path, renderer, !options.sync);
+    }
+  }
+  if (!options.traceFile.empty()) {
+    if (!Profiler::instance().writeChromeTrace(options.traceFile)) {
+      fprintf(stderr, "can not write %s\n", options.traceFile.c_str());
+      return 1;
+    }
+    printf("frame timeline written to %s\n", options.traceFile.c_str());
+  }
+
+  // The renderer is gone; once the scene is too, whatever is still
+  // allocated leaked.
+  for (uint64_t i = 0; i < scene->textures.size(); i++) {
+    delete scene->textures[i];
+  }
+  delete scene;
+  if (options.memory) {
+    MemoryTracker::instance().printStats(std::cout);
+    MemoryTracker::instance().printLeaks(std::cout);
+  }
+  return 0;
+}
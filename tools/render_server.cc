@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "camera.h"
+#include "checker_textures.h"
+#include "image_io.h"
+#include "net.h"
+#include "render_server.h"
+#include "room_scene.h"
+#include "thread_pool.h"
+
+// Render service for the room scene, see render_server.h.
+//
+// render_server serve [--socket S] [--threads T] [--batch N] [--window MS]
+//   loads the scene once and serves requests until SIGINT / SIGTERM
+// render_server client [--socket S] [options]
+//   sends requests one after the other and prints their latencies
+// render_server local [--clients C] [--threads T] [--batch N] [options]
+//   runs a server in process with C concurrent clients, once without
+//   batching and once with batches of up to N requests
+//
+// options: --requests R (8 per client), --size WxH (320x240), --bounces B (3),
+//          --samples S (1), --format ppm|qoi (qoi), --out prefix (writes
+//          prefix<client>_<request>.<format>)
+
+using namespace raytracer_cu;
+
+namespace {
+
+struct Options {
+  std::string mode;
+  std::string socketPath = "/tmp/raytracer.sock";
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  int batch = 8;
+  int windowMs = 2;
+  int clients = 4;
+  int requests = 8;
+  int2 size = make_int2(320, 240);
+  int bounces = 3;
+  int samples = 1;
+  ImageFormat format = ImageFormat::QOI;
+  std::string out;
+};
+
+void usage() {
+  fprintf(stderr,
+          "usage: render_server serve|client|local [--socket S] [--threads T] "
+          "[--batch N] [--window MS] [--clients C] [--requests R] "
+          "[--size WxH] [--bounces B] [--samples S] [--format ppm|qoi] "
+          "[--out prefix]\n");
+  exit(1);
+}
+
+Options parseOptions(int argc, char **argv) {
+  if (argc < 2) {
+    usage();
+  }
+  Options options;
+  options.mode = argv[1];
+  for (int i = 2; i < argc; i++) {
+    std::string flag = argv[i];
+    if (i + 1 >= argc) {
+      usage();
+    }
+    std::string value = argv[++i];
+    if (flag == "--socket") {
+      options.socketPath = value;
+    } else if (flag == "--threads") {
+      options.threads = unsigned(std::max(1, atoi(value.c_str())));
+    } else if (flag == "--batch") {
+      options.batch = std::max(1, atoi(value.c_str()));
+    } else if (flag == "--window") {
+      options.windowMs = atoi(value.c_str());
+    } else if (flag == "--clients") {
+      options.clients = std::max(1, atoi(value.c_str()));
+    } else if (flag == "--requests") {
+      options.requests = atoi(value.c_str());
+    } else if (flag == "--size") {
+      if (sscanf(value.c_str(), "%dx%d", &options.size.x, &options.size.y) !=
+          2) {
+        usage();
+      }
+    } else if (flag == "--bounces") {
+      options.bounces = atoi(value.c_str());
+    } else if (flag == "--samples") {
+      options.samples = atoi(value.c_str());
+    } else if (flag == "--format") {
+      if (value == "ppm") {
+        options.format = ImageFormat::PPM;
+      } else if (value == "qoi") {
+        options.format = ImageFormat::QOI;
+      } else {
+        usage();
+      }
+    } else if (flag == "--out") {
+      options.out = value;
+    } else {
+      usage();
+    }
+  }
+  return options;
+}
+
+Scene *loadScene() {
+  RoomScene *scene = new RoomScene();
+  addCheckerTextures(scene, 3);
+  scene->buildScene();
+  return scene;
+}
+
+struct Latency {
+  RenderResponseHeader header;
+  float roundTripMs;
+};
+
+// One client: a request at a time, the camera orbits the room.
+bool runClient(const Options &options, int clientId,
+               std::vector<Latency> &latencies) {
+  int fd = connectRenderServer(options.socketPath);
+  if (fd < 0) {
+    fprintf(stderr, "can not connect to %s\n", options.socketPath.c_str());
+    return false;
+  }
+  bool ok = true;
+  std::vector<uint8_t> image;
+  for (int i = 0; i < options.requests && ok; i++) {
+    RenderRequest request;
+    request.requestId = uint32_t(clientId * options.requests + i);
+    request.camera = Camera::initialView();
+    request.camera.transform(getRotationMatrixY(0.1f * (clientId + i)));
+    request.width = options.size.x;
+    request.height = options.size.y;
+    request.maxBounces = options.bounces;
+    request.samples = options.samples;
+    request.format = options.format;
+
+    Latency latency;
+    auto start = std::chrono::steady_clock::now();
+    ok = sendRenderRequest(fd, request) &&
+         receiveRenderResponse(fd, latency.header, image) &&
+         latency.header.requestId == request.requestId &&
+         latency.header.status == RenderStatus::Ok;
+    latency.roundTripMs = std::chrono::duration<float, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+    if (!ok) {
+      fprintf(stderr, "client %d: request %u failed\n", clientId,
+              request.requestId);
+      break;
+    }
+    latencies.push_back(latency);
+
+    if (!options.out.empty()) {
+      std::string path = options.out + std::to_string(clientId) + "_" +
+                         std::to_string(i) +
+                         (options.format == ImageFormat::QOI ? ".qoi" : ".ppm");
+      writeFile(path, image);
+    }
+  }
+  closeSocket(fd);
+  return ok;
+}
+
+void printLatency(const Latency &latency) {
+  const RenderResponseHeader &header = latency.header;
+  printf("%8u %10.1f %10.1f %10.2f %12.1f %6u %10u\n", header.requestId,
+         header.queueMs, header.renderMs, header.encodeMs, latency.roundTripMs,
+         header.batchSize, header.size);
+}
+
+void printLatencyHeader() {
+  printf("%8s %10s %10s %10s %12s %6s %10s\n", "request", "queue ms",
+         "render ms", "encode ms", "round trip", "batch", "bytes");
+}
+
+float percentile(std::vector<float> values, float p) {
+  if (values.empty()) {
+    return 0.0f;
+  }
+  std::sort(values.begin(), values.end());
+  return values[std::min(values.size() - 1, size_t(p * values.size()))];
+}
+
+int runClientMode(const Options &options) {
+  std::vector<Latency> latencies;
+  bool ok = runClient(options, 0, latencies);
+  printLatencyHeader();
+  for (const Latency &latency : latencies) {
+    printLatency(latency);
+  }
+  return ok ? 0 : 1;
+}
+
+int runServe(const Options &options) {
+  // Blocked before the server threads start, so only sigwait sees them.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  Scene *scene = loadScene();
+  ThreadPool pool(int(options.threads) - 1);
+  RenderServer server(scene, pool, options.socketPath);
+  if (!server.listening()) {
+    return 1;
+  }
+  server.maxBatchSize = options.batch;
+  server.batchWindowMs = options.windowMs;
+  printf("serving on %s with %u threads\n", options.socketPath.c_str(),
+         options.threads);
+  fflush(stdout);
+
+  int signal;
+  sigwait(&signals, &signal);
+  RenderServerStats stats = server.stats();
+  printf("%llu requests in %llu batches\n",
+         (unsigned long long)stats.requests, (unsigned long long)stats.batches);
+  return 0;
+}
+
+// All clients at once against an in process server, returns requests/s.
+double runLocalPass(const Options &options, Scene *scene, ThreadPool &pool,
+                    int batch, bool verbose) {
+  RenderServer server(scene, pool, options.socketPath);
+  if (!server.listening()) {
+    exit(1);
+  }
+  server.maxBatchSize = batch;
+  server.batchWindowMs = options.windowMs;
+
+  std::vector<std::vector<Latency>> latencies(options.clients);
+  std::vector<std::thread> clients;
+  auto start = std::chrono::steady_clock::now();
+  for (int c = 0; c < options.clients; c++) {
+    clients.emplace_back(
+        [&options, &latencies, c] { runClient(options, c, latencies[c]); });
+  }
+  for (std::thread &client : clients) {
+    client.join();
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  std::vector<float> queueMs, roundTripMs;
+  int nRequests = 0;
+  if (verbose) {
+    printLatencyHeader();
+  }
+  for (const std::vector<Latency> &clientLatencies : latencies) {
+    for (const Latency &latency : clientLatencies) {
+      if (verbose) {
+        printLatency(latency);
+      }
+      queueMs.push_back(latency.header.queueMs);
+      roundTripMs.push_back(latency.roundTripMs);
+      nRequests++;
+    }
+  }
+  RenderServerStats stats = server.stats();
+  printf("max batch %d: %d requests in %.2f s (%.1f requests/s), "
+         "%.2f requests per batch, queue p50 %.1f ms, round trip p50 %.1f "
+         "ms p95 %.1f ms\n",
+         batch, nRequests, seconds, nRequests / seconds,
+         stats.batches ? double(stats.requests) / stats.batches : 0.0,
+         percentile(queueMs, 0.5f), percentile(roundTripMs, 0.5f),
+         percentile(roundTripMs, 0.95f));
+  return nRequests / seconds;
+}
+
+int runLocal(const Options &options) {
+  Scene *scene = loadScene();
+  ThreadPool pool(int(options.threads) - 1);
+  printf("%d clients x %d requests, %dx%d, %d bounces, %d samples, "
+         "%u threads\n",
+         options.clients, options.requests, options.size.x, options.size.y,
+         options.bounces, options.samples, options.threads);
+  double unbatched = runLocalPass(options, scene, pool, 1, false);
+  double batched = runLocalPass(options, scene, pool, options.batch, true);
+  printf("batching speedup: %.2fx\n", batched / unbatched);
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options = parseOptions(argc, argv);
+  if (options.mode == "serve") {
+    return runServe(options);
+  } else if (options.mode == "client") {
+    return runClientMode(options);
+  } else if (options.mode == "local") {
+    return runLocal(options);
+  }
+  usage();
+  return 1;
+}
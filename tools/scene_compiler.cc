@@ -0,0 +1,522 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#include "checker_textures.h"
+#include "room_scene.h"
+#include "sphere.h"
+#include "triangle.h"
+
+// Compiles the room scene to C++, see compiled_scene.h.
+//
+// scene_compiler [--textures N] [--out file.cc]
+//
+// Builds RoomScene with N checker textures (default 3, the textured
+// materials sample the textures bound with compiled::bindTextures at run
+// time) and writes the generated source to --out (default stdout). Fails
+// on objects and shaders it does not know and on virtual textures.
+
+using namespace raytracer_cu;
+
+namespace {
+
+struct Options {
+  int nTextures = 3;
+  std::string out;
+};
+
+void usage() {
+  fprintf(stderr, "usage: scene_compiler [--textures N] [--out file.cc]\n");
+  exit(1);
+}
+
+Options parseOptions(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (i + 1 >= argc) {
+      usage();
+    }
+    const char *value = argv[++i];
+    if (flag == "--textures") {
+      options.nTextures = atoi(value);
+    } else if (flag == "--out") {
+      options.out = value;
+    } else {
+      usage();
+    }
+  }
+  return options;
+}
+
+// A float literal that reads back as the same float.
+std::string lit(float v) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.9g", v);
+  std::string s = buffer;
+  if (s.find_first_of(".e") == std::string::npos) {
+    s += ".0";
+  }
+  return s + "f";
+}
+
+std::string vec(float3 v) {
+  return "make_float3(" + lit(v.x) + ", " + lit(v.y) + ", " + lit(v.z) + ")";
+}
+
+std::string array(float3 v) {
+  return "{" + lit(v.x) + ", " + lit(v.y) + ", " + lit(v.z) + "}";
+}
+
+class SceneCompiler {
+private:
+  Scene *scene;
+  std::string error;
+
+  std::vector<Triangle *> triangles;
+  std::vector<Sphere *> spheres;
+  // Per object: the shading function and the primitive array entry.
+  std::vector<std::string> objectShading;
+  std::vector<std::string> objectTests; // hit test and normal per object
+  std::vector<std::string> objectNormals;
+  std::map<std::string, int> materialIds; // body -> material number
+  std::vector<std::string> materials;
+  bool usesDiffuse[2] = {false, false}; // without / with shadow rays
+
+  int textureIndex(ColorBuffer<float3> *texture) {
+    int nTextures = int(scene->textures.size());
+    for (int i = 0; i < nTextures; i++) {
+      if (scene->textures[i] == texture) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  // The secondary rays and the diffuse term of Generic*Shader::shade, with
+  // the terms of the weights under the threshold left out.
+  std::string shadingBody(Shader *shader, bool sphere, std::string albedo) {
+    bool reflect = shader->reflectedWeight > shader->weightThreshold;
+    bool refract = shader->refractedWeight > shader->weightThreshold;
+    bool diffuse = shader->diffuseWeight > shader->weightThreshold;
+    std::string body;
+    if (reflect) {
+      body += "  float3 reflectedColor = make_float3(0.0f, 0.0f, 0.0f);\n";
+    }
+    if (refract) {
+      body += "  float3 refractedColor = make_float3(0.0f, 0.0f, 0.0f);\n";
+    }
+    if (reflect || refract) {
+      body += "  if (ray.bounces > 0) {\n";
+      if (sphere) {
+        body += "    bool inside = sphere.r > length(ray.origin - "
+                "f3(sphere.center));\n";
+      }
+      if (reflect) {
+        body += std::string(sphere ? "    if (!inside) {\n  " : "") +
+                "    reflectedColor = traceReflection(ray, hit, " +
+                lit(shader->bounceSurfDist) + ", " +
+                lit(shader->reflectedWeight) + ");\n" +
+                (sphere ? "    }\n" : "");
+      }
+      if (refract) {
+        std::string index = lit(shader->refractiveIndex);
+        if (sphere) {
+          index = "inside ? " + lit(1.0f / shader->refractiveIndex) + " : " +
+                  index;
+        }
+        body += "    refractedColor = traceRefraction(ray, hit, " +
+                lit(shader->bounceSurfDist) + ", " +
+                lit(shader->refractedWeight) + ", " + index + ");\n";
+      }
+      body += "  }\n";
+    }
+    std::vector<std::string> terms;
+    if (diffuse) {
+      usesDiffuse[shader->enableShadows] = true;
+      body += "  float3 fixedSurfacePoint = hit.surfacePoint + 0.1f * "
+              "hit.surfaceNormal;\n";
+      body += "  float3 diffuseColor = " +
+              std::string(shader->enableShadows ? "diffuseShadowed"
+                                                : "diffuse") +
+              "(fixedSurfacePoint, hit.surfaceNormal, " + albedo +
+              ", ray.seed);\n";
+      terms.push_back(lit(shader->diffuseWeight) + " * diffuseColor");
+    }
+    if (reflect) {
+      terms.push_back(lit(shader->reflectedWeight) + " * reflectedColor");
+    }
+    if (refract) {
+      terms.push_back(lit(shader->refractedWeight) + " * refractedColor");
+    }
+    if (terms.empty()) {
+      return body + "  return make_float3(0.0f, 0.0f, 0.0f);\n";
+    }
+    body += "  return " + terms[0];
+    for (size_t i = 1; i < terms.size(); i++) {
+      body += " +\n         " + terms[i];
+    }
+    return body + ";\n";
+  }
+
+  std::string material(const std::string &signature, const std::string &body,
+                       const std::string &comment) {
+    std::string key = signature + body;
+    auto found = materialIds.find(key);
+    int id;
+    if (found == materialIds.end()) {
+      id = int(materials.size());
+      materialIds[key] = id;
+      materials.push_back("// " + comment + "\nfloat3 shadeMaterial" +
+                          std::to_string(id) + "(" + signature + ") {\n" +
+                          body + "}\n");
+    } else {
+      id = found->second;
+    }
+    return "shadeMaterial" + std::to_string(id);
+  }
+
+  std::string profile(Shader *shader) {
+    char buffer[160];
+    snprintf(buffer, sizeof(buffer),
+             "diffuse %g, reflected %g, refracted %g (index %g), shadows %s",
+             shader->diffuseWeight, shader->reflectedWeight,
+             shader->refractedWeight, shader->refractiveIndex,
+             shader->enableShadows ? "on" : "off");
+    return buffer;
+  }
+
+  bool addTriangle(Triangle *triangle) {
+    int index = int(triangles.size());
+    triangles.push_back(triangle);
+    std::string entry = "triangles[" + std::to_string(index) + "]";
+    objectTests.push_back("hitTriangle(ray, " + entry + ", point)");
+    objectNormals.push_back("f3(" + entry + ".normal)");
+    GenericTriangleShader *shader =
+        static_cast<GenericTriangleShader *>(triangle->shader);
+    if (!shader) {
+      objectShading.push_back("return " + vec(triangle->color) + ";");
+      return true;
+    }
+    if (typeid(*shader) != typeid(GenericTriangleShader)) {
+      error = "unknown triangle shader";
+      return false;
+    }
+    if (shader->virtualTexture) {
+      error = "virtual textures can not be compiled";
+      return false;
+    }
+    std::string albedo = vec(shader->color);
+    std::string comment = "triangles, " + profile(shader);
+    if (shader->texture) {
+      int t = textureIndex(shader->texture);
+      if (t < 0) {
+        error = "texture not in Scene::textures";
+        return false;
+      }
+      albedo = "albedo(" + std::to_string(t) + ", tri, hit.surfacePoint, " +
+               albedo + ")";
+      comment += ", texture " + std::to_string(t);
+    }
+    std::string name = material(
+        "Ray &ray, Intersection &hit, const CompiledTriangle &tri",
+        shadingBody(shader, false, albedo), comment);
+    objectShading.push_back("return " + name + "(ray, hit, " + entry + ");");
+    return true;
+  }
+
+  bool addSphere(Sphere *sphere) {
+    int index = int(spheres.size());
+    spheres.push_back(sphere);
+    std::string entry = "spheres[" + std::to_string(index) + "]";
+    objectTests.push_back("hitSphere(ray, " + entry + ", point, normal)");
+    objectNormals.push_back("normal");
+    GenericSphereShader *shader =
+        static_cast<GenericSphereShader *>(sphere->shader);
+    if (!shader) {
+      objectShading.push_back("return " + vec(sphere->color) + ";");
+      return true;
+    }
+    if (typeid(*shader) != typeid(GenericSphereShader)) {
+      error = "unknown sphere shader";
+      return false;
+    }
+    std::string name =
+        material("Ray &ray, Intersection &hit, const CompiledSphere &sphere",
+                 shadingBody(shader, true, vec(shader->color)),
+                 "spheres, " + profile(shader));
+    objectShading.push_back("return " + name + "(ray, hit, " + entry + ");");
+    return true;
+  }
+
+  // One block per light and shadow sample, as Scene::computeDiffuseComponent.
+  std::string diffuseFunction(bool shadows) {
+    std::string f = std::string("float3 ") +
+                    (shadows ? "diffuseShadowed" : "diffuse") +
+                    "(float3 surfacePoint, float3 surfaceNormal,\n"
+                    "              float3 surfaceColor, uint32_t &seed) {\n"
+                    "  float3 diffuseReflection = make_float3(0.0f, 0.0f, "
+                    "0.0f);\n";
+    int nLights = int(scene->lights.size());
+    for (int l = 0; l < nLights; l++) {
+      Light *light = scene->lights[l];
+      bool area = light->isAreaLight();
+      int nSamples = area ? light->nShadowSamples : 1;
+      f += "  {\n    // light " + std::to_string(l) +
+           (area ? ", " + std::to_string(nSamples) + " samples" : "") + "\n";
+      f += "    float3 lightContribution = make_float3(0.0f, 0.0f, 0.0f);\n";
+      for (int s = 0; s < nSamples; s++) {
+        f += "    {\n";
+        if (area) {
+          f += "      float u = randomFloat(seed);\n"
+               "      float v = randomFloat(seed);\n"
+               "      float3 lightPoint = " +
+               vec(light->lightPosition) + " +\n" +
+               "                          (u - 0.5f) * " + vec(light->edge1) +
+               " +\n" + "                          (v - 0.5f) * " +
+               vec(light->edge2) + ";\n";
+        } else {
+          f += "      float3 lightPoint = " + vec(light->lightPosition) +
+               ";\n";
+        }
+        f += "      float3 toLight = lightPoint - surfacePoint;\n"
+             "      float angle =\n"
+             "          dot(div(toLight, length(toLight)), surfaceNormal);\n";
+        if (shadows) {
+          f += "      if (angle >= 0. &&\n"
+               "          !occluded(Ray(surfacePoint, toLight), "
+               "length(toLight))) {\n";
+        } else {
+          f += "      if (angle >= 0.) {\n";
+        }
+        f += "        lightContribution = lightContribution + surfaceColor "
+             "* angle;\n"
+             "      }\n"
+             "    }\n";
+      }
+      f += "    diffuseReflection =\n"
+           "        diffuseReflection + div(lightContribution, " +
+           lit(float(nSamples)) + ");\n  }\n";
+    }
+    return f + "  return diffuseReflection;\n}\n";
+  }
+
+  std::string closestHitFunction() {
+    std::string f =
+        "bool closestHit(const Ray &ray, Intersection &hit) {\n"
+        "  float minDist = 99999.0f;\n"
+        "  int objectId = -1;\n"
+        "  float3 point, normal;\n";
+    for (size_t o = 0; o < objectTests.size(); o++) {
+      f += "  if (" + objectTests[o] + ") {\n"
+           "    float dist = length(point - ray.origin);\n"
+           "    if (dist < minDist) {\n"
+           "      minDist = dist;\n"
+           "      objectId = " + std::to_string(o) + ";\n"
+           "      hit.surfacePoint = point;\n"
+           "      hit.surfaceNormal = " + objectNormals[o] + ";\n"
+           "    }\n"
+           "  }\n";
+    }
+    return f + "  hit.object = nullptr;\n"
+               "  hit.objectId = objectId;\n"
+               "  hit.footprint = 0.0f;\n"
+               "  hit.level = 0;\n"
+               "  return objectId >= 0;\n"
+               "}\n";
+  }
+
+  // Any hit closer than maxDist, the shadow test of computeDiffuseComponent.
+  std::string occludedFunction() {
+    std::string f = "bool occluded(const Ray &ray, float maxDist) {\n"
+                    "  float3 point, normal;\n";
+    for (size_t t = 0; t < triangles.size(); t++) {
+      f += "  if (hitTriangle(ray, triangles[" + std::to_string(t) +
+           "], point) &&\n      length(point - ray.origin) < maxDist) {\n"
+           "    return true;\n  }\n";
+    }
+    for (size_t s = 0; s < spheres.size(); s++) {
+      f += "  if (hitSphere(ray, spheres[" + std::to_string(s) +
+           "], point, normal) &&\n      length(point - ray.origin) < "
+           "maxDist) {\n    return true;\n  }\n";
+    }
+    return f + "  return false;\n}\n";
+  }
+
+public:
+  explicit SceneCompiler(Scene *scene) : scene(scene) {}
+  const std::string &lastError() const { return error; }
+
+  bool compile(const std::string &sceneName, std::string &code) {
+    int nObjects = int(scene->sceneObjects.size());
+    for (int o = 0; o < nObjects; o++) {
+      Object *object = scene->sceneObjects[o];
+      bool ok;
+      if (Triangle *triangle = dynamic_cast<Triangle *>(object)) {
+        ok = addTriangle(triangle);
+      } else if (Sphere *sphere = dynamic_cast<Sphere *>(object)) {
+        ok = addSphere(sphere);
+      } else {
+        error = "unknown object type";
+        ok = false;
+      }
+      if (!ok) {
+        error = "object " + std::to_string(o) + ": " + error;
+        return false;
+      }
+    }
+
+    code = "// Generated by scene_compiler from " + sceneName +
+           ", do not edit.\n\n"
+           "#include \"compiled_scene.h\"\n"
+           "#include \"shader.h\"\n\n"
+           "namespace raytracer_cu {\n"
+           "namespace compiled {\n\n"
+           "const CompiledSceneInfo sceneInfo = {\"" +
+           sceneName + "\", " + std::to_string(triangles.size()) + ", " +
+           std::to_string(spheres.size()) + ", " +
+           std::to_string(scene->lights.size()) + ", " +
+           std::to_string(materials.size()) + ", " +
+           std::to_string(scene->textures.size()) + ", " +
+           std::to_string(scene->maxBounces) + ", " +
+           lit(scene->minThroughput) + "};\n\n"
+           "namespace {\n\n"
+           "constexpr float minThroughput = " +
+           lit(scene->minThroughput) + ";\n\n";
+
+    code += "constexpr CompiledTriangle triangles[" +
+            std::to_string(std::max<size_t>(triangles.size(), 1)) + "] = {\n";
+    for (Triangle *t : triangles) {
+      code += "    {" + array(t->vertex0) + ",\n     " +
+              array(t->vertex1 - t->vertex0) + ",\n     " +
+              array(t->vertex2 - t->vertex0) + ",\n     " +
+              array(t->normal_) + ",\n     {" + lit(t->texCoord0.x) + ", " +
+              lit(t->texCoord0.y) + ", " + lit(t->texCoord1.x) + ", " +
+              lit(t->texCoord1.y) + ", " + lit(t->texCoord2.x) + ", " +
+              lit(t->texCoord2.y) + "}},\n";
+    }
+    code += "};\n\nconstexpr CompiledSphere spheres[" +
+            std::to_string(std::max<size_t>(spheres.size(), 1)) + "] = {\n";
+    for (Sphere *s : spheres) {
+      code += "    {" + array(s->center) + ", " + lit(s->r) + "},\n";
+    }
+    code += "};\n\n";
+
+    code += "ColorBuffer<float3> *textures[" +
+            std::to_string(std::max<uint64_t>(scene->textures.size(), 1)) +
+            "] = {};\n\n"
+            "float3 albedo(int t, const CompiledTriangle &tri, float3 point,\n"
+            "              float3 color) {\n"
+            "  return textures[t] ? sampleTexture(textures[t], tri, point) "
+            ": color;\n"
+            "}\n\n";
+    code += closestHitFunction() + "\n" + occludedFunction() + "\n";
+    for (bool shadows : {false, true}) {
+      if (usesDiffuse[shadows]) {
+        code += diffuseFunction(shadows) + "\n";
+      }
+    }
+    code += "float3 traceReflection(Ray &ray, Intersection &hit,\n"
+            "                       float bounceSurfDist, float weight);\n"
+            "float3 traceRefraction(Ray &ray, Intersection &hit,\n"
+            "                       float bounceSurfDist, float weight,\n"
+            "                       float refractiveIndex);\n\n";
+    for (const std::string &m : materials) {
+      code += m + "\n";
+    }
+
+    code += "float3 shade(Ray &ray, Intersection &hit) {\n"
+            "  switch (hit.objectId) {\n";
+    for (size_t o = 0; o < objectShading.size(); o++) {
+      code += "  case " + std::to_string(o) + ":\n    " + objectShading[o] +
+              "\n";
+    }
+    code += "  }\n  return make_float3(0.0f, 0.0f, 0.0f);\n}\n\n";
+
+    // Shader::reflectionRay / refractionRay and the throughput cut of
+    // compute*Component.
+    code +=
+        "float3 traceSecondary(Ray &secondary) {\n"
+        "  float3 color = make_float3(0.0f, 0.0f, 0.0f);\n"
+        "  if (secondary.throughput < minThroughput) {\n"
+        "    return color;\n"
+        "  }\n"
+        "  Intersection hit;\n"
+        "  trace(secondary, color, hit);\n"
+        "  return color;\n"
+        "}\n\n"
+        "float3 traceReflection(Ray &ray, Intersection &hit,\n"
+        "                       float bounceSurfDist, float weight) {\n"
+        "  float3 origin = hit.surfacePoint + bounceSurfDist * "
+        "hit.surfaceNormal;\n"
+        "  Ray reflected(origin, computeReflectionDirection(ray, "
+        "hit.surfaceNormal),\n"
+        "                ray.bounces - 1);\n"
+        "  reflected.seed = splitSeed(ray.seed);\n"
+        "  reflected.throughput = ray.throughput * weight;\n"
+        "  return traceSecondary(reflected);\n"
+        "}\n\n"
+        "float3 traceRefraction(Ray &ray, Intersection &hit,\n"
+        "                       float bounceSurfDist, float weight,\n"
+        "                       float refractiveIndex) {\n"
+        "  float sign = dot(hit.surfaceNormal, ray.direction) > -0.001f ? "
+        "-1.0f : 1.0f;\n"
+        "  float3 normal = sign * hit.surfaceNormal;\n"
+        "  float3 direction =\n"
+        "      computeRafractionDirection(ray, normal, refractiveIndex);\n"
+        "  Ray refracted(hit.surfacePoint - bounceSurfDist * normal, "
+        "direction,\n"
+        "                ray.bounces - 1);\n"
+        "  refracted.seed = splitSeed(ray.seed);\n"
+        "  refracted.throughput = ray.throughput * weight;\n"
+        "  return traceSecondary(refracted);\n"
+        "}\n\n"
+        "} // namespace\n\n"
+        "void bindTextures(ColorBuffer<float3> *const *bound, int n) {\n"
+        "  for (int t = 0; t < sceneInfo.nTextures; t++) {\n"
+        "    textures[t] = t < n ? bound[t] : nullptr;\n"
+        "  }\n"
+        "}\n\n"
+        "bool trace(Ray &ray, float3 &color, Intersection &hit) {\n"
+        "  if (!closestHit(ray, hit)) {\n"
+        "    return false;\n"
+        "  }\n"
+        "  color = shade(ray, hit);\n"
+        "  return true;\n"
+        "}\n\n"
+        "} // namespace compiled\n"
+        "} // namespace raytracer_cu\n";
+    return true;
+  }
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options = parseOptions(argc, argv);
+  RoomScene *scene = new RoomScene();
+  addCheckerTextures(scene, options.nTextures);
+  scene->buildScene();
+
+  SceneCompiler compiler(scene);
+  std::string code;
+  if (!compiler.compile("RoomScene", code)) {
+    fprintf(stderr, "scene_compiler: %s\n", compiler.lastError().c_str());
+    return 1;
+  }
+  FILE *out = options.out.empty() ? stdout : fopen(options.out.c_str(), "w");
+  if (!out) {
+    fprintf(stderr, "can not write %s\n", options.out.c_str());
+    return 1;
+  }
+  fwrite(code.data(), 1, code.size(), out);
+  if (out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
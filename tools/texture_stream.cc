@@ -0,0 +1,178 @@
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "camera_path.h"
+#include "host_renderer.h"
+#include "room_scene.h"
+#include "thread_pool.h"
+#include "virtual_texture.h"
+
+// Renders the room scene with streamed textures, see virtual_texture.h.
+//
+// texture_stream [--texture-size N] [--tile T] [--cache MB] [--frames F]
+//                [--size WxH] [--threads T] [--dir path] [--sync]
+//
+// Bakes three N x N procedural textures (default 8192, 192 MB each as
+// RGB8, 768 MB each as the float3 ColorBuffers of Renderer::addTexture)
+// into --dir unless they are there, then renders F frames of a turntable
+// with a cache of --cache MB (default 32). Per frame it prints the level 0
+// hit rate, the samples that fell back to a coarser level, the tiles and
+// bytes read and the resident tile memory.
+//
+// --sync   misses load the tile before sampling (no fallbacks)
+
+using namespace raytracer_cu;
+
+namespace {
+
+struct Options {
+  int textureSize = 8192;
+  int tileSize = 64;
+  double cacheMb = 32.0;
+  int frames = 24;
+  int2 size = make_int2(640, 480);
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string dir = ".";
+  bool sync = false;
+};
+
+void usage() {
+  fprintf(stderr, "usage: texture_stream [--texture-size N] [--tile T] "
+                  "[--cache MB] [--frames F] [--size WxH] [--threads T] "
+                  "[--dir path] [--sync]\n");
+  exit(1);
+}
+
+Options parseOptions(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (flag == "--sync") {
+      options.sync = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      usage();
+    }
+    const char *value = argv[++i];
+    if (flag == "--texture-size") {
+      options.textureSize = atoi(value);
+    } else if (flag == "--tile") {
+      options.tileSize = atoi(value);
+    } else if (flag == "--cache") {
+      options.cacheMb = atof(value);
+    } else if (flag == "--frames") {
+      options.frames = atoi(value);
+    } else if (flag == "--size") {
+      if (sscanf(value, "%dx%d", &options.size.x, &options.size.y) != 2) {
+        usage();
+      }
+    } else if (flag == "--threads") {
+      options.threads = unsigned(std::max(1, atoi(value)));
+    } else if (flag == "--dir") {
+      options.dir = value;
+    } else {
+      usage();
+    }
+  }
+  return options;
+}
+
+// Checkers from 4 to 512 texels wide over a tint, with detail at every
+// level of the pyramid.
+float3 proceduralTexel(int texture, int x, int y) {
+  float c = 0.25f;
+  for (int shift = 2; shift <= 9; shift++) {
+    c += ((x >> shift) ^ (y >> shift)) & 1 ? 0.08f : 0.0f;
+  }
+  float3 tints[3] = {make_float3(1.0f, 0.9f, 0.7f),
+                     make_float3(0.7f, 0.9f, 1.0f),
+                     make_float3(0.9f, 1.0f, 0.8f)};
+  return c * tints[texture % 3];
+}
+
+bool fileExists(const std::string &path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options = parseOptions(argc, argv);
+  size_t texels = size_t(options.textureSize) * options.textureSize;
+
+  TileCache cache(size_t(options.cacheMb * 1024.0 * 1024.0), !options.sync);
+  std::vector<std::unique_ptr<VirtualTexture>> textures;
+  for (int t = 0; t < 3; t++) {
+    char name[64];
+    snprintf(name, sizeof(name), "/texture%d_%d_%d.vtx", t,
+             options.textureSize, options.tileSize);
+    std::string path = options.dir + name;
+    if (!fileExists(path)) {
+      printf("baking %s\n", path.c_str());
+      if (!bakeTiledTexture(path, options.textureSize, options.textureSize,
+                            options.tileSize, [t](int x, int y) {
+                              return proceduralTexel(t, x, y);
+                            })) {
+        fprintf(stderr, "can not write %s\n", path.c_str());
+        return 1;
+      }
+    }
+    textures.push_back(VirtualTexture::open(path, cache));
+    if (!textures.back()) {
+      fprintf(stderr, "can not read %s\n", path.c_str());
+      return 1;
+    }
+  }
+
+  RoomScene *scene = new RoomScene();
+  for (auto &texture : textures) {
+    scene->virtualTextures.push_back(texture.get());
+  }
+  scene->buildScene();
+  ThreadPool pool(int(options.threads) - 1);
+  HostRenderer renderer(scene, pool);
+  CameraPath path = CameraPath::turntable(make_float3(0.0f, 0.0f, 0.0f),
+                                          200.0f, 0.0f, options.frames);
+
+  printf("3 textures %dx%d (%.0f MB as float3, %.0f MB on disk), %d^2 "
+         "tiles, cache %.0f MB, %s loads\n",
+         options.textureSize, options.textureSize,
+         3.0 * texels * sizeof(float3) / (1 << 20), 3.0 * texels * 3 / (1 << 20),
+         options.tileSize, options.cacheMb,
+         options.sync ? "synchronous" : "asynchronous");
+  printf("%6s %9s %10s %10s %10s %9s %11s %9s\n", "frame", "ms", "hit rate",
+         "fallbacks", "tiles", "MB read", "resident MB", "evicted");
+  std::vector<uint8_t> image(size_t(options.size.x) * options.size.y * 4);
+  uint64_t totalRead = 0;
+  for (int frame = 0; frame < options.frames; frame++) {
+    cache.resetStats();
+    auto start = std::chrono::steady_clock::now();
+    renderer.render(path.at(float(frame)), options.size, uint32_t(frame),
+                    image.data());
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    TileCacheStats stats = cache.stats();
+    totalRead += stats.bytesRead;
+    printf("%6d %9.1f %9.1f%% %10llu %10llu %9.1f %11.1f %9llu\n", frame, ms,
+           100.0 * stats.hitRate(), (unsigned long long)stats.fallbacks,
+           (unsigned long long)stats.tilesLoaded,
+           stats.bytesRead / double(1 << 20),
+           stats.residentBytes / double(1 << 20),
+           (unsigned long long)stats.evictions);
+  }
+  cache.waitForLoads();
+  TileCacheStats stats = cache.stats();
+  printf("read %.1f MB in total, peak resident %.1f MB of %.1f MB\n",
+         totalRead / double(1 << 20), stats.peakResidentBytes / double(1 << 20),
+         stats.capacityBytes / double(1 << 20));
+  return 0;
+}
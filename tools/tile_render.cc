@@ -0,0 +1,238 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "camera.h"
+#include "checker_textures.h"
+#include "image_io.h"
+#include "room_scene.h"
+#include "thread_pool.h"
+#include "tile_render.h"
+
+// Distributed offline rendering of the room scene, see tile_render.h.
+//
+// tile_render coordinator [--port P] [--workers N] [options]
+//   waits for N workers, renders one frame and shuts the workers down
+// tile_render worker [--host H] [--port P] [--threads T] [--fail-after K]
+//   serves tiles until the coordinator is done
+// tile_render local [--workers N] [--threads T] [--fail-after K] [options]
+//   renders the frame with 1..N worker processes started on localhost and
+//   prints the scaling efficiency; with --fail-after an extra worker joins
+//   every run and drops out after K tiles
+//
+// options: --size WxH (1920x1080), --bounces B (3), --tile T (64),
+//          --frames F (1, best of F is reported), --out image.ppm
+
+using namespace raytracer_cu;
+
+namespace {
+
+struct Options {
+  std::string mode;
+  std::string host = "127.0.0.1";
+  int port = 0;
+  int workers = 1;
+  unsigned threads = 1; // per worker, including the calling thread
+  int failAfter = -1;
+  int2 size = make_int2(1920, 1080);
+  int bounces = 3;
+  int tileSize = 64;
+  int frames = 1;
+  std::string out;
+};
+
+void usage() {
+  fprintf(stderr,
+          "usage: tile_render coordinator|worker|local [--host H] [--port P] "
+          "[--workers N] [--threads T] [--fail-after K] [--size WxH] "
+          "[--bounces B] [--tile T] [--frames F] [--out image.ppm]\n");
+  exit(1);
+}
+
+Options parseOptions(int argc, char **argv) {
+  if (argc < 2) {
+    usage();
+  }
+  Options options;
+  options.mode = argv[1];
+  for (int i = 2; i < argc; i++) {
+    std::string flag = argv[i];
+    if (i + 1 >= argc) {
+      usage();
+    }
+    const char *value = argv[++i];
+    if (flag == "--host") {
+      options.host = value;
+    } else if (flag == "--port") {
+      options.port = atoi(value);
+    } else if (flag == "--workers") {
+      options.workers = atoi(value);
+    } else if (flag == "--threads") {
+      options.threads = unsigned(atoi(value));
+    } else if (flag == "--fail-after") {
+      options.failAfter = atoi(value);
+    } else if (flag == "--size") {
+      if (sscanf(value, "%dx%d", &options.size.x, &options.size.y) != 2) {
+        usage();
+      }
+    } else if (flag == "--bounces") {
+      options.bounces = atoi(value);
+    } else if (flag == "--tile") {
+      options.tileSize = atoi(value);
+    } else if (flag == "--frames") {
+      options.frames = atoi(value);
+    } else if (flag == "--out") {
+      options.out = value;
+    } else {
+      usage();
+    }
+  }
+  return options;
+}
+
+int runWorker(const Options &options) {
+  RoomScene *scene = new RoomScene();
+  addCheckerTextures(scene, 3);
+  scene->buildScene();
+
+  // The calling thread renders too.
+  ThreadPool pool(int(options.threads) - 1);
+  TileWorker worker(scene, pool);
+  worker.failAfterTiles = options.failAfter;
+  int tiles = worker.serve(options.host, options.port);
+  return tiles > 0 || options.failAfter == 0 ? 0 : 1;
+}
+
+// Renders `frames` frames and returns the best frame time in milliseconds.
+double renderFrames(TileCoordinator &coordinator, const Options &options,
+                    std::vector<uint8_t> &image) {
+  double best = 1e30;
+  for (int frame = 0; frame < options.frames; frame++) {
+    auto start = std::chrono::steady_clock::now();
+    coordinator.renderFrame(Camera::initialView(), options.size,
+                            options.bounces, 0, image.data());
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    best = ms < best ? ms : best;
+  }
+  return best;
+}
+
+void printWorkerStats(TileCoordinator &coordinator) {
+  for (const TileWorkerStats &stats : coordinator.workerStats()) {
+    printf("  worker %d (%u threads): %d tiles, %.1f ms tracing%s\n",
+           stats.workerId, stats.nThreads, stats.tilesRendered, stats.renderMs,
+           stats.failed ? ", failed" : "");
+  }
+}
+
+int runCoordinator(const Options &options) {
+  TileCoordinator coordinator(options.port);
+  if (!coordinator.listening()) {
+    return 1;
+  }
+  coordinator.tileSize = options.tileSize;
+  printf("listening on port %d, waiting for %d workers\n", coordinator.port(),
+         options.workers);
+  coordinator.waitForWorkers(options.workers, 1 << 30);
+
+  std::vector<uint8_t> image(options.size.x * options.size.y * 4);
+  double ms = renderFrames(coordinator, options, image);
+  printf("%dx%d, %d bounces: %.1f ms per frame\n", options.size.x,
+         options.size.y, options.bounces, ms);
+  printWorkerStats(coordinator);
+  if (!options.out.empty() &&
+      !writePPM(options.out, image.data(), options.size.x, options.size.y)) {
+    fprintf(stderr, "can not write %s\n", options.out.c_str());
+    return 1;
+  }
+  return 0;
+}
+
+void spawnWorker(const Options &options, int port, int failAfter) {
+  if (fork() == 0) {
+    std::string portArg = std::to_string(port);
+    std::string threadsArg = std::to_string(options.threads);
+    std::string failArg = std::to_string(failAfter);
+    execl("/proc/self/exe", "tile_render", "worker", "--port", portArg.c_str(),
+          "--threads", threadsArg.c_str(), "--fail-after", failArg.c_str(),
+          (char *)nullptr);
+    _exit(127);
+  }
+}
+
+int runLocal(const Options &options) {
+  std::vector<uint8_t> reference;
+  double singleWorkerMs = 0.0;
+  bool identical = true;
+
+  printf("%dx%d, %d bounces, %dpx tiles, %u threads per worker\n",
+         options.size.x, options.size.y, options.bounces, options.tileSize,
+         options.threads);
+  printf("%8s %12s %10s %11s\n", "workers", "ms/frame", "speedup",
+         "efficiency");
+  for (int n = 1; n <= options.workers; n++) {
+    TileCoordinator coordinator(0);
+    if (!coordinator.listening()) {
+      return 1;
+    }
+    coordinator.tileSize = options.tileSize;
+
+    int nProcesses = options.failAfter >= 0 ? n + 1 : n;
+    for (int i = 0; i < nProcesses; i++) {
+      spawnWorker(options, coordinator.port(), i == n ? options.failAfter : -1);
+    }
+    if (!coordinator.waitForWorkers(nProcesses, 60000)) {
+      fprintf(stderr, "workers did not connect\n");
+      return 1;
+    }
+
+    std::vector<uint8_t> image(options.size.x * options.size.y * 4);
+    double ms = renderFrames(coordinator, options, image);
+    if (n == 1) {
+      singleWorkerMs = ms;
+      reference = image;
+    } else {
+      identical = identical && image == reference;
+    }
+    double speedup = singleWorkerMs / ms;
+    printf("%8d %12.1f %10.2f %10.0f%%\n", n, ms, speedup,
+           100.0 * speedup / n);
+    printWorkerStats(coordinator);
+
+    if (n == options.workers && !options.out.empty() &&
+        !writePPM(options.out, image.data(), options.size.x, options.size.y)) {
+      fprintf(stderr, "can not write %s\n", options.out.c_str());
+    }
+  }
+  printf("frames identical across worker counts: %s\n",
+         identical ? "yes" : "no");
+
+  // The coordinators shut their workers down when they go out of scope.
+  int status;
+  while (wait(&status) > 0) {
+  }
+  return identical ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options = parseOptions(argc, argv);
+  if (options.mode == "worker") {
+    return runWorker(options);
+  } else if (options.mode == "coordinator") {
+    return runCoordinator(options);
+  } else if (options.mode == "local") {
+    return runLocal(options);
+  }
+  usage();
+  return 1;
+}